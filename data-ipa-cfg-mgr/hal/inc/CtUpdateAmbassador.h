@@ -53,6 +53,8 @@ public:
     CtUpdateAmbassador(const ::android::sp<ITetheringOffloadCallback>& /* cb */);
     /* ------------------- CONNTRACK TIMEOUT UPDATER ------------------------ */
     void updateTimeout(IpaNatTimeoutUpdate /* update */);
+    void updateTimeouts(const IpaNatTimeoutUpdate* /* updates */, bool* /* sent */,
+            int /* num */);
 private:
     static bool translate(IpaNatTimeoutUpdate /* in */, HALNatTimeoutUpdate& /* out */);
     static bool translate(IpaIpAddrPortPair /* in */, HALIpAddrPortPair& /* out */);
@@ -159,6 +159,17 @@ public:
         } natTimeoutUpdate_t;
         virtual ~ConntrackTimeoutUpdater(){}
         virtual void updateTimeout(NatTimeoutUpdate /* update */) {}
+        /**
+         * Forward several updates.  The framework callback has no batch
+         * call, so each one is still a single updateTimeout().  sent[i]
+         * is set to false for each update that could not be forwarded.
+         */
+        virtual void updateTimeouts(const NatTimeoutUpdate* updates, bool* sent, int num) {
+            for (int i = 0; i < num; i++) {
+                updateTimeout(updates[i]);
+                sent[i] = true;
+            }
+        }
     }; /* ConntrackTimeoutUpdater */
 
     /**
@@ -82,6 +82,22 @@ void CtUpdateAmbassador::updateTimeout(IpaNatTimeoutUpdate in) {
     }
 } /* updateTimeout */
 
+void CtUpdateAmbassador::updateTimeouts(const IpaNatTimeoutUpdate* in, bool* sent, int num) {
+    HALNatTimeoutUpdate out;
+
+    if (DBG) {
+        ALOGD("updateTimeouts(num=%d)", num);
+    }
+    for (int i = 0; i < num; i++) {
+        if (!translate(in[i], out)) {
+            ALOGE("Failed to translate timeout event :(");
+            sent[i] = false;
+            continue;
+        }
+        sent[i] = mFramework->updateTimeout(out).isOk();
+    }
+} /* updateTimeouts */
+
 bool CtUpdateAmbassador::translate(IpaNatTimeoutUpdate in, HALNatTimeoutUpdate &out) {
     return translate(in.src, out.src)
             && translate(in.dst, out.dst)
@@ -40,6 +40,7 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define IPA_CONNTRACK_MESSAGE_H
 
 #include <pthread.h>
+#include <stdint.h>
 #include "IPACM_Defs.h"
 
 
@@ -54,16 +55,35 @@ typedef struct _ipacm_cmd_q_data {
 	void *evt_data;
 }ipacm_cmd_q_data;
 
+/* Workers of the command queue, each with its own queues and thread.
+	 A listener is bound to one of them, so the events of an interface
+	 stay in order while the conntrack events go on without waiting for
+	 slow interface handlers */
+enum ipacm_cmd_shard
+{
+	IPACM_CMD_SHARD_IFACE,
+	IPACM_CMD_SHARD_NAT,
+	IPACM_CMD_SHARD_MAX
+};
+
 typedef struct cmd_s
 {
-	void (*callback_ptr)(ipacm_cmd_q_data *);
+	void (*callback_ptr)(struct cmd_s *);
 	ipacm_cmd_q_data data;
+	/* worker the message is queued on, and the workers yet to handle an
+		 event posted to several of them, NULL for a single one */
+	int shard;
+	int *pending;
+	/* IPACM_EvtStats::Now() when posted, 0 if not timed */
+	uint64_t post_ns;
 }cmd_t;
 
 class Message
 {
 private:
+	/* written by the posters, see MessageQueue */
 	Message *m_next;
+	friend class MessageQueue;
 
 public:
 	cmd_t evt;
@@ -72,36 +92,63 @@ public:
 	{
 		m_next = NULL;
 		evt.callback_ptr = NULL;
+		evt.shard = IPACM_CMD_SHARD_IFACE;
+		evt.pending = NULL;
+		evt.post_ns = 0;
 	}
 	~Message() { }
 	void setnext(Message *item) { m_next = item; }
 	Message* getnext()       { return m_next; }
 };
 
+/* Lock free queue of one priority of one worker. Any thread may
+	 enqueue, only the worker of the shard dequeues: a poster swaps its
+	 message in at Tail and then links it behind the previous one, the
+	 worker walks from Head. stub keeps the list from ever being empty */
 class MessageQueue
 {
 
 private:
 	Message *Head;
 	Message *Tail;
+	Message stub;
+	int shard;
+	/* messages queued and the most seen, never below the actual count */
+	int depth;
+	int peak_depth;
+	void push(Message *item);
 	Message* dequeue(void);
-	static MessageQueue *inst_internal;
-	static MessageQueue *inst_external;
+	static MessageQueue *inst_internal[IPACM_CMD_SHARD_MAX];
+	static MessageQueue *inst_external[IPACM_CMD_SHARD_MAX];
+	static pthread_once_t inst_once;
+	static void CreateInstances(void);
 
-	MessageQueue()
+	MessageQueue(int shard_id)
 	{
-		Head = NULL;
-		Tail = NULL;
+		Head = &stub;
+		Tail = &stub;
+		shard = shard_id;
+		depth = 0;
+		peak_depth = 0;
 	}
 
 public:
 
 	~MessageQueue() { }
+	/* Safe from any thread, wakes the worker if it sleeps */
 	void enqueue(Message *item);
 
+	/* Holds back the wakeups of the messages the calling thread
+		 enqueues until EndBatch, which wakes each worker once */
+	static void BeginBatch(void);
+	static void EndBatch(void);
+	int GetDepth(void) { return __atomic_load_n(&depth, __ATOMIC_RELAXED); }
+	int GetPeakDepth(void) { return __atomic_load_n(&peak_depth, __ATOMIC_RELAXED); }
+
+	/* Worker loop, param is the shard cast to a pointer */
 	static void* Process(void *);
-	static MessageQueue* getInstanceInternal();
-	static MessageQueue* getInstanceExternal();
+	static MessageQueue* getInstanceInternal(int shard = IPACM_CMD_SHARD_IFACE);
+	static MessageQueue* getInstanceExternal(int shard = IPACM_CMD_SHARD_IFACE);
 
 };
 
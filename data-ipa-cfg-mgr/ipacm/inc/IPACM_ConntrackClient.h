@@ -38,6 +38,7 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <errno.h>
 
 #include "IPACM_ConntrackClient.h"
+#include "IPACM_ConntrackFilter.h"
 #include "IPACM_CmdQueue.h"
 #include "IPACM_Conntrack_NATApp.h"
 #include "IPACM_EvtDispatcher.h"
@@ -67,24 +68,34 @@ private:
 
    struct nfct_handle *tcp_hdl;
    struct nfct_handle *udp_hdl;
-   struct nfct_filter *tcp_filter;
-   struct nfct_filter *udp_filter;
-   static int IPA_Conntrack_Filters_Ignore_Local_Addrs(struct nfct_filter *filter);
-   static int IPA_Conntrack_Filters_Ignore_Bridge_Addrs(struct nfct_filter *filter);
-   static int IPA_Conntrack_Filters_Ignore_Local_Iface(struct nfct_filter *, ipacm_event_iface_up *);
+   IPACM_ConntrackFilter *tcp_filter;
+   IPACM_ConntrackFilter *udp_filter;
+   /* events read from each socket and not posted yet */
+   ipacm_ct_evt_batch *tcp_batch;
+   ipacm_ct_evt_batch *udp_batch;
+   static int IPA_Conntrack_Filters_Ignore_Local_Addrs(IPACM_ConntrackFilter *filter);
+   static int IPA_Conntrack_Filters_Ignore_Bridge_Addrs(IPACM_ConntrackFilter *filter);
+   static int IPA_Conntrack_Filters_Ignore_Local_Iface(IPACM_ConntrackFilter *, ipacm_event_iface_up *);
    IPACM_ConntrackClient();
 
 public:
    static int IPAConntrackEventCB(enum nf_conntrack_msg_type type,
                                   struct nf_conntrack *ct,
                                   void *data);
-
-   static int IPA_Conntrack_UDP_Filter_Init(void);
-   static int IPA_Conntrack_TCP_Filter_Init(void);
-   static void* TCPRegisterWithConnTrack(void *);
-   static void* UDPRegisterWithConnTrack(void *);
-   static void* UDPConnTimeoutUpdate(void *);
-
+   static void FlushCTBatch(ipacm_ct_evt_batch **);
+   static int DrainCTEvents(struct nfct_handle *, ipacm_ct_evt_batch **);
+   static int ReadTCPEvents(int fd, void *);
+   static int ReadUDPEvents(int fd, void *);
+
+   static int TCPRegisterWithConnTrack(void);
+   static int UDPRegisterWithConnTrack(void);
+   /* Reactor handler of the nat timerfd, it posts IPA_NAT_TIMER_EVENT */
+   static int ReadNatTimer(int fd, void *);
+   /* Sweep of the nat worker, rearms the nat timerfd */
+   static int UDPConnTimeoutUpdate(int fd);
+
+   /* Adds a lan (param of the iface) or the wan (isWan) to the filters and
+      reattaches them, param NULL only recompiles them from the config */
    static void UpdateUDPFilters(void *, bool);
    static void UpdateTCPFilters(void *, bool);
    static void Read_TcpUdp_Timeout(char *in, int len);
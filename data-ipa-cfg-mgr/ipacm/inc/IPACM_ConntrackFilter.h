@@ -0,0 +1,119 @@
+/*
+Copyright (c) 2013-2016, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+		* Redistributions of source code must retain the above copyright
+			notice, this list of conditions and the following disclaimer.
+		* Redistributions in binary form must reproduce the above
+			copyright notice, this list of conditions and the following
+			disclaimer in the documentation and/or other materials provided
+			with the distribution.
+		* Neither the name of The Linux Foundation nor the names of its
+			contributors may be used to endorse or promote products derived
+			from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*!
+	@file
+	IPACM_ConntrackFilter.h
+
+	@brief
+	This file implements the socket filters of the conntrack event handles
+
+	@Author
+
+*/
+#ifndef IPACM_CONNTRACKFILTER_H
+#define IPACM_CONNTRACKFILTER_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <linux/filter.h>
+
+#include "IPACM_Defs.h"
+
+/* Most addresses each direction of a filter ignores, most alg ports it
+	 drops and the longest program it compiles to */
+#define IPACM_CT_FILTER_MAX_ADDRS 32
+#define IPACM_CT_FILTER_MAX_PORTS IPA_MAX_ALG_ENTRIES
+#define IPACM_CT_FILTER_MAX_INSNS 512
+
+/* Places of the compiled program jumped to before they are emitted */
+enum ipacm_ct_filter_label
+{
+	CT_FILTER_ACCEPT = 0,
+	CT_FILTER_DROP,
+	CT_FILTER_CT_MSG,
+	CT_FILTER_STATE_OK,
+	CT_FILTER_NAT_OK,
+	CT_FILTER_ALG_ORIG_SRC,
+	CT_FILTER_ALG_REPL_SRC,
+	CT_FILTER_ALG_REPL_DST,
+	CT_FILTER_LABEL_MAX
+};
+
+/* Compiles what IPACM ignores of the conntrack events of one protocol
+	 into a classic bpf program on the event socket, so that the kernel
+	 drops them instead of sending them over */
+class IPACM_ConntrackFilter
+{
+public:
+
+	IPACM_ConntrackFilter(uint8_t l4proto);
+	~IPACM_ConntrackFilter() { }
+
+	/* Ignores the connections from and/or to an ipv4 address */
+	int IgnoreAddr(uint32_t addr, bool src, bool dst);
+
+	/* Lets through the connections of the wan address without nat flags */
+	void SetWanAddr(uint32_t addr);
+
+	/* Compiles the program with the current alg ports of the config and
+		 attaches it, replacing the filter the socket had */
+	int Attach(int fd);
+
+private:
+
+	uint8_t proto;
+
+	uint32_t ign_src[IPACM_CT_FILTER_MAX_ADDRS];
+	int num_ign_src;
+	uint32_t ign_dst[IPACM_CT_FILTER_MAX_ADDRS];
+	int num_ign_dst;
+	uint32_t wan_addr;
+
+	uint32_t alg_ports[IPACM_CT_FILTER_MAX_PORTS];
+	int num_alg_ports;
+
+	struct sock_filter insns[IPACM_CT_FILTER_MAX_INSNS];
+	int num_insns;
+	int labels[CT_FILTER_LABEL_MAX];
+
+	pthread_mutex_t lock;
+
+	void LoadAlgPorts(void);
+	int Compile(void);
+
+	void Emit(uint16_t code, uint32_t k);
+	void EmitJmp(uint16_t code, uint32_t k, bool when, int label);
+	void EmitGoto(int label);
+	void EmitFindAttr(bool nested, uint32_t type, int missing_label);
+	void EmitLoadAttr(uint16_t size, uint32_t mem);
+	void EmitInSet(const uint32_t *set, int num, int label);
+	void SetLabel(int label);
+};
+
+#endif /* IPACM_CONNTRACKFILTER_H */
@@ -66,7 +66,7 @@ class IPACM_ConntrackListener : public IPACM_Listener
 
 private:
 	bool isCTReg;
-	bool isNatThreadStart;
+	int NatTimerFd;
 	bool WanUp;
 	NatApp *nat_inst;
 
@@ -77,16 +77,25 @@ private:
 	uint32_t nonnat_iface_ipv4_addr[MAX_IFACE_ADDRESS];
 	uint32_t sta_clnt_ipv4_addr[MAX_STA_CLNT_IFACES];
 	IPACM_Config *pConfig;
+
+	/* New nat entries of the conntrack batch being processed, they are
+		 added to the nat table together */
+	bool isBatching;
+	int pendCnt;
+	nat_table_entry pendEntries[IPA_CT_EVT_BATCH_MAX];
 #ifdef CT_OPT
 	IPACM_LanToLan *p_lan2lan;
 #endif
 
 	void ProcessCTMessage(void *);
+	void ProcessCTBatch(void *);
+	void AddNatEntry(const nat_table_entry *);
+	void FlushNatEntries(void);
 	void ProcessTCPorUDPMsg(struct nf_conntrack *,
 	enum nf_conntrack_msg_type, u_int8_t);
 	void TriggerWANUp(void *);
 	void TriggerWANDown(uint32_t);
-	int  CreateNatThreads(void);
+	int  CreateNatTimer(void);
 	bool AddIface(nat_table_entry *, bool *);
 	void AddORDeleteNatEntry(const nat_entry_bundle *);
 	void PopulateTCPorUDPEntry(struct nf_conntrack *, uint32_t, nat_table_entry *);
@@ -115,9 +124,14 @@ public:
 	void HandleNeighIpAddrDelEvt(uint32_t);
 	void HandleSTAClientAddEvt(uint32_t);
 	void HandleSTAClientDelEvt(uint32_t);
-	int  CreateConnTrackThreads(void);
+	int  CreateConnTrackListeners(void);
 };
 
 extern IPACM_ConntrackListener *CtList;
 
+/* Serializes the conntrack listener and the nat cache between the nat
+	 worker of the command queue, the nat timeout thread and the interface
+	 handlers calling into them, recursive as the handlers nest */
+extern pthread_mutex_t ipacm_nat_lock;
+
 #endif /* IPACM_CONNTRACK_LISTENER */
@@ -32,20 +32,65 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <string.h>  /* for stderror */
 #include <stdlib.h>
 #include <cstdio>  /* for perror */
+#include <errno.h>
+#include <time.h>
+#include <sys/uio.h>
 
 #include "IPACM_Config.h"
 #include "IPACM_Xml.h"
 
 extern "C"
 {
+#include <libnfnetlink/libnfnetlink.h>
 #include <libnetfilter_conntrack/libnetfilter_conntrack.h>
 #include <ipa_nat_drv.h>
 }
 
-#define MAX_TEMP_ENTRIES 25
+/* Flows of clients not known yet are staged in an area of
+	 IPACM_NAT_TEMP_MIN_ENTRIES entries, doubled as needed up to the size
+	 of the nat table. A full one takes a new flow in place of the oldest */
+#define IPACM_NAT_TEMP_MIN_ENTRIES 32
 
 #define IPACM_TCP_FULL_FILE_NAME  "/proc/sys/net/ipv4/netfilter/ip_conntrack_tcp_timeout_established"
 #define IPACM_UDP_FULL_FILE_NAME   "/proc/sys/net/ipv4/netfilter/ip_conntrack_udp_timeout_stream"
+#define IPACM_NAT_STATS_FILE_NAME "/data/misc/ipa/nat_stats"
+
+/* Most idle rules removed by one ReapIdleEntries() call */
+#define IPACM_NAT_REAP_MAX_ENTRIES 32
+
+/* Most rules inserted into the nat table by one driver call */
+#define IPACM_NAT_ADD_BATCH_MAX 64
+
+/* A full table takes a new flow in place of an entry the hw saw no
+	 traffic on for IPACM_NAT_EVICT_IDLE sweeps, trying at most
+	 IPACM_NAT_EVICT_TRIES of them when the hw table has no room */
+#define IPACM_NAT_EVICT_IDLE 1
+#define IPACM_NAT_EVICT_TRIES 2
+
+/* Timer wheel of the cache entries: a tick of IPACM_NAT_WHEEL_TICK
+	 seconds, IPACM_NAT_WHEEL_LEVELS levels of IPACM_NAT_WHEEL_SLOTS
+	 buckets each, coarser by IPACM_NAT_WHEEL_SLOTS at every level */
+#define IPACM_NAT_WHEEL_TICK 5
+#define IPACM_NAT_WHEEL_BITS 6
+#define IPACM_NAT_WHEEL_SLOTS (1 << IPACM_NAT_WHEEL_BITS)
+#define IPACM_NAT_WHEEL_LEVELS 3
+/* Extra bucket of the entries that are due */
+#define IPACM_NAT_WHEEL_DUE (IPACM_NAT_WHEEL_LEVELS * IPACM_NAT_WHEEL_SLOTS)
+
+/* Ticks before its conntrack entry times out that an entry is checked
+	 for hw traffic */
+#define IPACM_NAT_WHEEL_MARGIN 4
+
+/* Seconds the conntrack timeouts read from /proc are used for */
+#define IPACM_NAT_TIMEOUT_REFRESH 300
+
+/* Most conntrack entries refreshed with one netlink send, the room of
+	 each update message, of the acks read at once and the ms to wait
+	 for them */
+#define IPACM_CT_UPDATE_BATCH_MAX 32
+#define IPACM_CT_UPDATE_MSG_LEN 512
+#define IPACM_CT_UPDATE_ACK_LEN 4096
+#define IPACM_CT_UPDATE_ACK_WAIT 1000
 
 typedef struct _nat_table_entry
 {
@@ -67,6 +112,43 @@ typedef struct _nat_table_entry
 
 }nat_table_entry;
 
+typedef struct _nat_timer_node
+{
+	int next;
+	int prev;
+	int bucket;
+	uint32_t expiry;
+	uint32_t deadline;
+}nat_timer_node;
+
+/* Traffic of a cache entry as sampled from the hw timestamps by the
+	 periodic sweeps, the hw has no byte or packet counters */
+typedef struct _nat_flow_hint
+{
+	uint16_t sweeps;
+	uint16_t active;
+	uint16_t idle;
+	uint16_t hit;
+}nat_flow_hint;
+
+/* Lists a staged flow is on: by 5-tuple, private ip and target ip in
+	 hash buckets, and by the time it was staged */
+enum nat_temp_link
+{
+	NAT_TEMP_TUPLE,
+	NAT_TEMP_PRIV,
+	NAT_TEMP_TRGT,
+	NAT_TEMP_AGE,
+	NAT_TEMP_LINKS
+};
+
+typedef struct _nat_temp_node
+{
+	int next[NAT_TEMP_LINKS];
+	int prev[NAT_TEMP_LINKS];
+	time_t staged;
+}nat_temp_node;
+
 #define CHK_TBL_HDL()  if(nat_table_hdl == 0){ return -1; }
 
 class NatApp
@@ -76,32 +158,111 @@ private:
 	static NatApp *pInstance;
 
 	nat_table_entry *cache;
-	nat_table_entry temp[MAX_TEMP_ENTRIES];
 	uint32_t pub_ip_addr;
 	uint32_t pub_ip_addr_pre;
 	uint32_t nat_table_hdl;
 
 	int curCnt, max_entries;
 
+	/* Open addressing indexes of the cache, by 5-tuple and by client
+		 private ip. The client index points at the head of a list
+		 through clnt_next/clnt_prev of all the flows of the client */
+	int *tuple_idx;
+	int *clnt_idx;
+	uint32_t idx_mask;
+	int *clnt_next;
+	int *clnt_prev;
+
+	/* Unused cache slots */
+	int *free_slots;
+	int free_cnt;
+
+	/* Every cache slot in use is queued on the timer wheel for the tick
+		 it is checked at, the deadline is the tick its conntrack entry
+		 times out at unless refreshed. The lists are linked through timers[]
+		 and changed by both the conntrack listener and the timeout sweep,
+		 so like the rest of the cache they are only touched under
+		 ipacm_nat_lock */
+	nat_timer_node *timers;
+	int wheel[IPACM_NAT_WHEEL_DUE + 1];
+	uint32_t wheel_tick;
+
+	/* Traffic of each cache slot, the timestamps it is sampled from, and
+		 the flows taken in by evicting an idle one or refused for the lack
+		 of one */
+	nat_flow_hint *hints;
+	ipa_nat_rule_ts *ts_snap;
+	uint32_t evicted;
+	uint32_t refused;
+
+	/* Staged flows, kept dense in temp[0..temp_cnt), with the bucket
+		 heads of the hashed lists and the ends of the age list */
+	nat_table_entry *temp;
+	nat_temp_node *temp_nodes;
+	int temp_cnt, temp_size;
+	int *temp_idx[NAT_TEMP_AGE];
+	int temp_oldest, temp_newest;
+	uint32_t temp_replaced;
+	uint32_t temp_aged;
+
 	ipacm_alg *pALGPorts;
 	uint16_t nALGPort;
 
 	uint32_t tcp_timeout;
 	uint32_t udp_timeout;
+	time_t timeout_read;
 
 	uint32_t PwrSaveIfs[IPA_MAX_NUM_WIFI_CLIENTS];
 
 	struct nf_conntrack *ct;
-	struct nfct_handle *ct_hdl;
+#ifndef FEATURE_IPACM_HAL
+	struct nfnl_handle *nfnl_hdl;
+	struct nfnl_subsys_handle *ct_ssh;
+	uint32_t ct_seq;
+	/* Room for one batch of update messages and its acks, kept here
+		 rather than on the stack of the timeout refresh */
+	char ct_msgs[IPACM_CT_UPDATE_BATCH_MAX * IPACM_CT_UPDATE_MSG_LEN];
+	char ct_acks[IPACM_CT_UPDATE_ACK_LEN];
+	struct iovec ct_iov[IPACM_CT_UPDATE_BATCH_MAX];
+#endif
 
 	NatApp();
 	int Init();
 
-	void UpdateCTUdpTs(nat_table_entry *, uint32_t);
+	void UpdateCTUdpTs(const int *, int, int *);
+	void RefreshEntries(const int *, const uint32_t *, int, uint32_t);
 	bool ChkForDup(const nat_table_entry *);
+	uint32_t TupleHash(const nat_table_entry *);
+	uint32_t IdxHash(const int *, int);
+	void IdxRemove(int *, uint32_t);
+	int FindEntry(const nat_table_entry *);
+	int FindClnt(uint32_t, uint32_t *);
+	int AllocEntry(const nat_table_entry *);
+	void FreeEntry(int);
+	void WheelAdd(int, uint32_t);
+	void WheelDel(int);
+	void WheelAdvance(uint32_t);
+	void ScheduleEntry(int, uint32_t);
+	bool CheckEntry(int, uint32_t, uint32_t *);
+	uint32_t GetTimeoutTicks(uint8_t);
+	void ChkTimeouts();
+	int FindVictim(const ipa_nat_ipv4_rule *);
+	bool EvictEntry(const ipa_nat_ipv4_rule *);
+	bool isHwTblFull(void);
+	int EvictAndAdd(const ipa_nat_ipv4_rule *, uint32_t *);
+	uint32_t TempHash(int, const nat_table_entry *);
+	void TempLink(int);
+	void TempUnlink(int);
+	void TempFree(int);
+	int FindTempEntry(const nat_table_entry *);
+	bool GrowTemp(void);
+	void AgeTempEntries(void);
 	bool isAlgPort(uint8_t, uint16_t);
 	void Reset();
 	bool isPwrSaveIf(uint32_t);
+	static int CmpRuleTs(const void *, const void *);
+	void PrintLatency(FILE *, const char *, const uint32_t *);
+	static void ReapCb(uint32_t, uint32_t, const ipa_nat_ipv4_rule *, void *);
 
 public:
 	static NatApp* GetInstance();
@@ -111,9 +272,14 @@ public:
 	int DeleteTable(uint32_t);
 
 	int AddEntry(const nat_table_entry *);
+	int AddEntries(const nat_table_entry *, int);
 	int DeleteEntry(const nat_table_entry *);
 
 	void UpdateUDPTimeStamp();
+	unsigned int GetTimerSleep(unsigned int);
+	void UpdateNatStats();
+	void UpdateFlowHints();
+	void ReapIdleEntries();
 
 	int UpdatePwrSaveIf(uint32_t);
 	int ResetPwrSaveIf(uint32_t);
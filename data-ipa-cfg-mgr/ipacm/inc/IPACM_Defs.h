@@ -79,6 +79,7 @@ extern "C"
 #define IPA_MAX_PRIVATE_SUBNET_ENTRIES 3
 #define IPA_MAX_ALG_ENTRIES 20
 #define IPA_MAX_RM_ENTRY 6
+#define IPA_CT_EVT_BATCH_MAX 64
 
 #define IPV4_ADDR_LINKLOCAL 0xA9FE0000
 #define IPV4_ADDR_LINKLOCAL_MASK 0xFFFF0000
@@ -158,6 +159,7 @@ typedef enum
 	IPA_SW_ROUTING_DISABLE,                   /* NULL */
 	IPA_PROCESS_CT_MESSAGE,                   /* ipacm_ct_evt_data */
 	IPA_PROCESS_CT_MESSAGE_V6,                /* ipacm_ct_evt_data */
+	IPA_PROCESS_CT_MESSAGE_BATCH,             /* ipacm_ct_evt_batch */
 	IPA_LAN_TO_LAN_NEW_CONNECTION,            /* ipacm_event_connection */
 	IPA_LAN_TO_LAN_DEL_CONNECTION,            /* ipacm_event_connection */
 	IPA_WLAN_SWITCH_TO_SCC,                   /* No Data */
@@ -196,6 +198,8 @@ typedef enum
 	IPA_HANDLE_VLAN_IFACE_INFO,               /* ipacm_event_data_all */
 #endif
 	IPA_LAN_DELETE_SELF,                      /* ipacm_event_data_fid */
+	IPA_CFG_RELOADED_EVENT,                   /* NULL */
+	IPA_NAT_TIMER_EVENT,                      /* NULL */
 	IPACM_EVENT_MAX
 } ipa_cm_event_id;
 
@@ -235,6 +239,13 @@ typedef struct
 	enum nf_conntrack_msg_type type;
 }ipacm_ct_evt_data;
 
+/* Conntrack events drained from one listener socket, in arrival order */
+typedef struct
+{
+	int num_evts;
+	ipacm_ct_evt_data evts[IPA_CT_EVT_BATCH_MAX];
+}ipacm_ct_evt_batch;
+
 typedef struct
 {
 	char iface_name[IPA_IFACE_NAME_LEN];
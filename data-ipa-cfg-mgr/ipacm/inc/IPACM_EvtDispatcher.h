@@ -41,36 +41,56 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define IPACM_EvtDispatcher_H
 
 #include <stdio.h>
+#include <pthread.h>
 #include <IPACM_CmdQueue.h>
 #include "IPACM_Defs.h"
 #include "IPACM_Listener.h"
 
-/* queue */
-typedef struct _cmd_evts
+typedef struct _evt_listener
 {
-	ipa_cm_event_id event;
 	IPACM_Listener *obj;
-	//int ipa_interface_index;
-	_cmd_evts *next;
-}  cmd_evts;
+	int shard;
+}  evt_listener;
 
+/* Listeners of one event in registration order, with the mask of the
+	 workers they are bound to. registr/deregistr replace the whole array,
+	 a dispatch keeps the one it started with until its ref is dropped */
+typedef struct _evt_subscribers
+{
+	int ref;
+	int cnt;
+	uint32_t shards;
+	evt_listener l[1];
+}  evt_subscribers;
 
 
 class IPACM_EvtDispatcher
 {
 public:
 
-	/* api for all iface instances to register events */
-	static int registr(ipa_cm_event_id event, IPACM_Listener *obj);
+	/* api for all iface instances to register events, the events are
+		 handed to obj on the worker of shard */
+	static int registr(ipa_cm_event_id event, IPACM_Listener *obj,
+			int shard = IPACM_CMD_SHARD_IFACE);
 
 	/* api for all iface instances to de-register events */
 	static int deregistr(IPACM_Listener *obj);
 
 	static int PostEvt(ipacm_cmd_q_data *);
-	static void ProcessEvt(ipacm_cmd_q_data *);
+	static void ProcessEvt(cmd_t *);
 
 private:
-	static cmd_evts *head;
+	static evt_subscribers *subs[IPACM_EVENT_MAX];
+	/* Bumped by every deregistr, listeners gone during a dispatch are
+		 skipped */
+	static uint32_t subs_gen;
+	static pthread_mutex_t subs_lock;
+
+	static evt_subscribers *GetSubs(ipa_cm_event_id, uint32_t *);
+	static void PutSubs(ipa_cm_event_id, evt_subscribers *);
+	static bool isSubscribed(ipa_cm_event_id, IPACM_Listener *, uint32_t *);
+	static void SetSubs(ipa_cm_event_id, evt_subscribers *);
+	static int EnqueueEvt(Message *);
 };
 
 #endif /* IPACM_EvtDispatcher_H */
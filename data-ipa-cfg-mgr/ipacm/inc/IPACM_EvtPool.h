@@ -0,0 +1,114 @@
+/*
+Copyright (c) 2013-2016, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+		* Redistributions of source code must retain the above copyright
+			notice, this list of conditions and the following disclaimer.
+		* Redistributions in binary form must reproduce the above
+			copyright notice, this list of conditions and the following
+			disclaimer in the documentation and/or other materials provided
+			with the distribution.
+		* Neither the name of The Linux Foundation nor the names of its
+			contributors may be used to endorse or promote products derived
+			from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*!
+	@file
+	IPACM_EvtPool.h
+
+	@brief
+	This file implements the fixed size pools of the IPACM event objects
+
+	@Author
+
+*/
+#ifndef IPACM_EVTPOOL_H
+#define IPACM_EVTPOOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/* Objects of each pool, the message pool covers the events of the other
+	 pools in flight plus the rest of the events */
+#define IPACM_CT_BATCH_POOL_SIZE 16
+#define IPACM_CT_EVT_POOL_SIZE 64
+#define IPACM_NEIGH_EVT_POOL_SIZE 256
+#define IPACM_MSG_POOL_SIZE (IPACM_CT_BATCH_POOL_SIZE + IPACM_CT_EVT_POOL_SIZE + \
+	IPACM_NEIGH_EVT_POOL_SIZE + 128)
+
+/* Most pools the event data is looked up in when it is released */
+#define IPACM_EVT_POOL_MAX 8
+
+typedef struct _ipacm_evt_pool_stats
+{
+	const char *name;
+	int size;
+	int in_use;
+	int max_in_use;
+	uint32_t gets;
+	uint32_t misses;
+}ipacm_evt_pool_stats;
+
+class IPACM_EvtPool
+{
+public:
+
+	IPACM_EvtPool(const char *name, size_t obj_size, int num_objs);
+	~IPACM_EvtPool() { }
+
+	/* Takes an object, NULL if the pool is exhausted. Every miss is
+		 counted, the caller drops the event or falls back to the heap */
+	void *Get(void);
+
+	/* Gives back an object, false if it is not from this pool */
+	bool Put(void *obj);
+
+	void GetStats(ipacm_evt_pool_stats *stats);
+
+	/* Gives back the data of a processed event to its pool, or frees it
+		 when it was allocated from the heap */
+	static void Release(void *obj);
+
+	static int GetPoolCnt(void);
+	static IPACM_EvtPool *GetPool(int index);
+
+private:
+
+	const char *pool_name;
+	char *objs;
+	size_t obj_size;
+	int num_objs;
+	void *free_list;
+
+	int in_use;
+	int max_in_use;
+	uint32_t gets;
+	uint32_t misses;
+
+	pthread_mutex_t lock;
+
+	static IPACM_EvtPool *pools[IPACM_EVT_POOL_MAX];
+	static int num_pools;
+};
+
+extern IPACM_EvtPool ipacm_ct_batch_pool;
+extern IPACM_EvtPool ipacm_ct_evt_pool;
+extern IPACM_EvtPool ipacm_neigh_evt_pool;
+extern IPACM_EvtPool ipacm_msg_pool;
+
+#endif /* IPACM_EVTPOOL_H */
@@ -0,0 +1,90 @@
+/*
+Copyright (c) 2013-2016, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+		* Redistributions of source code must retain the above copyright
+			notice, this list of conditions and the following disclaimer.
+		* Redistributions in binary form must reproduce the above
+			copyright notice, this list of conditions and the following
+			disclaimer in the documentation and/or other materials provided
+			with the distribution.
+		* Neither the name of The Linux Foundation nor the names of its
+			contributors may be used to endorse or promote products derived
+			from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*!
+	@file
+	IPACM_EvtStats.h
+
+	@brief
+	This file implements the latency and queue depth statistics of the
+	IPACM event loop
+
+	@Author
+
+*/
+#ifndef IPACM_EVTSTATS_H
+#define IPACM_EVTSTATS_H
+
+#include <stdint.h>
+
+/* Buckets of the latency histograms: bucket 0 counts below 1us, bucket
+	 n from 2^(n-1)us up to 2^n us, the last one everything above */
+#define IPACM_EVT_HIST_BUCKETS 24
+
+typedef struct _ipacm_evt_hist
+{
+	uint32_t cnt;
+	uint32_t max_us;
+	uint64_t sum_us;
+	uint32_t bucket[IPACM_EVT_HIST_BUCKETS];
+}ipacm_evt_hist;
+
+class IPACM_EvtStats
+{
+public:
+
+	/* Monotonic time in ns the event timestamps are taken with */
+	static uint64_t Now(void);
+
+	/* Time an event waited in its queue, from PostEvt to the dequeue */
+	static void RecordWait(int event, uint64_t posted_ns, uint64_t now_ns);
+
+	/* Time the listeners of an event ran on one worker */
+	static void RecordExec(int event, uint64_t start_ns, uint64_t now_ns);
+
+	/* Asks for a dump, async signal safe */
+	static void RequestDump(void);
+
+	/* fd readable once a dump was asked for, -1 if it cannot be had */
+	static int GetDumpFd(void);
+
+	/* Consumes the requests of the dump fd */
+	static void AckDump(void);
+
+	/* Writes the statistics as JSON to path, replaced atomically */
+	static int Dump(const char *path);
+
+private:
+
+	static void Add(ipacm_evt_hist *hist, uint64_t ns);
+
+	static ipacm_evt_hist wait_hist[];
+	static ipacm_evt_hist exec_hist[];
+};
+
+#endif /* IPACM_EVTSTATS_H */
@@ -58,7 +58,6 @@ extern "C"
 #include <netinet/in.h>
 #include "IPACM_Defs.h"
 
-#define MAX_NUM_OF_FD 10
 #define IPA_NL_MSG_MAX_LEN (2048)
 
 /*--------------------------------------------------------------------------- 
@@ -91,10 +90,10 @@ extern "C"
 
 
 /*--------------------------------------------------------------------------- 
-	 Type representing function callback registered with a socket listener 
-	 thread for reading from a socket on receipt of an incoming message
+	 Type representing function callback registered with the reactor for
+	 reading from a socket until it would block
 ---------------------------------------------------------------------------*/
-typedef int (*ipa_sock_thrd_fd_read_f)(int fd);
+typedef int (*ipa_sock_thrd_fd_read_f)(int fd, void *param);
 
 typedef enum
 {
@@ -105,20 +104,6 @@ typedef enum
 	IPA_LINK_DOWN
 } ipa_nl_state_e;
 
-typedef struct
-{
-	int sk_fd;
-	ipa_sock_thrd_fd_read_f read_func;
-} ipa_nl_sk_fd_map_info_t;
-
-typedef struct
-{
-	ipa_nl_sk_fd_map_info_t sk_fds[MAX_NUM_OF_FD];
-	fd_set fdset;
-	int num_fd;
-	int max_fd;
-} ipa_nl_sk_fd_set_info_t;
-
 typedef struct
 {
 	int                 sk_fd;       /* socket descriptor */
@@ -206,12 +191,11 @@ int ipa_nl_listener_init
 (
 	 unsigned int nl_type,
 	 unsigned int nl_groups,
-	 ipa_nl_sk_fd_set_info_t *sk_fdset,
 	 ipa_sock_thrd_fd_read_f read_f
 	 );
 
-/*  Virtual function registered to receive incoming messages over the NETLINK routing socket*/
-int ipa_nl_recv_msg(int fd);
+/*  Reactor handler of the NETLINK routing socket, reads it until it would block */
+int ipa_nl_recv_msg(int fd, void *param);
 
 /* map mask value for ipv6 */
 int mask_v6(int index, uint32_t *mask);
@@ -0,0 +1,100 @@
+/*
+Copyright (c) 2013-2016, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+		* Redistributions of source code must retain the above copyright
+			notice, this list of conditions and the following disclaimer.
+		* Redistributions in binary form must reproduce the above
+			copyright notice, this list of conditions and the following
+			disclaimer in the documentation and/or other materials provided
+			with the distribution.
+		* Neither the name of The Linux Foundation nor the names of its
+			contributors may be used to endorse or promote products derived
+			from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*!
+	@file
+	IPACM_Reactor.h
+
+	@brief
+	This file implements the epoll loop reading the IPACM sockets
+
+	@Author
+
+*/
+#ifndef IPACM_REACTOR_H
+#define IPACM_REACTOR_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+/* netlink, driver, inotify, two conntrack sockets, the nat timer, the
+	 stats dump and room to spare */
+#define IPACM_REACTOR_MAX_FDS 16
+
+/* Read handler of an fd. The fd is edge triggered, the handler is only
+	 called again once more data arrived so it must read until the fd
+	 would block */
+typedef int (*ipacm_reactor_read_f)(int fd, void *param);
+
+typedef struct _ipacm_reactor_src
+{
+	int fd;
+	uint32_t gen;
+	ipacm_reactor_read_f read_f;
+	void *param;
+}ipacm_reactor_src;
+
+class IPACM_Reactor
+{
+public:
+
+	static IPACM_Reactor* GetInstance(void);
+
+	/* Watches fd from now on, safe from any thread. The fd is made non
+		 blocking only once it is watched: files that cannot be polled fail
+		 with errno EPERM and stay blocking */
+	int AddFd(int fd, ipacm_reactor_read_f read_f, void *param);
+
+	/* Stops watching fd. When it returns the handler of fd is not running
+		 and will not run again, the caller may close it */
+	int DelFd(int fd);
+
+	/* Runs the handlers of the ready fds in the calling thread. The
+		 events they post wake each command queue worker once per round.
+		 Returns only on error */
+	int Run(void);
+
+private:
+
+	IPACM_Reactor();
+	static void CreateInstance(void);
+
+	int epoll_fd;
+	pthread_t thread;
+	bool running;
+	/* slot whose handler is running, -1 if none */
+	int busy;
+	pthread_mutex_t lock;
+	pthread_cond_t idle;
+	ipacm_reactor_src srcs[IPACM_REACTOR_MAX_FDS];
+
+	static IPACM_Reactor *pInstance;
+	static pthread_once_t inst_once;
+};
+
+#endif /* IPACM_REACTOR_H */
@@ -0,0 +1,1145 @@
+/*
+Copyright (c) 2013-2016, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+		* Redistributions of source code must retain the above copyright
+			notice, this list of conditions and the following disclaimer.
+		* Redistributions in binary form must reproduce the above
+			copyright notice, this list of conditions and the following
+			disclaimer in the documentation and/or other materials provided
+			with the distribution.
+		* Neither the name of The Linux Foundation nor the names of its
+			contributors may be used to endorse or promote products derived
+			from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*!
+	@file
+	ipacm_ct_bench.cpp
+
+	@brief
+	Throughput benchmark of the conntrack to nat pipeline of ipacm.
+	Synthetic or recorded conntrack events are handed to the callback of
+	the conntrack client, go through the command queue and the conntrack
+	listener and end in the nat driver on top of the simulated IPA device.
+	Reports the events/sec, the queue depth over time, the latency of
+	every stage and the heap allocations of the pipeline.
+
+	Recorded streams are the text output of "conntrack -E", optionally
+	with "-o timestamp", one event per line, for instance:
+	  [UPDATE] tcp      6 432000 ESTABLISHED src=192.168.225.2 dst=198.18.0.1 sport=40000 dport=443 src=198.18.0.1 dst=10.0.0.1 sport=443 dport=40000 [ASSURED]
+	Events of other protocols are skipped.
+
+	@Author
+
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "IPACM_ConntrackClient.h"
+#include "IPACM_ConntrackListener.h"
+#include "IPACM_EvtDispatcher.h"
+#include "IPACM_EvtPool.h"
+#include "IPACM_EvtStats.h"
+#include "IPACM_Iface.h"
+#include "IPACM_Reactor.h"
+#include "ipacm_sim.h"
+
+extern "C"
+{
+#include "ipa_nat_sim.h"
+}
+
+#define BENCH_WAN_IP         0x0A000001 /* 10.0.0.1 */
+#define BENCH_SUBNET         0xC0A8E100 /* 192.168.225.0 */
+#define BENCH_TARGET_NET     0xC6120000 /* 198.18.0.0 */
+#define BENCH_TARGETS        1024
+#define BENCH_FIRST_PORT     1024
+#define BENCH_MAX_EVENTS     (1 << 24)
+#define BENCH_DEPTH_POINTS   20
+
+typedef enum
+{
+	BENCH_SYNTHETIC,
+	BENCH_TRACE
+}bench_workload;
+
+/* One conntrack event, addresses and ports in network order as they are
+	 set on the conntrack object */
+typedef struct
+{
+	uint8_t type;
+	uint8_t family;
+	uint8_t l4proto;
+	uint8_t tcp_state;
+	uint32_t status;
+	uint32_t orig_src[4];
+	uint32_t orig_dst[4];
+	uint32_t repl_src[4];
+	uint32_t repl_dst[4];
+	uint16_t orig_sport;
+	uint16_t orig_dport;
+	uint16_t repl_sport;
+	uint16_t repl_dport;
+}bench_ct_rec;
+
+typedef struct
+{
+	uint32_t *ns;
+	int cnt;
+	int max;
+}bench_lat;
+
+typedef struct
+{
+	bench_ct_rec *recs;
+	int num_recs;
+	int skipped;
+
+	/* clients of the stream, the ones past num_up never come up */
+	uint32_t clnts[MAX_IFACE_ADDRESS];
+	int num_clnts;
+	int num_up;
+
+	/* stamps of every event, by the sequence number carried in ATTR_ID */
+	uint64_t *cb_ns;
+
+	/* events of the batch the conntrack listener is on */
+	uint32_t cur_seqs[IPA_CT_EVT_BATCH_MAX];
+	int cur_cnt;
+	uint64_t cur_deq_ns;
+
+	uint32_t handed;
+	uint32_t processed;
+	uint32_t batches;
+	ipacm_ct_evt_batch *marker;
+	bool done;
+
+	bench_lat queue_lat;
+	bench_lat batch_lat;
+	bench_lat e2e_lat;
+	bench_lat nat_add_lat;
+	bench_lat nat_del_lat;
+
+	/* ct batches in flight, sampled every sample_ms */
+	uint16_t *depth;
+	int depth_cnt;
+	int depth_max;
+	int sample_ms;
+
+	bool count_allocs;
+	uint64_t allocs;
+	uint64_t frees;
+	uint64_t alloc_bytes;
+}bench_ctx;
+
+static bench_ctx bench;
+static pthread_mutex_t bench_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t bench_cond = PTHREAD_COND_INITIALIZER;
+
+static uint64_t BenchNowNs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int BenchLatInit(bench_lat *lat, int max)
+{
+	lat->ns = (uint32_t *)calloc(max, sizeof(uint32_t));
+	lat->cnt = 0;
+	lat->max = max;
+	return (lat->ns == NULL) ? -1 : 0;
+}
+
+/* The nat deletes also come from the timeout thread */
+static void BenchLatAdd(bench_lat *lat, uint64_t ns)
+{
+	int idx = __atomic_fetch_add(&lat->cnt, 1, __ATOMIC_RELAXED);
+
+	if(idx < lat->max)
+	{
+		lat->ns[idx] = (ns > UINT32_MAX) ? UINT32_MAX : (uint32_t)ns;
+	}
+}
+
+/*
+ * Heap allocations of the whole process are counted while the stream
+ * runs, glibc keeps the real allocator under its __libc_ names
+ */
+extern "C"
+{
+
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t num, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void __libc_free(void *ptr);
+
+static inline void BenchCountAlloc(size_t size)
+{
+	if(__atomic_load_n(&bench.count_allocs, __ATOMIC_RELAXED))
+	{
+		__atomic_fetch_add(&bench.allocs, 1, __ATOMIC_RELAXED);
+		__atomic_fetch_add(&bench.alloc_bytes, size, __ATOMIC_RELAXED);
+	}
+}
+
+void *malloc(size_t size) __THROW
+{
+	BenchCountAlloc(size);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t num, size_t size) __THROW
+{
+	BenchCountAlloc(num * size);
+	return __libc_calloc(num, size);
+}
+
+void *realloc(void *ptr, size_t size) __THROW
+{
+	BenchCountAlloc(size);
+	return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) __THROW
+{
+	if(ptr != NULL && __atomic_load_n(&bench.count_allocs, __ATOMIC_RELAXED))
+	{
+		__atomic_fetch_add(&bench.frees, 1, __ATOMIC_RELAXED);
+	}
+	__libc_free(ptr);
+}
+
+/* Time of the nat rule inserts and deletes of the nat app */
+int __real_ipa_nat_add_ipv4_rule(uint32_t tbl_hdl,
+				const ipa_nat_ipv4_rule *rule, uint32_t *rule_hdl);
+int __real_ipa_nat_del_ipv4_rule(uint32_t tbl_hdl, uint32_t rule_hdl);
+
+int __wrap_ipa_nat_add_ipv4_rule(uint32_t tbl_hdl,
+				const ipa_nat_ipv4_rule *rule, uint32_t *rule_hdl)
+{
+	uint64_t start = BenchNowNs();
+	int ret;
+
+	ret = __real_ipa_nat_add_ipv4_rule(tbl_hdl, rule, rule_hdl);
+	BenchLatAdd(&bench.nat_add_lat, BenchNowNs() - start);
+	return ret;
+}
+
+int __wrap_ipa_nat_del_ipv4_rule(uint32_t tbl_hdl, uint32_t rule_hdl)
+{
+	uint64_t start = BenchNowNs();
+	int ret;
+
+	ret = __real_ipa_nat_del_ipv4_rule(tbl_hdl, rule_hdl);
+	BenchLatAdd(&bench.nat_del_lat, BenchNowNs() - start);
+	return ret;
+}
+
+}
+
+/* Registered for the conntrack events around the conntrack listener, the
+	 head sees the events as they come off the command queue and the tail
+	 once the listener is done with them */
+class BenchStage : public IPACM_Listener
+{
+public:
+	BenchStage(bool tail)
+	{
+		isTail = tail;
+	}
+	void event_callback(ipa_cm_event_id evt, void *data);
+
+private:
+	bool isTail;
+
+	void Head(struct nf_conntrack *ct, uint64_t now);
+	void Tail(uint64_t now);
+};
+
+void BenchStage::Head(struct nf_conntrack *ct, uint64_t now)
+{
+	uint32_t seq;
+
+	if(ct == NULL || bench.cur_cnt == IPA_CT_EVT_BATCH_MAX)
+	{
+		return;
+	}
+
+	seq = nfct_get_attr_u32(ct, ATTR_ID);
+	if(seq >= (uint32_t)bench.num_recs)
+	{
+		return;
+	}
+
+	BenchLatAdd(&bench.queue_lat, now - bench.cb_ns[seq]);
+	bench.cur_seqs[bench.cur_cnt++] = seq;
+}
+
+/* The conntrack objects are gone by now, the events are known by the
+	 sequence numbers the head kept */
+void BenchStage::Tail(uint64_t now)
+{
+	int cnt;
+
+	if(bench.cur_cnt == 0)
+	{
+		return;
+	}
+
+	BenchLatAdd(&bench.batch_lat, now - bench.cur_deq_ns);
+	for(cnt = 0; cnt < bench.cur_cnt; cnt++)
+	{
+		BenchLatAdd(&bench.e2e_lat, now - bench.cb_ns[bench.cur_seqs[cnt]]);
+	}
+	__atomic_fetch_add(&bench.processed, bench.cur_cnt, __ATOMIC_RELAXED);
+	bench.batches++;
+}
+
+void BenchStage::event_callback(ipa_cm_event_id evt, void *data)
+{
+	ipacm_ct_evt_batch *batch = (ipacm_ct_evt_batch *)data;
+	uint64_t now = BenchNowNs();
+	int cnt;
+
+	if(batch == bench.marker)
+	{
+		if(isTail)
+		{
+			pthread_mutex_lock(&bench_lock);
+			bench.done = true;
+			pthread_cond_signal(&bench_cond);
+			pthread_mutex_unlock(&bench_lock);
+		}
+		return;
+	}
+
+	if(isTail)
+	{
+		Tail(now);
+		return;
+	}
+
+	bench.cur_cnt = 0;
+	bench.cur_deq_ns = now;
+	if(evt == IPA_PROCESS_CT_MESSAGE_BATCH)
+	{
+		for(cnt = 0; cnt < batch->num_evts; cnt++)
+		{
+			Head(batch->evts[cnt].ct, now);
+		}
+	}
+	else
+	{
+		Head(((ipacm_ct_evt_data *)data)->ct, now);
+	}
+}
+
+static void *BenchSampleDepth(void *param)
+{
+	ipacm_evt_pool_stats stats;
+	(void)param;
+
+	while(!__atomic_load_n(&bench.done, __ATOMIC_RELAXED) &&
+				bench.depth_cnt < bench.depth_max)
+	{
+		usleep(bench.sample_ms * 1000);
+		ipacm_ct_batch_pool.GetStats(&stats);
+		bench.depth[bench.depth_cnt++] = (uint16_t)stats.in_use;
+	}
+
+	return NULL;
+}
+
+/* runs the nat timer, the reactor never returns */
+static void *BenchReactor(void *param)
+{
+	(void)param;
+	IPACM_Reactor::GetInstance()->Run();
+	return NULL;
+}
+
+static struct nf_conntrack *BenchBuildCt(const bench_ct_rec *rec, uint32_t seq)
+{
+	struct nf_conntrack *ct;
+
+	ct = nfct_new();
+	if(ct == NULL)
+	{
+		return NULL;
+	}
+
+	nfct_set_attr_u8(ct, ATTR_ORIG_L3PROTO, rec->family);
+	nfct_set_attr_u8(ct, ATTR_REPL_L3PROTO, rec->family);
+	nfct_set_attr_u8(ct, ATTR_ORIG_L4PROTO, rec->l4proto);
+	nfct_set_attr_u8(ct, ATTR_REPL_L4PROTO, rec->l4proto);
+	nfct_set_attr_u32(ct, ATTR_ORIG_IPV4_SRC, rec->orig_src[0]);
+	nfct_set_attr_u32(ct, ATTR_ORIG_IPV4_DST, rec->orig_dst[0]);
+	nfct_set_attr_u32(ct, ATTR_REPL_IPV4_SRC, rec->repl_src[0]);
+	nfct_set_attr_u32(ct, ATTR_REPL_IPV4_DST, rec->repl_dst[0]);
+	nfct_set_attr_u16(ct, ATTR_ORIG_PORT_SRC, rec->orig_sport);
+	nfct_set_attr_u16(ct, ATTR_ORIG_PORT_DST, rec->orig_dport);
+	nfct_set_attr_u16(ct, ATTR_REPL_PORT_SRC, rec->repl_sport);
+	nfct_set_attr_u16(ct, ATTR_REPL_PORT_DST, rec->repl_dport);
+	if(IPPROTO_TCP == rec->l4proto)
+	{
+		nfct_set_attr_u8(ct, ATTR_TCP_STATE, rec->tcp_state);
+	}
+	nfct_set_attr_u32(ct, ATTR_STATUS, rec->status);
+	nfct_set_attr_u32(ct, ATTR_ID, seq);
+
+	return ct;
+}
+
+static bench_ct_rec *BenchNextRec(void)
+{
+	bench_ct_rec *rec = &bench.recs[bench.num_recs++];
+
+	memset(rec, 0, sizeof(*rec));
+	return rec;
+}
+
+/* Flows of the clients through the wan address. A flow is opened until
+	 the given number of them is live, then every new one replaces one of
+	 them. Tcp shows up established and goes with fin wait and destroy, udp
+	 with new and destroy, which is what passes the conntrack filters */
+static int BenchGenSynthetic(int num_evts, int num_flows, int udp_pct,
+				uint32_t subnet, uint32_t wan_ip)
+{
+	bench_ct_rec *live, *rec;
+	uint16_t ports[MAX_IFACE_ADDRESS];
+	int live_cnt = 0, idx, clnt;
+
+	live = (bench_ct_rec *)calloc(num_flows, sizeof(bench_ct_rec));
+	if(live == NULL)
+	{
+		return -1;
+	}
+
+	for(clnt = 0; clnt < bench.num_clnts; clnt++)
+	{
+		bench.clnts[clnt] = subnet + 2 + clnt;
+		ports[clnt] = BENCH_FIRST_PORT;
+	}
+
+	while(bench.num_recs < num_evts)
+	{
+		if(live_cnt == num_flows)
+		{
+			idx = rand() % live_cnt;
+			rec = BenchNextRec();
+			*rec = live[idx];
+			if(IPPROTO_UDP == rec->l4proto)
+			{
+				rec->type = NFCT_T_DESTROY;
+			}
+			else
+			{
+				rec->tcp_state = TCP_CONNTRACK_FIN_WAIT;
+				if(bench.num_recs < num_evts)
+				{
+					rec = BenchNextRec();
+					*rec = live[idx];
+					rec->type = NFCT_T_DESTROY;
+					rec->tcp_state = TCP_CONNTRACK_TIME_WAIT;
+				}
+			}
+			live[idx] = live[--live_cnt];
+			continue;
+		}
+
+		clnt = rand() % bench.num_clnts;
+		rec = BenchNextRec();
+		rec->family = AF_INET;
+		rec->status = IPS_SRC_NAT | IPS_SRC_NAT_DONE;
+		rec->orig_src[0] = htonl(bench.clnts[clnt]);
+		rec->orig_dst[0] = htonl(BENCH_TARGET_NET + rand() % BENCH_TARGETS);
+		rec->orig_sport = htons(ports[clnt]);
+		if(rand() % 100 < udp_pct)
+		{
+			rec->type = NFCT_T_NEW;
+			rec->l4proto = IPPROTO_UDP;
+			rec->orig_dport = htons((rand() & 1) ? 443 : 53);
+		}
+		else
+		{
+			rec->type = NFCT_T_UPDATE;
+			rec->l4proto = IPPROTO_TCP;
+			rec->tcp_state = TCP_CONNTRACK_ESTABLISHED;
+			rec->orig_dport = htons(443);
+		}
+		rec->repl_src[0] = rec->orig_dst[0];
+		rec->repl_dst[0] = htonl(wan_ip);
+		rec->repl_sport = rec->orig_dport;
+		rec->repl_dport = rec->orig_sport;
+
+		if(ports[clnt]++ == 0xFFFF)
+		{
+			ports[clnt] = BENCH_FIRST_PORT;
+		}
+		live[live_cnt++] = *rec;
+	}
+
+	free(live);
+	return 0;
+}
+
+static const struct
+{
+	const char *name;
+	uint8_t state;
+}bench_tcp_states[] =
+{
+	{ "NONE", TCP_CONNTRACK_NONE },
+	{ "SYN_SENT", TCP_CONNTRACK_SYN_SENT },
+	{ "SYN_RECV", TCP_CONNTRACK_SYN_RECV },
+	{ "ESTABLISHED", TCP_CONNTRACK_ESTABLISHED },
+	{ "FIN_WAIT", TCP_CONNTRACK_FIN_WAIT },
+	{ "CLOSE_WAIT", TCP_CONNTRACK_CLOSE_WAIT },
+	{ "LAST_ACK", TCP_CONNTRACK_LAST_ACK },
+	{ "TIME_WAIT", TCP_CONNTRACK_TIME_WAIT },
+	{ "CLOSE", TCP_CONNTRACK_CLOSE },
+	{ "LISTEN", TCP_CONNTRACK_LISTEN },
+	{ "SYN_SENT2", TCP_CONNTRACK_LISTEN },
+};
+
+static int BenchParseAddr(const char *str, bench_ct_rec *rec, uint32_t *addr)
+{
+	uint8_t family = (strchr(str, ':') != NULL) ? AF_INET6 : AF_INET;
+
+	if(inet_pton(family, str, addr) != 1)
+	{
+		return -1;
+	}
+	rec->family = family;
+	return 0;
+}
+
+/* Returns 1 for an event, 0 for a line to skip and -1 if it is malformed */
+static int BenchParseLine(char *line, bench_ct_rec *rec)
+{
+	char *tok, *val, *save = NULL;
+	uint16_t port;
+	int tuples = 0, have_type = 0, cnt;
+
+	memset(rec, 0, sizeof(*rec));
+	for(tok = strtok_r(line, " \t\r\n", &save); tok != NULL;
+			tok = strtok_r(NULL, " \t\r\n", &save))
+	{
+		if(!strcmp(tok, "[NEW]") || !strcmp(tok, "[UPDATE]") || !strcmp(tok, "[DESTROY]"))
+		{
+			rec->type = (tok[1] == 'N') ? NFCT_T_NEW :
+				((tok[1] == 'U') ? NFCT_T_UPDATE : NFCT_T_DESTROY);
+			have_type = 1;
+		}
+		else if(!strcmp(tok, "tcp"))
+		{
+			rec->l4proto = IPPROTO_TCP;
+		}
+		else if(!strcmp(tok, "udp"))
+		{
+			rec->l4proto = IPPROTO_UDP;
+		}
+		else if((val = strchr(tok, '=')) != NULL)
+		{
+			*val++ = '\0';
+			if(!strcmp(tok, "src"))
+			{
+				if(++tuples > 2 ||
+					 BenchParseAddr(val, rec, (tuples == 1) ? rec->orig_src : rec->repl_src))
+				{
+					return -1;
+				}
+			}
+			else if(!strcmp(tok, "dst"))
+			{
+				if(tuples == 0 ||
+					 BenchParseAddr(val, rec, (tuples == 1) ? rec->orig_dst : rec->repl_dst))
+				{
+					return -1;
+				}
+			}
+			else if(!strcmp(tok, "sport") || !strcmp(tok, "dport"))
+			{
+				if(tuples == 0)
+				{
+					return -1;
+				}
+				port = htons((uint16_t)atoi(val));
+				if(tok[0] == 's')
+				{
+					*((tuples == 1) ? &rec->orig_sport : &rec->repl_sport) = port;
+				}
+				else
+				{
+					*((tuples == 1) ? &rec->orig_dport : &rec->repl_dport) = port;
+				}
+			}
+		}
+		else
+		{
+			for(cnt = 0; cnt < (int)(sizeof(bench_tcp_states) / sizeof(bench_tcp_states[0])); cnt++)
+			{
+				if(!strcmp(tok, bench_tcp_states[cnt].name))
+				{
+					rec->tcp_state = bench_tcp_states[cnt].state;
+					break;
+				}
+			}
+		}
+	}
+
+	if(!have_type || rec->l4proto == 0)
+	{
+		return 0;
+	}
+	if(tuples != 2)
+	{
+		return -1;
+	}
+	/* the conntrack callback drops the ipv6 events, there is no ipv6 nat */
+	if(AF_INET6 == rec->family)
+	{
+		return 0;
+	}
+
+	/* the nat the kernel did shows in the reply tuple */
+	if(memcmp(rec->repl_dst, rec->orig_src, sizeof(rec->orig_src)) ||
+		 rec->repl_dport != rec->orig_sport)
+	{
+		rec->status |= IPS_SRC_NAT | IPS_SRC_NAT_DONE;
+	}
+	if(memcmp(rec->repl_src, rec->orig_dst, sizeof(rec->orig_dst)) ||
+		 rec->repl_sport != rec->orig_dport)
+	{
+		rec->status |= IPS_DST_NAT | IPS_DST_NAT_DONE;
+	}
+
+	return 1;
+}
+
+static void BenchAddClnt(const bench_ct_rec *rec)
+{
+	uint32_t addr;
+	int cnt;
+
+	if(rec->status & IPS_SRC_NAT)
+	{
+		addr = ntohl(rec->orig_src[0]);
+	}
+	else if(rec->status & IPS_DST_NAT)
+	{
+		addr = ntohl(rec->repl_src[0]);
+	}
+	else
+	{
+		return;
+	}
+
+	for(cnt = 0; cnt < bench.num_clnts; cnt++)
+	{
+		if(bench.clnts[cnt] == addr)
+		{
+			return;
+		}
+	}
+	if(bench.num_clnts < MAX_IFACE_ADDRESS)
+	{
+		bench.clnts[bench.num_clnts++] = addr;
+	}
+}
+
+/* The clients are the private ends of the nat flows. Without a given
+	 wan address it is the public end of the first nat flow */
+static int BenchReadTrace(const char *path, int max_evts, uint32_t *wan_ip)
+{
+	char line[1024];
+	bench_ct_rec *rec;
+	int line_no = 0, ret;
+	FILE *fp;
+
+	fp = fopen(path, "r");
+	if(fp == NULL)
+	{
+		perror(path);
+		return -1;
+	}
+
+	while(bench.num_recs < max_evts && fgets(line, sizeof(line), fp) != NULL)
+	{
+		line_no++;
+		rec = &bench.recs[bench.num_recs];
+		ret = BenchParseLine(line, rec);
+		if(ret < 0)
+		{
+			fprintf(stderr, "%s:%d: malformed line\n", path, line_no);
+			fclose(fp);
+			return -1;
+		}
+		if(ret == 0)
+		{
+			bench.skipped++;
+			continue;
+		}
+
+		if(*wan_ip == 0)
+		{
+			if(rec->status & IPS_SRC_NAT)
+			{
+				*wan_ip = ntohl(rec->repl_dst[0]);
+			}
+			else if(rec->status & IPS_DST_NAT)
+			{
+				*wan_ip = ntohl(rec->orig_dst[0]);
+			}
+		}
+		BenchAddClnt(rec);
+		bench.num_recs++;
+	}
+
+	fclose(fp);
+	return 0;
+}
+
+/* What the lan and wan interfaces of ipacm tell the conntrack listener
+	 when they come up */
+static void BenchBringUp(IPACM_Config *pConfig, uint32_t wan_ip)
+{
+	char lan_ifname[IPA_IFACE_NAME_LEN] = IPACM_SIM_LAN_IFNAME;
+	ipacm_event_iface_up wan;
+	ipacm_event_data_all clnt;
+	int cnt;
+
+	memset(&wan, 0, sizeof(wan));
+	strlcpy(wan.ifname, "rmnet_data0", sizeof(wan.ifname));
+	wan.ipv4_addr = wan_ip;
+	CtList->event_callback(IPA_HANDLE_WAN_UP, &wan);
+
+	pConfig->AddNatIfaces(lan_ifname, IPA_IP_v4);
+	for(cnt = 0; cnt < bench.num_up; cnt++)
+	{
+		memset(&clnt, 0, sizeof(clnt));
+		clnt.iptype = IPA_IP_v4;
+		clnt.if_index = IPACM_SIM_LAN_IFINDEX;
+		clnt.ipv4_addr = bench.clnts[cnt];
+		CtList->HandleNeighIpAddrAddEvt(&clnt);
+	}
+}
+
+/* Hands the events to the conntrack callback the way the listener thread
+	 does, a batch is flushed once drain_evts events were read or, when the
+	 stream is paced, whenever the socket would be empty */
+static void BenchRun(int drain_evts, int rate)
+{
+	ipacm_ct_evt_batch *batch = NULL;
+	ipacm_cmd_q_data evt_data;
+	struct nf_conntrack *ct;
+	uint64_t start, due;
+	int seq, drained = 0;
+
+	start = BenchNowNs();
+	for(seq = 0; seq < bench.num_recs; seq++)
+	{
+		if(rate > 0)
+		{
+			due = start + (uint64_t)seq * 1000000000ULL / rate;
+			if(BenchNowNs() < due)
+			{
+				IPACM_ConntrackClient::FlushCTBatch(&batch);
+				drained = 0;
+				while(BenchNowNs() < due)
+				{
+					;
+				}
+			}
+		}
+
+		ct = BenchBuildCt(&bench.recs[seq], seq);
+		if(ct == NULL)
+		{
+			continue;
+		}
+
+		bench.cb_ns[seq] = BenchNowNs();
+		__atomic_fetch_add(&bench.handed, 1, __ATOMIC_RELAXED);
+		IPACM_ConntrackClient::IPAConntrackEventCB(
+			(enum nf_conntrack_msg_type)bench.recs[seq].type, ct, &batch);
+
+		if(++drained == drain_evts)
+		{
+			IPACM_ConntrackClient::FlushCTBatch(&batch);
+			drained = 0;
+		}
+	}
+	IPACM_ConntrackClient::FlushCTBatch(&batch);
+
+	/* the queue is in order, the marker comes out after every event */
+	evt_data.event = IPA_PROCESS_CT_MESSAGE_BATCH;
+	evt_data.evt_data = bench.marker;
+	pthread_mutex_lock(&bench_lock);
+	if(IPACM_EvtDispatcher::PostEvt(&evt_data) == IPACM_SUCCESS)
+	{
+		while(!bench.done)
+		{
+			pthread_cond_wait(&bench_cond, &bench_lock);
+		}
+	}
+	else
+	{
+		bench.done = true;
+	}
+	pthread_mutex_unlock(&bench_lock);
+}
+
+static int BenchCmpU32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static void BenchPrintLat(FILE *out, const char *name, bench_lat *lat)
+{
+	int cnt = (lat->cnt < lat->max) ? lat->cnt : lat->max;
+
+	if(0 == cnt)
+	{
+		fprintf(out, "%s latency ns: no samples\n", name);
+		return;
+	}
+
+	qsort(lat->ns, cnt, sizeof(uint32_t), BenchCmpU32);
+	fprintf(out, "%s latency ns: p50 %u p90 %u p99 %u max %u (%d samples)\n",
+		name,
+		lat->ns[cnt / 2],
+		lat->ns[(int)(cnt * 0.90)],
+		lat->ns[(int)(cnt * 0.99)],
+		lat->ns[cnt - 1],
+		cnt);
+}
+
+/* Largest depth of every 1/BENCH_DEPTH_POINTS of the run */
+static void BenchPrintDepth(FILE *out)
+{
+	uint64_t sum = 0;
+	int cnt, point, first, last, max;
+
+	if(bench.depth_cnt == 0)
+	{
+		fprintf(out, "queue depth: no samples\n");
+		return;
+	}
+
+	max = 0;
+	for(cnt = 0; cnt < bench.depth_cnt; cnt++)
+	{
+		sum += bench.depth[cnt];
+		if(bench.depth[cnt] > max)
+		{
+			max = bench.depth[cnt];
+		}
+	}
+	fprintf(out, "queue depth in ct batches: max %d avg %.2f of %d, every %d ms:\n",
+		max, (double)sum / bench.depth_cnt, IPACM_CT_BATCH_POOL_SIZE, bench.sample_ms);
+
+	for(point = 0; point < BENCH_DEPTH_POINTS; point++)
+	{
+		first = point * bench.depth_cnt / BENCH_DEPTH_POINTS;
+		last = (point + 1) * bench.depth_cnt / BENCH_DEPTH_POINTS;
+		if(first == last)
+		{
+			continue;
+		}
+
+		max = 0;
+		for(cnt = first; cnt < last; cnt++)
+		{
+			if(bench.depth[cnt] > max)
+			{
+				max = bench.depth[cnt];
+			}
+		}
+		fprintf(out, "  %6d ms: %d\n", first * bench.sample_ms, max);
+	}
+}
+
+static void BenchUsage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-n events] [-c clients] [-l flows] [-u udp%%] [-t down%%]\n"
+		"          [-f trace] [-b drain] [-r rate] [-x cfg] [-w wan ip] [-s seed]\n"
+		"          [-i interval] [-j stats] [-v]\n"
+		"  -n  events of the stream (default 100000)\n"
+		"  -c  synthetic clients (default 8, at most %d)\n"
+		"  -l  synthetic flows live at once (default 400)\n"
+		"  -u  share of the synthetic flows on udp (default 50)\n"
+		"  -t  share of the clients that never come up (default 0)\n"
+		"  -f  replay the output of \"conntrack -E\" instead\n"
+		"  -b  events read from the socket before a batch is posted (default %d)\n"
+		"  -r  events per second, 0 hands them over as fast as possible (default 0)\n"
+		"  -x  IPACM_cfg.xml (default ../src/IPACM_cfg.xml)\n"
+		"  -w  wan address (default the public end of the first nat flow, or 10.0.0.1)\n"
+		"  -s  random seed (default 1)\n"
+		"  -i  queue depth sample interval in ms (default 10)\n"
+		"  -j  also write the event loop statistics dump of ipacm to this file\n"
+		"  -v  keep the ipacm logs\n",
+		prog, MAX_IFACE_ADDRESS, IPA_CT_EVT_BATCH_MAX);
+}
+
+int main(int argc, char **argv)
+{
+	bench_workload workload = BENCH_SYNTHETIC;
+	const char *trace = NULL, *stats_file = NULL;
+	int num_evts = 100000, num_flows = 400, udp_pct = 50, down_pct = 0;
+	int drain_evts = IPA_CT_EVT_BATCH_MAX, rate = 0, verbose = 0;
+	int opt, out_fd, cnt, shed;
+	uint32_t wan_ip = 0, subnet = BENCH_SUBNET;
+	uint32_t misses[IPACM_EVT_POOL_MAX];
+	uint64_t start, elapsed;
+	pthread_t cmd_thread[IPACM_CMD_SHARD_MAX], depth_thread, reactor_thread;
+	ipacm_evt_pool_stats pool_stats;
+	struct ipa_nat_sim_stats sim_stats;
+	ipacm_sim_stats ct_stats;
+	IPACM_Config *pConfig;
+	BenchStage *head, *tail;
+	struct in_addr addr;
+	FILE *out;
+
+	srand(1);
+	bench.num_clnts = 8;
+	bench.sample_ms = 10;
+	while((opt = getopt(argc, argv, "n:c:l:u:t:f:b:r:x:w:s:i:j:v")) != -1)
+	{
+		switch(opt)
+		{
+		case 'n': num_evts = atoi(optarg); break;
+		case 'c': bench.num_clnts = atoi(optarg); break;
+		case 'l': num_flows = atoi(optarg); break;
+		case 'u': udp_pct = atoi(optarg); break;
+		case 't': down_pct = atoi(optarg); break;
+		case 'f': trace = optarg; workload = BENCH_TRACE; break;
+		case 'b': drain_evts = atoi(optarg); break;
+		case 'r': rate = atoi(optarg); break;
+		case 'x': ipacm_sim_set_cfg_file(optarg); break;
+		case 's': srand(atoi(optarg)); break;
+		case 'i': bench.sample_ms = atoi(optarg); break;
+		case 'j': stats_file = optarg; break;
+		case 'v': verbose = 1; break;
+		case 'w':
+			if(inet_pton(AF_INET, optarg, &addr) != 1)
+			{
+				BenchUsage(argv[0]);
+				return 1;
+			}
+			wan_ip = ntohl(addr.s_addr);
+			break;
+		default:
+			BenchUsage(argv[0]);
+			return 1;
+		}
+	}
+
+	if(num_evts <= 0 || num_evts > BENCH_MAX_EVENTS || num_flows <= 0 ||
+		 bench.num_clnts <= 0 || bench.num_clnts > MAX_IFACE_ADDRESS ||
+		 udp_pct < 0 || udp_pct > 100 || down_pct < 0 || down_pct > 100 ||
+		 drain_evts <= 0 || rate < 0 || bench.sample_ms <= 0)
+	{
+		BenchUsage(argv[0]);
+		return 1;
+	}
+
+	/* ipacm logs to stdout, keep the report apart from them */
+	out_fd = dup(STDOUT_FILENO);
+	out = fdopen(out_fd, "w");
+	if(NULL == out)
+	{
+		perror("unable to dup stdout");
+		return 1;
+	}
+	if(!verbose && NULL == freopen("/dev/null", "w", stdout))
+	{
+		perror("unable to silence ipacm");
+		return 1;
+	}
+
+	pConfig = IPACM_Config::GetInstance();
+	if(pConfig == NULL)
+	{
+		fprintf(stderr, "unable to read the ipacm config\n");
+		return 1;
+	}
+	IPACM_Iface::ipacmcfg = pConfig;
+	if(pConfig->ipa_num_private_subnet > 0)
+	{
+		subnet = pConfig->private_subnet_table[0].subnet_addr;
+	}
+
+	bench.recs = (bench_ct_rec *)calloc(num_evts, sizeof(bench_ct_rec));
+	bench.cb_ns = (uint64_t *)calloc(num_evts, sizeof(uint64_t));
+	bench.depth_max = 1 << 20;
+	bench.depth = (uint16_t *)calloc(bench.depth_max, sizeof(uint16_t));
+	bench.marker = (ipacm_ct_evt_batch *)calloc(1, sizeof(ipacm_ct_evt_batch));
+	if(bench.recs == NULL || bench.cb_ns == NULL || bench.depth == NULL ||
+		 bench.marker == NULL ||
+		 BenchLatInit(&bench.queue_lat, num_evts) ||
+		 BenchLatInit(&bench.batch_lat, num_evts) ||
+		 BenchLatInit(&bench.e2e_lat, num_evts) ||
+		 BenchLatInit(&bench.nat_add_lat, num_evts) ||
+		 BenchLatInit(&bench.nat_del_lat, num_evts))
+	{
+		fprintf(stderr, "unable to allocate memory\n");
+		return 1;
+	}
+
+	if(BENCH_TRACE == workload)
+	{
+		bench.num_clnts = 0;
+		if(BenchReadTrace(trace, num_evts, &wan_ip))
+		{
+			return 1;
+		}
+	}
+	else
+	{
+		if(wan_ip == 0)
+		{
+			wan_ip = BENCH_WAN_IP;
+		}
+		if(BenchGenSynthetic(num_evts, num_flows, udp_pct, subnet, wan_ip))
+		{
+			fprintf(stderr, "unable to allocate memory\n");
+			return 1;
+		}
+	}
+	if(wan_ip == 0)
+	{
+		wan_ip = BENCH_WAN_IP;
+	}
+	bench.num_up = bench.num_clnts - bench.num_clnts * down_pct / 100;
+
+	/* the stages are told apart by the order of the registrations, on
+		 the worker of the conntrack listener */
+	head = new BenchStage(false);
+	IPACM_EvtDispatcher::registr(IPA_PROCESS_CT_MESSAGE, head, IPACM_CMD_SHARD_NAT);
+	IPACM_EvtDispatcher::registr(IPA_PROCESS_CT_MESSAGE_BATCH, head, IPACM_CMD_SHARD_NAT);
+	CtList = new IPACM_ConntrackListener();
+	tail = new BenchStage(true);
+	IPACM_EvtDispatcher::registr(IPA_PROCESS_CT_MESSAGE, tail, IPACM_CMD_SHARD_NAT);
+	IPACM_EvtDispatcher::registr(IPA_PROCESS_CT_MESSAGE_BATCH, tail, IPACM_CMD_SHARD_NAT);
+
+	BenchBringUp(pConfig, wan_ip);
+
+	for(cnt = 0; cnt < IPACM_CMD_SHARD_MAX; cnt++)
+	{
+		if(pthread_create(&cmd_thread[cnt], NULL, MessageQueue::Process,
+				(void *)(intptr_t)cnt) != 0)
+		{
+			fprintf(stderr, "unable to create the command queue thread\n");
+			return 1;
+		}
+	}
+	if(pthread_create(&reactor_thread, NULL, BenchReactor, NULL) != 0)
+	{
+		fprintf(stderr, "unable to create the reactor thread\n");
+		return 1;
+	}
+
+	for(cnt = 0; cnt < IPACM_EvtPool::GetPoolCnt(); cnt++)
+	{
+		IPACM_EvtPool::GetPool(cnt)->GetStats(&pool_stats);
+		misses[cnt] = pool_stats.misses;
+	}
+	ipa_nat_sim_reset_stats();
+
+	if(pthread_create(&depth_thread, NULL, BenchSampleDepth, NULL) != 0)
+	{
+		fprintf(stderr, "unable to create the sampling thread\n");
+		return 1;
+	}
+
+	__atomic_store_n(&bench.count_allocs, true, __ATOMIC_RELAXED);
+	start = BenchNowNs();
+	BenchRun(drain_evts, rate);
+	elapsed = BenchNowNs() - start;
+	__atomic_store_n(&bench.count_allocs, false, __ATOMIC_RELAXED);
+	pthread_join(depth_thread, NULL);
+
+	ipa_nat_sim_get_stats(&sim_stats);
+	ipacm_sim_get_stats(&ct_stats);
+
+	addr.s_addr = htonl(wan_ip);
+	fprintf(out, "stream: %s, %d events (%d lines skipped), wan %s\n",
+		trace ? trace : "synthetic", bench.num_recs, bench.skipped, inet_ntoa(addr));
+	fprintf(out, "clients: %d up, %d never up\n",
+		bench.num_up, bench.num_clnts - bench.num_up);
+	fprintf(out, "throughput: %u events in %.3f s, %.0f events/s\n",
+		bench.handed, elapsed / 1e9, elapsed ? bench.handed * 1e9 / elapsed : 0.0);
+
+	shed = 0;
+	fprintf(out, "pools:\n");
+	for(cnt = 0; cnt < IPACM_EvtPool::GetPoolCnt(); cnt++)
+	{
+		IPACM_EvtPool::GetPool(cnt)->GetStats(&pool_stats);
+		fprintf(out, "  %-12s size %4d max in use %4d gets %u misses %u\n",
+			pool_stats.name, pool_stats.size, pool_stats.max_in_use,
+			pool_stats.gets, pool_stats.misses - misses[cnt]);
+		if(IPACM_EvtPool::GetPool(cnt) == &ipacm_ct_batch_pool ||
+			 IPACM_EvtPool::GetPool(cnt) == &ipacm_ct_evt_pool)
+		{
+			shed += pool_stats.misses - misses[cnt];
+		}
+	}
+	fprintf(out, "listener: %u events in %u batches, %d shed, %d coalesced\n",
+		bench.processed, bench.batches, shed,
+		(int)(bench.handed - bench.processed) - shed);
+
+	BenchPrintDepth(out);
+	BenchPrintLat(out, "queue (callback to dequeue)", &bench.queue_lat);
+	BenchPrintLat(out, "batch (dequeue to processed)", &bench.batch_lat);
+	BenchPrintLat(out, "end to end (callback to processed)", &bench.e2e_lat);
+	BenchPrintLat(out, "nat add", &bench.nat_add_lat);
+	BenchPrintLat(out, "nat delete", &bench.nat_del_lat);
+
+	fprintf(out, "heap: %llu allocations (%.2f per event), %llu frees, %llu bytes\n",
+		(unsigned long long)bench.allocs,
+		bench.handed ? (double)bench.allocs / bench.handed : 0.0,
+		(unsigned long long)bench.frees,
+		(unsigned long long)bench.alloc_bytes);
+	fprintf(out, "dma: %llu commands, %llu writes, largest %u\n",
+		(unsigned long long)sim_stats.dma_cmds,
+		(unsigned long long)sim_stats.dma_writes,
+		sim_stats.max_dma_writes);
+	fprintf(out, "conntrack: %u refreshes kept from the host\n", ct_stats.ct_updates);
+	fclose(out);
+
+	if(stats_file != NULL && IPACM_EvtStats::Dump(stats_file) != IPACM_SUCCESS)
+	{
+		fprintf(stderr, "unable to write %s\n", stats_file);
+	}
+
+	/* the command queue and the nat threads never return */
+	_exit(0);
+}
@@ -0,0 +1,140 @@
+/*
+Copyright (c) 2013-2016, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+		* Redistributions of source code must retain the above copyright
+			notice, this list of conditions and the following disclaimer.
+		* Redistributions in binary form must reproduce the above
+			copyright notice, this list of conditions and the following
+			disclaimer in the documentation and/or other materials provided
+			with the distribution.
+		* Neither the name of The Linux Foundation nor the names of its
+			contributors may be used to endorse or promote products derived
+			from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*!
+	@file
+	ipacm_sim.cpp
+
+	@brief
+	This file implements the host stand-ins of the ipacm conntrack
+	pipeline. The calls into the system are redirected with the linker
+	(--wrap) so that the ipacm sources are built unchanged.
+
+	@Author
+
+*/
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <net/if.h>
+
+#include "IPACM_Iface.h"
+#include "IPACM_Wan.h"
+#include "IPACM_Xml.h"
+#include "ipacm_sim.h"
+
+extern "C"
+{
+#include <libnfnetlink/libnfnetlink.h>
+}
+
+/* Normally defined by the interface objects and the main of ipacm, none
+	 of which is linked */
+IPACM_Config *IPACM_Iface::ipacmcfg = NULL;
+uint32_t IPACM_Wan::curr_wan_ip = 0;
+uint32_t ipacm_event_stats[IPACM_EVENT_MAX];
+
+static char sim_cfg_file[PATH_MAX] = "../src/IPACM_cfg.xml";
+static ipacm_sim_stats sim_stats;
+
+void ipacm_sim_set_cfg_file(const char *path)
+{
+	strlcpy(sim_cfg_file, path, sizeof(sim_cfg_file));
+}
+
+void ipacm_sim_get_stats(ipacm_sim_stats *stats)
+{
+	stats->ct_updates = __atomic_load_n(&sim_stats.ct_updates, __ATOMIC_RELAXED);
+	stats->ct_handles = __atomic_load_n(&sim_stats.ct_handles, __ATOMIC_RELAXED);
+}
+
+extern "C"
+{
+
+int __real_ipacm_read_cfg_xml(char *xml_file, IPACM_conf_t *config);
+int __real_ioctl(int fd, unsigned long req, ...);
+
+int __wrap_ipacm_read_cfg_xml(char *xml_file, IPACM_conf_t *config)
+{
+	(void)xml_file;
+	return __real_ipacm_read_cfg_xml(sim_cfg_file, config);
+}
+
+/* The clients of the bench are reported on a lan interface of the
+	 config, every other request goes to the host */
+int __wrap_ioctl(int fd, unsigned long req, ...)
+{
+	struct ifreq *ifr;
+	va_list ap;
+	void *arg;
+
+	va_start(ap, req);
+	arg = va_arg(ap, void *);
+	va_end(ap);
+
+	ifr = (struct ifreq *)arg;
+	if(req == SIOCGIFNAME && ifr != NULL && ifr->ifr_ifindex == IPACM_SIM_LAN_IFINDEX)
+	{
+		strlcpy(ifr->ifr_name, IPACM_SIM_LAN_IFNAME, sizeof(ifr->ifr_name));
+		return 0;
+	}
+
+	return __real_ioctl(fd, req, arg);
+}
+
+/* The events come from the bench, the conntrack listeners never get a
+	 handle on the host */
+struct nfct_handle *__wrap_nfct_open(uint8_t subsys_id, unsigned subscriptions)
+{
+	(void)subsys_id;
+	(void)subscriptions;
+
+	__atomic_fetch_add(&sim_stats.ct_handles, 1, __ATOMIC_RELAXED);
+	errno = EPERM;
+	return NULL;
+}
+
+/* The conntrack refreshes of the nat app are counted, they never reach
+	 the conntrack table of the host */
+int __wrap_nfnl_sendiov(const struct nfnl_handle *nfnlh,
+			const struct iovec *iov, unsigned int num, unsigned int flags)
+{
+	(void)nfnlh;
+	(void)iov;
+	(void)flags;
+
+	__atomic_fetch_add(&sim_stats.ct_updates, num, __ATOMIC_RELAXED);
+	errno = EPERM;
+	return -1;
+}
+
+}
@@ -0,0 +1,64 @@
+/*
+Copyright (c) 2013-2016, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+		* Redistributions of source code must retain the above copyright
+			notice, this list of conditions and the following disclaimer.
+		* Redistributions in binary form must reproduce the above
+			copyright notice, this list of conditions and the following
+			disclaimer in the documentation and/or other materials provided
+			with the distribution.
+		* Neither the name of The Linux Foundation nor the names of its
+			contributors may be used to endorse or promote products derived
+			from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*!
+	@file
+	ipacm_sim.h
+
+	@brief
+	In-process stand-ins for what the conntrack pipeline of ipacm uses
+	outside of itself. Linked with the conntrack client, listener and nat
+	sources, they let the pipeline run unchanged on a plain Linux host:
+	the config comes from a given IPACM_cfg.xml, the lan interface of the
+	clients is simulated and the conntrack sockets of the host are never
+	used.
+
+	@Author
+
+*/
+#ifndef IPACM_SIM_H
+#define IPACM_SIM_H
+
+#include <stdint.h>
+
+/* Interface index and name the simulated lan clients are reported on */
+#define IPACM_SIM_LAN_IFINDEX 0x7ff0
+#define IPACM_SIM_LAN_IFNAME  "rndis0"
+
+typedef struct
+{
+	uint32_t ct_updates;    /* conntrack refreshes of the nat app */
+	uint32_t ct_handles;    /* conntrack event handles asked for */
+}ipacm_sim_stats;
+
+/* IPACM_cfg.xml read in place of the one of the device */
+void ipacm_sim_set_cfg_file(const char *path);
+
+void ipacm_sim_get_stats(ipacm_sim_stats *stats);
+
+#endif /* IPACM_SIM_H */
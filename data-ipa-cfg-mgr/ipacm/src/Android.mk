@@ -41,6 +41,9 @@ LOCAL_SRC_FILES := IPACM_Main.cpp \
 		IPACM_EvtDispatcher.cpp \
 		IPACM_Config.cpp \
 		IPACM_CmdQueue.cpp \
+		IPACM_EvtPool.cpp \
+		IPACM_EvtStats.cpp \
+		IPACM_Reactor.cpp \
 		IPACM_Filtering.cpp \
 		IPACM_Routing.cpp \
 		IPACM_Header.cpp \
@@ -53,6 +56,7 @@ LOCAL_SRC_FILES := IPACM_Main.cpp \
 		IPACM_Netlink.cpp \
 		IPACM_Xml.cpp \
 		IPACM_Conntrack_NATApp.cpp\
+		IPACM_ConntrackFilter.cpp \
 		IPACM_ConntrackClient.cpp \
 		IPACM_ConntrackListener.cpp \
 		IPACM_Log.cpp \
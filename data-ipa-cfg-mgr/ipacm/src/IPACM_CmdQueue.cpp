@@ -38,82 +38,204 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 */
 #include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <new>
+#include <sys/eventfd.h>
 #include "IPACM_CmdQueue.h"
 #include "IPACM_Log.h"
 #include "IPACM_Iface.h"
+#include "IPACM_EvtPool.h"
+#include "IPACM_EvtStats.h"
 
-pthread_mutex_t mutex    = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t  cond_var = PTHREAD_COND_INITIALIZER;
+/* Wakeup of each worker: the worker sets cmd_sleeping before it
+	 blocks on its eventfd, a poster only writes the eventfd when it
+	 takes the flag back, so a busy worker costs no syscall */
+static int cmd_evt_fd[IPACM_CMD_SHARD_MAX];
+static int cmd_sleeping[IPACM_CMD_SHARD_MAX];
 
-MessageQueue* MessageQueue::inst_internal = NULL;
-MessageQueue* MessageQueue::inst_external = NULL;
+/* Workers the posts of the batch of this thread are to wake */
+static __thread bool cmd_batch;
+static __thread uint32_t cmd_batch_shards;
 
-MessageQueue* MessageQueue::getInstanceInternal()
+MessageQueue* MessageQueue::inst_internal[IPACM_CMD_SHARD_MAX];
+MessageQueue* MessageQueue::inst_external[IPACM_CMD_SHARD_MAX];
+pthread_once_t MessageQueue::inst_once = PTHREAD_ONCE_INIT;
+
+/* All created up front, the posters and the workers never race on them */
+void MessageQueue::CreateInstances(void)
 {
-	if(inst_internal == NULL)
+	int cnt;
+
+	for(cnt = 0; cnt < IPACM_CMD_SHARD_MAX; cnt++)
 	{
-		inst_internal = new MessageQueue();
-		if(inst_internal == NULL)
+		cmd_evt_fd[cnt] = eventfd(0, EFD_CLOEXEC);
+		if(cmd_evt_fd[cnt] < 0)
 		{
-			IPACMERR("unable to create internal Message Queue instance\n");
-			return NULL;
+			IPACMERR("unable to create eventfd of shard %d: %s\n", cnt, strerror(errno));
+			continue;
+		}
+
+		inst_internal[cnt] = new (std::nothrow) MessageQueue(cnt);
+		inst_external[cnt] = new (std::nothrow) MessageQueue(cnt);
+		if(inst_internal[cnt] == NULL || inst_external[cnt] == NULL)
+		{
+			IPACMERR("unable to create Message Queue instances of shard %d\n", cnt);
+			delete inst_internal[cnt];
+			delete inst_external[cnt];
+			inst_internal[cnt] = NULL;
+			inst_external[cnt] = NULL;
+			close(cmd_evt_fd[cnt]);
+			cmd_evt_fd[cnt] = -1;
 		}
 	}
+}
+
+MessageQueue* MessageQueue::getInstanceInternal(int shard)
+{
+	if(shard < 0 || shard >= IPACM_CMD_SHARD_MAX)
+	{
+		IPACMERR("Invalid cmd queue shard %d\n", shard);
+		return NULL;
+	}
+
+	pthread_once(&inst_once, CreateInstances);
+	if(inst_internal[shard] == NULL)
+	{
+		IPACMERR("unable to create internal Message Queue instance\n");
+	}
+	return inst_internal[shard];
+}
+
+MessageQueue* MessageQueue::getInstanceExternal(int shard)
+{
+	if(shard < 0 || shard >= IPACM_CMD_SHARD_MAX)
+	{
+		IPACMERR("Invalid cmd queue shard %d\n", shard);
+		return NULL;
+	}
 
-	return inst_internal;
+	pthread_once(&inst_once, CreateInstances);
+	if(inst_external[shard] == NULL)
+	{
+		IPACMERR("unable to create external Message Queue instance\n");
+	}
+	return inst_external[shard];
+}
+
+void MessageQueue::push(Message *item)
+{
+	Message *prev;
+
+	__atomic_store_n(&item->m_next, NULL, __ATOMIC_RELAXED);
+	prev = __atomic_exchange_n(&Tail, item, __ATOMIC_ACQ_REL);
+	/* until this store the worker sees the queue end at prev */
+	__atomic_store_n(&prev->m_next, item, __ATOMIC_RELEASE);
 }
 
-MessageQueue* MessageQueue::getInstanceExternal()
+/* Wakes the worker of shard if it sleeps */
+static void WakeShard(int shard)
 {
-	if(inst_external == NULL)
+	uint64_t one = 1;
+
+	/* pairs with the fence of Process, either the worker finds the
+		 message on its second look or we see it asleep */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if(__atomic_load_n(&cmd_sleeping[shard], __ATOMIC_RELAXED) &&
+		 __atomic_exchange_n(&cmd_sleeping[shard], 0, __ATOMIC_ACQ_REL))
 	{
-		inst_external = new MessageQueue();
-		if(inst_external == NULL)
+		if(write(cmd_evt_fd[shard], &one, sizeof(one)) != sizeof(one))
 		{
-			IPACMERR("unable to create external Message Queue instance\n");
-			return NULL;
+			IPACMERR("unable to wake cmd queue shard %d: %s\n", shard, strerror(errno));
 		}
 	}
-
-	return inst_external;
 }
 
 void MessageQueue::enqueue(Message *item)
 {
-	if(!Head)
+	int cnt, peak;
+
+	cnt = __sync_add_and_fetch(&depth, 1);
+	peak = peak_depth;
+	while(cnt > peak)
 	{
-		Tail = item;
-		Head = item;
+		peak = __sync_val_compare_and_swap(&peak_depth, peak, cnt);
 	}
-	else
+
+	push(item);
+
+	if(cmd_batch)
 	{
-		if(Tail == NULL)
-		{
-			IPACMDBG("Tail is null\n");
-			Head->setnext(item);
-		}
-		else
+		cmd_batch_shards |= 1 << shard;
+		return;
+	}
+	WakeShard(shard);
+}
+
+void MessageQueue::BeginBatch(void)
+{
+	cmd_batch = true;
+	cmd_batch_shards = 0;
+}
+
+void MessageQueue::EndBatch(void)
+{
+	int shard;
+
+	cmd_batch = false;
+	for(shard = 0; shard < IPACM_CMD_SHARD_MAX; shard++)
+	{
+		if(cmd_batch_shards & (1 << shard))
 		{
-			Tail->setnext(item);
+			WakeShard(shard);
 		}
-		Tail = item;
 	}
+	cmd_batch_shards = 0;
 }
 
-
+/* Only called by the worker of the shard */
 Message* MessageQueue::dequeue(void)
 {
-	if(Head == NULL)
+	Message *head = Head;
+	Message *next = __atomic_load_n(&head->m_next, __ATOMIC_ACQUIRE);
+
+	if(head == &stub)
 	{
-		return NULL;
+		if(next == NULL)
+		{
+			return NULL;
+		}
+		Head = next;
+		head = next;
+		next = __atomic_load_n(&head->m_next, __ATOMIC_ACQUIRE);
 	}
-	else
+
+	if(next != NULL)
 	{
-		Message *tmp = Head;
-		Head = Head->getnext();
+		Head = next;
+		__sync_fetch_and_sub(&depth, 1);
+		return head;
+	}
 
-		return tmp;
+	/* a poster swapped in behind head but has not linked it yet, its
+		 message is taken on the next pass */
+	if(head != __atomic_load_n(&Tail, __ATOMIC_ACQUIRE))
+	{
+		return NULL;
 	}
+
+	/* head is the last message, put the stub behind it to free it */
+	push(&stub);
+	next = __atomic_load_n(&head->m_next, __ATOMIC_ACQUIRE);
+	if(next != NULL)
+	{
+		Head = next;
+		__sync_fetch_and_sub(&depth, 1);
+		return head;
+	}
+
+	return NULL;
 }
 
 
@@ -122,19 +244,21 @@ void* MessageQueue::Process(void *param)
 	MessageQueue *MsgQueueInternal = NULL;
 	MessageQueue *MsgQueueExternal = NULL;
 	Message *item = NULL;
-	param = NULL;
+	int shard = (int)(intptr_t)param;
 	const char *eventName = NULL;
+	bool external;
+	uint64_t cnt;
 
-	IPACMDBG("MessageQueue::Process()\n");
+	IPACMDBG("MessageQueue::Process() shard %d\n", shard);
 
-	MsgQueueInternal = MessageQueue::getInstanceInternal();
+	MsgQueueInternal = MessageQueue::getInstanceInternal(shard);
 	if(MsgQueueInternal == NULL)
 	{
 		IPACMERR("unable to start internal cmd queue process\n");
 		return NULL;
 	}
 
-	MsgQueueExternal = MessageQueue::getInstanceExternal();
+	MsgQueueExternal = MessageQueue::getInstanceExternal(shard);
 	if(MsgQueueExternal == NULL)
 	{
 		IPACMERR("unable to start external cmd queue process\n");
@@ -143,73 +267,64 @@ void* MessageQueue::Process(void *param)
 
 	while(1)
 	{
-		if(pthread_mutex_lock(&mutex) != 0)
-		{
-			IPACMERR("unable to lock the mutex\n");
-			return NULL;
-		}
-
+		/* internal events first */
+		external = false;
 		item = MsgQueueInternal->dequeue();
 		if(item == NULL)
 		{
+			external = true;
 			item = MsgQueueExternal->dequeue();
-			if(item)
-			{
-				eventName = IPACM_Iface::ipacmcfg->getEventName(item->evt.data.event);
-				if (eventName != NULL)
-				{
-					IPACMDBG("Get event %s from external queue.\n",
-							eventName);
-				}
-			}
-		}
-		else
-		{
-			eventName = IPACM_Iface::ipacmcfg->getEventName(item->evt.data.event);
-			if (eventName != NULL)
-			{
-				IPACMDBG("Get event %s from internal queue.\n",
-					eventName);
-			}
 		}
 
 		if(item == NULL)
 		{
-			IPACMDBG("Waiting for Message\n");
+			/* say we go to sleep, then look once more so a message posted
+				 in between is not left behind */
+			__atomic_store_n(&cmd_sleeping[shard], 1, __ATOMIC_RELAXED);
+			__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+			external = false;
+			item = MsgQueueInternal->dequeue();
+			if(item == NULL)
+			{
+				external = true;
+				item = MsgQueueExternal->dequeue();
+			}
 
-			if(pthread_cond_wait(&cond_var, &mutex) != 0)
+			if(item == NULL)
 			{
-				IPACMERR("unable to lock the mutex\n");
+				IPACMDBG("Waiting for Message\n");
 
-				if(pthread_mutex_unlock(&mutex) != 0)
+				if(read(cmd_evt_fd[shard], &cnt, sizeof(cnt)) < 0 && errno != EINTR)
 				{
-					IPACMERR("unable to unlock the mutex\n");
+					IPACMERR("unable to wait on cmd queue shard %d: %s\n", shard, strerror(errno));
 					return NULL;
 				}
-
-				return NULL;
-			}
-
-			if(pthread_mutex_unlock(&mutex) != 0)
-			{
-				IPACMERR("unable to unlock the mutex\n");
-				return NULL;
+				continue;
 			}
 
+			/* a poster may have taken the flag already and woken us,
+				 that only costs one empty pass */
+			__atomic_store_n(&cmd_sleeping[shard], 0, __ATOMIC_RELAXED);
 		}
-		else
+
+		IPACM_EvtStats::RecordWait(item->evt.data.event, item->evt.post_ns,
+			IPACM_EvtStats::Now());
+
+		eventName = IPACM_Iface::ipacmcfg->getEventName(item->evt.data.event);
+		if (eventName != NULL)
 		{
-			if(pthread_mutex_unlock(&mutex) != 0)
-			{
-				IPACMERR("unable to unlock the mutex\n");
-				return NULL;
-			}
+			IPACMDBG("Get event %s from %s queue.\n",
+					eventName, external ? "external" : "internal");
+		}
 
-			IPACMDBG("Processing item %pK event ID: %d\n",item,item->evt.data.event);
-			item->evt.callback_ptr(&item->evt.data);
+		IPACMDBG("Processing item %pK event ID: %d\n",item,item->evt.data.event);
+		item->evt.callback_ptr(&item->evt);
+		if(!ipacm_msg_pool.Put(item))
+		{
 			delete item;
-			item = NULL;
 		}
+		item = NULL;
 
 	} /* Go forever until a termination indication is received */
 
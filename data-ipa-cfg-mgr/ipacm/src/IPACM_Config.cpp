@@ -80,6 +80,7 @@ const char *ipacm_event_name[] = {
 	__stringify(IPA_SW_ROUTING_DISABLE),                   /* NULL */
 	__stringify(IPA_PROCESS_CT_MESSAGE),                   /* ipacm_ct_evt_data */
 	__stringify(IPA_PROCESS_CT_MESSAGE_V6),                /* ipacm_ct_evt_data */
+	__stringify(IPA_PROCESS_CT_MESSAGE_BATCH),             /* ipacm_ct_evt_batch */
 	__stringify(IPA_LAN_TO_LAN_NEW_CONNECTION),            /* ipacm_event_connection */
 	__stringify(IPA_LAN_TO_LAN_DEL_CONNECTION),            /* ipacm_event_connection */
 	__stringify(IPA_WLAN_SWITCH_TO_SCC),                   /* No Data */
@@ -115,6 +116,8 @@ const char *ipacm_event_name[] = {
 	__stringify(IPA_VLAN_CLIENT_INFO),                     /* ipacm_event_data_all */
 	__stringify(IPA_VLAN_IFACE_INFO),                      /* ipacm_event_data_all */
 #endif
+	__stringify(IPA_CFG_RELOADED_EVENT),                   /* NULL */
+	__stringify(IPA_NAT_TIMER_EVENT),                      /* NULL */
 	__stringify(IPACM_EVENT_MAX),
 };
 
@@ -31,6 +31,8 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <sys/ioctl.h>
@@ -38,6 +40,8 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "IPACM_Iface.h"
 #include "IPACM_ConntrackListener.h"
 #include "IPACM_ConntrackClient.h"
+#include "IPACM_EvtPool.h"
+#include "IPACM_Reactor.h"
 #include "IPACM_Log.h"
 
 #define LO_NAME "lo"
@@ -58,6 +62,8 @@ IPACM_ConntrackClient::IPACM_ConntrackClient()
 
 	tcp_hdl = NULL;
 	udp_hdl = NULL;
+	tcp_batch = NULL;
+	udp_batch = NULL;
 	tcp_filter = NULL;
 	udp_filter = NULL;
 	fd_tcp = -1;
@@ -72,7 +78,7 @@ IPACM_ConntrackClient* IPACM_ConntrackClient::GetInstance()
 	{
 		pInstance = new IPACM_ConntrackClient();
 
-		pInstance->udp_filter = nfct_filter_create();
+		pInstance->udp_filter = new IPACM_ConntrackFilter(IPPROTO_UDP);
 		if(pInstance->udp_filter == NULL)
 		{
 			IPACMERR("unable to create UDP filter\n");
@@ -81,7 +87,7 @@ IPACM_ConntrackClient* IPACM_ConntrackClient::GetInstance()
 		}
 		IPACMDBG("Created UDP filter\n");
 
-		pInstance->tcp_filter = nfct_filter_create();
+		pInstance->tcp_filter = new IPACM_ConntrackFilter(IPPROTO_TCP);
 		if(pInstance->tcp_filter == NULL)
 		{
 			IPACMERR("unable to create TCP filter\n");
@@ -103,8 +109,8 @@ int IPACM_ConntrackClient::IPAConntrackEventCB
 {
 	ipacm_cmd_q_data evt_data;
 	ipacm_ct_evt_data *ct_data;
+	ipacm_ct_evt_batch **batch = (ipacm_ct_evt_batch **)data;
 	uint8_t ip_type = 0;
-	data = NULL;
 
 	IPACMDBG("Event callback called with msgtype: %d\n",type);
 
@@ -120,10 +126,37 @@ int IPACM_ConntrackClient::IPAConntrackEventCB
 
 #endif
 
-	ct_data = (ipacm_ct_evt_data *)malloc(sizeof(ipacm_ct_evt_data));
+	/* ipv4 events are collected and posted once the socket is drained */
+	if(batch != NULL && AF_INET6 != ip_type)
+	{
+		if(*batch == NULL)
+		{
+			/* With every batch in flight the event is shed, the pool
+				 counts it */
+			*batch = (ipacm_ct_evt_batch *)ipacm_ct_batch_pool.Get();
+			if(*batch == NULL)
+			{
+				IPACMDBG("no conntrack batch free, dropping event\n");
+				goto IGNORE;
+			}
+			(*batch)->num_evts = 0;
+		}
+
+		(*batch)->evts[(*batch)->num_evts].ct = ct;
+		(*batch)->evts[(*batch)->num_evts].type = type;
+		(*batch)->num_evts++;
+
+		if((*batch)->num_evts == IPA_CT_EVT_BATCH_MAX)
+		{
+			FlushCTBatch(batch);
+		}
+		return NFCT_CB_STOLEN;
+	}
+
+	ct_data = (ipacm_ct_evt_data *)ipacm_ct_evt_pool.Get();
 	if(ct_data == NULL)
 	{
-		IPACMERR("unable to allocate memory \n");
+		IPACMDBG("no conntrack event free, dropping event\n");
 		goto IGNORE;
 	}
 
@@ -143,7 +176,7 @@ int IPACM_ConntrackClient::IPAConntrackEventCB
 	if(0 != IPACM_EvtDispatcher::PostEvt(&evt_data))
 	{
 		IPACMERR("Error sending Conntrack message to processing thread!\n");
-		free(ct_data);
+		ipacm_ct_evt_pool.Put(ct_data);
 		goto IGNORE;
 	}
 
@@ -157,9 +190,152 @@ IGNORE:
 
 }
 
+/* Drop the flows that were created and destroyed within the batch and
+	 post the rest to the processing thread as one event */
+void IPACM_ConntrackClient::FlushCTBatch(ipacm_ct_evt_batch **batch)
+{
+	ipacm_cmd_q_data evt_data;
+	ipacm_ct_evt_batch *pending = *batch;
+	struct nf_conntrack *ct;
+	int i, j, k, num = 0;
+
+	if(pending == NULL)
+	{
+		return;
+	}
+	*batch = NULL;
+
+	for(i = 0; i < pending->num_evts; i++)
+	{
+		if(pending->evts[i].ct == NULL || pending->evts[i].type != NFCT_T_DESTROY)
+		{
+			continue;
+		}
+
+		for(j = 0; j < i; j++)
+		{
+			if(pending->evts[j].ct != NULL &&
+				 pending->evts[j].type == NFCT_T_NEW &&
+				 nfct_cmp(pending->evts[j].ct, pending->evts[i].ct, NFCT_CMP_ORIG))
+			{
+				break;
+			}
+		}
+
+		if(j == i)
+		{
+			continue;
+		}
+
+		/* the flow never reached the nat table, forget every event of it */
+		ct = pending->evts[i].ct;
+		for(k = j; k < i; k++)
+		{
+			if(pending->evts[k].ct != NULL &&
+				 nfct_cmp(pending->evts[k].ct, ct, NFCT_CMP_ORIG))
+			{
+				nfct_destroy(pending->evts[k].ct);
+				pending->evts[k].ct = NULL;
+			}
+		}
+		nfct_destroy(ct);
+		pending->evts[i].ct = NULL;
+	}
+
+	for(i = 0; i < pending->num_evts; i++)
+	{
+		if(pending->evts[i].ct != NULL)
+		{
+			pending->evts[num++] = pending->evts[i];
+		}
+	}
+	IPACMDBG("Conntrack batch of %d events, %d after coalescing\n",
+					 pending->num_evts, num);
+	pending->num_evts = num;
+
+	if(num == 0)
+	{
+		ipacm_ct_batch_pool.Put(pending);
+		return;
+	}
+
+	evt_data.event = IPA_PROCESS_CT_MESSAGE_BATCH;
+	evt_data.evt_data = (void *)pending;
+	if(0 != IPACM_EvtDispatcher::PostEvt(&evt_data))
+	{
+		IPACMERR("Error sending Conntrack batch to processing thread!\n");
+		for(i = 0; i < num; i++)
+		{
+			nfct_destroy(pending->evts[i].ct);
+		}
+		ipacm_ct_batch_pool.Put(pending);
+	}
+
+	return;
+}
+
+/* Read the conntrack socket until it would block and post what was
+	 read as one batch */
+int IPACM_ConntrackClient::DrainCTEvents
+(
+	 struct nfct_handle *hdl,
+	 ipacm_ct_evt_batch **batch
+	 )
+{
+	int ret;
+
+	while(1)
+	{
+		/* nfct_catch only returns once a read failed */
+		errno = 0;
+		ret = nfct_catch(hdl);
+		FlushCTBatch(batch);
+		if(ret != -1 || errno == 0 || errno == EINTR)
+		{
+			continue;
+		}
+		if(errno == EAGAIN || errno == EWOULDBLOCK)
+		{
+			return 0;
+		}
+		if(errno == ENOBUFS)
+		{
+			IPACMERR("conntrack events lost, socket buffer overrun\n");
+			continue;
+		}
+		IPACMERR("(%d)(%s)\n", ret, strerror(errno));
+		return -1;
+	}
+}
+
+/* Reactor handlers of the conntrack sockets */
+int IPACM_ConntrackClient::ReadTCPEvents(int fd, void *param)
+{
+	IPACM_ConntrackClient *pClient = (IPACM_ConntrackClient *)param;
+
+	(void)fd;
+	if(DrainCTEvents(pClient->tcp_hdl, &pClient->tcp_batch) != 0)
+	{
+		return IPACM_FAILURE;
+	}
+	return IPACM_SUCCESS;
+}
+
+int IPACM_ConntrackClient::ReadUDPEvents(int fd, void *param)
+{
+	IPACM_ConntrackClient *pClient = (IPACM_ConntrackClient *)param;
+
+	(void)fd;
+	if(DrainCTEvents(pClient->udp_hdl, &pClient->udp_batch) != 0)
+	{
+		return IPACM_FAILURE;
+	}
+	return IPACM_SUCCESS;
+}
+
 int IPACM_ConntrackClient::IPA_Conntrack_Filters_Ignore_Bridge_Addrs
 (
-	 struct nfct_filter *filter
+	 IPACM_ConntrackFilter *filter
 )
 {
 	int fd;
@@ -199,54 +375,23 @@ int IPACM_ConntrackClient::IPA_Conntrack_Filters_Ignore_Bridge_Addrs
 	ipv4_addr = ntohl(((struct sockaddr_in *)&ifr.ifr_addr)->sin_addr.s_addr);
 	close(fd);
 
-	/* ignore whatever is destined to or originates from broadcast ip address */
-	struct nfct_filter_ipv4 filter_ipv4;
-
-	filter_ipv4.addr = ipv4_addr;
-	filter_ipv4.mask = 0xffffffff;
-
-	nfct_filter_set_logic(filter,
-												NFCT_FILTER_DST_IPV4,
-												NFCT_FILTER_LOGIC_NEGATIVE);
-
-	nfct_filter_add_attr(filter, NFCT_FILTER_DST_IPV4, &filter_ipv4);
-
-	nfct_filter_set_logic(filter,
-												NFCT_FILTER_SRC_IPV4,
-												NFCT_FILTER_LOGIC_NEGATIVE);
-
-	nfct_filter_add_attr(filter, NFCT_FILTER_SRC_IPV4, &filter_ipv4);
-
-	return 0;
+	/* ignore whatever is destined to or originates from bridge ip address */
+	return filter->IgnoreAddr(ipv4_addr, true, true);
 }
 
 int IPACM_ConntrackClient::IPA_Conntrack_Filters_Ignore_Local_Iface
 (
-	 struct nfct_filter *filter,
+	 IPACM_ConntrackFilter *filter,
 	 ipacm_event_iface_up *param
 )
 {
-	struct nfct_filter_ipv4 filter_ipv4;
-
-	filter_ipv4.addr = param->ipv4_addr;
-	filter_ipv4.mask = 0xffffffff;
-
-	/* ignore whatever is destined to local interfaces */
-	IPACMDBG("Ignore connections destinated to interface %s", param->ifname);
+	/* ignore whatever is destined to or originates from local interfaces */
+	IPACMDBG("Ignore connections of interface %s", param->ifname);
 	iptodot("with ipv4 address", param->ipv4_addr);
-	nfct_filter_set_logic(filter,
-												NFCT_FILTER_DST_IPV4,
-												NFCT_FILTER_LOGIC_NEGATIVE);
-
-	nfct_filter_add_attr(filter, NFCT_FILTER_DST_IPV4, &filter_ipv4);
-
-	IPACMDBG("Ignore connections orignated from interface %s", param->ifname);
-	iptodot("with ipv4 address", filter_ipv4.addr);
-	nfct_filter_set_logic(filter,
-												NFCT_FILTER_SRC_IPV4,
-												NFCT_FILTER_LOGIC_NEGATIVE);
-
-	nfct_filter_add_attr(filter, NFCT_FILTER_SRC_IPV4, &filter_ipv4);
+	if(filter->IgnoreAddr(param->ipv4_addr, true, true) < 0)
+	{
+		return -1;
+	}
 
 	/* Retrieve broadcast address */
 	/* Intialize with 255.255.255.255 */
@@ -256,139 +401,69 @@ int IPACM_ConntrackClient::IPA_Conntrack_Filters_Ignore_Local_Iface
 	bc_ip_addr = (bc_ip_addr & (~param->addr_mask));
 	bc_ip_addr = (bc_ip_addr | (param->ipv4_addr & param->addr_mask));
 
-	/* netfitler expecting in host-byte order */
-	filter_ipv4.addr = bc_ip_addr;
-	filter_ipv4.mask = 0xffffffff;
-
-	iptodot("with broadcast address", filter_ipv4.addr);
-	nfct_filter_set_logic(filter,
-												NFCT_FILTER_DST_IPV4,
-												NFCT_FILTER_LOGIC_NEGATIVE);
-
-	nfct_filter_add_attr(filter, NFCT_FILTER_DST_IPV4, &filter_ipv4);
-
-	return 0;
+	/* filter expecting in host-byte order */
+	iptodot("with broadcast address", bc_ip_addr);
+	return filter->IgnoreAddr(bc_ip_addr, false, true);
 }
 
 /* Function which sets up filters to ignore
 		 connections to and from local interfaces */
 int IPACM_ConntrackClient::IPA_Conntrack_Filters_Ignore_Local_Addrs
 (
-	 struct nfct_filter *filter
+	 IPACM_ConntrackFilter *filter
 )
 {
-	struct nfct_filter_ipv4 filter_ipv4;
-
 	/* ignore whatever is destined to or originates from broadcast ip address */
-	filter_ipv4.addr = 0xffffffff;
-	filter_ipv4.mask = 0xffffffff;
-
-	nfct_filter_set_logic(filter,
-												NFCT_FILTER_DST_IPV4,
-												NFCT_FILTER_LOGIC_NEGATIVE);
-
-	nfct_filter_add_attr(filter, NFCT_FILTER_DST_IPV4, &filter_ipv4);
-
-	nfct_filter_set_logic(filter,
-												NFCT_FILTER_SRC_IPV4,
-												NFCT_FILTER_LOGIC_NEGATIVE);
-
-	nfct_filter_add_attr(filter, NFCT_FILTER_SRC_IPV4, &filter_ipv4);
-
-	return 0;
+	return filter->IgnoreAddr(BROADCAST_IPV4_ADDR, true, true);
 } /* IPA_Conntrack_Filters_Ignore_Local_Addrs() */
 
-/* Initialize TCP Filter */
-int IPACM_ConntrackClient::IPA_Conntrack_TCP_Filter_Init(void)
+/* Reactor handler of the nat timer, the sweep changes the nat cache and
+	 waits for the kernel to ack the timeout updates, so it is posted to
+	 the nat worker */
+int IPACM_ConntrackClient::ReadNatTimer(int fd, void *param)
 {
-	int ret = 0;
-	IPACM_ConntrackClient *pClient;
-
-	IPACMDBG("\n");
-
-	pClient = IPACM_ConntrackClient::GetInstance();
-	if(pClient == NULL)
-	{
-		IPACMERR("unable to get conntrack client instance\n");
-		return -1;
-	}
-
-	ret = nfct_filter_set_logic(pClient->tcp_filter,
-															NFCT_FILTER_L4PROTO,
-															NFCT_FILTER_LOGIC_POSITIVE);
-	if(ret == -1)
-	{
-		IPACMERR("Unable to set filter logic\n");
-		return -1;
-	}
-
-	/* set protocol filters as tcp and udp */
-	nfct_filter_add_attr_u32(pClient->tcp_filter, NFCT_FILTER_L4PROTO, IPPROTO_TCP);
-
-
-	struct nfct_filter_proto tcp_proto_state;
-	tcp_proto_state.proto = IPPROTO_TCP;
-	tcp_proto_state.state = TCP_CONNTRACK_ESTABLISHED;
-
-	ret = nfct_filter_set_logic(pClient->tcp_filter,
-															NFCT_FILTER_L4PROTO_STATE,
-															NFCT_FILTER_LOGIC_POSITIVE);
-	if(ret == -1)
-	{
-		IPACMERR("unable to set filter logic\n");
-		return -1;
-	}
-	nfct_filter_add_attr(pClient->tcp_filter,
-											 NFCT_FILTER_L4PROTO_STATE,
-											 &tcp_proto_state);
-
-
-	tcp_proto_state.proto = IPPROTO_TCP;
-	tcp_proto_state.state = TCP_CONNTRACK_FIN_WAIT;
-	ret = nfct_filter_set_logic(pClient->tcp_filter,
-															NFCT_FILTER_L4PROTO_STATE,
-															NFCT_FILTER_LOGIC_POSITIVE);
-	if(ret == -1)
-	{
-		IPACMERR("unable to set filter logic\n");
-		return -1;
-	}
-
-	nfct_filter_add_attr(pClient->tcp_filter,
-											 NFCT_FILTER_L4PROTO_STATE,
-											 &tcp_proto_state);
-	return 0;
-}
-
+	ipacm_cmd_q_data evt_data;
+	struct itimerspec its;
+	uint64_t expired;
+	(void)param;
 
-/* Initialize UDP Filter */
-int IPACM_ConntrackClient::IPA_Conntrack_UDP_Filter_Init(void)
-{
-	int ret = 0;
-	IPACM_ConntrackClient *pClient = IPACM_ConntrackClient::GetInstance();
-	if(pClient == NULL)
+	if(read(fd, &expired, sizeof(expired)) < 0)
 	{
-		IPACMERR("unable to get conntrack client instance\n");
-		return -1;
+		if(errno != EAGAIN && errno != EWOULDBLOCK)
+		{
+			IPACMERR("unable to read nat timer: %s\n", strerror(errno));
+		}
+		return IPACM_SUCCESS;
 	}
 
-	ret = nfct_filter_set_logic(pClient->udp_filter,
-															NFCT_FILTER_L4PROTO,
-															NFCT_FILTER_LOGIC_POSITIVE);
-	if(ret == -1)
+	memset(&evt_data, 0, sizeof(evt_data));
+	evt_data.event = IPA_NAT_TIMER_EVENT;
+	evt_data.evt_data = NULL;
+	if(IPACM_EvtDispatcher::PostEvt(&evt_data) != IPACM_SUCCESS)
 	{
-		IPACMERR("unable to set filter logic\n");
+		/* nobody else rearms it */
+		IPACMERR("unable to post nat timer event, retrying in 1s\n");
+		memset(&its, 0, sizeof(its));
+		its.it_value.tv_sec = 1;
+		if(timerfd_settime(fd, 0, &its, NULL) < 0)
+		{
+			IPACMERR("unable to arm nat timer: %s\n", strerror(errno));
+			return IPACM_FAILURE;
+		}
 	}
-	/* set protocol filters as tcp and udp */
-	nfct_filter_add_attr_u32(pClient->udp_filter, NFCT_FILTER_L4PROTO, IPPROTO_UDP);
 
-	return 0;
+	return IPACM_SUCCESS;
 }
 
-void* IPACM_ConntrackClient::UDPConnTimeoutUpdate(void *ptr)
+/* Runs on the nat worker under ipacm_nat_lock: only the entries close to
+	 their conntrack timeout are checked, the timer is then armed for the
+	 next of them */
+int IPACM_ConntrackClient::UDPConnTimeoutUpdate(int fd)
 {
+	static time_t last_sweep = 0;
 	NatApp *nat_inst = NULL;
-	ptr = NULL;
+	struct itimerspec its;
+	struct timespec now;
 #ifdef IPACM_DEBUG
 	IPACMDBG("\n");
 #endif
@@ -397,36 +472,57 @@ void* IPACM_ConntrackClient::UDPConnTimeoutUpdate(void *ptr)
 	if(nat_inst == NULL)
 	{
 		IPACMERR("unable to create nat instance\n");
-		return NULL;
+		return IPACM_FAILURE;
 	}
 
-	while(1)
+	nat_inst->UpdateUDPTimeStamp();
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if(now.tv_sec - last_sweep >= UDP_TIMEOUT_UPDATE)
 	{
-		nat_inst->UpdateUDPTimeStamp();
-		sleep(UDP_TIMEOUT_UPDATE);
-	} /* end of while(1) loop */
+		last_sweep = now.tv_sec;
+		nat_inst->UpdateFlowHints();
+		nat_inst->ReapIdleEntries();
+		nat_inst->UpdateNatStats();
+	}
 
-#ifdef IPACM_DEBUG
-	IPACMDBG("Returning from %s() %d\n", __FUNCTION__, __LINE__);
-#endif
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_sec = nat_inst->GetTimerSleep(UDP_TIMEOUT_UPDATE);
+	if(its.it_value.tv_sec == 0)
+	{
+		its.it_value.tv_sec = 1;
+	}
+	if(timerfd_settime(fd, 0, &its, NULL) < 0)
+	{
+		IPACMERR("unable to arm nat timer: %s\n", strerror(errno));
+		return IPACM_FAILURE;
+	}
 
-	return NULL;
+	return IPACM_SUCCESS;
 }
 
-/* Thread to initialize TCP Conntrack Filters*/
-void* IPACM_ConntrackClient::TCPRegisterWithConnTrack(void *)
+/* Opens the TCP conntrack handle, attaches its filter and hands its
+	 socket to the reactor */
+int IPACM_ConntrackClient::TCPRegisterWithConnTrack(void)
 {
 	int ret;
 	IPACM_ConntrackClient *pClient;
+	IPACM_Reactor *reactor;
 	unsigned subscrips = 0;
 
 	IPACMDBG("\n");
 
 	pClient = IPACM_ConntrackClient::GetInstance();
-	if(pClient == NULL)
+	reactor = IPACM_Reactor::GetInstance();
+	if(pClient == NULL || reactor == NULL)
 	{
 		IPACMERR("unable to get conntrack client instance\n");
-		return NULL;
+		return -1;
+	}
+
+	if(pClient->tcp_hdl != NULL)
+	{
+		return 0;
 	}
 
 	subscrips = (NF_NETLINK_CONNTRACK_UPDATE | NF_NETLINK_CONNTRACK_DESTROY);
@@ -437,7 +533,7 @@ void* IPACM_ConntrackClient::TCPRegisterWithConnTrack(void *)
 #ifdef FEATURE_IPACM_HAL
 	if (pClient->fd_tcp < 0) {
 		IPACMERR("unable to get conntrack TCP handle due to fd_tcp is invalid \n");
-		return NULL;
+		return -1;
 	} else {
 		pClient->tcp_hdl = nfct_open2(CONNTRACK, subscrips, pClient->fd_tcp);
 	}
@@ -448,86 +544,80 @@ void* IPACM_ConntrackClient::TCPRegisterWithConnTrack(void *)
 	if(pClient->tcp_hdl == NULL)
 	{
 		PERROR("nfct_open failed on getting tcp_hdl\n");
-		return NULL;
-	}
-
-	/* Initialize the filter */
-	ret = IPA_Conntrack_TCP_Filter_Init();
-	if(ret == -1)
-	{
-		IPACMERR("Unable to initliaze TCP Filter\n");
-		return NULL;
+		return -1;
 	}
 
-	/* Attach the filter to net filter handler */
-	ret = nfct_filter_attach(nfct_fd(pClient->tcp_hdl), pClient->tcp_filter);
+	/* Compile the filter and attach it to net filter handler */
+	ret = pClient->tcp_filter->Attach(nfct_fd(pClient->tcp_hdl));
 	if(ret == -1)
 	{
 		IPACMDBG("unable to attach TCP filter\n");
-		return NULL;
+		goto fail;
 	}
 
-	/* Register callback with netfilter handler */
-	IPACMDBG_H("tcp handle:%pK, fd:%d\n", pClient->tcp_hdl, nfct_fd(pClient->tcp_hdl));
+	/* Register callback with netfilter handler, the events are handed
+		 over in batches once the socket has been drained */
 #ifndef CT_OPT
-	nfct_callback_register(pClient->tcp_hdl,
-			(nf_conntrack_msg_type)	(NFCT_T_UPDATE | NFCT_T_DESTROY | NFCT_T_NEW),
-						IPAConntrackEventCB, NULL);
+	ret = nfct_callback_register(pClient->tcp_hdl,
+			(nf_conntrack_msg_type)(NFCT_T_UPDATE | NFCT_T_DESTROY | NFCT_T_NEW),
+			IPAConntrackEventCB, &pClient->tcp_batch);
 #else
-	nfct_callback_register(pClient->tcp_hdl, (nf_conntrack_msg_type) NFCT_T_ALL, IPAConntrackEventCB, NULL);
+	ret = nfct_callback_register(pClient->tcp_hdl, (nf_conntrack_msg_type)NFCT_T_ALL,
+			IPAConntrackEventCB, &pClient->tcp_batch);
 #endif
-
-	/* Block to catch events from net filter connection track */
-	/* nfct_catch() receives conntrack events from kernel-space, by default it
-			 blocks waiting for events. */
-	IPACMDBG("Waiting for events\n");
-
-	ret = nfct_catch(pClient->tcp_hdl);
 	if(ret == -1)
 	{
-		IPACMERR("(%d)(%s)\n", ret, strerror(errno));
-		return NULL;
+		IPACMERR("unable to register conntrack callback\n");
+		goto fail;
 	}
 
-	IPACMDBG("Exit from tcp thread\n");
+	if(reactor->AddFd(nfct_fd(pClient->tcp_hdl), ReadTCPEvents, pClient) != IPACM_SUCCESS)
+	{
+		IPACMERR("unable to watch tcp conntrack fd:%d\n", nfct_fd(pClient->tcp_hdl));
+		nfct_callback_unregister(pClient->tcp_hdl);
+		goto fail;
+	}
 
-	/* destroy the filter.. this will not detach the filter */
-	nfct_filter_destroy(pClient->tcp_filter);
-	pClient->tcp_filter = NULL;
+	IPACMDBG_H("tcp handle:%pK, fd:%d\n", pClient->tcp_hdl, nfct_fd(pClient->tcp_hdl));
+	return 0;
 
-	/* de-register the callback */
-	nfct_callback_unregister(pClient->tcp_hdl);
-	/* close the handle */
+fail:
 #ifdef FEATURE_IPACM_HAL
 	nfct_close2(pClient->tcp_hdl, true);
 #else
 	nfct_close(pClient->tcp_hdl);
 #endif
 	pClient->tcp_hdl = NULL;
-
-	pthread_exit(NULL);
-	return NULL;
+	return -1;
 }
 
-/* Thread to initialize UDP Conntrack Filters*/
-void* IPACM_ConntrackClient::UDPRegisterWithConnTrack(void *)
+/* Opens the UDP conntrack handle, attaches its filter and hands its
+	 socket to the reactor */
+int IPACM_ConntrackClient::UDPRegisterWithConnTrack(void)
 {
 	int ret;
 	IPACM_ConntrackClient *pClient = NULL;
+	IPACM_Reactor *reactor;
 
 	IPACMDBG("\n");
 
 	pClient = IPACM_ConntrackClient::GetInstance();
-	if(pClient == NULL)
+	reactor = IPACM_Reactor::GetInstance();
+	if(pClient == NULL || reactor == NULL)
 	{
 		IPACMERR("unable to retrieve instance of conntrack client\n");
-		return NULL;
+		return -1;
+	}
+
+	if(pClient->udp_hdl != NULL)
+	{
+		return 0;
 	}
 
 #ifdef FEATURE_IPACM_HAL
 	if (pClient->fd_udp < 0) {
 		IPACMERR("unable to get conntrack UDP handle due to fd_udp is invalid \n");
-		return NULL;
+		return -1;
 	} else {
 		pClient->udp_hdl = nfct_open2(CONNTRACK,
 					(NF_NETLINK_CONNTRACK_NEW | NF_NETLINK_CONNTRACK_DESTROY), pClient->fd_udp);
@@ -539,64 +629,44 @@ void* IPACM_ConntrackClient::UDPRegisterWithConnTrack(void *)
 	if(pClient->udp_hdl == NULL)
 	{
 		PERROR("nfct_open failed on getting udp_hdl\n");
-		return NULL;
-	}
-
-	/* Initialize Filter */
-	ret = IPA_Conntrack_UDP_Filter_Init();
-	if(-1 == ret)
-	{
-		IPACMDBG("Unable to initalize udp filters\n");
-		return NULL;
+		return -1;
 	}
 
-	/* Attach the filter to net filter handler */
-	ret = nfct_filter_attach(nfct_fd(pClient->udp_hdl), pClient->udp_filter);
+	/* Compile the filter and attach it to net filter handler */
+	ret = pClient->udp_filter->Attach(nfct_fd(pClient->udp_hdl));
 	if(ret == -1)
 	{
 		IPACMDBG("unable to attach the filter\n");
-		return NULL;
+		goto fail;
 	}
 
-	/* Register callback with netfilter handler */
-	IPACMDBG_H("udp handle:%pK, fd:%d\n", pClient->udp_hdl, nfct_fd(pClient->udp_hdl));
-	nfct_callback_register(pClient->udp_hdl,
+	ret = nfct_callback_register(pClient->udp_hdl,
 			(nf_conntrack_msg_type)(NFCT_T_NEW | NFCT_T_DESTROY),
-			IPAConntrackEventCB,
-			NULL);
-
-	/* Block to catch events from net filter connection track */
-ctcatch:
-	ret = nfct_catch(pClient->udp_hdl);
+			IPAConntrackEventCB, &pClient->udp_batch);
 	if(ret == -1)
 	{
-		IPACMDBG("(%d)(%s)\n", ret, strerror(errno));
-		return NULL;
+		IPACMERR("unable to register conntrack callback\n");
+		goto fail;
 	}
-	else
+
+	if(reactor->AddFd(nfct_fd(pClient->udp_hdl), ReadUDPEvents, pClient) != IPACM_SUCCESS)
 	{
-		IPACMDBG("ctcatch ret:%d\n", ret);
-		goto ctcatch;
+		IPACMERR("unable to watch udp conntrack fd:%d\n", nfct_fd(pClient->udp_hdl));
+		nfct_callback_unregister(pClient->udp_hdl);
+		goto fail;
 	}
 
-	IPACMDBG("Exit from udp thread with ret: %d\n", ret);
-
-	/* destroy the filter.. this will not detach the filter */
-	nfct_filter_destroy(pClient->udp_filter);
-	pClient->udp_filter = NULL;
+	IPACMDBG_H("udp handle:%pK, fd:%d\n", pClient->udp_hdl, nfct_fd(pClient->udp_hdl));
+	return 0;
 
-	/* de-register the callback */
-	nfct_callback_unregister(pClient->udp_hdl);
-	/* close the handle */
+fail:
 #ifdef FEATURE_IPACM_HAL
 	nfct_close2(pClient->udp_hdl, true);
 #else
 	nfct_close(pClient->udp_hdl);
 #endif
 	pClient->udp_hdl = NULL;
-
-	pthread_exit(NULL);
-	return NULL;
+	return -1;
 }
 
 /* Thread to initialize TCP Conntrack Filters*/
@@ -615,12 +685,13 @@ void IPACM_ConntrackClient::UNRegisterWithConnTrack(void)
 
 	/* destroy the TCP filter.. this will not detach the filter */
 	if (pClient->tcp_filter) {
-		nfct_filter_destroy(pClient->tcp_filter);
+		delete pClient->tcp_filter;
 		pClient->tcp_filter = NULL;
 	}
 
 	/* de-register the callback */
 	if (pClient->tcp_hdl) {
+		IPACM_Reactor::GetInstance()->DelFd(nfct_fd(pClient->tcp_hdl));
 		nfct_callback_unregister(pClient->tcp_hdl);
 		/* close the handle */
 		nfct_close(pClient->tcp_hdl);
@@ -629,12 +700,13 @@ void IPACM_ConntrackClient::UNRegisterWithConnTrack(void)
 
 	/* destroy the filter.. this will not detach the filter */
 	if (pClient->udp_filter) {
-		nfct_filter_destroy(pClient->udp_filter);
+		delete pClient->udp_filter;
 		pClient->udp_filter = NULL;
 	}
 
 	/* de-register the callback */
 	if (pClient->udp_hdl) {
+		IPACM_Reactor::GetInstance()->DelFd(nfct_fd(pClient->udp_hdl));
 		nfct_callback_unregister(pClient->udp_hdl);
 		/* close the handle */
 		nfct_close(pClient->udp_hdl);
@@ -665,7 +737,15 @@ void IPACM_ConntrackClient::UpdateUDPFilters(void *param, bool isWan)
 		 return;
 	}
 
-	if(!isWan)
+	if(param == NULL)
+	{
+		IPACMDBG("Recompiling udp filter\n");
+	}
+	else if(isWan)
+	{
+		pClient->udp_filter->SetWanAddr(((ipacm_event_iface_up *)param)->ipv4_addr);
+	}
+	else
 	{
 		IPA_Conntrack_Filters_Ignore_Local_Iface(pClient->udp_filter,
 																		 (ipacm_event_iface_up *)param);
@@ -682,7 +762,7 @@ void IPACM_ConntrackClient::UpdateUDPFilters(void *param, bool isWan)
 	if(pClient->udp_hdl != NULL)
 	{
 		IPACMDBG("attaching the filter to udp handle\n");
-		ret = nfct_filter_attach(nfct_fd(pClient->udp_hdl), pClient->udp_filter);
+		ret = pClient->udp_filter->Attach(nfct_fd(pClient->udp_hdl));
 		if(ret == -1)
 		{
 			PERROR("unable to attach the filter to udp handle\n");
@@ -710,15 +790,23 @@ void IPACM_ConntrackClient::UpdateTCPFilters(void *param, bool isWan)
 	if(pClient->tcp_filter == NULL)
 		return;
 
-	if(!isWan)
+	if(param == NULL)
+	{
+		IPACMDBG("Recompiling tcp filter\n");
+	}
+	else if(isWan)
+	{
+		pClient->tcp_filter->SetWanAddr(((ipacm_event_iface_up *)param)->ipv4_addr);
+	}
+	else
 	{
 		IPA_Conntrack_Filters_Ignore_Local_Iface(pClient->tcp_filter,
 																	(ipacm_event_iface_up *)param);
 
 		if(!isIgnore)
 		{
-			IPA_Conntrack_Filters_Ignore_Bridge_Addrs(pClient->udp_filter);
-			IPA_Conntrack_Filters_Ignore_Local_Addrs(pClient->udp_filter);
+			IPA_Conntrack_Filters_Ignore_Bridge_Addrs(pClient->tcp_filter);
+			IPA_Conntrack_Filters_Ignore_Local_Addrs(pClient->tcp_filter);
 			isIgnore = true;
 		}
 	}
@@ -727,7 +815,7 @@ void IPACM_ConntrackClient::UpdateTCPFilters(void *param, bool isWan)
 	if(pClient->tcp_hdl != NULL)
 	{
 		IPACMDBG("attaching the filter to tcp handle\n");
-		ret = nfct_filter_attach(nfct_fd(pClient->tcp_hdl), pClient->tcp_filter);
+		ret = pClient->tcp_filter->Attach(nfct_fd(pClient->tcp_hdl));
 		if(ret == -1)
 		{
 			PERROR("unable to attach the filter to tcp handle\n");
@@ -0,0 +1,426 @@
+/*
+Copyright (c) 2013-2016, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+		* Redistributions of source code must retain the above copyright
+			notice, this list of conditions and the following disclaimer.
+		* Redistributions in binary form must reproduce the above
+			copyright notice, this list of conditions and the following
+			disclaimer in the documentation and/or other materials provided
+			with the distribution.
+		* Neither the name of The Linux Foundation nor the names of its
+			contributors may be used to endorse or promote products derived
+			from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*!
+	@file
+	IPACM_ConntrackFilter.cpp
+
+	@brief
+	This file implements the socket filters of the conntrack event handles
+
+	@Author
+
+*/
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <linux/netlink.h>
+
+#include "IPACM_ConntrackFilter.h"
+#include "IPACM_Config.h"
+#include "IPACM_Log.h"
+
+extern "C"
+{
+#include <libnetfilter_conntrack/libnetfilter_conntrack.h>
+#include <libnetfilter_conntrack/libnetfilter_conntrack_tcp.h>
+}
+
+/* Offsets of the event message the program looks at, the attributes
+	 follow the netfilter header */
+#define CT_FILTER_MSG_TYPE_OFF offsetof(struct nlmsghdr, nlmsg_type)
+#define CT_FILTER_FAMILY_OFF NLMSG_HDRLEN
+#define CT_FILTER_ATTRS_OFF NLMSG_LENGTH(sizeof(struct nfgenmsg))
+
+/* Scratch memory of the program */
+enum
+{
+	CT_FILTER_MEM_ORIG = 0,
+	CT_FILTER_MEM_ORIG_PROTO,
+	CT_FILTER_MEM_ORIG_IP,
+	CT_FILTER_MEM_SRC_IP,
+	CT_FILTER_MEM_DST_IP,
+	CT_FILTER_MEM_ORIG_SPORT,
+	CT_FILTER_MEM_ORIG_DPORT,
+	CT_FILTER_MEM_REPL_PROTO,
+	CT_FILTER_MEM_REPL_SPORT,
+	CT_FILTER_MEM_REPL_DPORT,
+	CT_FILTER_MEM_MSG_TYPE
+};
+
+#define CT_FILTER_MSG_NEW ((NFNL_SUBSYS_CTNETLINK << 8) | IPCTNL_MSG_CT_NEW)
+#define CT_FILTER_MSG_DELETE ((NFNL_SUBSYS_CTNETLINK << 8) | IPCTNL_MSG_CT_DELETE)
+
+IPACM_ConntrackFilter::IPACM_ConntrackFilter(uint8_t l4proto)
+{
+	proto = l4proto;
+	num_ign_src = 0;
+	num_ign_dst = 0;
+	wan_addr = 0;
+	num_alg_ports = 0;
+	num_insns = 0;
+	memset(labels, -1, sizeof(labels));
+	pthread_mutex_init(&lock, NULL);
+}
+
+int IPACM_ConntrackFilter::IgnoreAddr(uint32_t addr, bool src, bool dst)
+{
+	int cnt, ret = 0;
+
+	pthread_mutex_lock(&lock);
+	if(src)
+	{
+		for(cnt = 0; cnt < num_ign_src && ign_src[cnt] != addr; cnt++);
+		if(cnt == IPACM_CT_FILTER_MAX_ADDRS)
+		{
+			IPACMERR("unable to ignore src 0x%x, %d addresses already\n", addr, cnt);
+			ret = -1;
+		}
+		else if(cnt == num_ign_src)
+		{
+			ign_src[num_ign_src++] = addr;
+		}
+	}
+
+	if(dst)
+	{
+		for(cnt = 0; cnt < num_ign_dst && ign_dst[cnt] != addr; cnt++);
+		if(cnt == IPACM_CT_FILTER_MAX_ADDRS)
+		{
+			IPACMERR("unable to ignore dst 0x%x, %d addresses already\n", addr, cnt);
+			ret = -1;
+		}
+		else if(cnt == num_ign_dst)
+		{
+			ign_dst[num_ign_dst++] = addr;
+		}
+	}
+	pthread_mutex_unlock(&lock);
+
+	return ret;
+}
+
+void IPACM_ConntrackFilter::SetWanAddr(uint32_t addr)
+{
+	pthread_mutex_lock(&lock);
+	wan_addr = addr;
+	pthread_mutex_unlock(&lock);
+}
+
+/* Only the alg ports of the filter protocol are dropped */
+void IPACM_ConntrackFilter::LoadAlgPorts(void)
+{
+	ipacm_alg algs[IPA_MAX_ALG_ENTRIES];
+	IPACM_Config *pConfig;
+	int num, cnt, i;
+
+	num_alg_ports = 0;
+
+	pConfig = IPACM_Config::GetInstance();
+	if(pConfig == NULL)
+	{
+		IPACMERR("Unable to get Config instance\n");
+		return;
+	}
+
+	num = pConfig->GetAlgPortCnt();
+	if(num > IPA_MAX_ALG_ENTRIES)
+	{
+		num = IPA_MAX_ALG_ENTRIES;
+	}
+	if(num <= 0 || pConfig->GetAlgPorts(num, algs) != 0)
+	{
+		return;
+	}
+
+	for(cnt = 0; cnt < num; cnt++)
+	{
+		if(algs[cnt].protocol != proto)
+		{
+			continue;
+		}
+
+		for(i = 0; i < num_alg_ports && alg_ports[i] != algs[cnt].port; i++);
+		if(i == num_alg_ports)
+		{
+			alg_ports[num_alg_ports++] = algs[cnt].port;
+		}
+	}
+}
+
+void IPACM_ConntrackFilter::Emit(uint16_t code, uint32_t k)
+{
+	if(num_insns < IPACM_CT_FILTER_MAX_INSNS)
+	{
+		insns[num_insns].code = code;
+		insns[num_insns].jt = 0;
+		insns[num_insns].jf = 0;
+		insns[num_insns].k = k;
+	}
+	num_insns++;
+}
+
+/* Labels are only jumped to with BPF_JA, the 8 bit offsets of the
+	 conditional jumps would not reach across the address lists. k holds
+	 the label until Compile() resolves it */
+void IPACM_ConntrackFilter::EmitGoto(int label)
+{
+	Emit(BPF_JMP | BPF_JA, label);
+}
+
+/* Jumps to label when the test of A against k is when */
+void IPACM_ConntrackFilter::EmitJmp(uint16_t code, uint32_t k, bool when, int label)
+{
+	Emit(code, k);
+	if(num_insns <= IPACM_CT_FILTER_MAX_INSNS)
+	{
+		insns[num_insns - 1].jt = when ? 0 : 1;
+		insns[num_insns - 1].jf = when ? 1 : 0;
+	}
+	EmitGoto(label);
+}
+
+/* Looks up the attribute type from the one at offset A, among its
+	 nested attributes when nested. A is the offset of the attribute found */
+void IPACM_ConntrackFilter::EmitFindAttr(bool nested, uint32_t type, int missing_label)
+{
+	Emit(BPF_LDX | BPF_IMM, type);
+	Emit(BPF_LD | BPF_B | BPF_ABS,
+		SKF_AD_OFF + (nested ? SKF_AD_NLATTR_NEST : SKF_AD_NLATTR));
+	EmitJmp(BPF_JMP | BPF_JEQ | BPF_K, 0, true, missing_label);
+}
+
+/* Loads the payload of the attribute at offset A in host order and keeps
+	 it in scratch memory */
+void IPACM_ConntrackFilter::EmitLoadAttr(uint16_t size, uint32_t mem)
+{
+	Emit(BPF_MISC | BPF_TAX, 0);
+	Emit(BPF_LD | size | BPF_IND, NLA_HDRLEN);
+	Emit(BPF_ST, mem);
+}
+
+void IPACM_ConntrackFilter::EmitInSet(const uint32_t *set, int num, int label)
+{
+	int cnt;
+
+	for(cnt = 0; cnt < num; cnt++)
+	{
+		EmitJmp(BPF_JMP | BPF_JEQ | BPF_K, set[cnt], true, label);
+	}
+}
+
+void IPACM_ConntrackFilter::SetLabel(int label)
+{
+	labels[label] = num_insns;
+}
+
+/* The program passes the events IPACM acts on and drops the rest:
+	 - other protocols, and tcp updates to states other than established
+		 and fin wait
+	 - ipv4 connections of the ignored addresses
+	 - ipv4 connections without nat that do not involve the wan address
+	 - ipv4 connections on the target port, or on both the private and the
+		 public port, of an alg
+	 Events missing an attribute are passed for IPACM to sort out */
+int IPACM_ConntrackFilter::Compile(void)
+{
+	uint32_t msg_new = ntohs(CT_FILTER_MSG_NEW);
+	uint32_t msg_delete = ntohs(CT_FILTER_MSG_DELETE);
+	int cnt;
+
+	num_insns = 0;
+	memset(labels, -1, sizeof(labels));
+
+	/* The nlmsghdr is in host order while the loads are big endian */
+	Emit(BPF_LD | BPF_H | BPF_ABS, CT_FILTER_MSG_TYPE_OFF);
+	Emit(BPF_ST, CT_FILTER_MEM_MSG_TYPE);
+	EmitJmp(BPF_JMP | BPF_JEQ | BPF_K, msg_new, true, CT_FILTER_CT_MSG);
+	EmitJmp(BPF_JMP | BPF_JEQ | BPF_K, msg_delete, false, CT_FILTER_ACCEPT);
+	SetLabel(CT_FILTER_CT_MSG);
+
+	Emit(BPF_LD | BPF_IMM, CT_FILTER_ATTRS_OFF);
+	EmitFindAttr(false, CTA_TUPLE_ORIG, CT_FILTER_ACCEPT);
+	Emit(BPF_ST, CT_FILTER_MEM_ORIG);
+	EmitFindAttr(true, CTA_TUPLE_PROTO, CT_FILTER_ACCEPT);
+	Emit(BPF_ST, CT_FILTER_MEM_ORIG_PROTO);
+	EmitFindAttr(true, CTA_PROTO_NUM, CT_FILTER_ACCEPT);
+	Emit(BPF_MISC | BPF_TAX, 0);
+	Emit(BPF_LD | BPF_B | BPF_IND, NLA_HDRLEN);
+	EmitJmp(BPF_JMP | BPF_JEQ | BPF_K, proto, false, CT_FILTER_DROP);
+
+	if(proto == IPPROTO_TCP)
+	{
+		Emit(BPF_LD | BPF_MEM, CT_FILTER_MEM_MSG_TYPE);
+		EmitJmp(BPF_JMP | BPF_JEQ | BPF_K, msg_delete, true, CT_FILTER_STATE_OK);
+		Emit(BPF_LD | BPF_IMM, CT_FILTER_ATTRS_OFF);
+		EmitFindAttr(false, CTA_PROTOINFO, CT_FILTER_DROP);
+		EmitFindAttr(true, CTA_PROTOINFO_TCP, CT_FILTER_DROP);
+		EmitFindAttr(true, CTA_PROTOINFO_TCP_STATE, CT_FILTER_DROP);
+		Emit(BPF_MISC | BPF_TAX, 0);
+		Emit(BPF_LD | BPF_B | BPF_IND, NLA_HDRLEN);
+		EmitJmp(BPF_JMP | BPF_JEQ | BPF_K, TCP_CONNTRACK_ESTABLISHED, true, CT_FILTER_STATE_OK);
+		EmitJmp(BPF_JMP | BPF_JEQ | BPF_K, TCP_CONNTRACK_FIN_WAIT, false, CT_FILTER_DROP);
+		SetLabel(CT_FILTER_STATE_OK);
+	}
+
+	/* Only CT_OPT builds use ipv6 events, whatever their addresses and
+		 ports */
+	Emit(BPF_LD | BPF_B | BPF_ABS, CT_FILTER_FAMILY_OFF);
+#ifdef CT_OPT
+	EmitJmp(BPF_JMP | BPF_JEQ | BPF_K, AF_INET, false, CT_FILTER_ACCEPT);
+#else
+	EmitJmp(BPF_JMP | BPF_JEQ | BPF_K, AF_INET, false, CT_FILTER_DROP);
+#endif
+
+	Emit(BPF_LD | BPF_MEM, CT_FILTER_MEM_ORIG);
+	EmitFindAttr(true, CTA_TUPLE_IP, CT_FILTER_ACCEPT);
+	Emit(BPF_ST, CT_FILTER_MEM_ORIG_IP);
+	EmitFindAttr(true, CTA_IP_V4_SRC, CT_FILTER_ACCEPT);
+	EmitLoadAttr(BPF_W, CT_FILTER_MEM_SRC_IP);
+	EmitInSet(ign_src, num_ign_src, CT_FILTER_DROP);
+	Emit(BPF_LD | BPF_MEM, CT_FILTER_MEM_ORIG_IP);
+	EmitFindAttr(true, CTA_IP_V4_DST, CT_FILTER_ACCEPT);
+	EmitLoadAttr(BPF_W, CT_FILTER_MEM_DST_IP);
+	EmitInSet(ign_dst, num_ign_dst, CT_FILTER_DROP);
+
+#ifndef CT_OPT
+	/* Lan to lan connections are only of interest to the lan2lan offload */
+	Emit(BPF_LD | BPF_IMM, CT_FILTER_ATTRS_OFF);
+	EmitFindAttr(false, CTA_STATUS, CT_FILTER_NAT_OK);
+	Emit(BPF_MISC | BPF_TAX, 0);
+	Emit(BPF_LD | BPF_W | BPF_IND, NLA_HDRLEN);
+	EmitJmp(BPF_JMP | BPF_JSET | BPF_K, IPS_SRC_NAT | IPS_DST_NAT, true, CT_FILTER_NAT_OK);
+	if(wan_addr != 0)
+	{
+		Emit(BPF_LD | BPF_MEM, CT_FILTER_MEM_SRC_IP);
+		EmitJmp(BPF_JMP | BPF_JEQ | BPF_K, wan_addr, true, CT_FILTER_NAT_OK);
+		Emit(BPF_LD | BPF_MEM, CT_FILTER_MEM_DST_IP);
+		EmitJmp(BPF_JMP | BPF_JEQ | BPF_K, wan_addr, true, CT_FILTER_NAT_OK);
+	}
+	EmitGoto(CT_FILTER_DROP);
+	SetLabel(CT_FILTER_NAT_OK);
+#endif
+
+	/* Whichever way the connection was opened, the target port is the
+		 orig dst and reply src port or the orig src and reply dst port,
+		 the private and public ports are the other two */
+	if(num_alg_ports > 0)
+	{
+		Emit(BPF_LD | BPF_MEM, CT_FILTER_MEM_ORIG_PROTO);
+		EmitFindAttr(true, CTA_PROTO_SRC_PORT, CT_FILTER_ACCEPT);
+		EmitLoadAttr(BPF_H, CT_FILTER_MEM_ORIG_SPORT);
+		Emit(BPF_LD | BPF_MEM, CT_FILTER_MEM_ORIG_PROTO);
+		EmitFindAttr(true, CTA_PROTO_DST_PORT, CT_FILTER_ACCEPT);
+		EmitLoadAttr(BPF_H, CT_FILTER_MEM_ORIG_DPORT);
+
+		Emit(BPF_LD | BPF_IMM, CT_FILTER_ATTRS_OFF);
+		EmitFindAttr(false, CTA_TUPLE_REPLY, CT_FILTER_ACCEPT);
+		EmitFindAttr(true, CTA_TUPLE_PROTO, CT_FILTER_ACCEPT);
+		Emit(BPF_ST, CT_FILTER_MEM_REPL_PROTO);
+		EmitFindAttr(true, CTA_PROTO_SRC_PORT, CT_FILTER_ACCEPT);
+		EmitLoadAttr(BPF_H, CT_FILTER_MEM_REPL_SPORT);
+		Emit(BPF_LD | BPF_MEM, CT_FILTER_MEM_REPL_PROTO);
+		EmitFindAttr(true, CTA_PROTO_DST_PORT, CT_FILTER_ACCEPT);
+		EmitLoadAttr(BPF_H, CT_FILTER_MEM_REPL_DPORT);
+
+		Emit(BPF_LD | BPF_MEM, CT_FILTER_MEM_ORIG_DPORT);
+		EmitInSet(alg_ports, num_alg_ports, CT_FILTER_ALG_REPL_SRC);
+		EmitGoto(CT_FILTER_ALG_ORIG_SRC);
+		SetLabel(CT_FILTER_ALG_REPL_SRC);
+		Emit(BPF_LD | BPF_MEM, CT_FILTER_MEM_REPL_SPORT);
+		EmitInSet(alg_ports, num_alg_ports, CT_FILTER_DROP);
+
+		SetLabel(CT_FILTER_ALG_ORIG_SRC);
+		Emit(BPF_LD | BPF_MEM, CT_FILTER_MEM_ORIG_SPORT);
+		EmitInSet(alg_ports, num_alg_ports, CT_FILTER_ALG_REPL_DST);
+		EmitGoto(CT_FILTER_ACCEPT);
+		SetLabel(CT_FILTER_ALG_REPL_DST);
+		Emit(BPF_LD | BPF_MEM, CT_FILTER_MEM_REPL_DPORT);
+		EmitInSet(alg_ports, num_alg_ports, CT_FILTER_DROP);
+	}
+
+	SetLabel(CT_FILTER_ACCEPT);
+	Emit(BPF_RET | BPF_K, 0xffffffff);
+	SetLabel(CT_FILTER_DROP);
+	Emit(BPF_RET | BPF_K, 0);
+
+	if(num_insns > IPACM_CT_FILTER_MAX_INSNS)
+	{
+		IPACMERR("filter needs %d instructions, at most %d\n",
+						 num_insns, IPACM_CT_FILTER_MAX_INSNS);
+		return -1;
+	}
+
+	for(cnt = 0; cnt < num_insns; cnt++)
+	{
+		if(insns[cnt].code != (BPF_JMP | BPF_JA))
+		{
+			continue;
+		}
+
+		if(labels[insns[cnt].k] <= cnt)
+		{
+			IPACMERR("jump to label %d not placed after it\n", insns[cnt].k);
+			return -1;
+		}
+		insns[cnt].k = labels[insns[cnt].k] - cnt - 1;
+	}
+
+	return 0;
+}
+
+int IPACM_ConntrackFilter::Attach(int fd)
+{
+	struct sock_fprog prog;
+	int ret;
+
+	pthread_mutex_lock(&lock);
+	LoadAlgPorts();
+	ret = Compile();
+	if(ret == 0)
+	{
+		prog.len = num_insns;
+		prog.filter = insns;
+		ret = setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog));
+		if(ret < 0)
+		{
+			IPACMERR("unable to attach filter to fd %d: %s\n", fd, strerror(errno));
+		}
+		else
+		{
+			IPACMDBG_H("Attached %d instructions filter to fd %d, proto %d, %d+%d addrs, %d alg ports\n",
+								 num_insns, fd, proto, num_ign_src, num_ign_dst, num_alg_ports);
+		}
+	}
+	pthread_mutex_unlock(&lock);
+
+	return ret;
+}
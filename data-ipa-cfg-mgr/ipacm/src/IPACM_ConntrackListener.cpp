@@ -30,18 +30,23 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <sys/ioctl.h>
 #include <net/if.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
 
 #include "IPACM_ConntrackListener.h"
 #include "IPACM_ConntrackClient.h"
 #include "IPACM_EvtDispatcher.h"
 #include "IPACM_Iface.h"
 #include "IPACM_Wan.h"
+#include "IPACM_Reactor.h"
+
+pthread_mutex_t ipacm_nat_lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
 
 IPACM_ConntrackListener::IPACM_ConntrackListener()
 {
 	 IPACMDBG("\n");
 
-	 isNatThreadStart = false;
+	 NatTimerFd = -1;
 	 isCTReg = false;
 	 WanUp = false;
 	 nat_inst = NatApp::GetInstance();
@@ -50,19 +55,25 @@ IPACM_ConntrackListener::IPACM_ConntrackListener()
 	 StaClntCnt = 0;
 	 pNatIfaces = NULL;
 	 pConfig = IPACM_Config::GetInstance();;
+	 isBatching = false;
+	 pendCnt = 0;
 
 	 memset(nat_iface_ipv4_addr, 0, sizeof(nat_iface_ipv4_addr));
 	 memset(nonnat_iface_ipv4_addr, 0, sizeof(nonnat_iface_ipv4_addr));
 	 memset(sta_clnt_ipv4_addr, 0, sizeof(sta_clnt_ipv4_addr));
 
-	 IPACM_EvtDispatcher::registr(IPA_HANDLE_WAN_UP, this);
-	 IPACM_EvtDispatcher::registr(IPA_HANDLE_WAN_DOWN, this);
-	 IPACM_EvtDispatcher::registr(IPA_PROCESS_CT_MESSAGE, this);
-	 IPACM_EvtDispatcher::registr(IPA_PROCESS_CT_MESSAGE_V6, this);
-	 IPACM_EvtDispatcher::registr(IPA_HANDLE_WLAN_UP, this);
-	 IPACM_EvtDispatcher::registr(IPA_HANDLE_LAN_UP, this);
-	 IPACM_EvtDispatcher::registr(IPA_NEIGH_CLIENT_IP_ADDR_ADD_EVENT, this);
-	 IPACM_EvtDispatcher::registr(IPA_NEIGH_CLIENT_IP_ADDR_DEL_EVENT, this);
+	 /* conntrack events are handled on their own worker */
+	 IPACM_EvtDispatcher::registr(IPA_HANDLE_WAN_UP, this, IPACM_CMD_SHARD_NAT);
+	 IPACM_EvtDispatcher::registr(IPA_HANDLE_WAN_DOWN, this, IPACM_CMD_SHARD_NAT);
+	 IPACM_EvtDispatcher::registr(IPA_PROCESS_CT_MESSAGE, this, IPACM_CMD_SHARD_NAT);
+	 IPACM_EvtDispatcher::registr(IPA_PROCESS_CT_MESSAGE_V6, this, IPACM_CMD_SHARD_NAT);
+	 IPACM_EvtDispatcher::registr(IPA_PROCESS_CT_MESSAGE_BATCH, this, IPACM_CMD_SHARD_NAT);
+	 IPACM_EvtDispatcher::registr(IPA_HANDLE_WLAN_UP, this, IPACM_CMD_SHARD_NAT);
+	 IPACM_EvtDispatcher::registr(IPA_HANDLE_LAN_UP, this, IPACM_CMD_SHARD_NAT);
+	 IPACM_EvtDispatcher::registr(IPA_NEIGH_CLIENT_IP_ADDR_ADD_EVENT, this, IPACM_CMD_SHARD_NAT);
+	 IPACM_EvtDispatcher::registr(IPA_NEIGH_CLIENT_IP_ADDR_DEL_EVENT, this, IPACM_CMD_SHARD_NAT);
+	 IPACM_EvtDispatcher::registr(IPA_CFG_RELOADED_EVENT, this, IPACM_CMD_SHARD_NAT);
+	 IPACM_EvtDispatcher::registr(IPA_NAT_TIMER_EVENT, this, IPACM_CMD_SHARD_NAT);
 
 #ifdef CT_OPT
 	 p_lan2lan = IPACM_LanToLan::getLan2LanInstance();
@@ -74,12 +85,13 @@ void IPACM_ConntrackListener::event_callback(ipa_cm_event_id evt,
 {
 	 ipacm_event_iface_up *wan_down = NULL;
 
-	 if(data == NULL)
+	 if(data == NULL && evt != IPA_CFG_RELOADED_EVENT && evt != IPA_NAT_TIMER_EVENT)
 	 {
 		 IPACMERR("Invalid Data\n");
 		 return;
 	 }
 
+	 pthread_mutex_lock(&ipacm_nat_lock);
 	 switch(evt)
 	 {
 	 case IPA_PROCESS_CT_MESSAGE:
@@ -87,6 +99,11 @@ void IPACM_ConntrackListener::event_callback(ipa_cm_event_id evt,
 			ProcessCTMessage(data);
 			break;
 
+	 case IPA_PROCESS_CT_MESSAGE_BATCH:
+			IPACMDBG("Received IPA_PROCESS_CT_MESSAGE_BATCH event\n");
+			ProcessCTBatch(data);
+			break;
+
 #ifdef CT_OPT
 	 case IPA_PROCESS_CT_MESSAGE_V6:
 			IPACMDBG("Received IPA_PROCESS_CT_MESSAGE_V6 event\n");
@@ -96,7 +113,7 @@ void IPACM_ConntrackListener::event_callback(ipa_cm_event_id evt,
 
 	 case IPA_HANDLE_WAN_UP:
 			IPACMDBG_H("Received IPA_HANDLE_WAN_UP event\n");
-			CreateConnTrackThreads();
+			CreateConnTrackListeners();
 			TriggerWANUp(data);
 			break;
 
@@ -118,12 +135,29 @@ void IPACM_ConntrackListener::event_callback(ipa_cm_event_id evt,
 							 ((ipacm_event_iface_up *)data)->ipv4_addr);
 			if(isWanUp())
 			{
-				CreateConnTrackThreads();
+				CreateConnTrackListeners();
 				IPACM_ConntrackClient::UpdateUDPFilters(data, false);
 				IPACM_ConntrackClient::UpdateTCPFilters(data, false);
 			}
 			break;
 
+	/* the alg ports of the filters come from the config, it is
+		 reloaded on the iface worker before this is posted */
+	 case IPA_CFG_RELOADED_EVENT:
+			IPACMDBG_H("Received IPA_CFG_RELOADED_EVENT event\n");
+			if(isWanUp())
+			{
+				IPACM_ConntrackClient::UpdateUDPFilters(NULL, false);
+				IPACM_ConntrackClient::UpdateTCPFilters(NULL, false);
+			}
+			break;
+
+	/* the reactor only reads the timer, the sweep runs here under the
+		 nat lock */
+	 case IPA_NAT_TIMER_EVENT:
+			IPACM_ConntrackClient::UDPConnTimeoutUpdate(NatTimerFd);
+			break;
+
 	 case IPA_NEIGH_CLIENT_IP_ADDR_ADD_EVENT:
 		 IPACMDBG("Received IPA_NEIGH_CLIENT_IP_ADDR_ADD_EVENT event\n");
 		 HandleNonNatIPAddr(data, true);
@@ -138,6 +172,7 @@ void IPACM_ConntrackListener::event_callback(ipa_cm_event_id evt,
 			IPACMDBG("Ignore cmd %d\n", evt);
 			break;
 	 }
+	 pthread_mutex_unlock(&ipacm_nat_lock);
 }
 
 int IPACM_ConntrackListener::CheckNatIface(
@@ -288,6 +323,7 @@ void IPACM_ConntrackListener::HandleNeighIpAddrAddEvt(
 	bool NatIface = false;
 	int j, ret;
 
+	pthread_mutex_lock(&ipacm_nat_lock);
 	ret = CheckNatIface(data, &NatIface);
 	if (NatIface && ret == IPACM_SUCCESS)
 	{
@@ -313,6 +349,7 @@ void IPACM_ConntrackListener::HandleNeighIpAddrAddEvt(
 			nat_inst->FlushTempEntries(data->ipv4_addr, true);
 		}
 	}
+	pthread_mutex_unlock(&ipacm_nat_lock);
 	return;
 }
 
@@ -328,6 +365,7 @@ void IPACM_ConntrackListener::HandleNeighIpAddrDelEvt(
 	}
 
 	iptodot("HandleNeighIpAddrDelEvt(): Received ip addr", ipv4_addr);
+	pthread_mutex_lock(&ipacm_nat_lock);
 	for(cnt = 0; cnt<MAX_IFACE_ADDRESS; cnt++)
 	{
 		if (nat_iface_ipv4_addr[cnt] == ipv4_addr)
@@ -339,6 +377,7 @@ void IPACM_ConntrackListener::HandleNeighIpAddrDelEvt(
 			nat_inst->DelEntriesOnClntDiscon(ipv4_addr);
 		}
 	}
+	pthread_mutex_unlock(&ipacm_nat_lock);
 
 	return;
 }
@@ -372,85 +411,96 @@ void IPACM_ConntrackListener::TriggerWANUp(void *in_param)
 	 wan_ipaddr = wanup_data->ipv4_addr;
 	 memcpy(wan_ifname, wanup_data->ifname, sizeof(wan_ifname));
 
+	 /* let the connections of the wan address through the filters */
+	 IPACM_ConntrackClient::UpdateUDPFilters(wanup_data, true);
+	 IPACM_ConntrackClient::UpdateTCPFilters(wanup_data, true);
+
 	 if(nat_inst != NULL)
 	 {
 		 nat_inst->AddTable(wanup_data->ipv4_addr);
 	 }
 
-	 IPACMDBG("creating nat threads\n");
-	 CreateNatThreads();
+	 IPACMDBG("creating nat timer\n");
+	 CreateNatTimer();
 }
 
-int IPACM_ConntrackListener::CreateConnTrackThreads(void)
+/* The conntrack sockets are read by the reactor, a handle that could
+	 not be opened is retried on the next call */
+int IPACM_ConntrackListener::CreateConnTrackListeners(void)
 {
-	int ret;
-	pthread_t tcp_thread = 0, udp_thread = 0;
+	int ret = 0;
 
+	pthread_mutex_lock(&ipacm_nat_lock);
 	if(isCTReg == false)
 	{
-		ret = pthread_create(&tcp_thread, NULL, IPACM_ConntrackClient::TCPRegisterWithConnTrack, NULL);
-		if(0 != ret)
+		if(IPACM_ConntrackClient::TCPRegisterWithConnTrack() != 0)
 		{
-			IPACMERR("unable to create TCP conntrack event listner thread\n");
-			PERROR("unable to create TCP conntrack\n");
-			goto error;
+			IPACMERR("unable to register TCP conntrack event listener\n");
+			ret = -1;
 		}
-
-		IPACMDBG("created TCP conntrack event listner thread\n");
-		if(pthread_setname_np(tcp_thread, "tcp ct listener") != 0)
+		else
 		{
-			IPACMERR("unable to set thread name\n");
+			IPACMDBG("registered TCP conntrack event listener\n");
 		}
 
-		ret = pthread_create(&udp_thread, NULL, IPACM_ConntrackClient::UDPRegisterWithConnTrack, NULL);
-		if(0 != ret)
+		if(IPACM_ConntrackClient::UDPRegisterWithConnTrack() != 0)
 		{
-			IPACMERR("unable to create UDP conntrack event listner thread\n");
-			PERROR("unable to create UDP conntrack\n");
-			goto error;
+			IPACMERR("unable to register UDP conntrack event listener\n");
+			ret = -1;
 		}
-
-		IPACMDBG("created UDP conntrack event listner thread\n");
-		if(pthread_setname_np(udp_thread, "udp ct listener") != 0)
+		else
 		{
-			IPACMERR("unable to set thread name\n");
+			IPACMDBG("registered UDP conntrack event listener\n");
 		}
 
-		isCTReg = true;
+		if(ret == 0)
+		{
+			isCTReg = true;
+		}
 	}
 
-	return 0;
-
-error:
-	return -1;
+	pthread_mutex_unlock(&ipacm_nat_lock);
+	return ret;
 }
-int IPACM_ConntrackListener::CreateNatThreads(void)
+
+/* The udp conn timeout update is driven by a timerfd of the reactor, it
+	 fires at once and the nat worker rearms it after each sweep */
+int IPACM_ConntrackListener::CreateNatTimer(void)
 {
-	int ret;
-	pthread_t udpcto_thread = 0;
+	struct itimerspec its;
+	IPACM_Reactor *reactor;
+	int fd;
 
-	if(isNatThreadStart == false)
+	if(NatTimerFd < 0)
 	{
-		ret = pthread_create(&udpcto_thread, NULL, IPACM_ConntrackClient::UDPConnTimeoutUpdate, NULL);
-		if(0 != ret)
+		reactor = IPACM_Reactor::GetInstance();
+		if(reactor == NULL)
+		{
+			return -1;
+		}
+
+		fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+		if(fd < 0)
 		{
-			IPACMERR("unable to create udp conn timeout thread\n");
+			IPACMERR("unable to create udp conn timeout timer\n");
 			PERROR("unable to create udp conn timeout\n");
-			goto error;
+			return -1;
 		}
 
-		IPACMDBG("created upd conn timeout thread\n");
-		if(pthread_setname_np(udpcto_thread, "udp conn timeout") != 0)
+		memset(&its, 0, sizeof(its));
+		its.it_value.tv_nsec = 1;
+		if(timerfd_settime(fd, 0, &its, NULL) < 0 ||
+			 reactor->AddFd(fd, IPACM_ConntrackClient::ReadNatTimer, NULL) != IPACM_SUCCESS)
 		{
-			IPACMERR("unable to set thread name\n");
+			IPACMERR("unable to start udp conn timeout timer\n");
+			close(fd);
+			return -1;
 		}
 
-		isNatThreadStart = true;
+		IPACMDBG("created udp conn timeout timer\n");
+		NatTimerFd = fd;
 	}
 	return 0;
-
-error:
-	return -1;
 }
 
 void IPACM_ConntrackListener::TriggerWANDown(uint32_t wan_addr)
@@ -690,6 +740,60 @@ void IPACM_ConntrackListener::ProcessCTMessage(void *param)
 	 return;
 }
 
+void IPACM_ConntrackListener::ProcessCTBatch(void *param)
+{
+	 ipacm_ct_evt_batch *batch = (ipacm_ct_evt_batch *)param;
+	 int i;
+
+	 IPACMDBG("Processing batch of %d conntrack messages\n", batch->num_evts);
+
+	 isBatching = true;
+	 for(i = 0; i < batch->num_evts; i++)
+	 {
+			ProcessCTMessage(&batch->evts[i]);
+	 }
+	 FlushNatEntries();
+	 isBatching = false;
+
+	 return;
+}
+
+/* Add the entry right away, or hold it back while a conntrack batch is
+	 processed so that all new entries of the batch go in with one call */
+void IPACM_ConntrackListener::AddNatEntry(const nat_table_entry *rule)
+{
+	if (!isBatching)
+	{
+		nat_inst->AddEntry(rule);
+		return;
+	}
+
+	if (pendCnt == IPA_CT_EVT_BATCH_MAX)
+	{
+		FlushNatEntries();
+	}
+	memcpy(&pendEntries[pendCnt], rule, sizeof(nat_table_entry));
+	pendCnt++;
+
+	return;
+}
+
+void IPACM_ConntrackListener::FlushNatEntries(void)
+{
+	int ret;
+
+	if (pendCnt == 0)
+	{
+		return;
+	}
+
+	ret = nat_inst->AddEntries(pendEntries, pendCnt);
+	IPACMDBG("Added %d of %d pending nat entries\n", ret, pendCnt);
+	pendCnt = 0;
+
+	return;
+}
+
 bool IPACM_ConntrackListener::AddIface(
    nat_table_entry *rule, bool *isTempEntry)
 {
@@ -804,15 +908,17 @@ void IPACM_ConntrackListener::AddORDeleteNatEntry(const nat_entry_bundle *input)
 			if (!CtList->isWanUp())
 			{
 				IPACMDBG("Wan is not up, cache connections\n");
+				FlushNatEntries();
 				nat_inst->CacheEntry(input->rule);
 			}
 			else if (input->isTempEntry)
 			{
+				FlushNatEntries();
 				nat_inst->AddTempEntry(input->rule);
 			}
 			else
 			{
-				nat_inst->AddEntry(input->rule);
+				AddNatEntry(input->rule);
 			}
 		}
 		else if (TCP_CONNTRACK_FIN_WAIT == tcp_state ||
@@ -821,6 +927,7 @@ void IPACM_ConntrackListener::AddORDeleteNatEntry(const nat_entry_bundle *input)
 			IPACMDBG("TCP state TCP_CONNTRACK_FIN_WAIT(%d) "
 					 "or type NFCT_T_DESTROY(%d)\n", tcp_state, input->type);
 
+			FlushNatEntries();
 			nat_inst->DeleteEntry(input->rule);
 			nat_inst->DeleteTempEntry(input->rule);
 		}
@@ -839,20 +946,23 @@ void IPACM_ConntrackListener::AddORDeleteNatEntry(const nat_entry_bundle *input)
 			if (!CtList->isWanUp())
 			{
 				IPACMDBG("Wan is not up, cache connections\n");
+				FlushNatEntries();
 				nat_inst->CacheEntry(input->rule);
 			}
 			else if (input->isTempEntry)
 			{
+				FlushNatEntries();
 				nat_inst->AddTempEntry(input->rule);
 			}
 			else
 			{
-				nat_inst->AddEntry(input->rule);
+				AddNatEntry(input->rule);
 			}
 		}
 		else if (NFCT_T_DESTROY == input->type)
 		{
 			IPACMDBG("UDP connection close at time %ld\n", time(NULL));
+			FlushNatEntries();
 			nat_inst->DeleteEntry(input->rule);
 			nat_inst->DeleteTempEntry(input->rule);
 		}
@@ -1141,9 +1251,11 @@ void IPACM_ConntrackListener::HandleSTAClientAddEvt(uint32_t clnt_ip_addr)
 	 int cnt;
 	 IPACMDBG_H("Received STA client 0x%x\n", clnt_ip_addr);
 
+	 pthread_mutex_lock(&ipacm_nat_lock);
 	 if(StaClntCnt >= MAX_STA_CLNT_IFACES)
 	 {
 		IPACMDBG("Max STA client reached, ignore 0x%x\n", clnt_ip_addr);
+		pthread_mutex_unlock(&ipacm_nat_lock);
 		return;
 	 }
 
@@ -1169,6 +1281,7 @@ void IPACM_ConntrackListener::HandleSTAClientAddEvt(uint32_t clnt_ip_addr)
 	 }
 
 	 nat_inst->FlushTempEntries(clnt_ip_addr, true);
+	 pthread_mutex_unlock(&ipacm_nat_lock);
 	 return;
 }
 
@@ -1177,6 +1290,7 @@ void IPACM_ConntrackListener::HandleSTAClientDelEvt(uint32_t clnt_ip_addr)
 	 int cnt;
 	 IPACMDBG_H("Received STA client 0x%x\n", clnt_ip_addr);
 
+	 pthread_mutex_lock(&ipacm_nat_lock);
 	 for(cnt=0; cnt<MAX_STA_CLNT_IFACES; cnt++)
 	 {
 		if(sta_clnt_ipv4_addr[cnt] != 0 &&
@@ -1193,5 +1307,6 @@ void IPACM_ConntrackListener::HandleSTAClientDelEvt(uint32_t clnt_ip_addr)
 	 }
 
 	 nat_inst->FlushTempEntries(clnt_ip_addr, false);
+	 pthread_mutex_unlock(&ipacm_nat_lock);
    return;
 }
@@ -26,6 +26,8 @@ WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
 OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
 IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
+#include <poll.h>
+#include <sys/socket.h>
 #include "IPACM_Conntrack_NATApp.h"
 #include "IPACM_ConntrackClient.h"
 #ifdef FEATURE_IPACM_HAL
@@ -34,6 +36,19 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #define INVALID_IP_ADDR 0x0
 
+static inline time_t NatMonotonicSec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec;
+}
+
+static inline uint32_t NatWheelTick(void)
+{
+	return (uint32_t)(NatMonotonicSec() / IPACM_NAT_WHEEL_TICK);
+}
+
 /* NatApp class Implementation */
 NatApp *NatApp::pInstance = NULL;
 NatApp::NatApp()
@@ -46,19 +61,54 @@ NatApp::NatApp()
 
 	curCnt = 0;
 
+	tuple_idx = NULL;
+	clnt_idx = NULL;
+	idx_mask = 0;
+	clnt_next = NULL;
+	clnt_prev = NULL;
+	free_slots = NULL;
+	free_cnt = 0;
+
+	timers = NULL;
+	hints = NULL;
+	ts_snap = NULL;
+	evicted = 0;
+	refused = 0;
+	memset(wheel, -1, sizeof(wheel));
+	wheel_tick = 0;
+
+	tcp_timeout = 0;
+	udp_timeout = 0;
+	timeout_read = 0;
+
 	pALGPorts = NULL;
 	nALGPort = 0;
 
 	ct = NULL;
-	ct_hdl = NULL;
+#ifndef FEATURE_IPACM_HAL
+	nfnl_hdl = NULL;
+	ct_ssh = NULL;
+	ct_seq = (uint32_t)time(NULL);
+#endif
 
-	memset(temp, 0, sizeof(temp));
+	temp = NULL;
+	temp_nodes = NULL;
+	temp_cnt = 0;
+	temp_size = 0;
+	memset(temp_idx, 0, sizeof(temp_idx));
+	temp_oldest = -1;
+	temp_newest = -1;
+	temp_replaced = 0;
+	temp_aged = 0;
+
+	memset(PwrSaveIfs, 0, sizeof(PwrSaveIfs));
 }
 
 int NatApp::Init(void)
 {
 	IPACM_Config *pConfig;
-	int size = 0;
+	int size = 0, link;
+	uint32_t idx_size;
 
 	pConfig = IPACM_Config::GetInstance();
 	if(pConfig == NULL)
@@ -79,6 +129,65 @@ int NatApp::Init(void)
 	IPACMDBG("Allocated %d bytes for config manager nat cache\n", size);
 	memset(cache, 0, size);
 
+	/* Indexes at most half full */
+	for(idx_size = 1; idx_size < 2 * (uint32_t)max_entries; idx_size <<= 1);
+	idx_mask = idx_size - 1;
+
+	tuple_idx = (int *)malloc(sizeof(int) * idx_size);
+	clnt_idx = (int *)malloc(sizeof(int) * idx_size);
+	clnt_next = (int *)malloc(sizeof(int) * max_entries);
+	clnt_prev = (int *)malloc(sizeof(int) * max_entries);
+	free_slots = (int *)malloc(sizeof(int) * max_entries);
+	if(tuple_idx == NULL || clnt_idx == NULL || clnt_next == NULL ||
+		 clnt_prev == NULL || free_slots == NULL)
+	{
+		IPACMERR("Unable to allocate memory for cache index\n");
+		goto fail;
+	}
+	memset(tuple_idx, -1, sizeof(int) * idx_size);
+	memset(clnt_idx, -1, sizeof(int) * idx_size);
+
+	for(link = 0; link < NAT_TEMP_AGE; link++)
+	{
+		temp_idx[link] = (int *)malloc(sizeof(int) * idx_size);
+		if(temp_idx[link] == NULL)
+		{
+			IPACMERR("Unable to allocate memory for temp entry index\n");
+			goto fail;
+		}
+		memset(temp_idx[link], -1, sizeof(int) * idx_size);
+	}
+
+	/* Hand out the low slots first */
+	for(free_cnt = 0; free_cnt < max_entries; free_cnt++)
+	{
+		free_slots[free_cnt] = max_entries - 1 - free_cnt;
+	}
+
+	timers = (nat_timer_node *)malloc(sizeof(nat_timer_node) * max_entries);
+	if(timers == NULL)
+	{
+		IPACMERR("Unable to allocate memory for timer wheel\n");
+		goto fail;
+	}
+	memset(timers, -1, sizeof(nat_timer_node) * max_entries);
+	wheel_tick = NatWheelTick();
+
+	hints = (nat_flow_hint *)malloc(sizeof(nat_flow_hint) * max_entries);
+	if(hints == NULL)
+	{
+		IPACMERR("Unable to allocate memory for flow hints\n");
+		goto fail;
+	}
+	memset(hints, 0, sizeof(nat_flow_hint) * max_entries);
+
+	ts_snap = (ipa_nat_rule_ts *)malloc(sizeof(ipa_nat_rule_ts) * max_entries);
+	if(ts_snap == NULL)
+	{
+		IPACMERR("Unable to allocate memory for rule timestamps\n");
+		goto fail;
+	}
+
 	nALGPort = pConfig->GetAlgPortCnt();
 	if(nALGPort > 0)
 	{
@@ -111,6 +220,18 @@ fail:
 	{
 		free(cache);
 	}
+	free(timers);
+	free(hints);
+	free(ts_snap);
+	free(tuple_idx);
+	free(clnt_idx);
+	free(clnt_next);
+	free(clnt_prev);
+	free(free_slots);
+	for(link = 0; link < NAT_TEMP_AGE; link++)
+	{
+		free(temp_idx[link]);
+	}
 	if(pALGPorts != NULL)
 	{
 		free(pALGPorts);
@@ -178,7 +299,7 @@ int NatApp::AddTable(uint32_t pub_ip)
 				if(ipa_nat_add_ipv4_rule(nat_table_hdl, &nat_rule, &cache[cnt].rule_hdl) < 0)
 				{
 					IPACMERR("unable to add the rule delete from cache\n");
-					memset(&cache[cnt], 0, sizeof(cache[cnt]));
+					FreeEntry(cnt);
 					curCnt--;
 					continue;
 				}
@@ -240,10 +361,88 @@ int NatApp::DeleteTable(uint32_t pub_ip)
 /* Check for duplicate entries */
 bool NatApp::ChkForDup(const nat_table_entry *rule)
 {
-	int cnt = 0;
 	IPACMDBG("%s() %d\n", __FUNCTION__, __LINE__);
 
-	for(; cnt < max_entries; cnt++)
+	if(FindEntry(rule) >= 0)
+	{
+		log_nat(rule->protocol,rule->private_ip,rule->target_ip,rule->private_port,\
+		rule->target_port,"Duplicate Rule\n");
+		return true;
+	}
+
+	return false;
+}
+
+/* Spreads the bits of a key, finalizer of MurmurHash3 */
+static inline uint32_t NatHash(uint32_t key)
+{
+	key ^= key >> 16;
+	key *= 0x85ebca6b;
+	key ^= key >> 13;
+	key *= 0xc2b2ae35;
+	key ^= key >> 16;
+	return key;
+}
+
+uint32_t NatApp::TupleHash(const nat_table_entry *rule)
+{
+	uint32_t hash;
+
+	hash = NatHash(rule->private_ip);
+	hash = NatHash(hash ^ rule->target_ip);
+	hash = NatHash(hash ^ ((uint32_t)rule->private_port << 16 | rule->target_port));
+	return NatHash(hash ^ rule->protocol);
+}
+
+/* Home position of the cache slot stored in an index */
+uint32_t NatApp::IdxHash(const int *idx, int cnt)
+{
+	if(idx == tuple_idx)
+	{
+		return TupleHash(&cache[cnt]) & idx_mask;
+	}
+
+	return NatHash(cache[cnt].private_ip) & idx_mask;
+}
+
+/* Empties a position of an index, moving back the entries that
+	 probed past it so that lookups can stop at the first hole */
+void NatApp::IdxRemove(int *idx, uint32_t pos)
+{
+	uint32_t next = pos, home;
+
+	while(1)
+	{
+		idx[pos] = -1;
+		while(1)
+		{
+			next = (next + 1) & idx_mask;
+			if(idx[next] < 0)
+			{
+				return;
+			}
+
+			home = IdxHash(idx, idx[next]);
+			/* Stays if its home lies cyclically in (pos, next] */
+			if((pos <= next) ? (pos < home && home <= next) :
+				 (pos < home || home <= next))
+			{
+				continue;
+			}
+			break;
+		}
+		idx[pos] = idx[next];
+		pos = next;
+	}
+}
+
+/* Returns the cache slot of the 5-tuple of rule, -1 if not cached */
+int NatApp::FindEntry(const nat_table_entry *rule)
+{
+	uint32_t pos = TupleHash(rule) & idx_mask;
+	int cnt;
+
+	for(; (cnt = tuple_idx[pos]) >= 0; pos = (pos + 1) & idx_mask)
 	{
 		if(cache[cnt].private_ip == rule->private_ip &&
 			 cache[cnt].target_ip == rule->target_ip &&
@@ -251,52 +450,260 @@ bool NatApp::ChkForDup(const nat_table_entry *rule)
 			 cache[cnt].target_port == rule->target_port &&
 			 cache[cnt].protocol == rule->protocol)
 		{
-			log_nat(rule->protocol,rule->private_ip,rule->target_ip,rule->private_port,\
-			rule->target_port,"Duplicate Rule\n");
-			return true;
+			return cnt;
 		}
 	}
 
-	return false;
+	return -1;
+}
+
+/* Returns the first cache slot of a client, -1 if it has none.
+	 pos is set to its position in clnt_idx, or to the free position
+	 for a new client */
+int NatApp::FindClnt(uint32_t ip_addr, uint32_t *pos)
+{
+	int cnt;
+
+	for(*pos = NatHash(ip_addr) & idx_mask; (cnt = clnt_idx[*pos]) >= 0;
+			*pos = (*pos + 1) & idx_mask)
+	{
+		if(cache[cnt].private_ip == ip_addr)
+		{
+			return cnt;
+		}
+	}
+
+	return -1;
+}
+
+/* Takes a free cache slot for the 5-tuple of rule, -1 if the cache is full */
+int NatApp::AllocEntry(const nat_table_entry *rule)
+{
+	uint32_t pos;
+	int cnt, head;
+
+	if(free_cnt == 0)
+	{
+		return -1;
+	}
+	cnt = free_slots[--free_cnt];
+
+	cache[cnt].private_ip = rule->private_ip;
+	cache[cnt].target_ip = rule->target_ip;
+	cache[cnt].private_port = rule->private_port;
+	cache[cnt].target_port = rule->target_port;
+	cache[cnt].protocol = rule->protocol;
+
+	for(pos = TupleHash(rule) & idx_mask; tuple_idx[pos] >= 0;
+			pos = (pos + 1) & idx_mask);
+	tuple_idx[pos] = cnt;
+
+	/* New flows go to the head of the client list */
+	head = FindClnt(rule->private_ip, &pos);
+	clnt_prev[cnt] = -1;
+	clnt_next[cnt] = head;
+	if(head >= 0)
+	{
+		clnt_prev[head] = cnt;
+	}
+	clnt_idx[pos] = cnt;
+
+	memset(&hints[cnt], 0, sizeof(hints[cnt]));
+
+	ChkTimeouts();
+	ScheduleEntry(cnt, NatWheelTick());
+
+	return cnt;
+}
+
+/* Clears a cache slot and gives it back */
+void NatApp::FreeEntry(int cnt)
+{
+	uint32_t pos;
+
+	for(pos = TupleHash(&cache[cnt]) & idx_mask; tuple_idx[pos] != cnt;
+			pos = (pos + 1) & idx_mask);
+	IdxRemove(tuple_idx, pos);
+
+	if(clnt_prev[cnt] >= 0)
+	{
+		clnt_next[clnt_prev[cnt]] = clnt_next[cnt];
+		if(clnt_next[cnt] >= 0)
+		{
+			clnt_prev[clnt_next[cnt]] = clnt_prev[cnt];
+		}
+	}
+	else
+	{
+		FindClnt(cache[cnt].private_ip, &pos);
+		if(clnt_next[cnt] >= 0)
+		{
+			clnt_idx[pos] = clnt_next[cnt];
+			clnt_prev[clnt_next[cnt]] = -1;
+		}
+		else
+		{
+			IdxRemove(clnt_idx, pos);
+		}
+	}
+
+	WheelDel(cnt);
+	memset(&cache[cnt], 0, sizeof(cache[cnt]));
+	free_slots[free_cnt++] = cnt;
+}
+
+/* Queues a cache slot in the wheel bucket of the tick expiry, or in the
+	 due bucket when expiry has passed */
+void NatApp::WheelAdd(int cnt, uint32_t expiry)
+{
+	uint32_t delta, tick;
+	int level, bucket;
+
+	timers[cnt].expiry = expiry;
+
+	if((int32_t)(expiry - wheel_tick) <= 0)
+	{
+		bucket = IPACM_NAT_WHEEL_DUE;
+	}
+	else
+	{
+		/* Further than the wheel reaches, requeued when cascaded */
+		delta = expiry - wheel_tick;
+		tick = expiry;
+		if(delta >= (1U << (IPACM_NAT_WHEEL_BITS * IPACM_NAT_WHEEL_LEVELS)))
+		{
+			tick = wheel_tick + (1U << (IPACM_NAT_WHEEL_BITS * IPACM_NAT_WHEEL_LEVELS)) - 1;
+			delta = tick - wheel_tick;
+		}
+
+		for(level = 0; level < IPACM_NAT_WHEEL_LEVELS - 1; level++)
+		{
+			if(delta < (1U << (IPACM_NAT_WHEEL_BITS * (level + 1))))
+			{
+				break;
+			}
+		}
+		bucket = level * IPACM_NAT_WHEEL_SLOTS +
+			((tick >> (IPACM_NAT_WHEEL_BITS * level)) & (IPACM_NAT_WHEEL_SLOTS - 1));
+	}
+
+	timers[cnt].bucket = bucket;
+	timers[cnt].prev = -1;
+	timers[cnt].next = wheel[bucket];
+	if(wheel[bucket] >= 0)
+	{
+		timers[wheel[bucket]].prev = cnt;
+	}
+	wheel[bucket] = cnt;
+}
+
+void NatApp::WheelDel(int cnt)
+{
+	if(timers[cnt].bucket < 0)
+	{
+		return;
+	}
+
+	if(timers[cnt].prev >= 0)
+	{
+		timers[timers[cnt].prev].next = timers[cnt].next;
+	}
+	else
+	{
+		wheel[timers[cnt].bucket] = timers[cnt].next;
+	}
+	if(timers[cnt].next >= 0)
+	{
+		timers[timers[cnt].next].prev = timers[cnt].prev;
+	}
+	timers[cnt].bucket = -1;
+}
+
+/* Moves the wheel to tick now, the entries that became due on the way
+	 end up in the due bucket */
+void NatApp::WheelAdvance(uint32_t now)
+{
+	int level, bucket, cnt;
+
+	while((int32_t)(now - wheel_tick) > 0)
+	{
+		wheel_tick++;
+
+		/* Spread the coarser buckets that are now in reach */
+		for(level = 1; level < IPACM_NAT_WHEEL_LEVELS; level++)
+		{
+			if(wheel_tick & ((1U << (IPACM_NAT_WHEEL_BITS * level)) - 1))
+			{
+				break;
+			}
+
+			bucket = level * IPACM_NAT_WHEEL_SLOTS +
+				((wheel_tick >> (IPACM_NAT_WHEEL_BITS * level)) & (IPACM_NAT_WHEEL_SLOTS - 1));
+			while((cnt = wheel[bucket]) >= 0)
+			{
+				WheelDel(cnt);
+				WheelAdd(cnt, timers[cnt].expiry);
+			}
+		}
+
+		bucket = wheel_tick & (IPACM_NAT_WHEEL_SLOTS - 1);
+		while((cnt = wheel[bucket]) >= 0)
+		{
+			WheelDel(cnt);
+			WheelAdd(cnt, timers[cnt].expiry);
+		}
+	}
+}
+
+uint32_t NatApp::GetTimeoutTicks(uint8_t protocol)
+{
+	uint32_t ticks;
+
+	ticks = (protocol == IPPROTO_TCP ? tcp_timeout : udp_timeout) / IPACM_NAT_WHEEL_TICK;
+	if(ticks <= IPACM_NAT_WHEEL_MARGIN)
+	{
+		ticks = IPACM_NAT_WHEEL_MARGIN + 1;
+	}
+	return ticks;
+}
+
+/* Starts the conntrack timeout of an entry at tick now */
+void NatApp::ScheduleEntry(int cnt, uint32_t now)
+{
+	WheelDel(cnt);
+	timers[cnt].deadline = now + GetTimeoutTicks(cache[cnt].protocol);
+	WheelAdd(cnt, timers[cnt].deadline - IPACM_NAT_WHEEL_MARGIN);
 }
 
 /* Delete the entry from Nat table on connection close */
 int NatApp::DeleteEntry(const nat_table_entry *rule)
 {
-	int cnt = 0;
+	int cnt;
 	IPACMDBG("%s() %d\n", __FUNCTION__, __LINE__);
 
 	log_nat(rule->protocol,rule->private_ip,rule->target_ip,rule->private_port,\
 	rule->target_port,"for deletion\n");
 
 
-	for(; cnt < max_entries; cnt++)
+	cnt = FindEntry(rule);
+	if(cnt >= 0)
 	{
-		if(cache[cnt].private_ip == rule->private_ip &&
-			 cache[cnt].target_ip == rule->target_ip &&
-			 cache[cnt].private_port ==  rule->private_port  &&
-			 cache[cnt].target_port == rule->target_port &&
-			 cache[cnt].protocol == rule->protocol)
+		if(cache[cnt].enabled == true)
 		{
-
-			if(cache[cnt].enabled == true)
-			{
-				if(ipa_nat_del_ipv4_rule(nat_table_hdl, cache[cnt].rule_hdl) < 0)
-				{
-					IPACMERR("%s() %d deletion failed\n", __FUNCTION__, __LINE__);
-				}
-
-				IPACMDBG_H("Deleted Nat entry(%d) Successfully\n", cnt);
-			}
-			else
+			if(ipa_nat_del_ipv4_rule(nat_table_hdl, cache[cnt].rule_hdl) < 0)
 			{
-				IPACMDBG_H("Deleted Nat entry(%d) only from cache\n", cnt);
+				IPACMERR("%s() %d deletion failed\n", __FUNCTION__, __LINE__);
 			}
 
-			memset(&cache[cnt], 0, sizeof(cache[cnt]));
-			curCnt--;
-			break;
+			IPACMDBG_H("Deleted Nat entry(%d) Successfully\n", cnt);
 		}
+		else
+		{
+			IPACMDBG_H("Deleted Nat entry(%d) only from cache\n", cnt);
+		}
+
+		FreeEntry(cnt);
+		curCnt--;
 	}
 
 	return 0;
@@ -332,32 +739,23 @@ int NatApp::AddEntry(const nat_table_entry *rule)
 
 	if(!ChkForDup(rule))
 	{
-		for(; cnt < max_entries; cnt++)
-		{
-			if(cache[cnt].private_ip == 0 &&
-				 cache[cnt].target_ip == 0 &&
-				 cache[cnt].private_port == 0  &&
-				 cache[cnt].target_port == 0 &&
-				 cache[cnt].protocol == 0)
-			{
-				break;
-			}
-		}
-
-		if(max_entries == cnt)
+		memset(&nat_rule, 0, sizeof(nat_rule));
+		nat_rule.private_ip = rule->private_ip;
+		nat_rule.target_ip = rule->target_ip;
+		nat_rule.target_port = rule->target_port;
+		nat_rule.private_port = rule->private_port;
+		nat_rule.public_port = rule->public_port;
+		nat_rule.protocol = rule->protocol;
+
+		if(free_cnt == 0 && !EvictEntry(&nat_rule))
 		{
 			IPACMERR("Error: Unable to add, reached maximum rules\n");
+			refused++;
 			return -1;
 		}
 		else
 		{
-			memset(&nat_rule, 0, sizeof(nat_rule));
-			nat_rule.private_ip = rule->private_ip;
-			nat_rule.target_ip = rule->target_ip;
-			nat_rule.target_port = rule->target_port;
-			nat_rule.private_port = rule->private_port;
-			nat_rule.public_port = rule->public_port;
-			nat_rule.protocol = rule->protocol;
+			cnt = AllocEntry(rule);
 
 			if(isPwrSaveIf(rule->private_ip) ||
 				 isPwrSaveIf(rule->target_ip))
@@ -369,20 +767,17 @@ int NatApp::AddEntry(const nat_table_entry *rule)
 			else
 			{
 
-				if(ipa_nat_add_ipv4_rule(nat_table_hdl, &nat_rule, &cache[cnt].rule_hdl) < 0)
+				if(ipa_nat_add_ipv4_rule(nat_table_hdl, &nat_rule, &cache[cnt].rule_hdl) < 0 &&
+					 EvictAndAdd(&nat_rule, &cache[cnt].rule_hdl) < 0)
 				{
 					IPACMERR("unable to add the rule\n");
+					FreeEntry(cnt);
 					return -1;
 				}
 
 				cache[cnt].enabled = true;
 			}
 
-			cache[cnt].private_ip = rule->private_ip;
-			cache[cnt].target_ip = rule->target_ip;
-			cache[cnt].target_port = rule->target_port;
-			cache[cnt].private_port = rule->private_port;
-			cache[cnt].protocol = rule->protocol;
 			cache[cnt].timestamp = 0;
 			cache[cnt].public_port = rule->public_port;
 			cache[cnt].dst_nat = rule->dst_nat;
@@ -408,170 +803,777 @@ int NatApp::AddEntry(const nat_table_entry *rule)
 	return 0;
 }
 
-void NatApp::UpdateCTUdpTs(nat_table_entry *rule, uint32_t new_ts)
+/* Add the new entries of several connections with one driver call,
+	 returns the number of entries added or cached */
+int NatApp::AddEntries(const nat_table_entry *rules, int num)
 {
+	ipa_nat_ipv4_rule nat_rules[IPACM_NAT_ADD_BATCH_MAX];
+	uint32_t rule_hdls[IPACM_NAT_ADD_BATCH_MAX];
+	int slots[IPACM_NAT_ADD_BATCH_MAX];
+	const nat_table_entry *rule;
+	int cnt, i, num_hw = 0, added = 0;
+
+	IPACMDBG("%s() %d\n", __FUNCTION__, __LINE__);
+
+	CHK_TBL_HDL();
+
+	if(num > IPACM_NAT_ADD_BATCH_MAX)
+	{
+		added = AddEntries(rules + IPACM_NAT_ADD_BATCH_MAX,
+					num - IPACM_NAT_ADD_BATCH_MAX);
+		num = IPACM_NAT_ADD_BATCH_MAX;
+	}
+
+	for(i = 0; i < num; i++)
+	{
+		rule = &rules[i];
+		log_nat(rule->protocol,rule->private_ip,rule->target_ip,rule->private_port,\
+		rule->target_port,"for addition\n");
+		if(isAlgPort(rule->protocol, rule->private_port) ||
+			 isAlgPort(rule->protocol, rule->target_port))
+		{
+			IPACMERR("connection using ALG Port, ignore\n");
+			continue;
+		}
+
+		if(rule->private_ip == 0 ||
+			 rule->target_ip == 0 ||
+			 rule->private_port == 0  ||
+			 rule->target_port == 0 ||
+			 rule->protocol == 0)
+		{
+			IPACMERR("Invalid Connection, ignoring it\n");
+			continue;
+		}
+
+		if(ChkForDup(rule))
+		{
+			IPACMERR("Duplicate rule. Ignore it\n");
+			continue;
+		}
+
+		memset(&nat_rules[num_hw], 0, sizeof(ipa_nat_ipv4_rule));
+		nat_rules[num_hw].private_ip = rule->private_ip;
+		nat_rules[num_hw].target_ip = rule->target_ip;
+		nat_rules[num_hw].target_port = rule->target_port;
+		nat_rules[num_hw].private_port = rule->private_port;
+		nat_rules[num_hw].public_port = rule->public_port;
+		nat_rules[num_hw].protocol = rule->protocol;
+
+		if(free_cnt == 0 && !EvictEntry(&nat_rules[num_hw]))
+		{
+			IPACMERR("Error: Unable to add, reached maximum rules\n");
+			refused += num - i;
+			break;
+		}
+
+		cnt = AllocEntry(rule);
+		cache[cnt].timestamp = 0;
+		cache[cnt].public_port = rule->public_port;
+		cache[cnt].dst_nat = rule->dst_nat;
+		curCnt++;
+
+		if(isPwrSaveIf(rule->private_ip) ||
+			 isPwrSaveIf(rule->target_ip))
+		{
+			IPACMDBG("Device is Power Save mode: Dont insert into nat table but cache\n");
+			cache[cnt].enabled = false;
+			cache[cnt].rule_hdl = 0;
+			IPACMDBG_H("Cached rule(%d) successfully\n", cnt);
+			added++;
+			continue;
+		}
+
+		slots[num_hw] = cnt;
+		num_hw++;
+	}
+
+	if(num_hw == 0)
+	{
+		return added;
+	}
+
+	memset(rule_hdls, 0, sizeof(rule_hdls));
+	if(ipa_nat_add_ipv4_rules(nat_table_hdl, nat_rules, num_hw, rule_hdls) < 0)
+	{
+		IPACMERR("unable to add some of %d rules\n", num_hw);
+	}
+
+	for(i = 0; i < num_hw; i++)
+	{
+		cnt = slots[i];
+		if(rule_hdls[i] == 0 &&
+			 EvictAndAdd(&nat_rules[i], &rule_hdls[i]) < 0)
+		{
+			FreeEntry(cnt);
+			curCnt--;
+			continue;
+		}
+
+		cache[cnt].rule_hdl = rule_hdls[i];
+		cache[cnt].enabled = true;
+		IPACMDBG_H("Added rule(%d) successfully\n", cnt);
+		added++;
+	}
+
+	return added;
+}
+
+/* Refreshes the conntrack entries of several cache slots at once. status
+	 of each slot is 0 when refreshed, negative when the update was refused
+	 and positive when it could not be sent */
+void NatApp::UpdateCTUdpTs(const int *slots, int num, int *status)
+{
+	nat_table_entry *rule;
+	int i;
 #ifdef FEATURE_IPACM_HAL
-	IOffloadManager::ConntrackTimeoutUpdater::natTimeoutUpdate_t entry;
+	IOffloadManager::ConntrackTimeoutUpdater::natTimeoutUpdate_t entries[IPACM_CT_UPDATE_BATCH_MAX];
+	bool sent[IPACM_CT_UPDATE_BATCH_MAX];
 	IPACM_OffloadManager* OffloadMng;
+#else
+	struct nlmsghdr *nlh;
+	struct nlmsgerr *err;
+	struct pollfd pfd;
+	uint32_t seq;
+	int len, acked = 0;
+#endif
+
+	for(i = 0; i < num; i++)
+	{
+		status[i] = 1;
+	}
+	if(num > IPACM_CT_UPDATE_BATCH_MAX)
+	{
+		IPACMERR("%d conntrack updates requested, sending %d\n",
+						 num, IPACM_CT_UPDATE_BATCH_MAX);
+		num = IPACM_CT_UPDATE_BATCH_MAX;
+	}
+
+#ifndef FEATURE_IPACM_HAL
+	if(!nfnl_hdl)
+	{
+		nfnl_hdl = nfnl_open();
+		if(!nfnl_hdl)
+		{
+			PERROR("nfnl_open");
+			return;
+		}
+	}
+
+	if(!ct_ssh)
+	{
+		ct_ssh = nfnl_subsys_open(nfnl_hdl, NFNL_SUBSYS_CTNETLINK, IPCTNL_MSG_MAX, 0);
+		if(!ct_ssh)
+		{
+			PERROR("nfnl_subsys_open");
+			return;
+		}
+	}
+
+	if(!ct)
+	{
+		ct = nfct_new();
+		if(!ct)
+		{
+			PERROR("nfct_new");
+			return;
+		}
+	}
+
+	/* One netlink message per entry, sent together and told apart in
+		 the acks by their sequence number */
+	seq = ct_seq;
+	ct_seq += num;
+	for(i = 0; i < num; i++)
+	{
+		rule = &cache[slots[i]];
+		iptodot("Private IP:", rule->private_ip);
+		iptodot("Target IP:",  rule->target_ip);
+		IPACMDBG("Private Port: %d, Target Port: %d\n", rule->private_port, rule->target_port);
+
+		nfct_set_attr_u8(ct, ATTR_L3PROTO, AF_INET);
+		nfct_set_attr_u8(ct, ATTR_L4PROTO, rule->protocol);
+		if(rule->protocol == IPPROTO_UDP)
+		{
+			nfct_set_attr_u32(ct, ATTR_TIMEOUT, udp_timeout);
+		}
+		else
+		{
+			nfct_set_attr_u32(ct, ATTR_TIMEOUT, tcp_timeout);
+		}
+
+		if(rule->dst_nat == false)
+		{
+			nfct_set_attr_u32(ct, ATTR_IPV4_SRC, htonl(rule->private_ip));
+			nfct_set_attr_u16(ct, ATTR_PORT_SRC, htons(rule->private_port));
+
+			nfct_set_attr_u32(ct, ATTR_IPV4_DST, htonl(rule->target_ip));
+			nfct_set_attr_u16(ct, ATTR_PORT_DST, htons(rule->target_port));
+
+			IPACMDBG("dst nat is not set\n");
+		}
+		else
+		{
+			nfct_set_attr_u32(ct, ATTR_IPV4_SRC, htonl(rule->target_ip));
+			nfct_set_attr_u16(ct, ATTR_PORT_SRC, htons(rule->target_port));
+
+			nfct_set_attr_u32(ct, ATTR_IPV4_DST, htonl(pub_ip_addr));
+			nfct_set_attr_u16(ct, ATTR_PORT_DST, htons(rule->public_port));
+
+			IPACMDBG("dst nat is set\n");
+		}
+
+		IPACMDBG("updating %d connection with time: %d\n",
+						 rule->protocol, nfct_get_attr_u32(ct, ATTR_TIMEOUT));
+
+		nlh = (struct nlmsghdr *)&ct_msgs[i * IPACM_CT_UPDATE_MSG_LEN];
+		if(nfct_build_conntrack(ct_ssh, nlh, IPACM_CT_UPDATE_MSG_LEN,
+					IPCTNL_MSG_CT_NEW, NLM_F_ACK, ct) == -1)
+		{
+			IPACMERR("unable to build conntrack update\n");
+			return;
+		}
+		nlh->nlmsg_seq = seq + i;
+		ct_iov[i].iov_base = nlh;
+		ct_iov[i].iov_len = NLMSG_ALIGN(nlh->nlmsg_len);
+	}
+
+	if(nfnl_sendiov(nfnl_hdl, ct_iov, num, 0) == -1)
+	{
+		IPACMERR("unable to send %d conntrack updates: %s\n", num, strerror(errno));
+		return;
+	}
+
+	/* The kernel acks every message of the send on its own */
+	pfd.fd = nfnl_fd(nfnl_hdl);
+	pfd.events = POLLIN;
+	while(acked < num)
+	{
+		if(poll(&pfd, 1, IPACM_CT_UPDATE_ACK_WAIT) <= 0)
+		{
+			IPACMERR("%d of %d conntrack updates not acked\n", num - acked, num);
+			break;
+		}
+
+		len = recv(pfd.fd, ct_acks, sizeof(ct_acks), 0);
+		if(len <= 0)
+		{
+			IPACMERR("unable to read conntrack acks: %s\n", strerror(errno));
+			break;
+		}
+
+		for(nlh = (struct nlmsghdr *)ct_acks; NLMSG_OK(nlh, len);
+				nlh = NLMSG_NEXT(nlh, len))
+		{
+			if(nlh->nlmsg_type != NLMSG_ERROR ||
+				 nlh->nlmsg_seq - seq >= (uint32_t)num)
+			{
+				continue;
+			}
+
+			err = (struct nlmsgerr *)NLMSG_DATA(nlh);
+			i = nlh->nlmsg_seq - seq;
+			if(status[i] > 0)
+			{
+				status[i] = err->error;
+				acked++;
+			}
+		}
+	}
+
+	for(i = 0; i < num; i++)
+	{
+		if(status[i] < 0)
+		{
+			IPACMERR("unable to update time stamp: %s\n", strerror(-status[i]));
+		}
+	}
+#else
+	OffloadMng = IPACM_OffloadManager::GetInstance();
+	if (OffloadMng->touInstance == NULL) {
+		IPACMERR("OffloadMng->touInstance is NULL, can't forward to framework!\n");
+		return;
+	}
+
+	for(i = 0; i < num; i++)
+	{
+		rule = &cache[slots[i]];
+		if(rule->protocol == IPPROTO_UDP)
+		{
+			entries[i].proto = IOffloadManager::ConntrackTimeoutUpdater::UDP;;
+		}
+		else
+		{
+			entries[i].proto = IOffloadManager::ConntrackTimeoutUpdater::TCP;
+		}
+
+		if(rule->dst_nat == false)
+		{
+			entries[i].src.ipAddr = htonl(rule->private_ip);
+			entries[i].src.port = rule->private_port;
+			entries[i].dst.ipAddr = htonl(rule->target_ip);
+			entries[i].dst.port = rule->target_port;
+			IPACMDBG("dst nat is not set\n");
+		}
+		else
+		{
+			entries[i].src.ipAddr = htonl(rule->target_ip);
+			entries[i].src.port = rule->target_port;
+			entries[i].dst.ipAddr = htonl(pub_ip_addr);
+			entries[i].dst.port = rule->public_port;
+			IPACMDBG("dst nat is set\n");
+		}
+
+		iptodot("Source IP:", entries[i].src.ipAddr);
+		iptodot("Destination IP:",  entries[i].dst.ipAddr);
+		IPACMDBG("Source Port: %d, Destination Port: %d\n",
+						entries[i].src.port, entries[i].dst.port);
+	}
+
+	OffloadMng->touInstance->updateTimeouts(entries, sent, num);
+	for(i = 0; i < num; i++)
+	{
+		/* the framework never refuses an update, an unsent one is retried */
+		status[i] = sent[i] ? 0 : 1;
+	}
 #endif
-	iptodot("Private IP:", rule->private_ip);
-	iptodot("Target IP:",  rule->target_ip);
-	IPACMDBG("Private Port: %d, Target Port: %d\n", rule->private_port, rule->target_port);
+	return;
+}
+
+/* Looks at the hw timestamp of an entry that got close to its conntrack
+	 timeout. Returns true with the new timestamp in ts if the hw forwarded
+	 packets and the conntrack entry has to be refreshed, otherwise the
+	 entry is queued again */
+bool NatApp::CheckEntry(int cnt, uint32_t now, uint32_t *ts)
+{
+	*ts = 0;
+	if(cache[cnt].enabled == true &&
+		 cache[cnt].private_ip != cache[cnt].public_ip &&
+		 ipa_nat_query_timestamp(nat_table_hdl, cache[cnt].rule_hdl, ts) == 0)
+	{
+		if(cache[cnt].timestamp != *ts)
+		{
+			return true;
+		}
+
+		IPACMDBG("No Change in Time Stamp: cahce:%d, ipahw:%d\n",
+						 cache[cnt].timestamp, *ts);
+		if((int32_t)(timers[cnt].deadline - now) > 0)
+		{
+			/* keep looking until the conntrack entry times out */
+			WheelAdd(cnt, now + 1);
+			return false;
+		}
+	}
+
+	if((int32_t)(timers[cnt].deadline - now) > 0)
+	{
+		WheelAdd(cnt, timers[cnt].deadline);
+		return false;
+	}
+
+	/* Either the destroy event of the connection is on its way or the
+		 kernel saw packets and refreshed the conntrack entry itself */
+	ScheduleEntry(cnt, now);
+	return false;
+}
+
+/* Refreshes the conntrack entries of the slots, drops the entries whose
+	 conntrack entry is gone */
+void NatApp::RefreshEntries(const int *slots, const uint32_t *ts, int num, uint32_t now)
+{
+	int status[IPACM_CT_UPDATE_BATCH_MAX];
+	nat_table_entry key;
+	int i, cnt;
+
+	UpdateCTUdpTs(slots, num, status);
+
+	for(i = 0; i < num; i++)
+	{
+		cnt = slots[i];
+		if(status[i] == 0)
+		{
+			IPACMDBG("Updated time stamp successfully\n");
+			cache[cnt].timestamp = ts[i];
+			ScheduleEntry(cnt, now);
+		}
+		else if(status[i] < 0)
+		{
+			memcpy(&key, &cache[cnt], sizeof(key));
+			DeleteEntry(&key);
+		}
+		else if((int32_t)(timers[cnt].deadline - now) > 0)
+		{
+			/* try again on the next tick */
+			WheelAdd(cnt, now + 1);
+		}
+		else
+		{
+			ScheduleEntry(cnt, now);
+		}
+	}
+}
+
+/* Checks the entries due on the timer wheel */
+void NatApp::UpdateUDPTimeStamp()
+{
+	int slots[IPACM_CT_UPDATE_BATCH_MAX];
+	uint32_t ts[IPACM_CT_UPDATE_BATCH_MAX];
+	uint32_t now;
+	int cnt, num = 0;
+
+	ChkTimeouts();
+	AgeTempEntries();
+
+	now = NatWheelTick();
+	WheelAdvance(now);
+
+	while((cnt = wheel[IPACM_NAT_WHEEL_DUE]) >= 0)
+	{
+		WheelDel(cnt);
+		if(!CheckEntry(cnt, now, &ts[num]))
+		{
+			continue;
+		}
+
+		slots[num++] = cnt;
+		if(num == IPACM_CT_UPDATE_BATCH_MAX)
+		{
+			RefreshEntries(slots, ts, num, now);
+			num = 0;
+		}
+	}
+
+	if(num > 0)
+	{
+		RefreshEntries(slots, ts, num, now);
+	}
+}
+
+/* Seconds until the wheel has entries due, at most max_sec */
+unsigned int NatApp::GetTimerSleep(unsigned int max_sec)
+{
+	uint32_t tick, last;
+	time_t now;
+
+	last = wheel_tick + (max_sec + IPACM_NAT_WHEEL_TICK - 1) / IPACM_NAT_WHEEL_TICK;
+	for(tick = wheel_tick + 1; (int32_t)(last - tick) > 0; tick++)
+	{
+		/* a cascade or a non empty bucket */
+		if((tick & (IPACM_NAT_WHEEL_SLOTS - 1)) == 0 ||
+			 wheel[tick & (IPACM_NAT_WHEEL_SLOTS - 1)] >= 0)
+		{
+			break;
+		}
+	}
+
+	now = NatMonotonicSec();
+	if((time_t)tick * IPACM_NAT_WHEEL_TICK <= now)
+	{
+		return 1;
+	}
+	if((time_t)tick * IPACM_NAT_WHEEL_TICK - now > (time_t)max_sec)
+	{
+		return max_sec;
+	}
+	return (unsigned int)((time_t)tick * IPACM_NAT_WHEEL_TICK - now);
+}
+
+void NatApp::PrintLatency(FILE *fp, const char *name, const uint32_t *hist)
+{
+	int cnt;
+
+	fprintf(fp, "%s", name);
+	for(cnt = 0; cnt < IPA_NAT_LATENCY_BUCKETS; cnt++)
+	{
+		fprintf(fp, " %u", hist[cnt]);
+	}
+	fprintf(fp, "\n");
+}
+
+void NatApp::UpdateNatStats()
+{
+	ipa_nat_tbl_metrics metrics;
+	FILE *fp;
+
+	if(nat_table_hdl == 0)
+	{
+		return;
+	}
+
+	if(ipa_nat_get_tbl_metrics(nat_table_hdl, &metrics) < 0)
+	{
+		IPACMERR("unable to retrieve nat table metrics\n");
+		return;
+	}
+
+	fp = fopen(IPACM_NAT_STATS_FILE_NAME, "w");
+	if(fp == NULL)
+	{
+		IPACMERR("Failed to write nat stats to %s, error is %d - %s\n",
+				IPACM_NAT_STATS_FILE_NAME, errno, strerror(errno));
+		return;
+	}
+
+	fprintf(fp, "base %u/%u\n", metrics.base_used, metrics.base_entries);
+	fprintf(fp, "expn %u/%u\n", metrics.expn_used, metrics.expn_entries);
+	fprintf(fp, "index_expn %u/%u\n",
+			metrics.index_expn_used, metrics.index_expn_entries);
+	fprintf(fp, "base_chain inserts %llu collisions %llu probes %llu max %u\n",
+			(unsigned long long)metrics.hash.base.inserts,
+			(unsigned long long)metrics.hash.base.collisions,
+			(unsigned long long)metrics.hash.base.probes,
+			metrics.hash.base.max_chain);
+	fprintf(fp, "index_chain inserts %llu collisions %llu probes %llu max %u\n",
+			(unsigned long long)metrics.hash.index.inserts,
+			(unsigned long long)metrics.hash.index.collisions,
+			(unsigned long long)metrics.hash.index.probes,
+			metrics.hash.index.max_chain);
+	fprintf(fp, "failed_inserts %llu\n",
+			(unsigned long long)metrics.failed_inserts);
+	fprintf(fp, "dma cmds %llu writes %llu\n",
+			(unsigned long long)metrics.dma_cmds,
+			(unsigned long long)metrics.dma_writes);
+	fprintf(fp, "admission evicted %u refused %u\n", evicted, refused);
+	fprintf(fp, "temp staged %d/%d replaced %u aged %u\n",
+			temp_cnt, temp_size, temp_replaced, temp_aged);
+	PrintLatency(fp, "add_latency_us", metrics.add_latency);
+	PrintLatency(fp, "del_latency_us", metrics.del_latency);
+	fclose(fp);
+}
+
+/* Takes the rules whose hw timestamp changed since the previous sweep
+	 from the driver, a changed one means the hw carried traffic of the
+	 flow */
+void NatApp::UpdateFlowHints()
+{
+	uint16_t num, i;
+	int cnt;
+
+	if(nat_table_hdl == 0)
+	{
+		return;
+	}
+
+	/* A full snapshot resumes where it stopped on the next call */
+	do
+	{
+		if(ipa_nat_snapshot_timestamps(nat_table_hdl, ts_snap,
+					(uint16_t)max_entries, &num) < 0)
+		{
+			IPACMERR("unable to take the rule timestamps\n");
+			return;
+		}
+
+		qsort(ts_snap, num, sizeof(ipa_nat_rule_ts), CmpRuleTs);
+		for(cnt = 0; cnt < max_entries; cnt++)
+		{
+			if(cache[cnt].private_ip != 0 && cache[cnt].enabled == true &&
+				 bsearch(&cache[cnt].rule_hdl, ts_snap, num,
+								 sizeof(ipa_nat_rule_ts), CmpRuleTs) != NULL)
+			{
+				hints[cnt].hit = 1;
+			}
+		}
+	} while(num == max_entries);
+
+	for(cnt = 0; cnt < max_entries; cnt++)
+	{
+		if(cache[cnt].private_ip == 0 || cache[cnt].enabled == false)
+		{
+			continue;
+		}
+
+		if(hints[cnt].sweeps < UINT16_MAX)
+		{
+			hints[cnt].sweeps++;
+		}
+
+		if(hints[cnt].hit)
+		{
+			hints[cnt].hit = 0;
+			hints[cnt].active++;
+			hints[cnt].idle = 0;
+		}
+		else if(hints[cnt].idle < UINT16_MAX)
+		{
+			hints[cnt].idle++;
+		}
+	}
+}
+
+/* Orders snapshot pairs by rule handle, the key may be a bare handle */
+int NatApp::CmpRuleTs(const void *a, const void *b)
+{
+	uint32_t hdl_a = *(const uint32_t *)a;
+	uint32_t hdl_b = *(const uint32_t *)b;
+
+	return (hdl_a > hdl_b) - (hdl_a < hdl_b);
+}
+
+/* Returns the least valuable rule whose removal makes room for rule in
+	 the hw table, -1 if there is none or every such rule carried traffic
+	 lately. Only rules in an expansion table or on the collision chain
+	 of rule qualify. The longest idle goes first, then the one active
+	 in the fewest sweeps for its age, then udp before tcp. Rules not
+	 sampled yet and the dummy rules of embedded connections stay */
+int NatApp::FindVictim(const ipa_nat_ipv4_rule *rule)
+{
+	uint32_t key, best_key = 0, idle, rate;
+	int cnt, best = -1;
 
-#ifndef FEATURE_IPACM_HAL
-	int ret;
-	if(!ct_hdl)
+	for(cnt = 0; cnt < max_entries; cnt++)
 	{
-		ct_hdl = nfct_open(CONNTRACK, 0);
-		if(!ct_hdl)
+		if(cache[cnt].private_ip == 0 || cache[cnt].enabled == false ||
+			 cache[cnt].private_ip == pub_ip_addr ||
+			 hints[cnt].sweeps == 0 ||
+			 hints[cnt].idle < IPACM_NAT_EVICT_IDLE)
 		{
-			PERROR("nfct_open");
-			return;
+			continue;
 		}
-	}
 
-	if(!ct)
-	{
-		ct = nfct_new();
-		if(!ct)
+		idle = (hints[cnt].idle > 0xff) ? 0xff : hints[cnt].idle;
+		rate = hints[cnt].active * 0xff / hints[cnt].sweeps;
+		key = (idle << 16) | ((0xff - rate) << 8) |
+			(cache[cnt].protocol == IPPROTO_TCP ? 0 : 1);
+		if((best >= 0 && key <= best_key) ||
+			 ipa_nat_rule_frees_room(nat_table_hdl, cache[cnt].rule_hdl, rule) != 1)
 		{
-			PERROR("nfct_new");
-			return;
+			continue;
 		}
+
+		best = cnt;
+		best_key = key;
 	}
 
-	nfct_set_attr_u8(ct, ATTR_L3PROTO, AF_INET);
-	if(rule->protocol == IPPROTO_UDP)
+	return best;
+}
+
+/* Removes the least valuable rule to make room for a new flow */
+bool NatApp::EvictEntry(const ipa_nat_ipv4_rule *rule)
+{
+	int cnt;
+
+	cnt = FindVictim(rule);
+	if(cnt < 0)
 	{
-		nfct_set_attr_u8(ct, ATTR_L4PROTO, rule->protocol);
-		nfct_set_attr_u32(ct, ATTR_TIMEOUT, udp_timeout);
+		IPACMDBG("No idle rule to make room for a new flow\n");
+		return false;
 	}
-	else
+
+	if(ipa_nat_del_ipv4_rule(nat_table_hdl, cache[cnt].rule_hdl) < 0)
 	{
-		nfct_set_attr_u8(ct, ATTR_L4PROTO, rule->protocol);
-		nfct_set_attr_u32(ct, ATTR_TIMEOUT, tcp_timeout);
+		IPACMERR("unable to delete the rule of entry %d\n", cnt);
+		return false;
 	}
 
-	if(rule->dst_nat == false)
-	{
-		nfct_set_attr_u32(ct, ATTR_IPV4_SRC, htonl(rule->private_ip));
-		nfct_set_attr_u16(ct, ATTR_PORT_SRC, htons(rule->private_port));
+	log_nat(cache[cnt].protocol, cache[cnt].private_ip, cache[cnt].target_ip,
+		cache[cnt].private_port, cache[cnt].target_port, "evicted as idle\n");
+	IPACMDBG("Evicted entry %d idle for %d of %d sweeps\n", cnt,
+					 hints[cnt].idle, hints[cnt].sweeps);
+	FreeEntry(cnt);
+	curCnt--;
+	evicted++;
+	return true;
+}
 
-		nfct_set_attr_u32(ct, ATTR_IPV4_DST, htonl(rule->target_ip));
-		nfct_set_attr_u16(ct, ATTR_PORT_DST, htons(rule->target_port));
+/* True when the hw table has no room left for a colliding rule */
+bool NatApp::isHwTblFull(void)
+{
+	ipa_nat_tbl_metrics metrics;
 
-		IPACMDBG("dst nat is not set\n");
-	}
-	else
+	if(ipa_nat_get_tbl_metrics(nat_table_hdl, &metrics) < 0)
 	{
-		nfct_set_attr_u32(ct, ATTR_IPV4_SRC, htonl(rule->target_ip));
-		nfct_set_attr_u16(ct, ATTR_PORT_SRC, htons(rule->target_port));
-
-		nfct_set_attr_u32(ct, ATTR_IPV4_DST, htonl(pub_ip_addr));
-		nfct_set_attr_u16(ct, ATTR_PORT_DST, htons(rule->public_port));
-
-		IPACMDBG("dst nat is set\n");
+		return false;
 	}
 
-	iptodot("Source IP:", nfct_get_attr_u32(ct, ATTR_IPV4_SRC));
-	iptodot("Destination IP:",  nfct_get_attr_u32(ct, ATTR_IPV4_DST));
-	IPACMDBG("Source Port: %d, Destination Port: %d\n",
-					 nfct_get_attr_u16(ct, ATTR_PORT_SRC), nfct_get_attr_u16(ct, ATTR_PORT_DST));
+	/* Entry 0 of the expansion tables is never used */
+	return (metrics.expn_used + 1 >= metrics.expn_entries ||
+		metrics.index_expn_used + 1 >= metrics.index_expn_entries);
+}
 
-	IPACMDBG("updating %d connection with time: %d\n",
-					 rule->protocol, nfct_get_attr_u32(ct, ATTR_TIMEOUT));
+/* Adds a rule the hw table had no room for in place of idle rules */
+int NatApp::EvictAndAdd(const ipa_nat_ipv4_rule *rule, uint32_t *rule_hdl)
+{
+	int tries;
 
-	ret = nfct_query(ct_hdl, NFCT_Q_UPDATE, ct);
-	if(ret == -1)
-	{
-		IPACMERR("unable to update time stamp");
-		DeleteEntry(rule);
-	}
-	else
-	{
-		rule->timestamp = new_ts;
-		IPACMDBG("Updated time stamp successfully\n");
-	}
-#else
-	if(rule->protocol == IPPROTO_UDP)
+	for(tries = 0; tries < IPACM_NAT_EVICT_TRIES; tries++)
 	{
-		entry.proto = IOffloadManager::ConntrackTimeoutUpdater::UDP;;
-	}
-	else
-	{
-		entry.proto = IOffloadManager::ConntrackTimeoutUpdater::TCP;
-	}
+		if(!isHwTblFull() || !EvictEntry(rule))
+		{
+			break;
+		}
 
-	if(rule->dst_nat == false)
-	{
-		entry.src.ipAddr = htonl(rule->private_ip);
-		entry.src.port = rule->private_port;
-		entry.dst.ipAddr = htonl(rule->target_ip);
-		entry.dst.port = rule->target_port;
-		IPACMDBG("dst nat is not set\n");
-	}
-	else
-	{
-		entry.src.ipAddr = htonl(rule->target_ip);
-		entry.src.port = rule->target_port;
-		entry.dst.ipAddr = htonl(pub_ip_addr);
-		entry.dst.port = rule->public_port;
-		IPACMDBG("dst nat is set\n");
+		if(ipa_nat_add_ipv4_rule(nat_table_hdl, rule, rule_hdl) == 0)
+		{
+			return 0;
+		}
 	}
 
-	iptodot("Source IP:", entry.src.ipAddr);
-	iptodot("Destination IP:",  entry.dst.ipAddr);
-	IPACMDBG("Source Port: %d, Destination Port: %d\n",
-					entry.src.port, entry.dst.port);
-
-	OffloadMng = IPACM_OffloadManager::GetInstance();
-	if (OffloadMng->touInstance == NULL) {
-		IPACMERR("OffloadMng->touInstance is NULL, can't forward to framework!\n");
-	} else {
-		OffloadMng->touInstance->updateTimeout(entry);
-		IPACMDBG("Updated time stamp successfully\n");
-		rule->timestamp = new_ts;
-	}
-#endif
-	return;
+	*rule_hdl = 0;
+	refused++;
+	return -1;
 }
 
-void NatApp::UpdateUDPTimeStamp()
+/* Drops a rule removed by the driver reaper from the cache */
+void NatApp::ReapCb(uint32_t tbl_hdl, uint32_t rule_hdl,
+		const ipa_nat_ipv4_rule *rule, void *arg)
 {
+	NatApp *nat = (NatApp *)arg;
+	nat_table_entry key;
 	int cnt;
-	uint32_t ts;
-	bool read_to = false;
 
-	for(cnt = 0; cnt < max_entries; cnt++)
+	memset(&key, 0, sizeof(key));
+	key.private_ip = rule->private_ip;
+	key.target_ip = rule->target_ip;
+	key.private_port = rule->private_port;
+	key.target_port = rule->target_port;
+	key.protocol = rule->protocol;
+
+	cnt = nat->FindEntry(&key);
+	if(cnt >= 0 &&
+		 nat->cache[cnt].enabled == true &&
+		 nat->cache[cnt].rule_hdl == rule_hdl)
 	{
-		ts = 0;
-		if(cache[cnt].enabled == true &&
-		   (cache[cnt].private_ip != cache[cnt].public_ip))
-		{
-			IPACMDBG("\n");
-			if(ipa_nat_query_timestamp(nat_table_hdl, cache[cnt].rule_hdl, &ts) < 0)
-			{
-				IPACMERR("unable to retrieve timeout for rule hanle: %d\n", cache[cnt].rule_hdl);
-				continue;
-			}
+		log_nat(rule->protocol, rule->private_ip, rule->target_ip,
+			rule->private_port, rule->target_port, "reaped as idle\n");
+		nat->FreeEntry(cnt);
+		nat->curCnt--;
+		return;
+	}
 
-			if(cache[cnt].timestamp == ts)
-			{
-				IPACMDBG("No Change in Time Stamp: cahce:%d, ipahw:%d\n",
-								                  cache[cnt].timestamp, ts);
-				continue;
-			}
+	IPACMDBG("Reaped rule %d of table %d not cached\n", rule_hdl, tbl_hdl);
+}
 
-			if (read_to == false) {
-				read_to = true;
-				Read_TcpUdp_Timeout();
-			}
+/* Removes the rules the hw saw no traffic on for a conntrack timeout,
+	 for the case the destroy event of the connection got lost */
+void NatApp::ReapIdleEntries()
+{
+	ipa_nat_reap_cfg cfg;
+	uint16_t num_reaped = 0;
 
-			UpdateCTUdpTs(&cache[cnt], ts);
-		} /* end of outer if */
+	if(nat_table_hdl == 0)
+	{
+		return;
+	}
+
+	ChkTimeouts();
 
-	} /* end of for loop */
+	cfg.tcp_idle = tcp_timeout;
+	cfg.udp_idle = udp_timeout;
+	cfg.other_idle = udp_timeout;
+	cfg.max_rules = IPACM_NAT_REAP_MAX_ENTRIES;
+
+	if(ipa_nat_reap_idle_rules(nat_table_hdl, &cfg, ReapCb, this, &num_reaped) < 0)
+	{
+		IPACMERR("unable to reap idle nat rules\n");
+		return;
+	}
 
+	if(num_reaped)
+	{
+		IPACMDBG_H("Reaped %d idle nat rules, %d left\n", num_reaped, curCnt);
+	}
 }
 
 bool NatApp::isAlgPort(uint8_t proto, uint16_t port)
@@ -608,6 +1610,7 @@ bool NatApp::isPwrSaveIf(uint32_t ip_addr)
 int NatApp::UpdatePwrSaveIf(uint32_t client_lan_ip)
 {
 	int cnt;
+	uint32_t pos;
 	IPACMDBG_H("Received IP address: 0x%x\n", client_lan_ip);
 
 	if(client_lan_ip == INVALID_IP_ADDR)
@@ -635,10 +1638,9 @@ int NatApp::UpdatePwrSaveIf(uint32_t client_lan_ip)
 		}
 	}
 
-	for(cnt = 0; cnt < max_entries; cnt++)
+	for(cnt = FindClnt(client_lan_ip, &pos); cnt >= 0; cnt = clnt_next[cnt])
 	{
-		if(cache[cnt].private_ip == client_lan_ip &&
-			 cache[cnt].enabled == true)
+		if(cache[cnt].enabled == true)
 		{
 			if(ipa_nat_del_ipv4_rule(nat_table_hdl, cache[cnt].rule_hdl) < 0)
 			{
@@ -656,7 +1658,8 @@ int NatApp::UpdatePwrSaveIf(uint32_t client_lan_ip)
 
 int NatApp::ResetPwrSaveIf(uint32_t client_lan_ip)
 {
-	int cnt;
+	int cnt, next;
+	uint32_t pos;
 	ipa_nat_ipv4_rule nat_rule;
 
 	IPACMDBG_H("Received ip address: 0x%x\n", client_lan_ip);
@@ -676,12 +1679,13 @@ int NatApp::ResetPwrSaveIf(uint32_t client_lan_ip)
 		}
 	}
 
-	for(cnt = 0; cnt < max_entries; cnt++)
+	for(cnt = FindClnt(client_lan_ip, &pos); cnt >= 0; cnt = next)
 	{
 		IPACMDBG("cache (%d): enable %d, ip 0x%x\n", cnt, cache[cnt].enabled, cache[cnt].private_ip);
 
-		if(cache[cnt].private_ip == client_lan_ip &&
-			 cache[cnt].enabled == false)
+		/* The entry may be freed below */
+		next = clnt_next[cnt];
+		if(cache[cnt].enabled == false)
 		{
 			memset(&nat_rule, 0 , sizeof(nat_rule));
 			nat_rule.private_ip = cache[cnt].private_ip;
@@ -694,7 +1698,7 @@ int NatApp::ResetPwrSaveIf(uint32_t client_lan_ip)
 			if(ipa_nat_add_ipv4_rule(nat_table_hdl, &nat_rule, &cache[cnt].rule_hdl) < 0)
 			{
 				IPACMERR("unable to add the rule delete from cache\n");
-				memset(&cache[cnt], 0, sizeof(cache[cnt]));
+				FreeEntry(cnt);
 				curCnt--;
 				continue;
 			}
@@ -723,6 +1727,230 @@ uint32_t NatApp::GetTableHdl(uint32_t in_ip_addr)
 	return -1;
 }
 
+/* Bucket of a staged flow on one of the hashed lists */
+uint32_t NatApp::TempHash(int link, const nat_table_entry *rule)
+{
+	if(link == NAT_TEMP_TUPLE)
+	{
+		return TupleHash(rule) & idx_mask;
+	}
+
+	return NatHash(link == NAT_TEMP_PRIV ? rule->private_ip : rule->target_ip) & idx_mask;
+}
+
+/* Puts the staged flow cnt at the head of its buckets and at the new
+	 end of the age list */
+void NatApp::TempLink(int cnt)
+{
+	nat_temp_node *node = &temp_nodes[cnt];
+	int *head;
+	int link;
+
+	for(link = 0; link < NAT_TEMP_AGE; link++)
+	{
+		head = &temp_idx[link][TempHash(link, &temp[cnt])];
+		node->prev[link] = -1;
+		node->next[link] = *head;
+		if(*head >= 0)
+		{
+			temp_nodes[*head].prev[link] = cnt;
+		}
+		*head = cnt;
+	}
+
+	node->prev[NAT_TEMP_AGE] = temp_newest;
+	node->next[NAT_TEMP_AGE] = -1;
+	if(temp_newest >= 0)
+	{
+		temp_nodes[temp_newest].next[NAT_TEMP_AGE] = cnt;
+	}
+	else
+	{
+		temp_oldest = cnt;
+	}
+	temp_newest = cnt;
+}
+
+/* Takes the staged flow cnt off every list */
+void NatApp::TempUnlink(int cnt)
+{
+	nat_temp_node *node = &temp_nodes[cnt];
+	int link;
+
+	for(link = 0; link < NAT_TEMP_LINKS; link++)
+	{
+		if(node->prev[link] >= 0)
+		{
+			temp_nodes[node->prev[link]].next[link] = node->next[link];
+		}
+		else if(link == NAT_TEMP_AGE)
+		{
+			temp_oldest = node->next[link];
+		}
+		else
+		{
+			temp_idx[link][TempHash(link, &temp[cnt])] = node->next[link];
+		}
+
+		if(node->next[link] >= 0)
+		{
+			temp_nodes[node->next[link]].prev[link] = node->prev[link];
+		}
+		else if(link == NAT_TEMP_AGE)
+		{
+			temp_newest = node->prev[link];
+		}
+	}
+}
+
+/* Drops the staged flow cnt, the last one moves into its place */
+void NatApp::TempFree(int cnt)
+{
+	nat_temp_node *node;
+	int last, link;
+
+	TempUnlink(cnt);
+	last = --temp_cnt;
+	if(cnt == last)
+	{
+		return;
+	}
+
+	temp[cnt] = temp[last];
+	temp_nodes[cnt] = temp_nodes[last];
+	node = &temp_nodes[cnt];
+	for(link = 0; link < NAT_TEMP_LINKS; link++)
+	{
+		if(node->prev[link] >= 0)
+		{
+			temp_nodes[node->prev[link]].next[link] = cnt;
+		}
+		else if(link == NAT_TEMP_AGE)
+		{
+			temp_oldest = cnt;
+		}
+		else
+		{
+			temp_idx[link][TempHash(link, &temp[cnt])] = cnt;
+		}
+
+		if(node->next[link] >= 0)
+		{
+			temp_nodes[node->next[link]].prev[link] = cnt;
+		}
+		else if(link == NAT_TEMP_AGE)
+		{
+			temp_newest = cnt;
+		}
+	}
+}
+
+/* Returns the staged flow of the 5-tuple of rule, -1 if not staged */
+int NatApp::FindTempEntry(const nat_table_entry *rule)
+{
+	int cnt;
+
+	if(temp_cnt == 0)
+	{
+		return -1;
+	}
+
+	for(cnt = temp_idx[NAT_TEMP_TUPLE][TempHash(NAT_TEMP_TUPLE, rule)]; cnt >= 0;
+			cnt = temp_nodes[cnt].next[NAT_TEMP_TUPLE])
+	{
+		if(temp[cnt].private_ip == rule->private_ip &&
+			 temp[cnt].target_ip == rule->target_ip &&
+			 temp[cnt].private_port ==  rule->private_port  &&
+			 temp[cnt].target_port == rule->target_port &&
+			 temp[cnt].protocol == rule->protocol)
+		{
+			return cnt;
+		}
+	}
+
+	return -1;
+}
+
+/* Doubles the staging area, false once it has the size of the nat table */
+bool NatApp::GrowTemp(void)
+{
+	nat_table_entry *entries;
+	nat_temp_node *nodes;
+	int size;
+
+	if(temp_size >= max_entries)
+	{
+		return false;
+	}
+
+	size = (temp_size == 0) ? IPACM_NAT_TEMP_MIN_ENTRIES : 2 * temp_size;
+	if(size > max_entries)
+	{
+		size = max_entries;
+	}
+
+	entries = (nat_table_entry *)realloc(temp, sizeof(nat_table_entry) * size);
+	if(entries == NULL)
+	{
+		IPACMERR("Unable to allocate memory for %d temp entries\n", size);
+		return false;
+	}
+	temp = entries;
+
+	nodes = (nat_temp_node *)realloc(temp_nodes, sizeof(nat_temp_node) * size);
+	if(nodes == NULL)
+	{
+		IPACMERR("Unable to allocate memory for %d temp entries\n", size);
+		return false;
+	}
+	temp_nodes = nodes;
+
+	IPACMDBG("Temp entries grown from %d to %d\n", temp_size, size);
+	temp_size = size;
+	return true;
+}
+
+/* Drops the staged flows older than the conntrack timeout of their
+	 protocol, their client never showed up */
+void NatApp::AgeTempEntries(void)
+{
+	time_t now, age, min_age;
+	int cnt, next;
+
+	now = NatMonotonicSec();
+	min_age = (time_t)GetTimeoutTicks(IPPROTO_TCP) * IPACM_NAT_WHEEL_TICK;
+	age = (time_t)GetTimeoutTicks(IPPROTO_UDP) * IPACM_NAT_WHEEL_TICK;
+	if(age < min_age)
+	{
+		min_age = age;
+	}
+
+	for(cnt = temp_oldest; cnt >= 0; cnt = next)
+	{
+		age = now - temp_nodes[cnt].staged;
+		if(age < min_age)
+		{
+			break;
+		}
+
+		next = temp_nodes[cnt].next[NAT_TEMP_AGE];
+		if(age < (time_t)GetTimeoutTicks(temp[cnt].protocol) * IPACM_NAT_WHEEL_TICK)
+		{
+			continue;
+		}
+
+		log_nat(temp[cnt].protocol, temp[cnt].private_ip, temp[cnt].target_ip,
+			temp[cnt].private_port, temp[cnt].target_port, "Aged temp entry\n");
+		TempFree(cnt);
+		temp_aged++;
+		/* the last one took the freed place */
+		if(next == temp_cnt)
+		{
+			next = cnt;
+		}
+	}
+}
+
 void NatApp::AddTempEntry(const nat_table_entry *new_entry)
 {
 	int cnt;
@@ -745,31 +1973,32 @@ void NatApp::AddTempEntry(const nat_table_entry *new_entry)
 		return;
 	}
 
-	for(cnt=0; cnt<MAX_TEMP_ENTRIES; cnt++)
+	if(FindTempEntry(new_entry) >= 0)
 	{
-		if(temp[cnt].private_ip == new_entry->private_ip &&
-			 temp[cnt].target_ip == new_entry->target_ip &&
-			 temp[cnt].private_port ==  new_entry->private_port  &&
-			 temp[cnt].target_port == new_entry->target_port &&
-			 temp[cnt].protocol == new_entry->protocol)
-		{
-			IPACMDBG("Received duplicate Temp entry\n");
-			return;
-		}
+		IPACMDBG("Received duplicate Temp entry\n");
+		return;
 	}
 
-	for(cnt=0; cnt<MAX_TEMP_ENTRIES; cnt++)
+	if(temp_cnt == temp_size && !GrowTemp())
 	{
-		if(temp[cnt].private_ip == 0 &&
-			 temp[cnt].target_ip == 0)
+		if(temp_oldest < 0)
 		{
-			memcpy(&temp[cnt], new_entry, sizeof(nat_table_entry));
-			IPACMDBG("Added Temp Entry\n");
+			IPACMERR("Unable to add temp entry, no room\n");
 			return;
 		}
+
+		log_nat(temp[temp_oldest].protocol, temp[temp_oldest].private_ip,
+			temp[temp_oldest].target_ip, temp[temp_oldest].private_port,
+			temp[temp_oldest].target_port, "Replaced oldest temp entry\n");
+		TempFree(temp_oldest);
+		temp_replaced++;
 	}
 
-	IPACMDBG("Unable to add temp entry, cache full\n");
+	cnt = temp_cnt++;
+	memcpy(&temp[cnt], new_entry, sizeof(nat_table_entry));
+	temp_nodes[cnt].staged = NatMonotonicSec();
+	TempLink(cnt);
+	IPACMDBG("Added Temp Entry(%d)\n", cnt);
 	return;
 }
 
@@ -783,51 +2012,61 @@ void NatApp::DeleteTempEntry(const nat_table_entry *entry)
 	IPACMDBG("Private Port: %d\t Target Port: %d\n", entry->private_port, entry->target_port);
 	IPACMDBG("protocol: %d\n", entry->protocol);
 
-	for(cnt=0; cnt<MAX_TEMP_ENTRIES; cnt++)
+	cnt = FindTempEntry(entry);
+	if(cnt < 0)
 	{
-		if(temp[cnt].private_ip == entry->private_ip &&
-			 temp[cnt].target_ip == entry->target_ip &&
-			 temp[cnt].private_port ==  entry->private_port  &&
-			 temp[cnt].target_port == entry->target_port &&
-			 temp[cnt].protocol == entry->protocol)
-		{
-			memset(&temp[cnt], 0, sizeof(nat_table_entry));
-			IPACMDBG("Delete Temp Entry\n");
-			return;
-		}
+		IPACMDBG("No Such Temp Entry exists\n");
+		return;
 	}
 
-	IPACMDBG("No Such Temp Entry exists\n");
+	TempFree(cnt);
+	IPACMDBG("Delete Temp Entry\n");
 	return;
 }
 
+/* Adds or drops the staged flows with ip_addr at either end, walking
+	 only the buckets of ip_addr. A flow that fails to be added stays */
 void NatApp::FlushTempEntries(uint32_t ip_addr, bool isAdd,
 		bool isDummy)
 {
-	int cnt;
+	nat_table_entry rule;
+	uint32_t bucket;
+	int cnt, next, link;
 	int ret;
 
 	IPACMDBG_H("Received below with isAdd:%d ", isAdd);
 	iptodot("IP Address: ", ip_addr);
 
-	for(cnt=0; cnt<MAX_TEMP_ENTRIES; cnt++)
+	if(temp_cnt == 0)
+	{
+		return;
+	}
+
+	bucket = NatHash(ip_addr) & idx_mask;
+	for(link = NAT_TEMP_PRIV; link <= NAT_TEMP_TRGT; link++)
 	{
-		if(temp[cnt].private_ip == ip_addr ||
-			 temp[cnt].target_ip == ip_addr)
+		for(cnt = temp_idx[link][bucket]; cnt >= 0; cnt = next)
 		{
+			next = temp_nodes[cnt].next[link];
+			if((link == NAT_TEMP_PRIV ? temp[cnt].private_ip : temp[cnt].target_ip) != ip_addr)
+			{
+				continue;
+			}
+
 			if(isAdd)
 			{
 				if(temp[cnt].public_ip == pub_ip_addr)
 				{
+					rule = temp[cnt];
 					if (isDummy) {
 						/* To avoild DL expections for non IPA path */
-						temp[cnt].private_ip = temp[cnt].public_ip;
-						temp[cnt].private_port = temp[cnt].public_port;
+						rule.private_ip = rule.public_ip;
+						rule.private_port = rule.public_port;
 						IPACMDBG("Flushing dummy temp rule");
-						iptodot("Private IP", temp[cnt].private_ip);
+						iptodot("Private IP", rule.private_ip);
 					}
 
-					ret = AddEntry(&temp[cnt]);
+					ret = AddEntry(&rule);
 					if(ret)
 					{
 						IPACMERR("unable to add temp entry: %d\n", ret);
@@ -835,7 +2074,13 @@ void NatApp::FlushTempEntries(uint32_t ip_addr, bool isAdd,
 					}
 				}
 			}
-			memset(&temp[cnt], 0, sizeof(nat_table_entry));
+
+			TempFree(cnt);
+			/* the last one took the freed place */
+			if(next == temp_cnt)
+			{
+				next = cnt;
+			}
 		}
 	}
 
@@ -845,6 +2090,7 @@ void NatApp::FlushTempEntries(uint32_t ip_addr, bool isAdd,
 int NatApp::DelEntriesOnClntDiscon(uint32_t ip_addr)
 {
 	int cnt, tmp = 0;
+	uint32_t pos;
 	IPACMDBG_H("Received IP address: 0x%x\n", ip_addr);
 
 	if(ip_addr == INVALID_IP_ADDR)
@@ -863,26 +2109,23 @@ int NatApp::DelEntriesOnClntDiscon(uint32_t ip_addr)
 		}
 	}
 
-	for(cnt = 0; cnt < max_entries; cnt++)
+	for(cnt = FindClnt(ip_addr, &pos); cnt >= 0; cnt = clnt_next[cnt])
 	{
-		if(cache[cnt].private_ip == ip_addr)
+		if(cache[cnt].enabled == true)
 		{
-			if(cache[cnt].enabled == true)
+			if(ipa_nat_del_ipv4_rule(nat_table_hdl, cache[cnt].rule_hdl) < 0)
 			{
-				if(ipa_nat_del_ipv4_rule(nat_table_hdl, cache[cnt].rule_hdl) < 0)
-				{
-					IPACMERR("unable to delete the rule\n");
-					continue;
-				}
-				else
-				{
-					IPACMDBG("won't delete the rule\n");
-					cache[cnt].enabled = false;
-					tmp++;
-				}
+				IPACMERR("unable to delete the rule\n");
+				continue;
+			}
+			else
+			{
+				IPACMDBG("won't delete the rule\n");
+				cache[cnt].enabled = false;
+				tmp++;
 			}
-			IPACMDBG("won't delete the rule for entry %d, enabled %d\n",cnt, cache[cnt].enabled);
 		}
+		IPACMDBG("won't delete the rule for entry %d, enabled %d\n",cnt, cache[cnt].enabled);
 	}
 
 	IPACMDBG("Deleted (but cached) %d entries\n", tmp);
@@ -914,7 +2157,7 @@ int NatApp::DelEntriesOnSTAClntDiscon(uint32_t ip_addr)
 				}
 			}
 
-			memset(&cache[cnt], 0, sizeof(cache[cnt]));
+			FreeEntry(cnt);
 			curCnt--;
 		}
 	}
@@ -939,19 +2182,8 @@ void NatApp::CacheEntry(const nat_table_entry *rule)
 
 	if(!ChkForDup(rule))
 	{
-		for(cnt=0; cnt < max_entries; cnt++)
-		{
-			if(cache[cnt].private_ip == 0 &&
-				 cache[cnt].target_ip == 0 &&
-				 cache[cnt].private_port == 0  &&
-				 cache[cnt].target_port == 0 &&
-				 cache[cnt].protocol == 0)
-			{
-				break;
-			}
-		}
-
-		if(max_entries == cnt)
+		cnt = AllocEntry(rule);
+		if(cnt < 0)
 		{
 			IPACMERR("Error: Unable to add, reached maximum rules\n");
 			return;
@@ -960,11 +2192,6 @@ void NatApp::CacheEntry(const nat_table_entry *rule)
 		{
 			cache[cnt].enabled = false;
 			cache[cnt].rule_hdl = 0;
-			cache[cnt].private_ip = rule->private_ip;
-			cache[cnt].target_ip = rule->target_ip;
-			cache[cnt].target_port = rule->target_port;
-			cache[cnt].private_port = rule->private_port;
-			cache[cnt].protocol = rule->protocol;
 			cache[cnt].timestamp = 0;
 			cache[cnt].public_port = rule->public_port;
 			cache[cnt].public_ip = rule->public_ip;
@@ -983,6 +2210,39 @@ void NatApp::CacheEntry(const nat_table_entry *rule)
 	return;
 }
 
+/* Re-reads the conntrack timeouts once they are IPACM_NAT_TIMEOUT_REFRESH
+	 seconds old, the entries queued with the old ones are queued again */
+void NatApp::ChkTimeouts()
+{
+	uint32_t tcp_pre = tcp_timeout, udp_pre = udp_timeout;
+	uint32_t now;
+	time_t now_sec;
+	int cnt;
+
+	now_sec = NatMonotonicSec();
+	if(timeout_read != 0 && now_sec - timeout_read < IPACM_NAT_TIMEOUT_REFRESH)
+	{
+		return;
+	}
+	timeout_read = now_sec;
+
+	Read_TcpUdp_Timeout();
+	if(tcp_pre == tcp_timeout && udp_pre == udp_timeout)
+	{
+		return;
+	}
+
+	now = NatWheelTick();
+	for(cnt = 0; cnt < max_entries; cnt++)
+	{
+		if(timers[cnt].bucket >= 0 &&
+			 (int32_t)(timers[cnt].deadline - (now + GetTimeoutTicks(cache[cnt].protocol))) > 0)
+		{
+			ScheduleEntry(cnt, now);
+		}
+	}
+}
+
 void NatApp::Read_TcpUdp_Timeout(void) {
 #ifdef FEATURE_IPACM_HAL
 	tcp_timeout = 432000;
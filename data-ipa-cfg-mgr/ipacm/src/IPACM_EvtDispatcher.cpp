@@ -38,35 +38,55 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 #include <string.h>
 #include <pthread.h>
+#include <new>
 #include <IPACM_EvtDispatcher.h>
 #include <IPACM_Neighbor.h>
 #include "IPACM_CmdQueue.h"
 #include "IPACM_Defs.h"
+#include "IPACM_EvtPool.h"
+#include "IPACM_EvtStats.h"
 
 
-extern pthread_mutex_t mutex;
-extern pthread_cond_t  cond_var;
-
-cmd_evts *IPACM_EvtDispatcher::head = NULL;
+evt_subscribers *IPACM_EvtDispatcher::subs[IPACM_EVENT_MAX];
+uint32_t IPACM_EvtDispatcher::subs_gen = 0;
+pthread_mutex_t IPACM_EvtDispatcher::subs_lock = PTHREAD_MUTEX_INITIALIZER;
 extern uint32_t ipacm_event_stats[IPACM_EVENT_MAX];
 
-int IPACM_EvtDispatcher::PostEvt
-(
-	 ipacm_cmd_q_data *data
-)
+static Message *AllocMessage(void)
+{
+	Message *item;
+
+	/* The pool covers the events in flight, the heap is left for bursts */
+	item = (Message *)ipacm_msg_pool.Get();
+	if(item != NULL)
+	{
+		return new (item) Message();
+	}
+	return new (std::nothrow) Message();
+}
+
+static void FreeMessage(Message *item)
+{
+	if(!ipacm_msg_pool.Put(item))
+	{
+		delete item;
+	}
+}
+
+int IPACM_EvtDispatcher::EnqueueEvt(Message *item)
 {
-	Message *item = NULL;
 	MessageQueue *MsgQueue = NULL;
+	int shard = item->evt.shard;
 
-	if(data->event < IPA_EXTERNAL_EVENT_MAX)
+	if(item->evt.data.event < IPA_EXTERNAL_EVENT_MAX)
 	{
-		IPACMDBG("Insert event into external queue.\n");
-		MsgQueue = MessageQueue::getInstanceExternal();
+		IPACMDBG("Insert event into external queue of shard %d.\n", shard);
+		MsgQueue = MessageQueue::getInstanceExternal(shard);
 	}
 	else
 	{
-		IPACMDBG("Insert event into internal queue.\n");
-		MsgQueue = MessageQueue::getInstanceInternal();
+		IPACMDBG("Insert event into internal queue of shard %d.\n", shard);
+		MsgQueue = MessageQueue::getInstanceInternal(shard);
 	}
 	if(MsgQueue == NULL)
 	{
@@ -74,141 +94,341 @@ int IPACM_EvtDispatcher::PostEvt
 		return IPACM_FAILURE;
 	}
 
-	item = new Message();
-	if(item == NULL)
+	IPACMDBG("Enqueing item\n");
+	MsgQueue->enqueue(item);
+	IPACMDBG("Enqueued item %pK\n", item);
+
+	return IPACM_SUCCESS;
+}
+
+/* Queues the event on every worker with a listener of it, the event
+	 data is released by the last of them */
+int IPACM_EvtDispatcher::PostEvt
+(
+	 ipacm_cmd_q_data *data
+)
+{
+	Message *items[IPACM_CMD_SHARD_MAX];
+	uint32_t shards = 0;
+	uint64_t now = IPACM_EvtStats::Now();
+	int *pending = NULL;
+	int shard, num = 0, cnt;
+
+	if(data->event < IPACM_EVENT_MAX)
 	{
-		IPACMERR("unable to create new message item\n");
-		return IPACM_FAILURE;
+		pthread_mutex_lock(&subs_lock);
+		if(subs[data->event] != NULL)
+		{
+			shards = subs[data->event]->shards;
+		}
+		pthread_mutex_unlock(&subs_lock);
+	}
+	/* still queued once to release its data */
+	if(shards == 0)
+	{
+		shards = 1 << IPACM_CMD_SHARD_IFACE;
 	}
 
-	item->evt.callback_ptr = IPACM_EvtDispatcher::ProcessEvt;
-	memcpy(&item->evt.data, data, sizeof(ipacm_cmd_q_data));
-
-	if(pthread_mutex_lock(&mutex) != 0)
+	for(shard = 0; shard < IPACM_CMD_SHARD_MAX; shard++)
 	{
-		IPACMERR("unable to lock the mutex\n");
-		return IPACM_FAILURE;
+		if((shards & (1 << shard)) == 0)
+		{
+			continue;
+		}
+
+		items[num] = AllocMessage();
+		if(items[num] == NULL)
+		{
+			IPACMERR("unable to create new message item\n");
+			goto fail;
+		}
+		items[num]->evt.callback_ptr = IPACM_EvtDispatcher::ProcessEvt;
+		memcpy(&items[num]->evt.data, data, sizeof(ipacm_cmd_q_data));
+		items[num]->evt.shard = shard;
+		items[num]->evt.post_ns = now;
+		num++;
 	}
 
-	IPACMDBG("Enqueing item\n");
-	MsgQueue->enqueue(item);
-	IPACMDBG("Enqueued item %pK\n", item);
+	if(num > 1)
+	{
+		pending = (int *)malloc(sizeof(int));
+		if(pending == NULL)
+		{
+			IPACMERR("unable to share event %d between %d workers\n", data->event, num);
+			goto fail;
+		}
+		*pending = num;
+		for(cnt = 0; cnt < num; cnt++)
+		{
+			items[cnt]->evt.pending = pending;
+		}
+	}
 
-	if(pthread_cond_signal(&cond_var) != 0)
+	for(cnt = 0; cnt < num; cnt++)
 	{
-		IPACMDBG("unable to lock the mutex\n");
-		/* Release the mutex before you return failure */
-		if(pthread_mutex_unlock(&mutex) != 0)
+		if(EnqueueEvt(items[cnt]) != IPACM_SUCCESS)
 		{
-			IPACMERR("unable to unlock the mutex\n");
+			/* the workers it reached release the data once done */
+			if(pending != NULL &&
+				 __sync_sub_and_fetch(pending, num - cnt) == 0)
+			{
+				free(pending);
+				IPACM_EvtPool::Release(data->evt_data);
+			}
+			for(; cnt < num; cnt++)
+			{
+				FreeMessage(items[cnt]);
+			}
 			return IPACM_FAILURE;
 		}
-		return IPACM_FAILURE;
 	}
 
-	if(pthread_mutex_unlock(&mutex) != 0)
+	return IPACM_SUCCESS;
+
+fail:
+	for(cnt = 0; cnt < num; cnt++)
 	{
-		IPACMERR("unable to unlock the mutex\n");
-		return IPACM_FAILURE;
+		FreeMessage(items[cnt]);
 	}
+	return IPACM_FAILURE;
+}
 
-	return IPACM_SUCCESS;
+#define EVT_SUBS_SIZE(cnt) (sizeof(evt_subscribers) + ((cnt) - 1) * sizeof(evt_listener))
+
+/* Takes a ref on the listeners of an event, gen is set to the
+	 deregistr generation they were taken at */
+evt_subscribers *IPACM_EvtDispatcher::GetSubs(ipa_cm_event_id event, uint32_t *gen)
+{
+	evt_subscribers *s;
+
+	pthread_mutex_lock(&subs_lock);
+	s = subs[event];
+	if(s != NULL)
+	{
+		s->ref++;
+	}
+	*gen = subs_gen;
+	pthread_mutex_unlock(&subs_lock);
+	return s;
+}
+
+/* Drops a ref, the last one frees an array already replaced */
+void IPACM_EvtDispatcher::PutSubs(ipa_cm_event_id event, evt_subscribers *s)
+{
+	pthread_mutex_lock(&subs_lock);
+	if(--s->ref == 0 && subs[event] != s)
+	{
+		free(s);
+	}
+	pthread_mutex_unlock(&subs_lock);
+}
+
+/* Whether obj still listens to event, only looked up once a deregistr
+	 happened since gen */
+bool IPACM_EvtDispatcher::isSubscribed(ipa_cm_event_id event, IPACM_Listener *obj, uint32_t *gen)
+{
+	evt_subscribers *s;
+	bool found = false;
+	int cnt;
+
+	pthread_mutex_lock(&subs_lock);
+	if(*gen == subs_gen)
+	{
+		pthread_mutex_unlock(&subs_lock);
+		return true;
+	}
+
+	s = subs[event];
+	for(cnt = 0; s != NULL && cnt < s->cnt; cnt++)
+	{
+		if(s->l[cnt].obj == obj)
+		{
+			found = true;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&subs_lock);
+	return found;
 }
 
-void IPACM_EvtDispatcher::ProcessEvt(ipacm_cmd_q_data *data)
+/* Installs the listeners of an event, called with subs_lock held. The
+	 array replaced is freed unless a dispatch still holds it */
+void IPACM_EvtDispatcher::SetSubs(ipa_cm_event_id event, evt_subscribers *s)
 {
+	evt_subscribers *old = subs[event];
+
+	subs[event] = s;
+	if(old != NULL && old->ref == 0)
+	{
+		free(old);
+	}
+}
 
-	cmd_evts *tmp = head, tmp1;
+/* Runs the listeners of an event bound to the worker of cmd */
+void IPACM_EvtDispatcher::ProcessEvt(cmd_t *cmd)
+{
+	ipacm_cmd_q_data *data = &cmd->data;
+	evt_subscribers *s = NULL;
+	IPACM_Listener *obj;
+	uint64_t start = IPACM_EvtStats::Now();
+	uint32_t gen;
+	int cnt;
 
-	if(head == NULL)
+	if(data->event < IPACM_EVENT_MAX)
 	{
-		IPACMDBG("Queue is empty\n");
+		s = GetSubs(data->event, &gen);
 	}
 
-	while(tmp != NULL)
+	if(s == NULL)
+	{
+		IPACMDBG("No listener of event %d\n", data->event);
+	}
+	else
 	{
-	        memcpy(&tmp1, tmp, sizeof(tmp1));
-		if(data->event == tmp1.event)
+		for(cnt = 0; cnt < s->cnt; cnt++)
 		{
-			ipacm_event_stats[data->event]++;
-			tmp1.obj->event_callback(data->event, data->evt_data);
+			obj = s->l[cnt].obj;
+			if(obj == NULL || s->l[cnt].shard != cmd->shard)
+			{
+				continue;
+			}
+
+			/* an earlier listener may have deleted it */
+			if(!isSubscribed(data->event, obj, &gen))
+			{
+				continue;
+			}
+
+			__sync_fetch_and_add(&ipacm_event_stats[data->event], 1);
+			obj->event_callback(data->event, data->evt_data);
 			IPACMDBG(" Find matched registered events\n");
 		}
-	        tmp = tmp1.next;
+		PutSubs(data->event, s);
 	}
 
+	IPACM_EvtStats::RecordExec(data->event, start, IPACM_EvtStats::Now());
 	IPACMDBG(" Finished process events\n");
-			
+
+	/* the other workers of the event are not done with it */
+	if(cmd->pending != NULL)
+	{
+		if(__sync_sub_and_fetch(cmd->pending, 1) != 0)
+		{
+			return;
+		}
+		free(cmd->pending);
+		cmd->pending = NULL;
+	}
+
 	if(data->evt_data != NULL)
 	{
 		IPACMDBG("free the event:%d data: %pK\n", data->event, data->evt_data);
-		free(data->evt_data);
+		IPACM_EvtPool::Release(data->evt_data);
 	}
 	return;
 }
 
-int IPACM_EvtDispatcher::registr(ipa_cm_event_id event, IPACM_Listener *obj)
+int IPACM_EvtDispatcher::registr(ipa_cm_event_id event, IPACM_Listener *obj, int shard)
 {
-	cmd_evts *tmp = head,*nw;
+	evt_subscribers *old, *nw;
+	int cnt;
 
-	nw = (cmd_evts *)malloc(sizeof(cmd_evts));
-	if(nw != NULL)
-	{
-		nw->event = event;
-		nw->obj = obj;
-		nw->next = NULL;
-	}
-	else
+	if(event >= IPACM_EVENT_MAX || shard < 0 || shard >= IPACM_CMD_SHARD_MAX)
 	{
+		IPACMERR("Invalid event %d or shard %d\n", event, shard);
 		return IPACM_FAILURE;
 	}
 
-	if(head == NULL)
+	pthread_mutex_lock(&subs_lock);
+	old = subs[event];
+	cnt = (old != NULL) ? old->cnt : 0;
+
+	nw = (evt_subscribers *)malloc(EVT_SUBS_SIZE(cnt + 1));
+	if(nw == NULL)
 	{
-		head = nw;
+		pthread_mutex_unlock(&subs_lock);
+		return IPACM_FAILURE;
 	}
-	else
+
+	nw->ref = 0;
+	nw->cnt = cnt + 1;
+	nw->shards = 1 << shard;
+	if(cnt > 0)
 	{
-		while(tmp->next)
-		{
-			tmp = tmp->next;
-		}
-		tmp->next = nw;
+		memcpy(nw->l, old->l, cnt * sizeof(evt_listener));
+		nw->shards |= old->shards;
 	}
+	nw->l[cnt].obj = obj;
+	nw->l[cnt].shard = shard;
+
+	SetSubs(event, nw);
+	pthread_mutex_unlock(&subs_lock);
 	return IPACM_SUCCESS;
 }
 
 
 int IPACM_EvtDispatcher::deregistr(IPACM_Listener *param)
 {
-	cmd_evts *tmp = head,*tmp1,*prev = head;
+	evt_subscribers *old, *nw;
+	int event, cnt, left;
 
-	while(tmp != NULL)
+	pthread_mutex_lock(&subs_lock);
+	for(event = 0; event < IPACM_EVENT_MAX; event++)
 	{
-		if(tmp->obj == param)
+		old = subs[event];
+		if(old == NULL)
 		{
-			tmp1 = tmp;
-			if(tmp == head)
-			{
-				head = head->next;
-			}
-			else if(tmp->next == NULL)
+			continue;
+		}
+
+		left = 0;
+		for(cnt = 0; cnt < old->cnt; cnt++)
+		{
+			if(old->l[cnt].obj != param)
 			{
-				prev->next = NULL;
+				left++;
 			}
-			else
+		}
+		if(left == old->cnt)
+		{
+			continue;
+		}
+
+		if(left == 0)
+		{
+			SetSubs((ipa_cm_event_id)event, NULL);
+			continue;
+		}
+
+		nw = (evt_subscribers *)malloc(EVT_SUBS_SIZE(left));
+		if(nw == NULL)
+		{
+			/* a dispatch holding old skips it through subs_gen */
+			IPACMERR("Unable to allocate listeners of event %d, clearing in place\n", event);
+			for(cnt = 0; cnt < old->cnt; cnt++)
 			{
-				prev->next = tmp->next;
+				if(old->l[cnt].obj == param)
+				{
+					old->l[cnt].obj = NULL;
+				}
 			}
-
-			tmp = tmp->next;
-			free(tmp1);
+			continue;
 		}
-		else
+
+		nw->ref = 0;
+		nw->cnt = 0;
+		nw->shards = 0;
+		for(cnt = 0; cnt < old->cnt; cnt++)
 		{
-			prev = tmp;
-			tmp = tmp->next;
+			if(old->l[cnt].obj != param)
+			{
+				nw->shards |= 1 << old->l[cnt].shard;
+				nw->l[nw->cnt++] = old->l[cnt];
+			}
 		}
+		SetSubs((ipa_cm_event_id)event, nw);
 	}
+	subs_gen++;
+	pthread_mutex_unlock(&subs_lock);
 	return IPACM_SUCCESS;
 }
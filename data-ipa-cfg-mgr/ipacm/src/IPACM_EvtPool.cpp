@@ -0,0 +1,188 @@
+/*
+Copyright (c) 2013-2018, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+		* Redistributions of source code must retain the above copyright
+			notice, this list of conditions and the following disclaimer.
+		* Redistributions in binary form must reproduce the above
+			copyright notice, this list of conditions and the following
+			disclaimer in the documentation and/or other materials provided
+			with the distribution.
+		* Neither the name of The Linux Foundation nor the names of its
+			contributors may be used to endorse or promote products derived
+			from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*!
+	@file
+	IPACM_EvtPool.cpp
+
+	@brief
+	This file implements the fixed size pools of the IPACM event objects
+
+	@Author
+
+*/
+#include <stdlib.h>
+#include <string.h>
+#include "IPACM_EvtPool.h"
+#include "IPACM_CmdQueue.h"
+#include "IPACM_Defs.h"
+#include "IPACM_Log.h"
+
+/* Objects are aligned as malloc would */
+#define IPACM_EVT_POOL_ALIGN 16
+
+IPACM_EvtPool *IPACM_EvtPool::pools[IPACM_EVT_POOL_MAX];
+int IPACM_EvtPool::num_pools = 0;
+
+IPACM_EvtPool ipacm_ct_batch_pool("ct batch", sizeof(ipacm_ct_evt_batch), IPACM_CT_BATCH_POOL_SIZE);
+IPACM_EvtPool ipacm_ct_evt_pool("ct event", sizeof(ipacm_ct_evt_data), IPACM_CT_EVT_POOL_SIZE);
+IPACM_EvtPool ipacm_neigh_evt_pool("neigh event", sizeof(ipacm_event_data_all), IPACM_NEIGH_EVT_POOL_SIZE);
+IPACM_EvtPool ipacm_msg_pool("message", sizeof(Message), IPACM_MSG_POOL_SIZE);
+
+IPACM_EvtPool::IPACM_EvtPool(const char *name, size_t size, int num)
+{
+	int cnt;
+
+	pool_name = name;
+	obj_size = (size + IPACM_EVT_POOL_ALIGN - 1) & ~((size_t)IPACM_EVT_POOL_ALIGN - 1);
+	num_objs = 0;
+	free_list = NULL;
+	in_use = 0;
+	max_in_use = 0;
+	gets = 0;
+	misses = 0;
+	pthread_mutex_init(&lock, NULL);
+
+	/* Without the memory every Get() misses, the callers cope with it */
+	objs = (char *)malloc(obj_size * num);
+	if(objs == NULL)
+	{
+		IPACMERR("unable to allocate %d objects of %s pool\n", num, name);
+	}
+	else
+	{
+		num_objs = num;
+		for(cnt = num_objs - 1; cnt >= 0; cnt--)
+		{
+			*(void **)(objs + cnt * obj_size) = free_list;
+			free_list = objs + cnt * obj_size;
+		}
+	}
+
+	if(num_pools < IPACM_EVT_POOL_MAX)
+	{
+		pools[num_pools++] = this;
+	}
+}
+
+void *IPACM_EvtPool::Get(void)
+{
+	void *obj;
+	uint32_t missed = 0;
+
+	pthread_mutex_lock(&lock);
+	gets++;
+	obj = free_list;
+	if(obj != NULL)
+	{
+		free_list = *(void **)obj;
+		in_use++;
+		if(in_use > max_in_use)
+		{
+			max_in_use = in_use;
+		}
+	}
+	else
+	{
+		missed = ++misses;
+	}
+	pthread_mutex_unlock(&lock);
+
+	/* Report the first miss and then every power of two of them */
+	if(missed != 0 && (missed & (missed - 1)) == 0)
+	{
+		IPACMERR("%s pool of %d exhausted, %u misses\n", pool_name, num_objs, missed);
+	}
+
+	return obj;
+}
+
+bool IPACM_EvtPool::Put(void *obj)
+{
+	char *addr = (char *)obj;
+
+	if(objs == NULL || addr < objs || addr >= objs + obj_size * num_objs)
+	{
+		return false;
+	}
+
+	pthread_mutex_lock(&lock);
+	*(void **)obj = free_list;
+	free_list = obj;
+	in_use--;
+	pthread_mutex_unlock(&lock);
+
+	return true;
+}
+
+void IPACM_EvtPool::GetStats(ipacm_evt_pool_stats *stats)
+{
+	pthread_mutex_lock(&lock);
+	stats->name = pool_name;
+	stats->size = num_objs;
+	stats->in_use = in_use;
+	stats->max_in_use = max_in_use;
+	stats->gets = gets;
+	stats->misses = misses;
+	pthread_mutex_unlock(&lock);
+}
+
+void IPACM_EvtPool::Release(void *obj)
+{
+	int cnt;
+
+	if(obj == NULL)
+	{
+		return;
+	}
+
+	for(cnt = 0; cnt < num_pools; cnt++)
+	{
+		if(pools[cnt]->Put(obj))
+		{
+			return;
+		}
+	}
+
+	free(obj);
+}
+
+int IPACM_EvtPool::GetPoolCnt(void)
+{
+	return num_pools;
+}
+
+IPACM_EvtPool *IPACM_EvtPool::GetPool(int index)
+{
+	if(index < 0 || index >= num_pools)
+	{
+		return NULL;
+	}
+
+	return pools[index];
+}
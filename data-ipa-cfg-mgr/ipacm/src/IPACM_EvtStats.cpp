@@ -0,0 +1,265 @@
+/*
+Copyright (c) 2013-2018, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+		* Redistributions of source code must retain the above copyright
+			notice, this list of conditions and the following disclaimer.
+		* Redistributions in binary form must reproduce the above
+			copyright notice, this list of conditions and the following
+			disclaimer in the documentation and/or other materials provided
+			with the distribution.
+		* Neither the name of The Linux Foundation nor the names of its
+			contributors may be used to endorse or promote products derived
+			from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*!
+	@file
+	IPACM_EvtStats.cpp
+
+	@brief
+	This file implements the latency and queue depth statistics of the
+	IPACM event loop
+
+	@Author
+
+*/
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include "IPACM_EvtStats.h"
+#include "IPACM_EvtPool.h"
+#include "IPACM_CmdQueue.h"
+#include "IPACM_Defs.h"
+#include "IPACM_Iface.h"
+#include "IPACM_Log.h"
+
+extern uint32_t ipacm_event_stats[IPACM_EVENT_MAX];
+
+static const char *ipacm_cmd_shard_name[IPACM_CMD_SHARD_MAX] =
+{
+	"iface",
+	"nat"
+};
+
+ipacm_evt_hist IPACM_EvtStats::wait_hist[IPACM_EVENT_MAX];
+ipacm_evt_hist IPACM_EvtStats::exec_hist[IPACM_EVENT_MAX];
+
+/* Dump requests, written from the signal handler */
+static int dump_fd = -1;
+static pthread_once_t dump_fd_once = PTHREAD_ONCE_INIT;
+
+uint64_t IPACM_EvtStats::Now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void IPACM_EvtStats::Add(ipacm_evt_hist *hist, uint64_t ns)
+{
+	uint64_t us = ns / 1000;
+	uint32_t max, val;
+	int bucket = 0;
+
+	if(us > 0)
+	{
+		bucket = 64 - __builtin_clzll(us);
+		if(bucket >= IPACM_EVT_HIST_BUCKETS)
+		{
+			bucket = IPACM_EVT_HIST_BUCKETS - 1;
+		}
+	}
+	val = (us > UINT32_MAX) ? UINT32_MAX : (uint32_t)us;
+
+	/* both workers may account the same event */
+	__sync_fetch_and_add(&hist->cnt, 1);
+	__sync_fetch_and_add(&hist->sum_us, us);
+	__sync_fetch_and_add(&hist->bucket[bucket], 1);
+	max = __atomic_load_n(&hist->max_us, __ATOMIC_RELAXED);
+	while(val > max)
+	{
+		max = __sync_val_compare_and_swap(&hist->max_us, max, val);
+	}
+}
+
+void IPACM_EvtStats::RecordWait(int event, uint64_t posted_ns, uint64_t now_ns)
+{
+	if(event < 0 || event >= IPACM_EVENT_MAX || posted_ns == 0)
+	{
+		return;
+	}
+	Add(&wait_hist[event], now_ns > posted_ns ? now_ns - posted_ns : 0);
+}
+
+void IPACM_EvtStats::RecordExec(int event, uint64_t start_ns, uint64_t now_ns)
+{
+	if(event < 0 || event >= IPACM_EVENT_MAX)
+	{
+		return;
+	}
+	Add(&exec_hist[event], now_ns > start_ns ? now_ns - start_ns : 0);
+}
+
+static void CreateDumpFd(void)
+{
+	dump_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if(dump_fd < 0)
+	{
+		IPACMERR("unable to create stats dump eventfd: %s\n", strerror(errno));
+	}
+}
+
+int IPACM_EvtStats::GetDumpFd(void)
+{
+	pthread_once(&dump_fd_once, CreateDumpFd);
+	return dump_fd;
+}
+
+void IPACM_EvtStats::RequestDump(void)
+{
+	uint64_t one = 1;
+	int saved_errno = errno;
+
+	if(dump_fd >= 0 && write(dump_fd, &one, sizeof(one)) < 0)
+	{
+		/* nothing to do from a signal handler, the dump is just missed */
+	}
+	errno = saved_errno;
+}
+
+void IPACM_EvtStats::AckDump(void)
+{
+	uint64_t cnt;
+
+	if(dump_fd >= 0 && read(dump_fd, &cnt, sizeof(cnt)) < 0 && errno != EAGAIN)
+	{
+		IPACMERR("unable to read stats dump eventfd: %s\n", strerror(errno));
+	}
+}
+
+static void DumpHist(FILE *fp, const char *name, const ipacm_evt_hist *hist)
+{
+	int cnt;
+
+	fprintf(fp, "\"%s\":{\"count\":%u,\"sum\":%llu,\"max\":%u,\"hist\":[",
+		name, hist->cnt, (unsigned long long)hist->sum_us, hist->max_us);
+	for(cnt = 0; cnt < IPACM_EVT_HIST_BUCKETS; cnt++)
+	{
+		fprintf(fp, "%s%u", cnt ? "," : "", hist->bucket[cnt]);
+	}
+	fprintf(fp, "]}");
+}
+
+/* One JSON object: the histogram bucket bounds, the events seen with
+	 their wait and handler times, the queue depths and the pool usage */
+int IPACM_EvtStats::Dump(const char *path)
+{
+	char tmp_path[IPA_MAX_FILE_LEN];
+	const char *name;
+	ipacm_evt_pool_stats pool;
+	MessageQueue *queue;
+	FILE *fp;
+	bool first;
+	int cnt, lane;
+
+	if(snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >= (int)sizeof(tmp_path))
+	{
+		IPACMERR("stats file name %s is too long\n", path);
+		return IPACM_FAILURE;
+	}
+	fp = fopen(tmp_path, "w");
+	if(fp == NULL)
+	{
+		IPACMERR("unable to open %s: %s\n", tmp_path, strerror(errno));
+		return IPACM_FAILURE;
+	}
+
+	fprintf(fp, "{\"time_ms\":%llu,\"hist_us\":[",
+		(unsigned long long)(Now() / 1000000));
+	for(cnt = 0; cnt < IPACM_EVT_HIST_BUCKETS - 1; cnt++)
+	{
+		fprintf(fp, "%s%u", cnt ? "," : "", 1U << cnt);
+	}
+	fprintf(fp, "],\n\"events\":[");
+
+	first = true;
+	for(cnt = 0; cnt < IPACM_EVENT_MAX; cnt++)
+	{
+		if(wait_hist[cnt].cnt == 0 && exec_hist[cnt].cnt == 0)
+		{
+			continue;
+		}
+		name = IPACM_Iface::ipacmcfg->getEventName((ipa_cm_event_id)cnt);
+		fprintf(fp, "%s\n{\"id\":%d,\"name\":\"%s\",\"handled\":%u,",
+			first ? "" : ",", cnt, name ? name : "", ipacm_event_stats[cnt]);
+		DumpHist(fp, "wait_us", &wait_hist[cnt]);
+		fprintf(fp, ",");
+		DumpHist(fp, "exec_us", &exec_hist[cnt]);
+		fprintf(fp, "}");
+		first = false;
+	}
+
+	fprintf(fp, "],\n\"queues\":[");
+	first = true;
+	for(cnt = 0; cnt < IPACM_CMD_SHARD_MAX; cnt++)
+	{
+		for(lane = 0; lane < 2; lane++)
+		{
+			queue = lane ? MessageQueue::getInstanceExternal(cnt) :
+				MessageQueue::getInstanceInternal(cnt);
+			if(queue == NULL)
+			{
+				continue;
+			}
+			fprintf(fp, "%s\n{\"shard\":\"%s\",\"lane\":\"%s\",\"depth\":%d,\"peak\":%d}",
+				first ? "" : ",", ipacm_cmd_shard_name[cnt], lane ? "external" : "internal",
+				queue->GetDepth(), queue->GetPeakDepth());
+			first = false;
+		}
+	}
+
+	fprintf(fp, "],\n\"pools\":[");
+	for(cnt = 0; cnt < IPACM_EvtPool::GetPoolCnt(); cnt++)
+	{
+		IPACM_EvtPool::GetPool(cnt)->GetStats(&pool);
+		fprintf(fp, "%s\n{\"name\":\"%s\",\"size\":%d,\"in_use\":%d,\"peak\":%d,\"gets\":%u,\"misses\":%u}",
+			cnt ? "," : "", pool.name, pool.size, pool.in_use, pool.max_in_use,
+			pool.gets, pool.misses);
+	}
+	fprintf(fp, "]}\n");
+
+	if(fclose(fp) != 0)
+	{
+		IPACMERR("unable to write %s: %s\n", tmp_path, strerror(errno));
+		unlink(tmp_path);
+		return IPACM_FAILURE;
+	}
+	if(rename(tmp_path, path) != 0)
+	{
+		IPACMERR("unable to rename %s: %s\n", tmp_path, strerror(errno));
+		unlink(tmp_path);
+		return IPACM_FAILURE;
+	}
+
+	IPACMDBG_H("Dumped event loop statistics to %s\n", path);
+	return IPACM_SUCCESS;
+}
@@ -48,6 +48,7 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <IPACM_Wan.h>
 #include <IPACM_Iface.h>
 #include <IPACM_Log.h>
+#include <IPACM_ConntrackListener.h>
 
 iface_instances *IPACM_IfaceManager::head = NULL;
 
@@ -73,6 +74,7 @@ void IPACM_IfaceManager::event_callback(ipa_cm_event_id event, void *param)
 	ipacm_event_data_mac *StaData = (ipacm_event_data_mac *)param;
 	ipacm_event_data_all *data_all = (ipacm_event_data_all *)param;
 	ipacm_ifacemgr_data ifmgr_data;
+	ipacm_cmd_q_data cfg_evt;
 
 	memset(&ifmgr_data,0,sizeof(ifmgr_data));
 
@@ -80,7 +82,16 @@ void IPACM_IfaceManager::event_callback(ipa_cm_event_id event, void *param)
 	{
 		case IPA_CFG_CHANGE_EVENT:
 				IPACMDBG_H(" RESET IPACM_cfg \n");
+				/* the nat worker reads the config under ipacm_nat_lock */
+				pthread_mutex_lock(&ipacm_nat_lock);
 				IPACM_Iface::ipacmcfg->Init();
+				pthread_mutex_unlock(&ipacm_nat_lock);
+
+				/* tell the nat worker once the new config is in place */
+				memset(&cfg_evt, 0, sizeof(cfg_evt));
+				cfg_evt.event = IPA_CFG_RELOADED_EVENT;
+				cfg_evt.evt_data = NULL;
+				IPACM_EvtDispatcher::PostEvt(&cfg_evt);
 			break;
 		case IPA_BRIDGE_LINK_UP_EVENT:
 			IPACMDBG_H(" Save the bridge0 mac info in IPACM_cfg \n");
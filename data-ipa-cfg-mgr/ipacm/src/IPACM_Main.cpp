@@ -45,6 +45,7 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <sys/socket.h>
 #include <signal.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <pthread.h>
 #include <sys/ioctl.h>
@@ -54,11 +55,14 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <fcntl.h>
 #include <sys/inotify.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <signal.h>
 #include "linux/ipa_qmi_service_v01.h"
 
 #include "IPACM_CmdQueue.h"
 #include "IPACM_EvtDispatcher.h"
+#include "IPACM_EvtStats.h"
+#include "IPACM_Reactor.h"
 #include "IPACM_Defs.h"
 #include "IPACM_Neighbor.h"
 #include "IPACM_IfaceManager.h"
@@ -84,9 +88,11 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define IPACM_CFG_FILE_NAME    "IPACM_cfg.xml"
 #ifdef FEATURE_IPA_ANDROID
 #define IPACM_PID_FILE "/data/vendor/ipa/ipacm.pid"
+#define IPACM_STATS_FILE "/data/vendor/ipa/ipacm_stats.json"
 #define IPACM_DIR_NAME     "/data"
 #else/* defined(FEATURE_IPA_ANDROID) */
 #define IPACM_PID_FILE "/etc/ipacm.pid"
+#define IPACM_STATS_FILE "/etc/ipacm_stats.json"
 #define IPACM_DIR_NAME     "/etc"
 #endif /* defined(NOT FEATURE_IPA_ANDROID)*/
 #define IPACM_NAME "ipacm"
@@ -115,57 +121,47 @@ IPACM_IfaceManager *ifacemgr;
 #endif
 
 /* start netlink socket monitor*/
-void* netlink_start(void *param)
+int netlink_start(void)
 {
-	param = NULL;
-	ipa_nl_sk_fd_set_info_t sk_fdset;
 	int ret_val = 0;
-	memset(&sk_fdset, 0, sizeof(ipa_nl_sk_fd_set_info_t));
-	IPACMDBG_H("netlink starter memset sk_fdset succeeds\n");
+
 	ret_val = ipa_nl_listener_init(NETLINK_ROUTE, (RTMGRP_IPV4_ROUTE | RTMGRP_IPV6_ROUTE | RTMGRP_LINK |
 																										RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR | RTMGRP_NEIGH |
 																										RTNLGRP_IPV6_PREFIX),
-																 &sk_fdset, ipa_nl_recv_msg);
+																 ipa_nl_recv_msg);
 
 	if (ret_val != IPACM_SUCCESS)
 	{
 		IPACMERR("Failed to initialize IPA netlink event listener\n");
-		return NULL;
+		return IPACM_FAILURE;
 	}
 
-	return NULL;
+	return IPACM_SUCCESS;
 }
 
-/* start firewall-rule monitor*/
-void* firewall_monitor(void *param)
+/* read the firewall-rule monitor until it would block */
+int firewall_monitor_read(int inotify_fd, void *param)
 {
 	int length;
-	int wd;
 	char buffer[INOTIFY_BUF_LEN];
-	int inotify_fd;
 	ipacm_cmd_q_data evt_data;
-	uint32_t mask = IN_MODIFY | IN_MOVE;
-
-	param = NULL;
-	inotify_fd = inotify_init();
-	if (inotify_fd < 0)
-	{
-		PERROR("inotify_init");
-	}
-
-	IPACMDBG_H("Waiting for nofications in dir %s with mask: 0x%x\n", IPACM_DIR_NAME, mask);
-
-	wd = inotify_add_watch(inotify_fd,
-												 IPACM_DIR_NAME,
-												 mask);
 
+	(void)param;
 	while (1)
 	{
 		length = read(inotify_fd, buffer, INOTIFY_BUF_LEN);
 		if (length < 0)
 		{
-			IPACMERR("inotify read() error return length: %d and mask: 0x%x\n", length, mask);
-			continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				return IPACM_SUCCESS;
+			}
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			IPACMERR("inotify read() error return length: %d\n", length);
+			return IPACM_FAILURE;
 		}
 
 		struct inotify_event* event;
@@ -173,7 +169,7 @@ void* firewall_monitor(void *param)
 		if(event == NULL)
 		{
 			IPACMERR("Failed to allocate memory.\n");
-			return NULL;
+			return IPACM_FAILURE;
 		}
 		memset(event, 0, length);
 		memcpy(event, buffer, length);
@@ -214,16 +210,50 @@ void* firewall_monitor(void *param)
 		free(event);
 	}
 
-	(void)inotify_rm_watch(inotify_fd, wd);
-	(void)close(inotify_fd);
-	return NULL;
+	return IPACM_SUCCESS;
+}
+
+/* start firewall-rule monitor*/
+int firewall_monitor(void)
+{
+	int inotify_fd;
+	uint32_t mask = IN_MODIFY | IN_MOVE;
+
+	inotify_fd = inotify_init1(IN_CLOEXEC);
+	if (inotify_fd < 0)
+	{
+		PERROR("inotify_init");
+		return IPACM_FAILURE;
+	}
+
+	IPACMDBG_H("Waiting for nofications in dir %s with mask: 0x%x\n", IPACM_DIR_NAME, mask);
+
+	if (inotify_add_watch(inotify_fd, IPACM_DIR_NAME, mask) < 0 ||
+		IPACM_Reactor::GetInstance()->AddFd(inotify_fd, firewall_monitor_read, NULL) != IPACM_SUCCESS)
+	{
+		IPACMERR("unable to monitor dir %s\n", IPACM_DIR_NAME);
+		(void)close(inotify_fd);
+		return IPACM_FAILURE;
+	}
+
+	return IPACM_SUCCESS;
 }
 
+/* write the event loop statistics each time SIGHUP asks for them */
+int stats_dump_read(int fd, void *param)
+{
+	(void)fd;
+	(void)param;
+	IPACM_EvtStats::AckDump();
+	return IPACM_EvtStats::Dump(IPACM_STATS_FILE);
+}
 
-/* start IPACM wan-driver notifier */
-void* ipa_driver_msg_notifier(void *param)
+/* read and post the messages of the IPA driver. From the reactor the
+	 fd is non blocking and read until it would block, a blocking fd is
+	 read for good */
+int ipa_driver_msg_read(int fd, void *param)
 {
-	int length, fd, cnt;
+	int length, cnt;
 	char buffer[IPA_DRIVER_WLAN_BUF_LEN];
 	struct ipa_msg_meta event_hdr;
 	struct ipa_ecm_msg event_ecm;
@@ -249,14 +279,7 @@ void* ipa_driver_msg_notifier(void *param)
 	ipacm_cmd_q_data new_neigh_evt;
 	ipacm_event_data_all* new_neigh_data;
 
-	param = NULL;
-	fd = open(IPA_DRIVER, O_RDWR);
-	if (fd < 0)
-	{
-		IPACMERR("Failed opening %s.\n", IPA_DRIVER);
-		return NULL;
-	}
-
+	(void)param;
 	while (1)
 	{
 		IPACMDBG_H("Waiting for nofications from IPA driver \n");
@@ -272,6 +295,10 @@ void* ipa_driver_msg_notifier(void *param)
 		length = read(fd, buffer, IPA_DRIVER_WLAN_BUF_LEN);
 		if (length < 0)
 		{
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				return IPACM_SUCCESS;
+			}
 			PERROR("didn't read IPA_driver correctly");
 			continue;
 		}
@@ -306,7 +333,7 @@ void* ipa_driver_msg_notifier(void *param)
 			if(data_fid == NULL)
 			{
 				IPACMERR("unable to allocate memory for event_wlan data_fid\n");
-				return NULL;
+				return IPACM_FAILURE;
 			}
 			ipa_get_if_index(event_wlan->name, &(data_fid->if_index));
 			evt_data.event = IPA_WLAN_AP_LINK_UP_EVENT;
@@ -323,7 +350,7 @@ void* ipa_driver_msg_notifier(void *param)
 			if(data_fid == NULL)
 			{
 				IPACMERR("unable to allocate memory for event_wlan data_fid\n");
-				return NULL;
+				return IPACM_FAILURE;
 			}
 			ipa_get_if_index(event_wlan->name, &(data_fid->if_index));
 			evt_data.event = IPA_WLAN_LINK_DOWN_EVENT;
@@ -339,7 +366,7 @@ void* ipa_driver_msg_notifier(void *param)
 			if(data == NULL)
 			{
 				IPACMERR("unable to allocate memory for event_wlan data_fid\n");
-				return NULL;
+				return IPACM_FAILURE;
 			}
 			memcpy(data->mac_addr,
 				 event_wlan->mac_addr,
@@ -359,7 +386,7 @@ void* ipa_driver_msg_notifier(void *param)
 			if(data_fid == NULL)
 			{
 				IPACMERR("unable to allocate memory for event_wlan data_fid\n");
-				return NULL;
+				return IPACM_FAILURE;
 			}
 			ipa_get_if_index(event_wlan->name, &(data_fid->if_index));
 			evt_data.event = IPA_WLAN_LINK_DOWN_EVENT;
@@ -376,7 +403,7 @@ void* ipa_driver_msg_notifier(void *param)
 		        if (data == NULL)
 		        {
 		    	        IPACMERR("unable to allocate memory for event_wlan data\n");
-		    	        return NULL;
+		    	        return IPACM_FAILURE;
 		        }
 			memcpy(data->mac_addr,
 						 event_wlan->mac_addr,
@@ -393,7 +420,7 @@ void* ipa_driver_msg_notifier(void *param)
 			if(event_ex_o.num_of_attribs > IPA_DRIVER_WLAN_EVENT_MAX_OF_ATTRIBS)
 			{
 				IPACMERR("buffer size overflow\n");
-				return NULL;
+				return IPACM_FAILURE;
 			}
 			length = sizeof(ipa_wlan_msg_ex)+ event_ex_o.num_of_attribs * sizeof(ipa_wlan_hdr_attrib_val);
 			IPACMDBG_H("num_of_attribs %d, length %d\n", event_ex_o.num_of_attribs, length);
@@ -401,14 +428,14 @@ void* ipa_driver_msg_notifier(void *param)
 			if(event_ex == NULL )
 			{
 				IPACMERR("Unable to allocate memory\n");
-				return NULL;
+				return IPACM_FAILURE;
 			}
 			memcpy(event_ex, buffer + sizeof(struct ipa_msg_meta), length);
 			data_ex = (ipacm_event_data_wlan_ex *)malloc(sizeof(ipacm_event_data_wlan_ex) + event_ex_o.num_of_attribs * sizeof(ipa_wlan_hdr_attrib_val));
 		    if (data_ex == NULL)
 		    {
 				IPACMERR("unable to allocate memory for event data\n");
-		    	return NULL;
+		    	return IPACM_FAILURE;
 		    }
 			data_ex->num_of_attribs = event_ex->num_of_attribs;
 
@@ -425,7 +452,7 @@ void* ipa_driver_msg_notifier(void *param)
 			if(new_neigh_data == NULL)
 			{
 				IPACMERR("Failed to allocate memory.\n");
-				return NULL;
+				return IPACM_FAILURE;
 			}
 			memset(new_neigh_data, 0, sizeof(ipacm_event_data_all));
 			new_neigh_data->iptype = IPA_IP_v6;
@@ -463,7 +490,7 @@ void* ipa_driver_msg_notifier(void *param)
 		        if (data == NULL)
 		        {
 		    	        IPACMERR("unable to allocate memory for event_wlan data\n");
-		    	        return NULL;
+		    	        return IPACM_FAILURE;
 		        }
 			memcpy(data->mac_addr,
 						 event_wlan->mac_addr,
@@ -483,7 +510,7 @@ void* ipa_driver_msg_notifier(void *param)
 		        if (data == NULL)
 		        {
 		    	        IPACMERR("unable to allocate memory for event_wlan data\n");
-		    	        return NULL;
+		    	        return IPACM_FAILURE;
 		        }
 			memcpy(data->mac_addr,
 						 event_wlan->mac_addr,
@@ -503,7 +530,7 @@ void* ipa_driver_msg_notifier(void *param)
 		        if (data == NULL)
 		        {
 		    	       IPACMERR("unable to allocate memory for event_wlan data\n");
-		    	       return NULL;
+		    	       return IPACM_FAILURE;
 		        }
 			memcpy(data->mac_addr,
 						 event_wlan->mac_addr,
@@ -520,7 +547,7 @@ void* ipa_driver_msg_notifier(void *param)
 			if(data_fid == NULL)
 			{
 				IPACMERR("unable to allocate memory for event_ecm data_fid\n");
-				return NULL;
+				return IPACM_FAILURE;
 			}
 			data_fid->if_index = event_ecm.ifindex;
 			evt_data.event = IPA_USB_LINK_UP_EVENT;
@@ -534,7 +561,7 @@ void* ipa_driver_msg_notifier(void *param)
 			if(data_fid == NULL)
 			{
 				IPACMERR("unable to allocate memory for event_ecm data_fid\n");
-				return NULL;
+				return IPACM_FAILURE;
 			}
 			data_fid->if_index = event_ecm.ifindex;
 			evt_data.event = IPA_LINK_DOWN_EVENT;
@@ -548,7 +575,7 @@ void* ipa_driver_msg_notifier(void *param)
 			if(data_iptype == NULL)
 			{
 				IPACMERR("unable to allocate memory for event_ecm data_iptype\n");
-				return NULL;
+				return IPACM_FAILURE;
 			}
 			ipa_get_if_index(event_wan.upstream_ifname, &(data_iptype->if_index));
 			ipa_get_if_index(event_wan.tethered_ifname, &(data_iptype->if_index_tether));
@@ -575,7 +602,7 @@ void* ipa_driver_msg_notifier(void *param)
 			if(data_iptype == NULL)
 			{
 				IPACMERR("unable to allocate memory for event_ecm data_iptype\n");
-				return NULL;
+				return IPACM_FAILURE;
 			}
 			ipa_get_if_index(event_wan.upstream_ifname, &(data_iptype->if_index));
 			ipa_get_if_index(event_wan.tethered_ifname, &(data_iptype->if_index_tether));
@@ -594,7 +621,7 @@ void* ipa_driver_msg_notifier(void *param)
 			if(data_fid == NULL)
 			{
 				IPACMERR("unable to allocate memory for event data_fid\n");
-				return NULL;
+				return IPACM_FAILURE;
 			}
 			ipa_get_if_index(event_wan.upstream_ifname, &(data_fid->if_index));
 			evt_data.event = IPA_WAN_EMBMS_LINK_UP_EVENT;
@@ -637,7 +664,7 @@ void* ipa_driver_msg_notifier(void *param)
 			if(data_fid == NULL)
 			{
 				IPACMERR("unable to allocate memory for xlat event\n");
-				return NULL;
+				return IPACM_FAILURE;
 			}
 			ipa_get_if_index(event_wan.upstream_ifname, &(data_fid->if_index));
 			evt_data.event = IPA_LINK_UP_EVENT;
@@ -651,7 +678,7 @@ void* ipa_driver_msg_notifier(void *param)
 			if(data_fid == NULL)
 			{
 				IPACMERR("unable to allocate memory for xlat event\n");
-				return NULL;
+				return IPACM_FAILURE;
 			}
 			ipa_get_if_index(event_wan.upstream_ifname, &(data_fid->if_index));
 			evt_data.event = IPA_WAN_XLAT_CONNECT_EVENT;
@@ -665,7 +692,7 @@ void* ipa_driver_msg_notifier(void *param)
 			if(data_tethering_stats == NULL)
 			{
 				IPACMERR("unable to allocate memory for event data_tethering_stats\n");
-				return NULL;
+				return IPACM_FAILURE;
 			}
 			memcpy(data_tethering_stats,
 					 &event_data_stats,
@@ -682,7 +709,7 @@ void* ipa_driver_msg_notifier(void *param)
 			if(data_network_stats == NULL)
 			{
 				IPACMERR("unable to allocate memory for event data_network_stats\n");
-				return NULL;
+				return IPACM_FAILURE;
 			}
 			memcpy(data_network_stats,
 					 &event_network_stats,
@@ -733,7 +760,7 @@ void* ipa_driver_msg_notifier(void *param)
 			if(vlan_info == NULL)
 			{
 				IPACMERR("Failed to allocate memory.\n");
-				return NULL;
+				return IPACM_FAILURE;
 			}
 			memcpy(vlan_info, buffer + sizeof(struct ipa_msg_meta), sizeof(*vlan_info));
 			evt_data.event = IPA_ADD_VLAN_IFACE;
@@ -745,7 +772,7 @@ void* ipa_driver_msg_notifier(void *param)
 			if(vlan_info == NULL)
 			{
 				IPACMERR("Failed to allocate memory.\n");
-				return NULL;
+				return IPACM_FAILURE;
 			}
 			memcpy(vlan_info, buffer + sizeof(struct ipa_msg_meta), sizeof(*vlan_info));
 			evt_data.event = IPA_DEL_VLAN_IFACE;
@@ -757,7 +784,7 @@ void* ipa_driver_msg_notifier(void *param)
 			if(mapping == NULL)
 			{
 				IPACMERR("Failed to allocate memory.\n");
-				return NULL;
+				return IPACM_FAILURE;
 			}
 			memcpy(mapping, buffer + sizeof(struct ipa_msg_meta), sizeof(*mapping));
 			evt_data.event = IPA_ADD_L2TP_VLAN_MAPPING;
@@ -769,7 +796,7 @@ void* ipa_driver_msg_notifier(void *param)
 			if(mapping == NULL)
 			{
 				IPACMERR("Failed to allocate memory.\n");
-				return NULL;
+				return IPACM_FAILURE;
 			}
 			memcpy(mapping, buffer + sizeof(struct ipa_msg_meta), sizeof(*mapping));
 			evt_data.event = IPA_DEL_L2TP_VLAN_MAPPING;
@@ -792,6 +819,15 @@ void* ipa_driver_msg_notifier(void *param)
 		}
 	}
 
+	return IPACM_FAILURE;
+}
+
+/* start IPACM wan-driver notifier, for a driver the reactor cannot poll */
+void* ipa_driver_msg_notifier(void *param)
+{
+	int fd = (int)(intptr_t)param;
+
+	ipa_driver_msg_read(fd, NULL);
 	(void)close(fd);
 	return NULL;
 }
@@ -800,6 +836,13 @@ void IPACM_Sig_Handler(int sig)
 {
 	ipacm_cmd_q_data evt_data;
 
+	/* only wakes the reactor, nothing else is safe here */
+	if(sig == SIGHUP)
+	{
+		IPACM_EvtStats::RequestDump();
+		return;
+	}
+
 	printf("Received Signal: %d\n", sig);
 	memset(&evt_data, 0, sizeof(evt_data));
 
@@ -828,14 +871,27 @@ void RegisterForSignals(void)
 
 	signal(SIGUSR1, IPACM_Sig_Handler);
 	signal(SIGUSR2, IPACM_Sig_Handler);
+	/* the dump fd must exist before the handler writes to it */
+	if(IPACM_EvtStats::GetDumpFd() >= 0)
+	{
+		signal(SIGHUP, IPACM_Sig_Handler);
+	}
 }
 
 
 int main(int argc, char **argv)
 {
 	int ret;
-	pthread_t netlink_thread = 0, monitor_thread = 0, ipa_driver_thread = 0;
-	pthread_t cmd_queue_thread = 0;
+	int fd;
+	pthread_t ipa_driver_thread = 0;
+	IPACM_Reactor *reactor;
+	pthread_t cmd_queue_thread[IPACM_CMD_SHARD_MAX] = {0};
+	static const char *cmd_queue_name[IPACM_CMD_SHARD_MAX] =
+	{
+		"cmd queue iface",
+		"cmd queue nat"
+	};
+	int shard;
 
 	/* check if ipacm is already running or not */
 	ipa_is_ipacm_running();
@@ -865,57 +921,52 @@ int main(int argc, char **argv)
 
 	RegisterForSignals();
 
-	if (IPACM_SUCCESS == cmd_queue_thread)
+	/* one command queue thread per worker */
+	for (shard = 0; shard < IPACM_CMD_SHARD_MAX; shard++)
 	{
-		ret = pthread_create(&cmd_queue_thread, NULL, MessageQueue::Process, NULL);
+		ret = pthread_create(&cmd_queue_thread[shard], NULL, MessageQueue::Process,
+				(void *)(intptr_t)shard);
 		if (IPACM_SUCCESS != ret)
 		{
 			IPACMERR("unable to command queue thread\n");
 			return ret;
 		}
-		IPACMDBG_H("created command queue thread\n");
-		if(pthread_setname_np(cmd_queue_thread, "cmd queue process") != 0)
+		IPACMDBG_H("created command queue thread %d\n", shard);
+		if(pthread_setname_np(cmd_queue_thread[shard], cmd_queue_name[shard]) != 0)
 		{
 			IPACMERR("unable to set thread name\n");
 		}
 	}
 
-	if (IPACM_SUCCESS == netlink_thread)
+	reactor = IPACM_Reactor::GetInstance();
+	if (reactor == NULL)
 	{
-		ret = pthread_create(&netlink_thread, NULL, netlink_start, NULL);
-		if (IPACM_SUCCESS != ret)
-		{
-			IPACMERR("unable to create netlink thread\n");
-			return ret;
-		}
-		IPACMDBG_H("created netlink thread\n");
-		if(pthread_setname_np(netlink_thread, "netlink socket") != 0)
-		{
-			IPACMERR("unable to set thread name\n");
-		}
+		IPACMERR("unable to create the reactor\n");
+		return IPACM_FAILURE;
+	}
+
+	if (netlink_start() != IPACM_SUCCESS)
+	{
+		IPACMERR("unable to start netlink listener\n");
 	}
 
 	/* Enable Firewall support only on MDM targets */
 #ifndef FEATURE_IPA_ANDROID
-	if (IPACM_SUCCESS == monitor_thread)
+	if (firewall_monitor() != IPACM_SUCCESS)
 	{
-		ret = pthread_create(&monitor_thread, NULL, firewall_monitor, NULL);
-		if (IPACM_SUCCESS != ret)
-		{
-			IPACMERR("unable to create monitor thread\n");
-			return ret;
-		}
-		IPACMDBG_H("created firewall monitor thread\n");
-		if(pthread_setname_np(monitor_thread, "firewall cfg process") != 0)
-		{
-			IPACMERR("unable to set thread name\n");
-		}
+		IPACMERR("unable to start firewall monitor\n");
 	}
 #endif
 
-	if (IPACM_SUCCESS == ipa_driver_thread)
+	fd = open(IPA_DRIVER, O_RDWR);
+	if (fd < 0)
+	{
+		IPACMERR("Failed opening %s.\n", IPA_DRIVER);
+	}
+	else if (reactor->AddFd(fd, ipa_driver_msg_read, NULL) != IPACM_SUCCESS)
 	{
-		ret = pthread_create(&ipa_driver_thread, NULL, ipa_driver_msg_notifier, NULL);
+		/* the driver cannot be polled, keep blocking reads on their own thread */
+		ret = pthread_create(&ipa_driver_thread, NULL, ipa_driver_msg_notifier, (void *)(intptr_t)fd);
 		if (IPACM_SUCCESS != ret)
 		{
 			IPACMERR("unable to create ipa_driver_wlan thread\n");
@@ -928,10 +979,23 @@ int main(int argc, char **argv)
 		}
 	}
 
-	pthread_join(cmd_queue_thread, NULL);
-	pthread_join(netlink_thread, NULL);
-	pthread_join(monitor_thread, NULL);
-	pthread_join(ipa_driver_thread, NULL);
+	if (IPACM_EvtStats::GetDumpFd() >= 0 &&
+		reactor->AddFd(IPACM_EvtStats::GetDumpFd(), stats_dump_read, NULL) != IPACM_SUCCESS)
+	{
+		IPACMERR("unable to watch the stats dump requests\n");
+	}
+
+	IPACMDBG_H("running the reactor\n");
+	reactor->Run();
+
+	for (shard = 0; shard < IPACM_CMD_SHARD_MAX; shard++)
+	{
+		pthread_join(cmd_queue_thread[shard], NULL);
+	}
+	if (ipa_driver_thread != 0)
+	{
+		pthread_join(ipa_driver_thread, NULL);
+	}
 	return IPACM_SUCCESS;
 }
 
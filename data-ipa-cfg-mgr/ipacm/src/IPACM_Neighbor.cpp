@@ -42,6 +42,7 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <IPACM_Neighbor.h>
 #include <IPACM_EvtDispatcher.h>
 #include "IPACM_Defs.h"
+#include "IPACM_EvtPool.h"
 #include "IPACM_Log.h"
 
 
@@ -121,10 +122,10 @@ void IPACM_Neighbor::event_callback(ipa_cm_event_id event, void *param)
 						if (neighbor_client[i].v4_addr != 0) /* not 0.0.0.0 */
 						{
 							evt_data.event = IPA_NEIGH_CLIENT_IP_ADDR_ADD_EVENT;
-							data_all = (ipacm_event_data_all *)malloc(sizeof(ipacm_event_data_all));
+							data_all = (ipacm_event_data_all *)ipacm_neigh_evt_pool.Get();
 							if (data_all == NULL)
 							{
-								IPACMERR("Unable to allocate memory\n");
+								IPACMDBG("no neighbor event free, dropping event\n");
 								return;
 							}
 							memset(data_all,0,sizeof(ipacm_event_data_all));
@@ -204,10 +205,10 @@ void IPACM_Neighbor::event_callback(ipa_cm_event_id event, void *param)
 								else
 									/* not to clean-up the client mac cache on bridge0 delneigh */
 									evt_data.event = IPA_NEIGH_CLIENT_IP_ADDR_DEL_EVENT;
-								data_all = (ipacm_event_data_all *)malloc(sizeof(ipacm_event_data_all));
+								data_all = (ipacm_event_data_all *)ipacm_neigh_evt_pool.Get();
 								if (data_all == NULL)
 								{
-									IPACMERR("Unable to allocate memory\n");
+									IPACMDBG("no neighbor event free, dropping event\n");
 									return;
 								}
 								memcpy(data_all, data, sizeof(ipacm_event_data_all));
@@ -345,10 +346,10 @@ void IPACM_Neighbor::event_callback(ipa_cm_event_id event, void *param)
 							/* not find client, no need clean-up */
 						}
 
-						data_all = (ipacm_event_data_all *)malloc(sizeof(ipacm_event_data_all));
+						data_all = (ipacm_event_data_all *)ipacm_neigh_evt_pool.Get();
 						if (data_all == NULL)
 						{
-							IPACMERR("Unable to allocate memory\n");
+							IPACMDBG("no neighbor event free, dropping event\n");
 							return;
 						}
 						memcpy(data_all, data, sizeof(ipacm_event_data_all));
@@ -378,10 +379,10 @@ void IPACM_Neighbor::event_callback(ipa_cm_event_id event, void *param)
 								/* construct IPA_NEIGH_CLIENT_IP_ADDR_ADD_EVENT command and insert to command-queue */
 								if (event == IPA_NEW_NEIGH_EVENT) evt_data.event = IPA_NEIGH_CLIENT_IP_ADDR_ADD_EVENT;
 								else evt_data.event = IPA_NEIGH_CLIENT_IP_ADDR_DEL_EVENT;
-								data_all = (ipacm_event_data_all *)malloc(sizeof(ipacm_event_data_all));
+								data_all = (ipacm_event_data_all *)ipacm_neigh_evt_pool.Get();
 								if (data_all == NULL)
 								{
-									IPACMERR("Unable to allocate memory\n");
+									IPACMDBG("no neighbor event free, dropping event\n");
 									return;
 								}
 								memcpy(data_all, data, sizeof(ipacm_event_data_all));
@@ -409,10 +410,10 @@ void IPACM_Neighbor::event_callback(ipa_cm_event_id event, void *param)
 							evt_data.event = IPA_NEIGH_CLIENT_IP_ADDR_ADD_EVENT;
 						else
 							evt_data.event = IPA_NEIGH_CLIENT_IP_ADDR_DEL_EVENT;
-						data_all = (ipacm_event_data_all *)malloc(sizeof(ipacm_event_data_all));
+						data_all = (ipacm_event_data_all *)ipacm_neigh_evt_pool.Get();
 						if (data_all == NULL)
 						{
-							IPACMERR("Unable to allocate memory\n");
+							IPACMDBG("no neighbor event free, dropping event\n");
 							return;
 						}
 						memcpy(data_all, data, sizeof(ipacm_event_data_all));
@@ -464,10 +465,10 @@ void IPACM_Neighbor::event_callback(ipa_cm_event_id event, void *param)
 										evt_data.event = IPA_NEIGH_CLIENT_IP_ADDR_ADD_EVENT;
 									else
 										evt_data.event = IPA_NEIGH_CLIENT_IP_ADDR_DEL_EVENT;
-									data_all = (ipacm_event_data_all *)malloc(sizeof(ipacm_event_data_all));
+									data_all = (ipacm_event_data_all *)ipacm_neigh_evt_pool.Get();
 									if (data_all == NULL)
 									{
-										IPACMERR("Unable to allocate memory\n");
+										IPACMDBG("no neighbor event free, dropping event\n");
 										return;
 									}
 									data_all->iptype = IPA_IP_v4;
@@ -38,6 +38,7 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 */
 #include <string.h>
+#include <errno.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
 #include <netinet/in.h>
@@ -45,11 +46,16 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "IPACM_Defs.h"
 #include "IPACM_Netlink.h"
 #include "IPACM_EvtDispatcher.h"
+#include "IPACM_EvtPool.h"
+#include "IPACM_Reactor.h"
 #include "IPACM_Log.h"
 
 int ipa_get_if_name(char *if_name, int if_index);
 int find_mask(int ip_v4_last, int *mask_value);
 
+/* ipa_nl_recv found the socket drained */
+#define IPA_NL_RECV_EMPTY 1
+
 #ifdef FEATURE_IPA_ANDROID
 
 #define IPACM_NL_COPY_ADDR( event_info, element )                                        \
@@ -171,85 +177,6 @@ static int ipa_nl_open_socket
 	return IPACM_SUCCESS;
 }
 
-/* Add fd to fdmap array and store read handler function ptr (up to MAX_NUM_OF_FD).*/
-static int ipa_nl_addfd_map
-(
-	 ipa_nl_sk_fd_set_info_t *info,
-	 int fd,
-	 ipa_sock_thrd_fd_read_f read_f
-	 )
-{
-	if(info->num_fd < MAX_NUM_OF_FD)
-	{
-		FD_SET(fd, &info->fdset);
-
-		/* Add fd to fdmap array and store read handler function ptr */
-		info->sk_fds[info->num_fd].sk_fd = fd;
-		info->sk_fds[info->num_fd].read_func = read_f;
-
-		/* Increment number of fds stored in fdmap */
-		info->num_fd++;
-		if(info->max_fd < fd)
-			info->max_fd = fd;
-	}
-	else
-	{
-		return IPACM_FAILURE;
-	}
-
-	return IPACM_SUCCESS;
-}
-
-/*  start socket listener */
-static int ipa_nl_sock_listener_start
-(
-	 ipa_nl_sk_fd_set_info_t *sk_fd_set
-	 )
-{
-	int i, ret;
-
-	while(true)
-	{
-	    for(i = 0; i < sk_fd_set->num_fd; i++ )
-		{
-			FD_SET(sk_fd_set->sk_fds[i].sk_fd, &(sk_fd_set->fdset));
-		}
-
-		if((ret = select(sk_fd_set->max_fd + 1, &(sk_fd_set->fdset), NULL, NULL, NULL)) < 0)
-		{
-			IPACMERR("ipa_nl select failed\n");
-		}
-		else
-		{
-			for(i = 0; i < sk_fd_set->num_fd; i++)
-			{
-
-				if(FD_ISSET(sk_fd_set->sk_fds[i].sk_fd, &(sk_fd_set->fdset)))
-				{
-
-					if(sk_fd_set->sk_fds[i].read_func)
-					{
-						if(IPACM_SUCCESS != ((sk_fd_set->sk_fds[i].read_func)(sk_fd_set->sk_fds[i].sk_fd)))
-						{
-							IPACMERR("Error on read callback[%d] fd=%d\n",
-											 i,
-											 sk_fd_set->sk_fds[i].sk_fd);
-						}
-						FD_CLR(sk_fd_set->sk_fds[i].sk_fd, &(sk_fd_set->fdset));
-					}
-					else
-					{
-						IPACMERR("No read function\n");
-					}
-				}
-
-			} /* end of for loop*/
-		} /* end of else */
-	} /* end of while */
-
-	return IPACM_SUCCESS;
-}
-
 /* allocate memory for ipa_nl__msg */
 static struct msghdr* ipa_nl_alloc_msg
 (
@@ -358,7 +285,9 @@ static void ipa_nl_release_msg
 	return;
 }
 
-/* receive and process nl message */
+/* receive and process nl message, IPA_NL_RECV_EMPTY once the socket
+	 would block. On failure errno tells a message was lost (ENOBUFS),
+	 bad (EBADMSG) or the socket failed */
 static int ipa_nl_recv
 (
 	 int              fd,
@@ -367,12 +296,13 @@ static int ipa_nl_recv
 	 )
 {
 	struct msghdr *msgh = NULL;
-	int rmsgl;
+	int rmsgl, err;
 
 	msgh = ipa_nl_alloc_msg(IPA_NL_MSG_MAX_LEN);
 	if(NULL == msgh)
 	{
 		IPACMERR("Failed to allocate NL message\n");
+		err = ENOMEM;
 		goto error;
 	}
 
@@ -383,6 +313,14 @@ static int ipa_nl_recv
 	/* Verify that something was read */
 	if(rmsgl <= 0)
 	{
+		err = (rmsgl < 0) ? errno : EBADMSG;
+		if(err == EAGAIN || err == EWOULDBLOCK)
+		{
+			ipa_nl_release_msg(msgh);
+			*msg_pptr    = NULL;
+			*msglen_ptr  = 0;
+			return IPA_NL_RECV_EMPTY;
+		}
 		PERROR("NL recv error");
 		goto error;
 	}
@@ -391,6 +329,7 @@ static int ipa_nl_recv
 	if(sizeof(struct sockaddr_nl) != msgh->msg_namelen)
 	{
 		IPACMERR("rcvd msg with namelen != sizeof sockaddr_nl\n");
+		err = EBADMSG;
 		goto error;
 	}
 
@@ -398,6 +337,7 @@ static int ipa_nl_recv
 	if(msgh->msg_flags & MSG_TRUNC)
 	{
 		IPACMERR("Rcvd msg truncated!\n");
+		err = EBADMSG;
 		goto error;
 	}
 
@@ -412,6 +352,7 @@ error:
 	ipa_nl_release_msg(msgh);
 	*msg_pptr    = NULL;
 	*msglen_ptr  = 0;
+	errno = err;
 
 	return IPACM_FAILURE;
 }
@@ -1378,11 +1319,12 @@ static int ipa_nl_decode_nlmsg
 			}
 
 			/* insert to command queue */
-		    data_all = (ipacm_event_data_all *)malloc(sizeof(ipacm_event_data_all));
+		    /* Shed the event when the pool is exhausted, the pool counts it */
+		    data_all = (ipacm_event_data_all *)ipacm_neigh_evt_pool.Get();
 		    if(data_all == NULL)
 			{
-		    	IPACMERR("unable to allocate memory for event data_all\n");
-						return IPACM_FAILURE;
+		    	IPACMDBG("no neighbor event free, dropping RTM_NEWNEIGH\n");
+				break;
 			}
 
 		    memset(data_all, 0, sizeof(ipacm_event_data_all));
@@ -1466,11 +1408,11 @@ static int ipa_nl_decode_nlmsg
 			}
 
 				/* insert to command queue */
-				data_all = (ipacm_event_data_all *)malloc(sizeof(ipacm_event_data_all));
+				data_all = (ipacm_event_data_all *)ipacm_neigh_evt_pool.Get();
 				if(data_all == NULL)
 				{
-					IPACMERR("unable to allocate memory for event data_all\n");
-					return IPACM_FAILURE;
+					IPACMDBG("no neighbor event free, dropping RTM_DELNEIGH\n");
+					break;
 				}
 
 		    memset(data_all, 0, sizeof(ipacm_event_data_all));
@@ -1532,32 +1474,41 @@ static int ipa_nl_decode_nlmsg
 }
 
 
-/*  Virtual function registered to receive incoming messages over the NETLINK routing socket*/
-int ipa_nl_recv_msg(int fd)
+/*  Reactor handler of the NETLINK routing socket, reads and decodes the
+		messages until the socket would block */
+int ipa_nl_recv_msg(int fd, void *param)
 {
 	struct msghdr *msghdr = NULL;
 	struct iovec *iov = NULL;
 	unsigned int msglen = 0;
 	ipa_nl_msg_t *nlmsg = NULL;
+	int ret;
 
+	(void)param;
 	nlmsg = (ipa_nl_msg_t *)malloc(sizeof(ipa_nl_msg_t));
 	if(NULL == nlmsg)
 	{
 		IPACMERR("Failed alloc of nlmsg \n");
-		goto error;
+		return IPACM_FAILURE;
 	}
-	else
+
+	while(1)
 	{
-		if(IPACM_SUCCESS != ipa_nl_recv(fd, &msghdr, &msglen))
+		ret = ipa_nl_recv(fd, &msghdr, &msglen);
+		if(ret == IPA_NL_RECV_EMPTY)
 		{
-			IPACMERR("Failed to receive nl message \n");
-			goto error;
+			ret = IPACM_SUCCESS;
+			break;
 		}
-
-		if(msghdr== NULL)
+		if(ret != IPACM_SUCCESS)
 		{
-			IPACMERR(" failed to get msghdr\n");
-			goto error;
+			/* only this message is lost, read on */
+			if(errno == ENOBUFS || errno == EBADMSG || errno == EINTR)
+			{
+				continue;
+			}
+			IPACMERR("Failed to receive nl message \n");
+			break;
 		}
 
 		iov = msghdr->msg_iov;
@@ -1566,32 +1517,14 @@ int ipa_nl_recv_msg(int fd)
 		if(IPACM_SUCCESS != ipa_nl_decode_nlmsg((char *)iov->iov_base, msglen, nlmsg))
 		{
 			IPACMERR("Failed to decode nl message \n");
-			goto error;
 		}
 		/* Release NetLink message buffer */
-		if(msghdr)
-		{
-			ipa_nl_release_msg(msghdr);
-		}
-		if(nlmsg)
-		{
-			free(nlmsg);
-		}
-	}
-
-	return IPACM_SUCCESS;
-
-error:
-	if(msghdr)
-	{
 		ipa_nl_release_msg(msghdr);
-	}
-	if(nlmsg)
-	{
-		free(nlmsg);
+		msghdr = NULL;
 	}
 
-	return IPACM_FAILURE;
+	free(nlmsg);
+	return ret;
 }
 
 /*  get ipa interface name */
@@ -1633,12 +1566,11 @@ int ipa_nl_listener_init
 (
 	 unsigned int nl_type,
 	 unsigned int nl_groups,
-	 ipa_nl_sk_fd_set_info_t *sk_fdset,
 	 ipa_sock_thrd_fd_read_f read_f
 	 )
 {
 	ipa_nl_sk_info_t sk_info;
-	int ret_val;
+	IPACM_Reactor *reactor;
 
 	memset(&sk_info, 0, sizeof(ipa_nl_sk_info_t));
 	IPACMDBG_H("Entering IPA NL listener init\n");
@@ -1653,24 +1585,15 @@ int ipa_nl_listener_init
 		return IPACM_FAILURE;
 	}
 
-	/* Add NETLINK socket to the list of sockets that the listener
-					 thread should listen on. */
-
-	if(ipa_nl_addfd_map(sk_fdset, sk_info.sk_fd, read_f) != IPACM_SUCCESS)
+	/* The reactor reads the NETLINK socket from now on */
+	reactor = IPACM_Reactor::GetInstance();
+	if(reactor == NULL || reactor->AddFd(sk_info.sk_fd, read_f, NULL) != IPACM_SUCCESS)
 	{
 		IPACMERR("cannot add nl routing sock for reading\n");
 		close(sk_info.sk_fd);
 		return IPACM_FAILURE;
 	}
 
-	/* Start the socket listener thread */
-	ret_val = ipa_nl_sock_listener_start(sk_fdset);
-
-	if(ret_val != IPACM_SUCCESS)
-	{
-		IPACMERR("Failed to start NL listener\n");
-	}
-
 	return IPACM_SUCCESS;
 }
 
@@ -167,8 +167,8 @@ RET IPACM_OffloadManager::provideFd(int fd, unsigned int groups)
 		IPACMERR("Received unexpected fd with groups %d.\n", groups);
 	}
 	if(cc->fd_tcp >0 && cc->fd_udp >0) {
-		IPACMDBG_H(" Got both fds from framework, start conntrack listener thread.\n");
-		CtList->CreateConnTrackThreads();
+		IPACMDBG_H(" Got both fds from framework, start conntrack listeners.\n");
+		CtList->CreateConnTrackListeners();
 	}
 	return SUCCESS;
 }
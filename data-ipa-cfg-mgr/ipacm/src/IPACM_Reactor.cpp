@@ -0,0 +1,245 @@
+/*
+Copyright (c) 2013-2018, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+		* Redistributions of source code must retain the above copyright
+			notice, this list of conditions and the following disclaimer.
+		* Redistributions in binary form must reproduce the above
+			copyright notice, this list of conditions and the following
+			disclaimer in the documentation and/or other materials provided
+			with the distribution.
+		* Neither the name of The Linux Foundation nor the names of its
+			contributors may be used to endorse or promote products derived
+			from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*!
+	@file
+	IPACM_Reactor.cpp
+
+	@brief
+	This file implements the epoll loop reading the IPACM sockets
+
+	@Author
+
+*/
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <new>
+#include <sys/epoll.h>
+#include "IPACM_Reactor.h"
+#include "IPACM_CmdQueue.h"
+#include "IPACM_Defs.h"
+#include "IPACM_Log.h"
+
+IPACM_Reactor *IPACM_Reactor::pInstance = NULL;
+pthread_once_t IPACM_Reactor::inst_once = PTHREAD_ONCE_INIT;
+
+IPACM_Reactor::IPACM_Reactor()
+{
+	int cnt;
+
+	running = false;
+	busy = -1;
+	pthread_mutex_init(&lock, NULL);
+	pthread_cond_init(&idle, NULL);
+	for(cnt = 0; cnt < IPACM_REACTOR_MAX_FDS; cnt++)
+	{
+		srcs[cnt].fd = -1;
+		srcs[cnt].gen = 0;
+		srcs[cnt].read_f = NULL;
+		srcs[cnt].param = NULL;
+	}
+
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if(epoll_fd < 0)
+	{
+		IPACMERR("unable to create epoll fd: %s\n", strerror(errno));
+	}
+}
+
+void IPACM_Reactor::CreateInstance(void)
+{
+	pInstance = new (std::nothrow) IPACM_Reactor();
+	if(pInstance != NULL && pInstance->epoll_fd < 0)
+	{
+		delete pInstance;
+		pInstance = NULL;
+	}
+}
+
+IPACM_Reactor* IPACM_Reactor::GetInstance(void)
+{
+	pthread_once(&inst_once, CreateInstance);
+	if(pInstance == NULL)
+	{
+		IPACMERR("unable to create reactor instance\n");
+	}
+	return pInstance;
+}
+
+int IPACM_Reactor::AddFd(int fd, ipacm_reactor_read_f read_f, void *param)
+{
+	struct epoll_event ev;
+	int slot, flags, err;
+
+	pthread_mutex_lock(&lock);
+	for(slot = 0; slot < IPACM_REACTOR_MAX_FDS; slot++)
+	{
+		if(srcs[slot].fd < 0)
+		{
+			break;
+		}
+	}
+	if(slot == IPACM_REACTOR_MAX_FDS)
+	{
+		pthread_mutex_unlock(&lock);
+		IPACMERR("no room to watch fd %d\n", fd);
+		errno = ENOSPC;
+		return IPACM_FAILURE;
+	}
+
+	/* a stale event of the slot carries the old generation */
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN | EPOLLET;
+	ev.data.u64 = ((uint64_t)srcs[slot].gen << 32) | (uint32_t)slot;
+	if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0)
+	{
+		err = errno;
+		pthread_mutex_unlock(&lock);
+		IPACMERR("unable to watch fd %d: %s\n", fd, strerror(err));
+		errno = err;
+		return IPACM_FAILURE;
+	}
+
+	flags = fcntl(fd, F_GETFL, 0);
+	if(flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+	{
+		err = errno;
+		epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+		pthread_mutex_unlock(&lock);
+		IPACMERR("unable to set fd %d non blocking: %s\n", fd, strerror(err));
+		errno = err;
+		return IPACM_FAILURE;
+	}
+
+	srcs[slot].fd = fd;
+	srcs[slot].read_f = read_f;
+	srcs[slot].param = param;
+	pthread_mutex_unlock(&lock);
+
+	IPACMDBG_H("watching fd %d in slot %d\n", fd, slot);
+	return IPACM_SUCCESS;
+}
+
+int IPACM_Reactor::DelFd(int fd)
+{
+	int slot;
+
+	pthread_mutex_lock(&lock);
+	for(slot = 0; slot < IPACM_REACTOR_MAX_FDS; slot++)
+	{
+		if(srcs[slot].fd == fd)
+		{
+			break;
+		}
+	}
+	if(slot == IPACM_REACTOR_MAX_FDS)
+	{
+		pthread_mutex_unlock(&lock);
+		IPACMERR("fd %d is not watched\n", fd);
+		return IPACM_FAILURE;
+	}
+
+	if(epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL) < 0)
+	{
+		IPACMERR("unable to stop watching fd %d: %s\n", fd, strerror(errno));
+	}
+	srcs[slot].fd = -1;
+	srcs[slot].gen++;
+
+	/* a handler removing its own fd does not wait for itself */
+	while(busy == slot && !(running && pthread_equal(thread, pthread_self())))
+	{
+		pthread_cond_wait(&idle, &lock);
+	}
+	pthread_mutex_unlock(&lock);
+
+	return IPACM_SUCCESS;
+}
+
+int IPACM_Reactor::Run(void)
+{
+	struct epoll_event evs[IPACM_REACTOR_MAX_FDS];
+	ipacm_reactor_src src;
+	uint32_t slot;
+	int num, cnt;
+
+	pthread_mutex_lock(&lock);
+	thread = pthread_self();
+	running = true;
+	pthread_mutex_unlock(&lock);
+
+	while(1)
+	{
+		num = epoll_wait(epoll_fd, evs, IPACM_REACTOR_MAX_FDS, -1);
+		if(num < 0)
+		{
+			if(errno == EINTR)
+			{
+				continue;
+			}
+			IPACMERR("epoll_wait failed: %s\n", strerror(errno));
+			break;
+		}
+
+		/* the workers are woken once all the ready fds were read */
+		MessageQueue::BeginBatch();
+		for(cnt = 0; cnt < num; cnt++)
+		{
+			slot = (uint32_t)evs[cnt].data.u64;
+
+			pthread_mutex_lock(&lock);
+			if(slot >= IPACM_REACTOR_MAX_FDS || srcs[slot].fd < 0 ||
+				 srcs[slot].gen != (uint32_t)(evs[cnt].data.u64 >> 32))
+			{
+				pthread_mutex_unlock(&lock);
+				continue;
+			}
+			src = srcs[slot];
+			busy = slot;
+			pthread_mutex_unlock(&lock);
+
+			if(src.read_f(src.fd, src.param) != IPACM_SUCCESS)
+			{
+				IPACMERR("Error on read callback of fd=%d\n", src.fd);
+			}
+
+			pthread_mutex_lock(&lock);
+			busy = -1;
+			pthread_cond_broadcast(&idle);
+			pthread_mutex_unlock(&lock);
+		}
+		MessageQueue::EndBatch();
+	}
+
+	pthread_mutex_lock(&lock);
+	running = false;
+	pthread_mutex_unlock(&lock);
+	return IPACM_FAILURE;
+}
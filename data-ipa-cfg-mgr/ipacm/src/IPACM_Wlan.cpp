@@ -763,7 +763,9 @@ void IPACM_Wlan::event_callback(ipa_cm_event_id event, void *param)
 						IPACMDBG_H("Adding Route Rules\n");
 						handle_wlan_client_route_rule(data->mac_addr, IPA_IP_v4);
 						IPACMDBG_H("Adding Nat Rules\n");
+						pthread_mutex_lock(&ipacm_nat_lock);
 						Nat_App->ResetPwrSaveIf(get_client_memptr(wlan_client, wlan_index)->v4_addr);
+						pthread_mutex_unlock(&ipacm_nat_lock);
 					}
 
 					if(get_client_memptr(wlan_client, wlan_index)->ipv6_set != 0) /* for ipv6 */
@@ -1581,7 +1583,9 @@ int IPACM_Wlan::handle_wlan_client_pwrsave(uint8_t *mac_addr)
 	    if(get_client_memptr(wlan_client, clt_indx)->ipv4_set == true)
 	    {
 			IPACMDBG_H("Deleting Nat Rules\n");
+			pthread_mutex_lock(&ipacm_nat_lock);
 			Nat_App->UpdatePwrSaveIf(get_client_memptr(wlan_client, clt_indx)->v4_addr);
+			pthread_mutex_unlock(&ipacm_nat_lock);
  	     }
 
 		IPACMDBG_H("Deleting default qos Route Rules\n");
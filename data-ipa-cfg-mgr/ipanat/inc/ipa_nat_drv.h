@@ -62,6 +62,119 @@ typedef struct {
 	uint32_t dst_metadata;
 } ipa_nat_pdn_entry;
 
+/**
+ * enum ipa_nat_hash_mode - hash used to place rules in a table
+ * @IPA_NAT_HASH_XOR_FOLD: 16 bit xor fold of the tuple, the hash
+ *  the IPA hw uses for its lookups
+ * @IPA_NAT_HASH_SEEDED: seeded multiply-xorshift of the tuple, only
+ *  for builds where the lookups are not done by the IPA hw
+ */
+typedef enum {
+	IPA_NAT_HASH_XOR_FOLD,
+	IPA_NAT_HASH_SEEDED,
+} ipa_nat_hash_mode;
+
+/**
+ * struct ipa_nat_chain_stats - collision chain telemetry
+ * @inserts: number of rules placed in the table
+ * @probes: list entries read while placing them,
+ *  probes / inserts is the average probe length
+ * @collisions: rules whose hash head was already taken
+ * @max_chain: longest list seen since the table was created
+ */
+typedef struct {
+	uint64_t inserts;
+	uint64_t probes;
+	uint64_t collisions;
+	uint16_t max_chain;
+} ipa_nat_chain_stats;
+
+/**
+ * struct ipa_nat_hash_stats - hash distribution of a nat table
+ * @base: chains of the base table
+ * @index: chains of the index table
+ */
+typedef struct {
+	ipa_nat_chain_stats base;
+	ipa_nat_chain_stats index;
+} ipa_nat_hash_stats;
+
+#define IPA_NAT_LATENCY_BUCKETS 16
+
+/**
+ * struct ipa_nat_tbl_metrics - occupancy and health of a nat table
+ * @base_entries: size of the base table
+ * @base_used: rules in the base table
+ * @expn_entries: size of the expansion table
+ * @expn_used: rules in the expansion table
+ * @index_expn_entries: size of the index expansion table
+ * @index_expn_used: entries in use in the index expansion table
+ * @hash: collision chains of the base and index tables
+ * @failed_inserts: rules that could not be added
+ * @dma_cmds: IPA_IOC_NAT_DMA commands posted
+ * @dma_writes: writes carried by those commands
+ * @add_latency: rule add calls by duration, bucket n counts the
+ *  calls that took less than 2^n microseconds, the last bucket
+ *  the longer ones
+ * @del_latency: rule delete calls by duration, as add_latency
+ *
+ * Entry 0 of the base and expansion tables is never used, so
+ * a full table holds one rule less than its size
+ */
+typedef struct {
+	uint16_t base_entries;
+	uint16_t base_used;
+	uint16_t expn_entries;
+	uint16_t expn_used;
+	uint16_t index_expn_entries;
+	uint16_t index_expn_used;
+	ipa_nat_hash_stats hash;
+	uint64_t failed_inserts;
+	uint64_t dma_cmds;
+	uint64_t dma_writes;
+	uint32_t add_latency[IPA_NAT_LATENCY_BUCKETS];
+	uint32_t del_latency[IPA_NAT_LATENCY_BUCKETS];
+} ipa_nat_tbl_metrics;
+
+/**
+ * struct ipa_nat_rule_ts - timestamp of a nat rule
+ * @rule_hdl: ipv4 nat rule handle
+ * @time_stamp: time stamp of the rule
+ */
+typedef struct {
+	uint32_t rule_hdl;
+	uint32_t time_stamp;
+} ipa_nat_rule_ts;
+
+/**
+ * struct ipa_nat_reap_cfg - idle thresholds of the rule reaper
+ * @tcp_idle: seconds a tcp rule may go without traffic
+ * @udp_idle: seconds a udp rule may go without traffic
+ * @other_idle: seconds a rule of any other protocol may go
+ *  without traffic
+ * @max_rules: most rules removed by one call
+ *
+ * A threshold of 0 keeps the rules of that protocol
+ */
+typedef struct {
+	uint32_t tcp_idle;
+	uint32_t udp_idle;
+	uint32_t other_idle;
+	uint16_t max_rules;
+} ipa_nat_reap_cfg;
+
+/**
+ * ipa_nat_reap_cb - reports a rule removed by the reaper
+ * @table_handle: handle of ipv4 nat table
+ * @rule_handle: handle the rule had, it may already be reused
+ * @rule: the removed rule
+ * @arg: argument given to ipa_nat_reap_idle_rules()
+ */
+typedef void (*ipa_nat_reap_cb)(uint32_t table_handle,
+	uint32_t rule_handle,
+	const ipa_nat_ipv4_rule *rule,
+	void *arg);
+
 /**
  * ipa_nat_add_ipv4_tbl() - create ipv4 nat table
  * @public_ip_addr: [in] public ipv4 address
@@ -86,6 +199,35 @@ int ipa_nat_add_ipv4_tbl(uint32_t public_ip_addr,
  */
 int ipa_nat_del_ipv4_tbl(uint32_t table_handle);
 
+/**
+ * ipa_nat_resize_ipv4_tbl() - grow an ipv4 nat table
+ * @table_handle: [in] handle of ipv4 nat table
+ * @number_of_entries: [in] new number of nat entries
+ *
+ * Moves the rules to a larger table, the rule handles stay valid.
+ * The IPA hw holds a single table, so while the tables are swapped
+ * the flows take the software path. On failure the table is kept
+ * as it was
+ *
+ * Returns:	0  On Success, negative on failure
+ */
+int ipa_nat_resize_ipv4_tbl(uint32_t table_handle,
+	uint16_t number_of_entries);
+
+/**
+ * ipa_nat_set_auto_resize() - grow an ipv4 nat table when it fills up
+ * @table_handle: [in] handle of ipv4 nat table
+ * @threshold: [in] occupancy in percent of the table or of its
+ *  expansion table that makes the next rule add double the table,
+ *  0 disables the growth
+ * @max_entries: [in] number of nat entries the table grows up to
+ *
+ * Returns:	0  On Success, negative on failure
+ */
+int ipa_nat_set_auto_resize(uint32_t table_handle,
+	uint8_t threshold,
+	uint16_t max_entries);
+
 /**
  * ipa_nat_add_ipv4_rule() - to insert new ipv4 rule
  * @table_handle: [in] handle of ipv4 nat table
@@ -112,6 +254,38 @@ int ipa_nat_add_ipv4_rule(uint32_t table_handle,
 int ipa_nat_del_ipv4_rule(uint32_t table_handle,
 				uint32_t rule_handle);
 
+/**
+ * ipa_nat_add_ipv4_rules() - to insert a batch of ipv4 rules
+ * @table_handle: [in] handle of ipv4 nat table
+ * @rules: [in] array of new rules
+ * @num_rules: [in] number of rules in the array
+ * @rule_handles: [out] handle of each rule, 0 if the rule was not added
+ *
+ * To insert several ipv4 nat rules with as few hw commands as
+ * possible
+ *
+ * Returns:	0  On Success, negative if any rule failed
+ */
+int ipa_nat_add_ipv4_rules(uint32_t table_handle,
+				const ipa_nat_ipv4_rule *rules,
+				uint16_t num_rules,
+				uint32_t *rule_handles);
+
+/**
+ * ipa_nat_del_ipv4_rules() - to delete a batch of ipv4 nat rules
+ * @table_handle: [in] handle of ipv4 nat table
+ * @rule_handles: [in] array of ipv4 nat rule handles
+ * @num_rules: [in] number of handles in the array
+ *
+ * To delete several ipv4 nat rules with as few hw commands as
+ * possible
+ *
+ * Returns:	0  On Success, negative if any rule failed
+ */
+int ipa_nat_del_ipv4_rules(uint32_t table_handle,
+				const uint32_t *rule_handles,
+				uint16_t num_rules);
+
 
 /**
  * ipa_nat_query_timestamp() - to query timestamp
@@ -142,3 +316,98 @@ int ipa_nat_query_timestamp(uint32_t  table_handle,
 int ipa_nat_modify_pdn(uint32_t  tbl_hdl,
 	uint8_t pdn_index,
 	ipa_nat_pdn_entry *pdn_info);
+
+/**
+ * ipa_nat_set_hash_mode() - select the hash of an ipv4 nat table
+ * @table_handle: [in] handle of ipv4 nat table
+ * @mode: [in] hash used to place the rules
+ * @seed: [in] seed of IPA_NAT_HASH_SEEDED, ignored otherwise
+ *
+ * The hash can only be changed while the table has no rules
+ *
+ * Returns:	0  On Success, negative on failure
+ */
+int ipa_nat_set_hash_mode(uint32_t table_handle,
+	ipa_nat_hash_mode mode,
+	uint32_t seed);
+
+/**
+ * ipa_nat_get_hash_stats() - collision chain telemetry of a table
+ * @table_handle: [in] handle of ipv4 nat table
+ * @stats: [out] chain statistics of the base and index tables
+ *
+ * Returns:	0  On Success, negative on failure
+ */
+int ipa_nat_get_hash_stats(uint32_t table_handle,
+	ipa_nat_hash_stats *stats);
+
+/**
+ * ipa_nat_get_tbl_metrics() - occupancy and health of a table
+ * @table_handle: [in] handle of ipv4 nat table
+ * @metrics: [out] metrics of the table
+ *
+ * The counters cover the table since it was created and are
+ * kept when the table is resized
+ *
+ * Returns:	0  On Success, negative on failure
+ */
+int ipa_nat_get_tbl_metrics(uint32_t table_handle,
+	ipa_nat_tbl_metrics *metrics);
+
+/**
+ * ipa_nat_snapshot_timestamps() - collect changed rule timestamps
+ * @table_handle: [in] handle of ipv4 nat table
+ * @rule_ts: [out] rule handle and timestamp pairs
+ * @max_rules: [in] number of elements of rule_ts
+ * @num_rules: [out] number of pairs filled in rule_ts
+ *
+ * Walks the base and expansion tables once and reports the rules
+ * whose timestamp changed since the previous snapshot. When rule_ts
+ * fills up the next call resumes where this one stopped
+ *
+ * Returns:	0  On Success, negative on failure
+ */
+int ipa_nat_snapshot_timestamps(uint32_t table_handle,
+	ipa_nat_rule_ts *rule_ts,
+	uint16_t max_rules,
+	uint16_t *num_rules);
+
+/**
+ * ipa_nat_rule_frees_room() - tell if deleting a rule helps a new one
+ * @table_handle: [in] handle of ipv4 nat table
+ * @rule_handle: [in] ipv4 nat rule handle of the rule to delete
+ * @clnt_rule: [in] rule to be added in its place
+ *
+ * A new rule needs an expansion table entry when the base or index
+ * entry it hashes to is taken. Deleting a rule can only make room for
+ * it when the rule sits in an expansion table, or holds the base or
+ * index entry the new rule hashes to
+ *
+ * Returns:	1 if it can, 0 if not, negative on failure
+ */
+int ipa_nat_rule_frees_room(uint32_t table_handle,
+	uint32_t rule_handle,
+	const ipa_nat_ipv4_rule *clnt_rule);
+
+/**
+ * ipa_nat_reap_idle_rules() - remove the rules without traffic
+ * @table_handle: [in] handle of ipv4 nat table
+ * @cfg: [in] idle thresholds
+ * @cb: [in] called for each removed rule, may be NULL
+ * @arg: [in] passed to cb
+ * @num_reaped: [out] number of removed rules
+ *
+ * The hw updates the timestamp of a rule on every hit. A rule is
+ * idle from the call that first found its timestamp unchanged, so
+ * the function is meant to be called periodically, with a period
+ * well below the thresholds. The idle rules are deleted in one
+ * batch and reported once the table is unlocked, so cb may call
+ * back into the driver
+ *
+ * Returns:	0  On Success, negative on failure
+ */
+int ipa_nat_reap_idle_rules(uint32_t table_handle,
+	const ipa_nat_reap_cfg *cfg,
+	ipa_nat_reap_cb cb,
+	void *arg,
+	uint16_t *num_reaped);
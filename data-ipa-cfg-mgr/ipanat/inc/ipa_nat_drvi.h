@@ -40,6 +40,7 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <sys/inotify.h>
 #include <errno.h>
 #include <pthread.h>
+#include <time.h>
 
 #include "ipa_nat_logi.h"
 
@@ -317,6 +318,15 @@ struct ipa_nat_indx_tbl_meta_info {
 	uint16_t prev_index;
 };
 
+/* Health counters of a table, see ipa_nat_tbl_metrics */
+struct ipa_nat_tbl_counters {
+	uint64_t failed_inserts;
+	uint64_t dma_cmds;
+	uint64_t dma_writes;
+	uint32_t add_latency[IPA_NAT_LATENCY_BUCKETS];
+	uint32_t del_latency[IPA_NAT_LATENCY_BUCKETS];
+};
+
 struct ipa_nat_ip4_table_cache {
 	uint8_t valid;
 	uint32_t public_addr;
@@ -343,6 +353,43 @@ struct ipa_nat_ip4_table_cache {
 
 	uint16_t cur_tbl_cnt;
 	uint16_t cur_expn_tbl_cnt;
+
+	/* Stacks of free expansion, index expansion and rule id slots,
+		 kept in step with add/delete so that allocation is O(1) */
+	uint16_t *expn_free_list;
+	uint16_t expn_free_cnt;
+	uint16_t *index_expn_free_list;
+	uint16_t index_expn_free_cnt;
+	uint16_t *rule_id_free_list;
+	uint16_t rule_id_free_cnt;
+
+	ipa_nat_hash_mode hash_mode;
+	uint32_t hash_seed;
+	ipa_nat_hash_stats hash_stats;
+
+	/* Rule handle owning each base/expansion table slot and the
+		 timestamp the last snapshot saw in it */
+	uint16_t *slot_rule_hdl;
+	uint32_t *slot_last_ts;
+	uint16_t snapshot_pos;
+
+	/* Timestamp the reaper last saw in each slot and the time,
+		 in seconds, it saw it change. 0 until the reaper visits
+		 the slot */
+	uint32_t *slot_reap_ts;
+	uint32_t *slot_active;
+	uint16_t reap_pos;
+
+	/* Requested size and automatic growth settings,
+		 see ipa_nati_set_auto_resize() */
+	uint16_t num_entries;
+	uint8_t grow_threshold;
+	uint16_t grow_max_entries;
+
+	/* Set when a failed resize could not give the table back to
+		 the hw, the table memory is then a copy in the heap */
+	uint8_t detached;
+	struct ipa_nat_tbl_counters counters;
 };
 
 struct ipa_nat_cache {
@@ -365,6 +412,60 @@ typedef enum {
 	IPA_NAT_DEL_TYPE_LAST,
 } del_type;
 
+/* The entries field of struct ipa_ioc_nat_dma_cmd is 8 bits wide */
+#define IPA_NAT_MAX_DMA_ENTRIES  255
+#define MAX_DMA_ENTRIES_FOR_DEL  3
+#define MAX_DMA_ENTRIES_FOR_ADD  3
+
+#define IPA_NAT_BATCH_BASE_BUSY  0x1
+#define IPA_NAT_BATCH_INDX_BUSY  0x2
+
+/* state of a delete needed once its dma writes are posted */
+struct ipa_nat_del_info {
+	uint8_t tbl_indx;
+	uint16_t cur_tbl_entry;
+	uint8_t expn_tbl;
+	del_type rule_pos;
+	uint16_t indx_tbl_entry;
+	del_type indx_rule_pos;
+	uint16_t indx_next_entry;
+};
+
+/* rule of a batch waiting for its dma writes to be posted */
+struct ipa_nat_batch_rule {
+	uint16_t pos;
+	uint16_t tbl_entry;
+	uint16_t indx_tbl_entry;
+	uint32_t rule_hdl;
+	struct ipa_nat_del_info del_info;
+};
+
+/*
+	Dma writes of a batch of rule additions or deletions. The writes are
+	posted with one IPA_IOC_NAT_DMA: index table writes first, then base
+	table writes and the enable bits of new rules last. busy[] marks the
+	base and index table lists that have writes pending, a rule touching
+	such a list is only handled after the pending writes are posted
+*/
+struct ipa_nat_dma_batch {
+	uint8_t tbl_indx;
+	struct ipa_ioc_nat_dma_cmd *cmd;
+
+	struct ipa_ioc_nat_dma_one indx_dma[IPA_NAT_MAX_DMA_ENTRIES];
+	uint16_t indx_cnt;
+	struct ipa_ioc_nat_dma_one base_dma[IPA_NAT_MAX_DMA_ENTRIES];
+	uint16_t base_cnt;
+	struct ipa_ioc_nat_dma_one enable_dma[IPA_NAT_MAX_DMA_ENTRIES];
+	uint16_t enable_cnt;
+
+	uint8_t *busy;
+	uint16_t busy_list[2 * IPA_NAT_MAX_DMA_ENTRIES];
+	uint16_t busy_cnt;
+
+	struct ipa_nat_batch_rule rules[IPA_NAT_MAX_DMA_ENTRIES];
+	uint16_t rule_cnt;
+};
+
 /**
  * ipa_nati_parse_ipv4_rule_hdl() - prase rule handle
  * @tbl_hdl:	[in] nat table rule
@@ -413,12 +514,18 @@ int ipa_nati_alloc_table(uint16_t number_of_entries,
 				struct ipa_ioc_nat_alloc_mem *mem,
 				uint16_t*, uint16_t*);
 
-int ipa_nati_update_cache(struct ipa_ioc_nat_alloc_mem *,
+int ipa_nati_update_cache(uint8_t tbl_indx,
+				struct ipa_ioc_nat_alloc_mem *,
 				uint32_t public_ip_addr,
 				uint16_t tbl_entries,
 				uint16_t expn_tbl_entries);
 
 int ipa_nati_del_ipv4_table(uint32_t tbl_hdl);
+int ipa_nati_resize_ipv4_table(uint32_t tbl_hdl,
+				uint16_t number_of_entries);
+int ipa_nati_set_auto_resize(uint32_t tbl_hdl,
+				uint8_t threshold,
+				uint16_t max_entries);
 int ipa_nati_reset_ipv4_table(uint32_t tbl_hdl);
 int ipa_nati_post_ipv4_init_cmd(uint8_t tbl_index);
 
@@ -428,6 +535,25 @@ int ipa_nati_query_timestamp(uint32_t  tbl_hdl,
 
 int ipa_nati_modify_pdn(struct ipa_ioc_nat_pdn_entry *entry);
 
+int ipa_nati_set_hash_mode(uint32_t tbl_hdl,
+				ipa_nat_hash_mode mode,
+				uint32_t seed);
+
+int ipa_nati_get_hash_stats(uint32_t tbl_hdl,
+				ipa_nat_hash_stats *stats);
+
+int ipa_nati_get_tbl_metrics(uint32_t tbl_hdl,
+				ipa_nat_tbl_metrics *metrics);
+
+int ipa_nati_snapshot_timestamps(uint32_t tbl_hdl,
+				ipa_nat_rule_ts *rule_ts,
+				uint16_t max_rules,
+				uint16_t *num_rules);
+
+int ipa_nati_rule_frees_room(uint32_t tbl_hdl,
+				uint32_t rule_hdl,
+				const ipa_nat_ipv4_rule *clnt_rule);
+
 int ipa_nati_add_ipv4_rule(uint32_t tbl_hdl,
 				const ipa_nat_ipv4_rule *clnt_rule,
 				uint32_t *rule_hdl);
@@ -439,8 +565,10 @@ int ipa_nati_generate_rule(uint32_t tbl_hdl,
 				uint16_t *tbl_entry,
 				uint16_t *indx_tbl_entry);
 
-uint16_t ipa_nati_expn_tbl_free_entry(struct ipa_nat_rule *expn_tbl,
-				uint16_t size);
+uint16_t ipa_nati_expn_tbl_free_entry(struct ipa_nat_ip4_table_cache *tbl_ptr);
+
+void ipa_nati_expn_tbl_release_entry(struct ipa_nat_ip4_table_cache *tbl_ptr,
+				uint16_t entry);
 
 uint16_t ipa_nati_generate_tbl_rule(const ipa_nat_ipv4_rule *clnt_rule,
 				struct ipa_nat_sw_rule *sw_rule,
@@ -450,35 +578,81 @@ uint16_t ipa_nati_generate_index_rule(const ipa_nat_ipv4_rule *clnt_rule,
 				struct ipa_nat_indx_tbl_sw_rule *sw_rule,
 				struct ipa_nat_ip4_table_cache *tbl_ptr);
 
-uint16_t ipa_nati_index_expn_get_free_entry(struct ipa_nat_indx_tbl_rule *tbl,
-				uint16_t size);
+uint16_t ipa_nati_index_expn_get_free_entry(
+				struct ipa_nat_ip4_table_cache *tbl_ptr);
+
+void ipa_nati_index_expn_release_entry(struct ipa_nat_ip4_table_cache *tbl_ptr,
+				uint16_t entry);
+
+void ipa_nati_rebuild_free_lists(struct ipa_nat_ip4_table_cache *tbl_ptr);
 
 void ipa_nati_copy_ipv4_rule_to_hw(
 				struct ipa_nat_ip4_table_cache *ipv4_cache,
 				struct ipa_nat_sw_rule *rule,
-				uint16_t entry, uint8_t tbl_index);
+				uint16_t entry, uint8_t tbl_index,
+				struct ipa_nat_dma_batch *batch);
 
 void ipa_nati_copy_ipv4_index_rule_to_hw(
 				struct ipa_nat_ip4_table_cache *ipv4_cache,
 				struct ipa_nat_indx_tbl_sw_rule *indx_sw_rule,
-				uint16_t entry, uint8_t tbl_index);
+				uint16_t entry, uint8_t tbl_index,
+				struct ipa_nat_dma_batch *batch);
 
-void ipa_nati_write_next_index(uint8_t tbl_indx,
+int ipa_nati_write_next_index(uint8_t tbl_indx,
 				nat_table_type tbl_type,
 				uint16_t value,
 				uint32_t offset);
 
+int ipa_nati_unlink_ipv4_rule(
+				struct ipa_nat_ip4_table_cache *ipv4_cache,
+				uint8_t tbl_index,
+				uint16_t prev_entry,
+				uint16_t indx_prev_entry);
+
+void ipa_nati_release_rule_entries(
+				struct ipa_nat_ip4_table_cache *ipv4_cache,
+				uint16_t entry,
+				uint16_t indx_entry);
+void ipa_nati_fill_enable_dma(uint8_t tbl_indx,
+				uint16_t entry,
+				struct ipa_ioc_nat_dma_one *dma);
+
 int ipa_nati_post_ipv4_dma_cmd(uint8_t tbl_indx,
 				uint16_t entry);
 
+int ipa_nati_add_ipv4_rules(uint32_t tbl_hdl,
+				const ipa_nat_ipv4_rule *clnt_rules,
+				uint16_t num_rules,
+				uint32_t *rule_hdls);
+
+int ipa_nati_del_ipv4_rules(uint32_t tbl_hdl,
+				const uint32_t *rule_hdls,
+				uint16_t num_rules);
+
 int ipa_nati_del_ipv4_rule(uint32_t tbl_hdl,
 				uint32_t rule_hdl);
 
+int ipa_nati_reap_idle_rules(uint32_t tbl_hdl,
+				const ipa_nat_reap_cfg *cfg,
+				ipa_nat_reap_cb cb,
+				void *arg,
+				uint16_t *num_reaped);
+
 int ipa_nati_post_del_dma_cmd(uint8_t tbl_indx,
 				uint16_t tbl_entry,
 				uint8_t expn_tbl,
 				del_type rule_pos);
 
+int ipa_nati_generate_del_dma_cmd(uint8_t tbl_indx,
+				uint16_t cur_tbl_entry,
+				uint8_t expn_tbl,
+				del_type rule_pos,
+				struct ipa_ioc_nat_dma_one *dma,
+				uint8_t *entries,
+				struct ipa_nat_del_info *info);
+
+void ipa_nati_update_del_sw_state(struct ipa_nat_del_info *info);
+
 void ipa_nati_find_index_rule_pos(
 				struct ipa_nat_ip4_table_cache *cache_ptr,
 				uint16_t tbl_entry,
@@ -0,0 +1,536 @@
+/*
+Copyright (c) 2017, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*=========================================================================*/
+/*!
+	@file
+	ipa_nat_bench.c
+
+	@brief
+	Benchmark of the nat driver on top of the simulated IPA device.
+	Replays a synthetic or recorded stream of flows and reports the
+	insert/delete latency percentiles, the collision chains and the
+	point where the expansion tables run out.
+
+	Recorded streams are text files, one flow operation per line:
+	  add|del <proto> <private ip> <private port> <target ip> <target port> <public port>
+	Lines starting with '#' are ignored.
+*/
+/*=========================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <getopt.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "ipa_nat_drv.h"
+#include "ipa_nat_sim.h"
+
+#define BENCH_PUBLIC_IP      0x0A000001 /* 10.0.0.1 */
+#define BENCH_FIRST_PORT     1024
+#define BENCH_HASH_BUCKETS   65536
+
+typedef enum {
+	BENCH_UNIFORM,
+	BENCH_CLUSTERED,
+	BENCH_TRACE,
+} bench_workload;
+
+struct bench_flow {
+	ipa_nat_ipv4_rule rule;
+	uint32_t rule_hdl;
+	int next;
+	int live_pos;
+};
+
+struct bench_lat {
+	uint32_t *ns;
+	int cnt;
+};
+
+struct bench_ctx {
+	uint32_t tbl_hdl;
+	uint16_t entries;
+
+	/* flows with stable ids, chained by tuple hash or on the free list */
+	struct bench_flow *flows;
+	int num_flows;
+	int free_flow;
+	int *buckets;
+
+	/* ids of the flows currently in the nat table */
+	int *live;
+	int live_cnt;
+
+	uint16_t next_port;
+
+	uint32_t adds_ok;
+	uint32_t adds_failed;
+	int first_fail_live;
+	uint32_t dels_ok;
+	uint32_t dels_failed;
+
+	struct bench_lat add_lat;
+	struct bench_lat del_lat;
+};
+
+static uint64_t bench_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint32_t bench_tuple_hash(const ipa_nat_ipv4_rule *rule)
+{
+	uint32_t hash = rule->private_ip * 0x9E3779B1;
+
+	hash ^= (rule->target_ip + rule->private_port) * 0x85EBCA6B;
+	hash ^= ((uint32_t)rule->target_port << 8 | rule->protocol) * 0xC2B2AE35;
+	return (hash ^ (hash >> 16)) % BENCH_HASH_BUCKETS;
+}
+
+static int bench_same_tuple(const ipa_nat_ipv4_rule *a,
+				const ipa_nat_ipv4_rule *b)
+{
+	return a->private_ip == b->private_ip &&
+		a->private_port == b->private_port &&
+		a->target_ip == b->target_ip &&
+		a->target_port == b->target_port &&
+		a->protocol == b->protocol;
+}
+
+static int bench_init(struct bench_ctx *ctx, int num_flows)
+{
+	int cnt;
+
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->first_fail_live = -1;
+	ctx->next_port = BENCH_FIRST_PORT;
+	ctx->num_flows = num_flows;
+
+	ctx->flows = calloc(num_flows, sizeof(struct bench_flow));
+	ctx->live = calloc(num_flows, sizeof(int));
+	ctx->buckets = malloc(BENCH_HASH_BUCKETS * sizeof(int));
+	ctx->add_lat.ns = calloc(num_flows, sizeof(uint32_t));
+	ctx->del_lat.ns = calloc(num_flows, sizeof(uint32_t));
+	if (!ctx->flows || !ctx->live || !ctx->buckets ||
+			!ctx->add_lat.ns || !ctx->del_lat.ns) {
+		fprintf(stderr, "unable to allocate memory\n");
+		return -1;
+	}
+
+	for (cnt = 0; cnt < BENCH_HASH_BUCKETS; cnt++) {
+		ctx->buckets[cnt] = -1;
+	}
+	for (cnt = 0; cnt < num_flows; cnt++) {
+		ctx->flows[cnt].next = cnt + 1;
+	}
+	ctx->flows[num_flows - 1].next = -1;
+	ctx->free_flow = 0;
+
+	return 0;
+}
+
+static void bench_free(struct bench_ctx *ctx)
+{
+	free(ctx->flows);
+	free(ctx->live);
+	free(ctx->buckets);
+	free(ctx->add_lat.ns);
+	free(ctx->del_lat.ns);
+}
+
+static int bench_find(struct bench_ctx *ctx, const ipa_nat_ipv4_rule *rule)
+{
+	int id = ctx->buckets[bench_tuple_hash(rule)];
+
+	while (id >= 0 && !bench_same_tuple(&ctx->flows[id].rule, rule)) {
+		id = ctx->flows[id].next;
+	}
+	return id;
+}
+
+static void bench_add(struct bench_ctx *ctx, ipa_nat_ipv4_rule *rule)
+{
+	struct bench_flow *flow;
+	uint64_t start;
+	uint32_t bucket;
+	int id, ret;
+
+	id = ctx->free_flow;
+	if (id < 0 || ctx->add_lat.cnt >= ctx->num_flows) {
+		ctx->adds_failed++;
+		return;
+	}
+	flow = &ctx->flows[id];
+
+	start = bench_now_ns();
+	ret = ipa_nat_add_ipv4_rule(ctx->tbl_hdl, rule, &flow->rule_hdl);
+	ctx->add_lat.ns[ctx->add_lat.cnt++] = (uint32_t)(bench_now_ns() - start);
+
+	if (ret) {
+		if (ctx->first_fail_live < 0) {
+			ctx->first_fail_live = ctx->live_cnt;
+		}
+		ctx->adds_failed++;
+		return;
+	}
+	ctx->adds_ok++;
+
+	ctx->free_flow = flow->next;
+	flow->rule = *rule;
+	bucket = bench_tuple_hash(rule);
+	flow->next = ctx->buckets[bucket];
+	ctx->buckets[bucket] = id;
+	flow->live_pos = ctx->live_cnt;
+	ctx->live[ctx->live_cnt++] = id;
+}
+
+static void bench_del(struct bench_ctx *ctx, int id)
+{
+	struct bench_flow *flow = &ctx->flows[id];
+	uint64_t start;
+	int *link;
+	int ret;
+
+	if (ctx->del_lat.cnt >= ctx->num_flows) {
+		ctx->dels_failed++;
+		return;
+	}
+
+	start = bench_now_ns();
+	ret = ipa_nat_del_ipv4_rule(ctx->tbl_hdl, flow->rule_hdl);
+	ctx->del_lat.ns[ctx->del_lat.cnt++] = (uint32_t)(bench_now_ns() - start);
+
+	if (ret) {
+		ctx->dels_failed++;
+		return;
+	}
+	ctx->dels_ok++;
+
+	link = &ctx->buckets[bench_tuple_hash(&flow->rule)];
+	while (*link != id) {
+		link = &ctx->flows[*link].next;
+	}
+	*link = flow->next;
+
+	ctx->live[flow->live_pos] = ctx->live[--ctx->live_cnt];
+	ctx->flows[ctx->live[flow->live_pos]].live_pos = flow->live_pos;
+
+	flow->next = ctx->free_flow;
+	ctx->free_flow = id;
+}
+
+static void bench_gen_rule(bench_workload workload, int seq,
+				struct bench_ctx *ctx, ipa_nat_ipv4_rule *rule)
+{
+	memset(rule, 0, sizeof(*rule));
+	rule->pdn_index = 0;
+	rule->public_port = ctx->next_port++;
+	if (ctx->next_port < BENCH_FIRST_PORT) {
+		ctx->next_port = BENCH_FIRST_PORT;
+	}
+
+	if (BENCH_CLUSTERED == workload) {
+		/* 16 clients behind the gateway talking to one CDN */
+		rule->private_ip = 0xC0A80100 | (seq % 16);    /* 192.168.1.x */
+		rule->private_port = 32768 + ((seq / 16) * 2) % 28000;
+		rule->target_ip = 0x68100000 | (seq % 2);      /* 104.16.0.x */
+		rule->target_port = 443;
+		rule->protocol = IPPROTO_TCP;
+	} else {
+		rule->private_ip = 0xC0A80000 | (rand() & 0xFFFF);
+		rule->private_port = 1024 + rand() % 64000;
+		rule->target_ip = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+		rule->target_port = (rand() & 1) ? 443 : 53;
+		rule->protocol = (rand() & 1) ? IPPROTO_TCP : IPPROTO_UDP;
+	}
+}
+
+static int bench_run_synthetic(struct bench_ctx *ctx,
+				bench_workload workload, int ops, int churn)
+{
+	ipa_nat_ipv4_rule rule;
+	int seq = 0, cnt;
+
+	/* fill until the requested number of adds is done */
+	for (cnt = 0; cnt < ops; cnt++) {
+		bench_gen_rule(workload, seq++, ctx, &rule);
+		bench_add(ctx, &rule);
+	}
+
+	/* steady state, replace a random flow by a new one */
+	for (cnt = 0; cnt < churn && ctx->live_cnt; cnt++) {
+		bench_del(ctx, ctx->live[rand() % ctx->live_cnt]);
+		bench_gen_rule(workload, seq++, ctx, &rule);
+		bench_add(ctx, &rule);
+	}
+
+	return 0;
+}
+
+static int bench_parse_ip(const char *str, uint32_t *ip)
+{
+	struct in_addr addr;
+
+	if (!inet_aton(str, &addr)) {
+		return -1;
+	}
+	*ip = ntohl(addr.s_addr);
+	return 0;
+}
+
+static int bench_run_trace(struct bench_ctx *ctx, const char *path)
+{
+	char line[256], op[8], priv_ip[32], trgt_ip[32];
+	unsigned int proto, priv_port, trgt_port, pub_port;
+	ipa_nat_ipv4_rule rule;
+	int line_no = 0, id;
+	FILE *fp;
+
+	fp = fopen(path, "r");
+	if (NULL == fp) {
+		perror("unable to open trace");
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), fp)) {
+		line_no++;
+		if ('#' == line[0] || '\n' == line[0]) {
+			continue;
+		}
+
+		memset(&rule, 0, sizeof(rule));
+		if (sscanf(line, "%7s %u %31s %u %31s %u %u", op, &proto,
+							 priv_ip, &priv_port, trgt_ip, &trgt_port, &pub_port) != 7 ||
+				bench_parse_ip(priv_ip, &rule.private_ip) ||
+				bench_parse_ip(trgt_ip, &rule.target_ip)) {
+			fprintf(stderr, "%s:%d: malformed line\n", path, line_no);
+			continue;
+		}
+		rule.protocol = (uint8_t)proto;
+		rule.private_port = (uint16_t)priv_port;
+		rule.target_port = (uint16_t)trgt_port;
+		rule.public_port = (uint16_t)pub_port;
+
+		id = bench_find(ctx, &rule);
+		if (!strcmp(op, "add")) {
+			if (id < 0) {
+				bench_add(ctx, &rule);
+			}
+		} else if (!strcmp(op, "del")) {
+			if (id >= 0) {
+				bench_del(ctx, id);
+			}
+		} else {
+			fprintf(stderr, "%s:%d: unknown operation %s\n", path, line_no, op);
+		}
+	}
+
+	fclose(fp);
+	return 0;
+}
+
+static int bench_cmp_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static void bench_print_lat(FILE *out, const char *name, struct bench_lat *lat)
+{
+	if (0 == lat->cnt) {
+		fprintf(out, "%s latency ns: no samples\n", name);
+		return;
+	}
+
+	qsort(lat->ns, lat->cnt, sizeof(uint32_t), bench_cmp_u32);
+	fprintf(out, "%s latency ns: p50 %u p90 %u p99 %u max %u (%d samples)\n",
+		name,
+		lat->ns[lat->cnt / 2],
+		lat->ns[(int)(lat->cnt * 0.90)],
+		lat->ns[(int)(lat->cnt * 0.99)],
+		lat->ns[lat->cnt - 1],
+		lat->cnt);
+}
+
+static void bench_print_chains(FILE *out, const char *name,
+				ipa_nat_chain_stats *stats)
+{
+	fprintf(out, "%s chains: max %u avg probes %.2f over %llu inserts\n",
+		name, stats->max_chain,
+		stats->inserts ? (double)stats->probes / stats->inserts : 0.0,
+		(unsigned long long)stats->inserts);
+}
+
+static void bench_usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-e entries] [-n adds] [-c churn] [-w uniform|clustered]\n"
+		"          [-f trace] [-s seed] [-H seed] [-4] [-v]\n"
+		"  -e  nat table entries (default 1000)\n"
+		"  -n  synthetic flows added to fill the table (default 2 * entries)\n"
+		"  -c  synthetic flows replaced after the fill (default 0)\n"
+		"  -w  synthetic workload (default uniform)\n"
+		"  -f  replay a recorded trace instead of a synthetic workload\n"
+		"  -s  random seed (default 1)\n"
+		"  -H  place rules with the seeded hash and the given seed\n"
+		"  -4  simulate IPA hw v4.0\n"
+		"  -v  keep the driver logs\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	bench_workload workload = BENCH_UNIFORM;
+	const char *trace = NULL;
+	int entries = 1000, ops = -1, churn = 0, verbose = 0;
+	int seeded = 0, opt, out_fd;
+	uint32_t hash_seed = 0;
+	struct bench_ctx ctx;
+	struct ipa_nat_sim_stats sim_stats;
+	ipa_nat_hash_stats hash_stats;
+	ipa_nat_pdn_entry pdn;
+	FILE *out;
+
+	srand(1);
+	while ((opt = getopt(argc, argv, "e:n:c:w:f:s:H:4v")) != -1) {
+		switch (opt) {
+		case 'e': entries = atoi(optarg); break;
+		case 'n': ops = atoi(optarg); break;
+		case 'c': churn = atoi(optarg); break;
+		case 'f': trace = optarg; workload = BENCH_TRACE; break;
+		case 's': srand(atoi(optarg)); break;
+		case 'H': seeded = 1; hash_seed = strtoul(optarg, NULL, 0); break;
+		case '4': ipa_nat_sim_set_hw_ver(IPA_HW_v4_0); break;
+		case 'v': verbose = 1; break;
+		case 'w':
+			if (!strcmp(optarg, "clustered")) {
+				workload = BENCH_CLUSTERED;
+			} else if (strcmp(optarg, "uniform")) {
+				bench_usage(argv[0]);
+				return 1;
+			}
+			break;
+		default:
+			bench_usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (entries <= 0 || entries > 0xFFFF) {
+		bench_usage(argv[0]);
+		return 1;
+	}
+	if (ops < 0) {
+		ops = 2 * entries;
+	}
+
+	/* the driver logs to stdout, keep the report apart from them */
+	out_fd = dup(STDOUT_FILENO);
+	out = fdopen(out_fd, "w");
+	if (NULL == out) {
+		perror("unable to dup stdout");
+		return 1;
+	}
+	if (!verbose && NULL == freopen("/dev/null", "w", stdout)) {
+		perror("unable to silence the driver");
+		return 1;
+	}
+
+	if (bench_init(&ctx, (BENCH_TRACE == workload) ? 0xFFFFF : ops + churn + 1)) {
+		return 1;
+	}
+	ctx.entries = (uint16_t)entries;
+
+	if (ipa_nat_add_ipv4_tbl(BENCH_PUBLIC_IP, ctx.entries, &ctx.tbl_hdl)) {
+		fprintf(stderr, "unable to create nat table\n");
+		return 1;
+	}
+
+	memset(&pdn, 0, sizeof(pdn));
+	pdn.public_ip = BENCH_PUBLIC_IP;
+	if (ipa_nat_modify_pdn(ctx.tbl_hdl, 0, &pdn)) {
+		fprintf(stderr, "unable to set the pdn\n");
+		return 1;
+	}
+
+	if (seeded && ipa_nat_set_hash_mode(ctx.tbl_hdl, IPA_NAT_HASH_SEEDED, hash_seed)) {
+		fprintf(stderr, "unable to select the seeded hash\n");
+		return 1;
+	}
+	ipa_nat_sim_reset_stats();
+
+	if (BENCH_TRACE == workload) {
+		if (bench_run_trace(&ctx, trace)) {
+			return 1;
+		}
+	} else {
+		bench_run_synthetic(&ctx, workload, ops, churn);
+	}
+
+	ipa_nat_get_hash_stats(ctx.tbl_hdl, &hash_stats);
+
+	/* drain the table to measure deletes of a loaded table too */
+	while (ctx.live_cnt) {
+		bench_del(&ctx, ctx.live[rand() % ctx.live_cnt]);
+	}
+	ipa_nat_sim_get_stats(&sim_stats);
+
+	fprintf(out, "table entries: %d, hash: %s\n", entries,
+		seeded ? "seeded" : "xor fold");
+	fprintf(out, "adds: ok %u failed %u\n", ctx.adds_ok, ctx.adds_failed);
+	if (ctx.first_fail_live >= 0) {
+		fprintf(out, "first add failure with %d live rules (%.1f%% of entries)\n",
+			ctx.first_fail_live, 100.0 * ctx.first_fail_live / entries);
+	} else {
+		fprintf(out, "no add failure\n");
+	}
+	fprintf(out, "deletes: ok %u failed %u\n", ctx.dels_ok, ctx.dels_failed);
+	bench_print_lat(out, "add", &ctx.add_lat);
+	bench_print_lat(out, "delete", &ctx.del_lat);
+	bench_print_chains(out, "base", &hash_stats.base);
+	bench_print_chains(out, "index", &hash_stats.index);
+	fprintf(out, "dma: %llu commands, %llu writes, largest %u\n",
+		(unsigned long long)sim_stats.dma_cmds,
+		(unsigned long long)sim_stats.dma_writes,
+		sim_stats.max_dma_writes);
+	fclose(out);
+
+	ipa_nat_del_ipv4_tbl(ctx.tbl_hdl);
+	bench_free(&ctx);
+
+	return 0;
+}
@@ -0,0 +1,259 @@
+/*
+Copyright (c) 2017, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+#include "ipa_nat_sim.h"
+#include "ipa_nat_logi.h"
+
+#define IPA_NAT_SIM_PAGE_SIZE 4096
+#define IPA_NAT_SIM_NUM_TBLS  4
+
+struct ipa_nat_sim_dev {
+	enum ipa_hw_type ver;
+
+	/* nat table memory as mapped by the driver */
+	char *mem;
+	size_t mem_size;
+	size_t alloc_size;
+
+	/* offsets of the base, expansion, index and index
+		 expansion tables, indexed by nat_table_type */
+	uint32_t tbl_offset[IPA_NAT_SIM_NUM_TBLS];
+
+	struct ipa_nat_sim_stats stats;
+};
+
+static struct ipa_nat_sim_dev sim_dev = {
+	.ver = IPA_HW_v3_0,
+};
+
+void ipa_nat_sim_set_hw_ver(enum ipa_hw_type ver)
+{
+	sim_dev.ver = ver;
+}
+
+void ipa_nat_sim_get_stats(struct ipa_nat_sim_stats *stats)
+{
+	*stats = sim_dev.stats;
+}
+
+void ipa_nat_sim_reset_stats(void)
+{
+	memset(&sim_dev.stats, 0, sizeof(sim_dev.stats));
+}
+
+int ipa_nat_sim_open(const char *path, int flags, ...)
+{
+	(void)flags;
+
+	if (!strcmp(path, "/dev/ipa")) {
+		return IPA_NAT_SIM_IPA_FD;
+	}
+
+	if (!strcmp(path, "/dev/ipaNatTable")) {
+		if (0 == sim_dev.alloc_size) {
+			IPAERR("nat memory not allocated\n");
+			errno = ENOENT;
+			return -1;
+		}
+		return IPA_NAT_SIM_NAT_FD;
+	}
+
+	errno = ENOENT;
+	return -1;
+}
+
+int ipa_nat_sim_close(int fd)
+{
+	if (IPA_NAT_SIM_IPA_FD != fd && IPA_NAT_SIM_NAT_FD != fd) {
+		errno = EBADF;
+		return -1;
+	}
+
+	return 0;
+}
+
+void *ipa_nat_sim_mmap(void *addr, size_t len, int prot,
+				int flags, int fd, off_t offset)
+{
+	(void)addr;
+	(void)prot;
+	(void)flags;
+
+	if (IPA_NAT_SIM_NAT_FD != fd || 0 != offset ||
+			len > sim_dev.alloc_size || NULL != sim_dev.mem) {
+		errno = EINVAL;
+		return MAP_FAILED;
+	}
+
+	/* the hw maps whole pages, the driver relies on it when dumping */
+	sim_dev.mem_size = (len + IPA_NAT_SIM_PAGE_SIZE - 1) &
+		~((size_t)IPA_NAT_SIM_PAGE_SIZE - 1);
+	sim_dev.mem = calloc(1, sim_dev.mem_size);
+	if (NULL == sim_dev.mem) {
+		errno = ENOMEM;
+		return MAP_FAILED;
+	}
+
+	return sim_dev.mem;
+}
+
+int ipa_nat_sim_munmap(void *addr, size_t len)
+{
+	(void)len;
+
+	if (addr != sim_dev.mem) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	free(sim_dev.mem);
+	sim_dev.mem = NULL;
+	sim_dev.mem_size = 0;
+	return 0;
+}
+
+static int ipa_nat_sim_init_nat(struct ipa_ioc_v4_nat_init *init)
+{
+	sim_dev.tbl_offset[0] = init->ipv4_rules_offset;
+	sim_dev.tbl_offset[1] = init->expn_rules_offset;
+	sim_dev.tbl_offset[2] = init->index_offset;
+	sim_dev.tbl_offset[3] = init->index_expn_offset;
+
+	if (init->index_expn_offset >= sim_dev.alloc_size) {
+		IPAERR("table offsets beyond nat memory\n");
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int ipa_nat_sim_dma(struct ipa_ioc_nat_dma_cmd *cmd)
+{
+	struct ipa_ioc_nat_dma_one *dma;
+	uint32_t offset;
+	int cnt;
+
+	if (NULL == sim_dev.mem) {
+		IPAERR("dma without nat memory\n");
+		return -EINVAL;
+	}
+
+	/* validate the whole command first, the hw rejects it as a whole */
+	for (cnt = 0; cnt < cmd->entries; cnt++) {
+		dma = &cmd->dma[cnt];
+		if (0 != dma->table_index || dma->base_addr >= IPA_NAT_SIM_NUM_TBLS) {
+			IPAERR("invalid dma %d: table %d base %d\n",
+				cnt, dma->table_index, dma->base_addr);
+			return -EINVAL;
+		}
+
+		offset = sim_dev.tbl_offset[dma->base_addr] + dma->offset;
+		if (offset + sizeof(dma->data) > sim_dev.mem_size) {
+			IPAERR("dma %d out of range: offset %u\n", cnt, offset);
+			return -EINVAL;
+		}
+	}
+
+	for (cnt = 0; cnt < cmd->entries; cnt++) {
+		dma = &cmd->dma[cnt];
+		offset = sim_dev.tbl_offset[dma->base_addr] + dma->offset;
+		memcpy(sim_dev.mem + offset, &dma->data, sizeof(dma->data));
+	}
+
+	sim_dev.stats.dma_cmds++;
+	sim_dev.stats.dma_writes += cmd->entries;
+	if (cmd->entries > sim_dev.stats.max_dma_writes) {
+		sim_dev.stats.max_dma_writes = cmd->entries;
+	}
+
+	return 0;
+}
+
+int ipa_nat_sim_ioctl(int fd, unsigned long req, ...)
+{
+	struct ipa_ioc_nat_alloc_mem *mem;
+	va_list args;
+	void *arg;
+	int ret = 0;
+
+	va_start(args, req);
+	arg = va_arg(args, void *);
+	va_end(args);
+
+	if (IPA_NAT_SIM_IPA_FD != fd) {
+		errno = EBADF;
+		return -1;
+	}
+
+	switch (req) {
+	case IPA_IOC_GET_HW_VERSION:
+		*(enum ipa_hw_type *)arg = sim_dev.ver;
+		break;
+
+	case IPA_IOC_ALLOC_NAT_MEM:
+		mem = (struct ipa_ioc_nat_alloc_mem *)arg;
+		sim_dev.alloc_size = mem->size;
+		mem->offset = 0;
+		break;
+
+	case IPA_IOC_V4_INIT_NAT:
+		ret = ipa_nat_sim_init_nat((struct ipa_ioc_v4_nat_init *)arg);
+		break;
+
+	case IPA_IOC_NAT_DMA:
+		ret = ipa_nat_sim_dma((struct ipa_ioc_nat_dma_cmd *)arg);
+		break;
+
+	case IPA_IOC_V4_DEL_NAT:
+		sim_dev.alloc_size = 0;
+		break;
+
+	case IPA_IOC_NAT_MODIFY_PDN:
+		break;
+
+	default:
+		IPAERR("unsupported ioctl 0x%lx\n", req);
+		ret = -ENOTTY;
+		break;
+	}
+
+	if (ret) {
+		errno = -ret;
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,70 @@
+/*
+Copyright (c) 2017, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef IPA_NAT_SIM_H
+#define IPA_NAT_SIM_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <linux/msm_ipa.h>
+
+/*
+	In-process stand-in for /dev/ipa and /dev/ipaNatTable. Builds with
+	FEATURE_IPA_NAT_SIM route the device calls of the nat driver here, so
+	the driver runs unchanged on a plain Linux host. The nat table memory
+	is heap backed and IPA_IOC_NAT_DMA writes go straight into it.
+*/
+
+#define IPA_NAT_SIM_IPA_FD  0x7ff0
+#define IPA_NAT_SIM_NAT_FD  0x7ff1
+
+/**
+ * struct ipa_nat_sim_stats - device calls seen by the simulator
+ * @dma_cmds: number of IPA_IOC_NAT_DMA commands
+ * @dma_writes: number of dma writes in those commands
+ * @max_dma_writes: largest command seen
+ */
+struct ipa_nat_sim_stats {
+	uint64_t dma_cmds;
+	uint64_t dma_writes;
+	uint32_t max_dma_writes;
+};
+
+void ipa_nat_sim_set_hw_ver(enum ipa_hw_type ver);
+void ipa_nat_sim_get_stats(struct ipa_nat_sim_stats *stats);
+void ipa_nat_sim_reset_stats(void);
+
+int ipa_nat_sim_open(const char *path, int flags, ...);
+int ipa_nat_sim_close(int fd);
+int ipa_nat_sim_ioctl(int fd, unsigned long req, ...);
+void *ipa_nat_sim_mmap(void *addr, size_t len, int prot,
+				int flags, int fd, off_t offset);
+int ipa_nat_sim_munmap(void *addr, size_t len);
+
+#endif /* IPA_NAT_SIM_H */
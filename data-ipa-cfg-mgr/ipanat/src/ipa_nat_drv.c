@@ -83,6 +83,48 @@ int ipa_nat_del_ipv4_tbl(uint32_t tbl_hdl)
   return ipa_nati_del_ipv4_table(tbl_hdl);
 }
 
+/**
+ * ipa_nat_resize_ipv4_tbl() - grow an ipv4 nat table
+ * @table_handle: [in] handle of ipv4 nat table
+ * @number_of_entries: [in] new number of nat entries
+ *
+ * Returns:	0  On Success, negative on failure
+ */
+int ipa_nat_resize_ipv4_tbl(uint32_t tbl_hdl,
+		uint16_t number_of_entries)
+{
+  if (IPA_NAT_INVALID_NAT_ENTRY == tbl_hdl ||
+      tbl_hdl > IPA_NAT_MAX_IP4_TBLS) {
+    IPAERR("invalid table handle passed \n");
+    return -EINVAL;
+  }
+  IPADBG("Passed Table Handle: 0x%x, entries %d\n", tbl_hdl, number_of_entries);
+
+  return ipa_nati_resize_ipv4_table(tbl_hdl, number_of_entries);
+}
+
+/**
+ * ipa_nat_set_auto_resize() - grow an ipv4 nat table when it fills up
+ * @table_handle: [in] handle of ipv4 nat table
+ * @threshold: [in] occupancy in percent that triggers the growth,
+ *  0 disables it
+ * @max_entries: [in] number of nat entries the table grows up to
+ *
+ * Returns:	0  On Success, negative on failure
+ */
+int ipa_nat_set_auto_resize(uint32_t tbl_hdl,
+		uint8_t threshold,
+		uint16_t max_entries)
+{
+  if (IPA_NAT_INVALID_NAT_ENTRY == tbl_hdl ||
+      tbl_hdl > IPA_NAT_MAX_IP4_TBLS || threshold > 100) {
+    IPAERR("invalid parameters passed \n");
+    return -EINVAL;
+  }
+
+  return ipa_nati_set_auto_resize(tbl_hdl, threshold, max_entries);
+}
+
 /**
  * ipa_nat_add_ipv4_rule() - to insert new ipv4 rule
  * @table_handle: [in] handle of ipv4 nat table
@@ -146,6 +188,75 @@ int ipa_nat_del_ipv4_rule(uint32_t tbl_hdl,
   return 0;
 }
 
+/**
+ * ipa_nat_add_ipv4_rules() - to insert a batch of ipv4 rules
+ * @table_handle: [in] handle of ipv4 nat table
+ * @rules: [in] array of new rules
+ * @num_rules: [in] number of rules in the array
+ * @rule_handles: [out] handle of each rule, 0 if the rule was not added
+ *
+ * To insert several ipv4 nat rules with as few hw commands as
+ * possible
+ *
+ * Returns:	0  On Success, negative if any rule failed
+ */
+int ipa_nat_add_ipv4_rules(uint32_t tbl_hdl,
+		const ipa_nat_ipv4_rule *clnt_rules,
+		uint16_t num_rules,
+		uint32_t *rule_hdls)
+{
+  int result = -EINVAL;
+
+  if (IPA_NAT_INVALID_NAT_ENTRY == tbl_hdl ||
+      tbl_hdl > IPA_NAT_MAX_IP4_TBLS || NULL == rule_hdls ||
+      NULL == clnt_rules) {
+    IPAERR("invalid parameters passed \n");
+    return result;
+  }
+  IPADBG("Passed Table handle: 0x%x, %d rules\n", tbl_hdl, num_rules);
+
+  result = ipa_nati_add_ipv4_rules(tbl_hdl, clnt_rules, num_rules, rule_hdls);
+  if (result) {
+    IPAERR("unable to add all the rules\n");
+    return result;
+  }
+
+  return 0;
+}
+
+/**
+ * ipa_nat_del_ipv4_rules() - to delete a batch of ipv4 nat rules
+ * @table_handle: [in] handle of ipv4 nat table
+ * @rule_handles: [in] array of ipv4 nat rule handles
+ * @num_rules: [in] number of handles in the array
+ *
+ * To delete several ipv4 nat rules with as few hw commands as
+ * possible
+ *
+ * Returns:	0  On Success, negative if any rule failed
+ */
+int ipa_nat_del_ipv4_rules(uint32_t tbl_hdl,
+		const uint32_t *rule_hdls,
+		uint16_t num_rules)
+{
+  int result = -EINVAL;
+
+  if (IPA_NAT_INVALID_NAT_ENTRY == tbl_hdl ||
+      tbl_hdl > IPA_NAT_MAX_IP4_TBLS || NULL == rule_hdls) {
+    IPAERR("invalid parameters passed \n");
+    return result;
+  }
+  IPADBG("Passed Table handle: 0x%x, %d rules\n", tbl_hdl, num_rules);
+
+  result = ipa_nati_del_ipv4_rules(tbl_hdl, rule_hdls, num_rules);
+  if (result) {
+    IPAERR("unable to delete all the rules from hw \n");
+    return result;
+  }
+
+  return 0;
+}
+
 /**
  * ipa_nat_query_timestamp() - to query timestamp
  * @table_handle: [in] handle of ipv4 nat table
@@ -199,7 +310,7 @@ int ipa_nat_modify_pdn(uint32_t  tbl_hdl,
 		return -EINVAL;
 	}
 
-	if (pdn_index > IPA_MAX_PDN_NUM) {
+	if (pdn_index >= IPA_MAX_PDN_NUM) {
 		IPAERR("PDN index is out of range %d", pdn_index);
 		return -EINVAL;
 	}
@@ -212,4 +323,137 @@ int ipa_nat_modify_pdn(uint32_t  tbl_hdl,
 	return ipa_nati_modify_pdn(&pdn_data);
 }
 
+/**
+ * ipa_nat_set_hash_mode() - select the hash of an ipv4 nat table
+ * @table_handle: [in] handle of ipv4 nat table
+ * @mode: [in] hash used to place the rules
+ * @seed: [in] seed of IPA_NAT_HASH_SEEDED, ignored otherwise
+ *
+ * The hash can only be changed while the table has no rules
+ *
+ * Returns:	0  On Success, negative on failure
+ */
+int ipa_nat_set_hash_mode(uint32_t tbl_hdl,
+	ipa_nat_hash_mode mode,
+	uint32_t seed)
+{
+	if (0 == tbl_hdl || tbl_hdl > IPA_NAT_MAX_IP4_TBLS) {
+		IPAERR("invalid parameters passed \n");
+		return -EINVAL;
+	}
+
+	if (IPA_NAT_HASH_XOR_FOLD != mode && IPA_NAT_HASH_SEEDED != mode) {
+		IPAERR("invalid hash mode %d\n", mode);
+		return -EINVAL;
+	}
+
+	return ipa_nati_set_hash_mode(tbl_hdl, mode, seed);
+}
+
+/**
+ * ipa_nat_get_hash_stats() - collision chain telemetry of a table
+ * @table_handle: [in] handle of ipv4 nat table
+ * @stats: [out] chain statistics of the base and index tables
+ *
+ * Returns:	0  On Success, negative on failure
+ */
+int ipa_nat_get_hash_stats(uint32_t tbl_hdl,
+	ipa_nat_hash_stats *stats)
+{
+	if (0 == tbl_hdl || tbl_hdl > IPA_NAT_MAX_IP4_TBLS ||
+			NULL == stats) {
+		IPAERR("invalid parameters passed \n");
+		return -EINVAL;
+	}
+
+	return ipa_nati_get_hash_stats(tbl_hdl, stats);
+}
+
+/**
+ * ipa_nat_get_tbl_metrics() - occupancy and health of a table
+ * @table_handle: [in] handle of ipv4 nat table
+ * @metrics: [out] metrics of the table
+ *
+ * Returns:	0  On Success, negative on failure
+ */
+int ipa_nat_get_tbl_metrics(uint32_t tbl_hdl,
+	ipa_nat_tbl_metrics *metrics)
+{
+	if (0 == tbl_hdl || tbl_hdl > IPA_NAT_MAX_IP4_TBLS ||
+			NULL == metrics) {
+		IPAERR("invalid parameters passed \n");
+		return -EINVAL;
+	}
+
+	return ipa_nati_get_tbl_metrics(tbl_hdl, metrics);
+}
+
+/**
+ * ipa_nat_snapshot_timestamps() - collect changed rule timestamps
+ * @table_handle: [in] handle of ipv4 nat table
+ * @rule_ts: [out] rule handle and timestamp pairs
+ * @max_rules: [in] number of elements of rule_ts
+ * @num_rules: [out] number of pairs filled in rule_ts
+ *
+ * Returns:	0  On Success, negative on failure
+ */
+int ipa_nat_snapshot_timestamps(uint32_t tbl_hdl,
+	ipa_nat_rule_ts *rule_ts,
+	uint16_t max_rules,
+	uint16_t *num_rules)
+{
+	if (0 == tbl_hdl || tbl_hdl > IPA_NAT_MAX_IP4_TBLS ||
+			NULL == rule_ts || 0 == max_rules || NULL == num_rules) {
+		IPAERR("invalid parameters passed \n");
+		return -EINVAL;
+	}
 
+	return ipa_nati_snapshot_timestamps(tbl_hdl, rule_ts,
+						max_rules, num_rules);
+}
+
+/**
+ * ipa_nat_rule_frees_room() - tell if deleting a rule helps a new one
+ * @table_handle: [in] handle of ipv4 nat table
+ * @rule_handle: [in] ipv4 nat rule handle of the rule to delete
+ * @clnt_rule: [in] rule to be added in its place
+ *
+ * Returns:	1 if it can, 0 if not, negative on failure
+ */
+int ipa_nat_rule_frees_room(uint32_t tbl_hdl,
+	uint32_t rule_hdl,
+	const ipa_nat_ipv4_rule *clnt_rule)
+{
+	if (0 == tbl_hdl || tbl_hdl > IPA_NAT_MAX_IP4_TBLS ||
+			NULL == clnt_rule || clnt_rule->pdn_index >= IPA_MAX_PDN_NUM) {
+		IPAERR("invalid parameters passed \n");
+		return -EINVAL;
+	}
+
+	return ipa_nati_rule_frees_room(tbl_hdl, rule_hdl, clnt_rule);
+}
+
+/**
+ * ipa_nat_reap_idle_rules() - remove the rules without traffic
+ * @table_handle: [in] handle of ipv4 nat table
+ * @cfg: [in] idle thresholds
+ * @cb: [in] called for each removed rule, may be NULL
+ * @arg: [in] passed to cb
+ * @num_reaped: [out] number of removed rules
+ *
+ * Returns:	0  On Success, negative on failure
+ */
+int ipa_nat_reap_idle_rules(uint32_t tbl_hdl,
+	const ipa_nat_reap_cfg *cfg,
+	ipa_nat_reap_cb cb,
+	void *arg,
+	uint16_t *num_reaped)
+{
+	if (0 == tbl_hdl || tbl_hdl > IPA_NAT_MAX_IP4_TBLS ||
+			NULL == cfg || 0 == cfg->max_rules || NULL == num_reaped) {
+		IPAERR("invalid parameters passed \n");
+		return -EINVAL;
+	}
+
+	return ipa_nati_reap_idle_rules(tbl_hdl, cfg, cb, arg, num_reaped);
+}
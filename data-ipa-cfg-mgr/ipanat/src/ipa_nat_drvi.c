@@ -27,6 +27,8 @@ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
 IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#define _GNU_SOURCE /* pthread_rwlockattr_setkind_np */
+
 #include "ipa_nat_drv.h"
 #include "ipa_nat_drvi.h"
 
@@ -47,9 +49,101 @@ static size_t strlcpy(char * dst, const char * src, size_t size) {
 
 
 struct ipa_nat_cache ipv4_nat_cache;
+
+/* Serializes table creation and deletion */
 pthread_mutex_t nat_mutex    = PTHREAD_MUTEX_INITIALIZER;
 
+/* Rules of a table change with its lock held exclusive, timestamp
+	 queries only read the table and share the lock */
+static pthread_rwlock_t nat_tbl_lock[IPA_NAT_MAX_IP4_TBLS];
+static pthread_once_t nat_tbl_lock_once = PTHREAD_ONCE_INIT;
+
 static ipa_nat_pdn_entry pdns[IPA_MAX_PDN_NUM];
+/* ones complement sum of pdns[].public_ip, see ipa_nati_set_pdn_ip() */
+static uint16_t pdn_ip_sums[IPA_MAX_PDN_NUM];
+
+static void ipa_nati_init_tbl_locks(void)
+{
+	pthread_rwlockattr_t attr;
+	int cnt;
+
+	pthread_rwlockattr_init(&attr);
+	/* the timestamp sweep must not starve rule add/delete */
+	pthread_rwlockattr_setkind_np(&attr,
+		PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+
+	for (cnt = 0; cnt < IPA_NAT_MAX_IP4_TBLS; cnt++) {
+		pthread_rwlock_init(&nat_tbl_lock[cnt], &attr);
+	}
+
+	pthread_rwlockattr_destroy(&attr);
+}
+
+static void ipa_nati_attach_tbl(uint8_t tbl_indx);
+
+/**
+ * ipa_nati_lock_tbl() - lock a nat table
+ * @tbl_indx: [in] nat table index
+ * @exclusive: [in] 1 to change the table, 0 to only read it
+ *
+ * Returns: 0 on success, negative on failure
+ */
+static int ipa_nati_lock_tbl(uint8_t tbl_indx, int exclusive)
+{
+	int ret;
+
+	pthread_once(&nat_tbl_lock_once, ipa_nati_init_tbl_locks);
+
+	if (exclusive) {
+		ret = pthread_rwlock_wrlock(&nat_tbl_lock[tbl_indx]);
+
+		/* a table detached by a failed resize goes back to the hw first */
+		if (!ret && ipv4_nat_cache.ip4_tbl[tbl_indx].detached) {
+			ipa_nati_attach_tbl(tbl_indx);
+		}
+	} else {
+		ret = pthread_rwlock_rdlock(&nat_tbl_lock[tbl_indx]);
+	}
+
+	return ret ? -1 : 0;
+}
+
+static int ipa_nati_unlock_tbl(uint8_t tbl_indx)
+{
+	return pthread_rwlock_unlock(&nat_tbl_lock[tbl_indx]) ? -1 : 0;
+}
+
+static int ipa_nati_grow_tbl(uint8_t tbl_indx, uint16_t new_rules);
+
+/* Posts a dma command to the IPA hw and accounts it to the table */
+static int ipa_nati_nat_dma(uint8_t tbl_indx, struct ipa_ioc_nat_dma_cmd *cmd)
+{
+	ipv4_nat_cache.ip4_tbl[tbl_indx].counters.dma_cmds++;
+	ipv4_nat_cache.ip4_tbl[tbl_indx].counters.dma_writes += cmd->entries;
+
+	return ioctl(ipv4_nat_cache.ipa_fd, IPA_IOC_NAT_DMA, cmd);
+}
+
+static uint64_t ipa_nati_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Counts a call started at start_us in its latency bucket */
+static void ipa_nati_record_latency(uint32_t *hist, uint64_t start_us)
+{
+	uint64_t elapsed = ipa_nati_now_us() - start_us;
+	int bucket = 0;
+
+	while (bucket < IPA_NAT_LATENCY_BUCKETS - 1 &&
+				 elapsed >= ((uint64_t)1 << bucket)) {
+		bucket++;
+	}
+	hist[bucket]++;
+}
 
 /* ------------------------------------------
 		UTILITY FUNCTIONS START
@@ -279,8 +373,39 @@ void GetNearestEven(uint16_t num, uint16_t *ret)
 	return;
 }
 
+/**
+ * ipa_nati_seeded_hash() - seeded multiply-xorshift hash
+ * @seed: [in] per table seed
+ * @words: [in] tuple to be hashed
+ * @cnt: [in] number of words in the tuple
+ *
+ * Every word is mixed with a multiply and an xorshift so that
+ * tuples differing only in a few bits still spread over the
+ * whole table
+ *
+ * Returns: 16 bit hash value
+ */
+static uint16_t ipa_nati_seeded_hash(uint32_t seed,
+			const uint32_t *words, int cnt)
+{
+	uint32_t hash = seed;
+	int i;
+
+	for (i = 0; i < cnt; i++) {
+		hash ^= words[i];
+		hash *= 0x9E3779B1;
+		hash ^= hash >> 15;
+	}
+
+	hash *= 0x85EBCA6B;
+	hash ^= hash >> 13;
+
+	return (uint16_t)(hash ^ (hash >> 16));
+}
+
 /**
  * dst_hash() - Find the index into ipv4 base table
+ * @tbl_ptr: [in] nat table the entry belongs to
  * @public_ip: [in] public_ip
  * @trgt_ip: [in] Target IP address
  * @trgt_port: [in]  Target port
@@ -295,16 +420,28 @@ void GetNearestEven(uint16_t num, uint16_t *ret)
  *
  * Returns: >0 index into ipv4 base table, negative on failure
  */
-static uint16_t dst_hash(uint32_t public_ip, uint32_t trgt_ip,
+static uint16_t dst_hash(const struct ipa_nat_ip4_table_cache *tbl_ptr,
+			uint32_t public_ip, uint32_t trgt_ip,
 			uint16_t trgt_port, uint16_t public_port,
 			uint8_t proto, uint16_t size)
 {
-	uint16_t hash = ((uint16_t)(trgt_ip)) ^ ((uint16_t)(trgt_ip >> 16)) ^
-		 (trgt_port) ^ (public_port) ^ (proto);
+	uint16_t hash;
+	uint32_t words[4];
+
+	if (IPA_NAT_HASH_SEEDED == tbl_ptr->hash_mode) {
+		words[0] = trgt_ip;
+		words[1] = public_ip;
+		words[2] = ((uint32_t)trgt_port << 16) | public_port;
+		words[3] = proto;
+		hash = ipa_nati_seeded_hash(tbl_ptr->hash_seed, words, 4);
+	} else {
+		hash = ((uint16_t)(trgt_ip)) ^ ((uint16_t)(trgt_ip >> 16)) ^
+			 (trgt_port) ^ (public_port) ^ (proto);
 
-	if (ipv4_nat_cache.ver >= IPA_HW_v4_0)
-		hash ^= ((uint16_t)(public_ip)) ^
-		((uint16_t)(public_ip >> 16));
+		if (ipv4_nat_cache.ver >= IPA_HW_v4_0)
+			hash ^= ((uint16_t)(public_ip)) ^
+			((uint16_t)(public_ip >> 16));
+	}
 
 	IPADBG("public ip 0x%X\n", public_ip);
 	IPADBG("trgt_ip: 0x%x trgt_port: 0x%x\n", trgt_ip, trgt_port);
@@ -325,6 +462,7 @@ static uint16_t dst_hash(uint32_t public_ip, uint32_t trgt_ip,
 
 /**
  * src_hash() - Find the index into ipv4 index base table
+ * @tbl_ptr: [in] nat table the entry belongs to
  * @priv_ip: [in] Private IP address
  * @priv_port: [in]  Private port
  * @trgt_ip: [in]  Target IP address
@@ -339,14 +477,26 @@ static uint16_t dst_hash(uint32_t public_ip, uint32_t trgt_ip,
  *
  * Returns: >0 index into ipv4 index base table, negative on failure
  */
-static uint16_t src_hash(uint32_t priv_ip, uint16_t priv_port,
+static uint16_t src_hash(const struct ipa_nat_ip4_table_cache *tbl_ptr,
+				uint32_t priv_ip, uint16_t priv_port,
 				uint32_t trgt_ip, uint16_t trgt_port,
 				uint8_t proto, uint16_t size)
 {
-	uint16_t hash =  ((uint16_t)(priv_ip)) ^ ((uint16_t)(priv_ip >> 16)) ^
-		 (priv_port) ^
-		 ((uint16_t)(trgt_ip)) ^ ((uint16_t)(trgt_ip >> 16)) ^
-		 (trgt_port) ^ (proto);
+	uint16_t hash;
+	uint32_t words[4];
+
+	if (IPA_NAT_HASH_SEEDED == tbl_ptr->hash_mode) {
+		words[0] = priv_ip;
+		words[1] = trgt_ip;
+		words[2] = ((uint32_t)priv_port << 16) | trgt_port;
+		words[3] = proto;
+		hash = ipa_nati_seeded_hash(tbl_ptr->hash_seed, words, 4);
+	} else {
+		hash =  ((uint16_t)(priv_ip)) ^ ((uint16_t)(priv_ip >> 16)) ^
+			 (priv_port) ^
+			 ((uint16_t)(trgt_ip)) ^ ((uint16_t)(trgt_ip >> 16)) ^
+			 (trgt_port) ^ (proto);
+	}
 
 	IPADBG("priv_ip: 0x%x priv_port: 0x%x\n", priv_ip, priv_port);
 	IPADBG("trgt_ip: 0x%x trgt_port: 0x%x\n", trgt_ip, trgt_port);
@@ -364,10 +514,49 @@ static uint16_t src_hash(uint32_t priv_ip, uint16_t priv_port,
 	return hash;
 }
 
+/**
+ * ipa_nati_cksum_fold() - fold a ones complement sum
+ * @sum: [in] sum of 16 bit words whose carries were not added back
+ *
+ * Adding the carries back once at the end gives the same result
+ * as adding them after every word, without a branch per word
+ *
+ * Returns: 16 bit ones complement sum
+ */
+static inline uint16_t ipa_nati_cksum_fold(uint32_t sum)
+{
+	sum = (sum & 0xFFFF) + (sum >> 16);
+	sum = (sum & 0xFFFF) + (sum >> 16);
+	return (uint16_t)sum;
+}
+
+/* Adds both 16 bit halves of a 32 bit word to an unfolded sum */
+static inline uint32_t ipa_nati_cksum_add32(uint32_t sum, uint32_t val)
+{
+	return sum + (val & 0xFFFF) + (val >> 16);
+}
+
+/**
+ * ipa_nati_set_pdn_ip() - set the public ip address of a PDN
+ * @pdn_index: [in] PDN index in the PDN config table
+ * @public_ip: [in] public ip address
+ *
+ * The public half of the checksum diffs only depends on the
+ * PDN, so its sum is computed here once rather than per rule
+ *
+ * Returns: None
+ */
+static void ipa_nati_set_pdn_ip(uint8_t pdn_index, uint32_t public_ip)
+{
+	pdns[pdn_index].public_ip = public_ip;
+	pdn_ip_sums[pdn_index] =
+		ipa_nati_cksum_fold(ipa_nati_cksum_add32(0, public_ip));
+}
+
 /**
  * ipa_nati_calc_ip_cksum() - Calculate the source nat
  *														 IP checksum diff
- * @pub_ip_addr: [in] public ip address
+ * @pub_ip_sum: [in] ones complement sum of public ip address
  * @priv_ip_addr: [in]	Private ip address
  *
  * source nat ip checksum different is calculated as
@@ -378,54 +567,16 @@ static uint16_t src_hash(uint32_t priv_ip, uint16_t priv_port,
  *
  * Returns: >0 ip checksum diff
  */
-static uint16_t ipa_nati_calc_ip_cksum(uint32_t pub_ip_addr,
+static inline uint16_t ipa_nati_calc_ip_cksum(uint16_t pub_ip_sum,
 										uint32_t priv_ip_addr)
 {
-	uint16_t ret;
-	uint32_t cksum = 0;
-
-	/* Add LSB(2 bytes) of public ip address to cksum */
-	cksum += (pub_ip_addr & 0xFFFF);
-
-	/* Add MSB(2 bytes) of public ip address to cksum
-		and check for carry forward(CF), if any add it
-	*/
-	cksum += (pub_ip_addr>>16);
-	if (cksum >> 16) {
-		cksum = (cksum & 0x0000FFFF);
-		cksum += 1;
-	}
-
-	/* Calculate the 1's complement of private ip address */
-	priv_ip_addr = (~priv_ip_addr);
-
-	/* Add LSB(2 bytes) of private ip address to cksum
-		 and check for carry forward(CF), if any add it
-	*/
-	cksum += (priv_ip_addr & 0xFFFF);
-	if (cksum >> 16) {
-		cksum = (cksum & 0x0000FFFF);
-		cksum += 1;
-	}
-
-	/* Add MSB(2 bytes) of private ip address to cksum
-		 and check for carry forward(CF), if any add it
-	*/
-	cksum += (priv_ip_addr>>16);
-	if (cksum >> 16) {
-		cksum = (cksum & 0x0000FFFF);
-		cksum += 1;
-	}
-
-	/* Return the LSB(2 bytes) of checksum	*/
-	ret = (uint16_t)cksum;
-	return ret;
+	return ipa_nati_cksum_fold(ipa_nati_cksum_add32(pub_ip_sum, ~priv_ip_addr));
 }
 
 /**
  * ipa_nati_calc_tcp_udp_cksum() - Calculate the source nat
  *																TCP/UDP checksum diff
- * @pub_ip_addr: [in] public ip address
+ * @pub_ip_sum: [in] ones complement sum of public ip address
  * @pub_port: [in] public tcp/udp port
  * @priv_ip_addr: [in]	Private ip address
  * @priv_port: [in] Private tcp/udp prot
@@ -438,69 +589,48 @@ static uint16_t ipa_nati_calc_ip_cksum(uint32_t pub_ip_addr,
  *
  * Returns: >0 tcp/udp checksum diff
  */
-static uint16_t ipa_nati_calc_tcp_udp_cksum(uint32_t pub_ip_addr,
+static inline uint16_t ipa_nati_calc_tcp_udp_cksum(uint16_t pub_ip_sum,
 										uint16_t pub_port,
 										uint32_t priv_ip_addr,
 										uint16_t priv_port)
 {
-	uint16_t ret = 0;
-	uint32_t cksum = 0;
-
-	/* Add LSB(2 bytes) of public ip address to cksum */
-	cksum += (pub_ip_addr & 0xFFFF);
-
-	/* Add MSB(2 bytes) of public ip address to cksum
-		and check for carry forward(CF), if any add it
-	*/
-	cksum += (pub_ip_addr>>16);
-	if (cksum >> 16) {
-		cksum = (cksum & 0x0000FFFF);
-		cksum += 1;
-	}
+	uint32_t cksum;
 
-	/* Add public port to cksum and
-		 check for carry forward(CF), if any add it */
-	cksum += pub_port;
-	if (cksum >> 16) {
-		cksum = (cksum & 0x0000FFFF);
-		cksum += 1;
-	}
+	cksum = ipa_nati_cksum_add32(pub_ip_sum + pub_port, ~priv_ip_addr);
+	cksum += (uint16_t)(~priv_port);
 
-	/* Calculate the 1's complement of private ip address */
-	priv_ip_addr = (~priv_ip_addr);
+	return ipa_nati_cksum_fold(cksum);
+}
 
-	/* Add LSB(2 bytes) of private ip address to cksum
-		 and check for carry forward(CF), if any add it
-	*/
-	cksum += (priv_ip_addr & 0xFFFF);
-	if (cksum >> 16) {
-		cksum = (cksum & 0x0000FFFF);
-		cksum += 1;
-	}
+/* Records rule handle cnt + 1 as the owner of the given table entry */
+static void ipa_nati_assign_rule_hdl(struct ipa_nat_ip4_table_cache *tbl_ptr,
+				uint16_t tbl_entry,
+				uint16_t cnt)
+{
+	uint16_t rule_hdl;
 
-	/* Add MSB(2 bytes) of private ip address to cksum
-		 and check for carry forward(CF), if any add
-	*/
-	cksum += (priv_ip_addr>>16);
-	if (cksum >> 16) {
-		cksum = (cksum & 0x0000FFFF);
-		cksum += 1;
-	}
+	if (tbl_entry >= tbl_ptr->table_entries) {
+		/* Increase the current expansion table count */
+		tbl_ptr->cur_expn_tbl_cnt++;
 
-	/* Calculate the 1's complement of private port */
-	priv_port = (~priv_port);
+		/* Update the index into table */
+		rule_hdl = tbl_entry - tbl_ptr->table_entries;
+		rule_hdl = (rule_hdl << IPA_NAT_RULE_HDL_TBL_TYPE_BITS);
+		/* Update the table type mask */
+		rule_hdl = (rule_hdl | IPA_NAT_RULE_HDL_TBL_TYPE_MASK);
+	} else {
+		/* Increase the current count */
+		tbl_ptr->cur_tbl_cnt++;
 
-	/* Add public port to cksum and
-	 check for carry forward(CF), if any add it */
-	cksum += priv_port;
-	if (cksum >> 16) {
-		cksum = (cksum & 0x0000FFFF);
-		cksum += 1;
+		rule_hdl = tbl_entry;
+		rule_hdl = (rule_hdl << IPA_NAT_RULE_HDL_TBL_TYPE_BITS);
 	}
 
-	/* return the LSB(2 bytes) of checksum */
-	ret = (uint16_t)cksum;
-	return ret;
+	tbl_ptr->rule_id_array[cnt] = rule_hdl;
+	tbl_ptr->slot_rule_hdl[tbl_entry] = cnt + 1;
+	tbl_ptr->slot_last_ts[tbl_entry] = 0;
+	tbl_ptr->slot_reap_ts[tbl_entry] = 0;
+	tbl_ptr->slot_active[tbl_entry] = 0;
 }
 
 /**
@@ -518,36 +648,19 @@ uint16_t ipa_nati_make_rule_hdl(uint16_t tbl_hdl,
 				uint16_t tbl_entry)
 {
 	struct ipa_nat_ip4_table_cache *tbl_ptr;
-	uint16_t rule_hdl = 0;
 	uint16_t cnt = 0;
 
 	tbl_ptr = &ipv4_nat_cache.ip4_tbl[tbl_hdl-1];
 
-	if (tbl_entry >= tbl_ptr->table_entries) {
-		/* Increase the current expansion table count */
-		tbl_ptr->cur_expn_tbl_cnt++;
-
-		/* Update the index into table */
-		rule_hdl = tbl_entry - tbl_ptr->table_entries;
-		rule_hdl = (rule_hdl << IPA_NAT_RULE_HDL_TBL_TYPE_BITS);
-		/* Update the table type mask */
-		rule_hdl = (rule_hdl | IPA_NAT_RULE_HDL_TBL_TYPE_MASK);
-	} else {
-		/* Increase the current count */
-		tbl_ptr->cur_tbl_cnt++;
-
-		rule_hdl = tbl_entry;
-		rule_hdl = (rule_hdl << IPA_NAT_RULE_HDL_TBL_TYPE_BITS);
-	}
-
-	for (; cnt < (tbl_ptr->table_entries + tbl_ptr->expn_table_entries); cnt++) {
-		if (IPA_NAT_INVALID_NAT_ENTRY == tbl_ptr->rule_id_array[cnt]) {
-			tbl_ptr->rule_id_array[cnt] = rule_hdl;
-			return cnt + 1;
-		}
+	if (0 == tbl_ptr->rule_id_free_cnt) {
+		IPAERR("no free rule handle available\n");
+		return 0;
 	}
 
-	return 0;
+	/* Take the next free slot of rule_id_array from the free list */
+	cnt = tbl_ptr->rule_id_free_list[--tbl_ptr->rule_id_free_cnt];
+	ipa_nati_assign_rule_hdl(tbl_ptr, tbl_entry, cnt);
+	return cnt + 1;
 }
 
 /**
@@ -573,7 +686,8 @@ void ipa_nati_parse_ipv4_rule_hdl(uint8_t tbl_index,
 	*tbl_entry = IPA_NAT_INVALID_NAT_ENTRY;
 	tbl_ptr = &ipv4_nat_cache.ip4_tbl[tbl_index];
 
-	if (rule_hdl >= (tbl_ptr->table_entries + tbl_ptr->expn_table_entries)) {
+	if (IPA_NAT_INVALID_NAT_ENTRY == rule_hdl ||
+			rule_hdl >= (tbl_ptr->table_entries + tbl_ptr->expn_table_entries)) {
 		IPAERR("invalid rule handle\n");
 		return;
 	}
@@ -591,6 +705,26 @@ void ipa_nati_parse_ipv4_rule_hdl(uint8_t tbl_index,
 	return;
 }
 
+/* Gives the rule handle of a deleted rule back to the free list */
+static void ipa_nati_release_rule_hdl(struct ipa_nat_ip4_table_cache *tbl_ptr,
+				uint16_t rule_hdl)
+{
+	uint16_t rule_id = tbl_ptr->rule_id_array[rule_hdl-1];
+	uint16_t slot = (rule_id >> IPA_NAT_RULE_HDL_TBL_TYPE_BITS);
+
+	if (rule_id & IPA_NAT_RULE_HDL_TBL_TYPE_MASK) {
+		slot += tbl_ptr->table_entries;
+		tbl_ptr->cur_expn_tbl_cnt--;
+	} else {
+		tbl_ptr->cur_tbl_cnt--;
+	}
+	tbl_ptr->slot_rule_hdl[slot] = IPA_NAT_INVALID_NAT_ENTRY;
+
+	tbl_ptr->rule_id_array[rule_hdl-1] = IPA_NAT_INVALID_NAT_ENTRY;
+	tbl_ptr->rule_id_free_list[tbl_ptr->rule_id_free_cnt++] =
+		(uint16_t)(rule_hdl - 1);
+}
+
 uint32_t ipa_nati_get_entry_offset(struct ipa_nat_ip4_table_cache *cache_ptr,
 						nat_table_type tbl_type,
 						uint16_t	tbl_entry)
@@ -673,20 +807,36 @@ void ipa_nati_reset_tbl(uint8_t tbl_indx)
 				 0,
 				 IPA_NAT_INDEX_TABLE_ENTRY_SIZE * expn_table_entries);
 
+	/* Every slot is free again after the reset */
+	ipa_nati_rebuild_free_lists(&ipv4_nat_cache.ip4_tbl[tbl_indx]);
+	memset(&ipv4_nat_cache.ip4_tbl[tbl_indx].hash_stats, 0,
+				 sizeof(ipv4_nat_cache.ip4_tbl[tbl_indx].hash_stats));
+	memset(&ipv4_nat_cache.ip4_tbl[tbl_indx].counters, 0,
+				 sizeof(ipv4_nat_cache.ip4_tbl[tbl_indx].counters));
+
 	IPADBG("returning from ipa_nati_reset_tbl()\n");
 	return;
 }
 
-int ipa_nati_add_ipv4_tbl(uint32_t public_ip_addr,
-				uint16_t number_of_entries,
-				uint32_t *tbl_hdl)
+/**
+ * ipa_nati_create_tbl() - allocate and initialize a nat table
+ * @tbl_indx: [in] index of the table in the cache
+ * @public_ip_addr: [in] public ipv4 address
+ * @number_of_entries: [in] number of nat entries
+ *
+ * Allocates the table memory, maps it, resets it and posts
+ * the init command to the IPA hw
+ *
+ * Returns: 0 on success, negative on failure
+ */
+static int ipa_nati_create_tbl(uint8_t tbl_indx,
+				uint32_t public_ip_addr,
+				uint16_t number_of_entries)
 {
 	struct ipa_ioc_nat_alloc_mem mem;
-	uint8_t tbl_indx = ipv4_nat_cache.table_cnt;
 	uint16_t table_entries, expn_table_entries;
 	int ret;
 
-	*tbl_hdl = 0;
 	/* Allocate table */
 	memset(&mem, 0, sizeof(mem));
 	ret = ipa_nati_alloc_table(number_of_entries,
@@ -702,7 +852,8 @@ int ipa_nati_add_ipv4_tbl(uint32_t public_ip_addr,
 		 The (IPA_NAT_UNUSED_BASE_ENTRIES/2) indicates zero entry entries
 		 for both base and expansion table
 	*/
-	ret = ipa_nati_update_cache(&mem,
+	ret = ipa_nati_update_cache(tbl_indx,
+															&mem,
 															public_ip_addr,
 															table_entries,
 															expn_table_entries);
@@ -721,11 +872,28 @@ int ipa_nati_add_ipv4_tbl(uint32_t public_ip_addr,
 		return -EINVAL;
 	}
 
+	ipv4_nat_cache.ip4_tbl[tbl_indx].num_entries = number_of_entries;
+	return 0;
+}
+
+int ipa_nati_add_ipv4_tbl(uint32_t public_ip_addr,
+				uint16_t number_of_entries,
+				uint32_t *tbl_hdl)
+{
+	int ret;
+
+	*tbl_hdl = 0;
+	ret = ipa_nati_create_tbl(ipv4_nat_cache.table_cnt,
+					public_ip_addr, number_of_entries);
+	if (0 != ret) {
+		return ret;
+	}
+
 	/* store the initial public ip address in the cached pdn table
 		this is backward compatible for pre IPAv4 versions, we will always
 		use this ip as the single PDN address
 	*/
-	pdns[0].public_ip = public_ip_addr;
+	ipa_nati_set_pdn_ip(0, public_ip_addr);
 
 	/* Return table handle */
 	ipv4_nat_cache.table_cnt++;
@@ -737,18 +905,18 @@ int ipa_nati_add_ipv4_tbl(uint32_t public_ip_addr,
 	return 0;
 }
 
-int ipa_nati_alloc_table(uint16_t number_of_entries,
-				struct ipa_ioc_nat_alloc_mem *mem,
+/**
+ * ipa_nati_calc_tbl_entries() - size of the tables of a nat table
+ * @number_of_entries: [in] number of nat entries
+ * @table_entries: [out] number of base table entries
+ * @expn_table_entries: [out] number of expansion table entries
+ *
+ * Returns: 0 on success, negative on failure
+ */
+static int ipa_nati_calc_tbl_entries(uint16_t number_of_entries,
 				uint16_t *table_entries,
 				uint16_t *expn_table_entries)
 {
-	int fd = 0, ret;
-	uint16_t total_entries;
-
-	/* Copy the table name */
-	strlcpy(mem->dev_name, NAT_DEV_NAME, IPA_RESOURCE_NAME_MAX);
-
-	/* Calculate the size for base table and expansion table */
 	*table_entries = (uint16_t)(number_of_entries * IPA_NAT_BASE_TABLE_PERCENTAGE);
 	if (*table_entries == 0) {
 		*table_entries = 1;
@@ -761,6 +929,27 @@ int ipa_nati_alloc_table(uint16_t number_of_entries,
 	*expn_table_entries = (uint16_t)(number_of_entries * IPA_NAT_EXPANSION_TABLE_PERCENTAGE);
 	GetNearestEven(*expn_table_entries, expn_table_entries);
 
+	return 0;
+}
+
+int ipa_nati_alloc_table(uint16_t number_of_entries,
+				struct ipa_ioc_nat_alloc_mem *mem,
+				uint16_t *table_entries,
+				uint16_t *expn_table_entries)
+{
+	int fd = 0, ret;
+	uint16_t total_entries;
+
+	/* Copy the table name */
+	strlcpy(mem->dev_name, NAT_DEV_NAME, IPA_RESOURCE_NAME_MAX);
+
+	/* Calculate the size for base table and expansion table */
+	ret = ipa_nati_calc_tbl_entries(number_of_entries,
+					table_entries, expn_table_entries);
+	if (ret) {
+		return ret;
+	}
+
 	total_entries = (*table_entries)+(*expn_table_entries);
 
 	/* Calclate the memory size for both table and index table entries */
@@ -789,12 +978,13 @@ int ipa_nati_alloc_table(uint16_t number_of_entries,
 }
 
 
-int ipa_nati_update_cache(struct ipa_ioc_nat_alloc_mem *mem,
+int ipa_nati_update_cache(uint8_t tbl_indx,
+				struct ipa_ioc_nat_alloc_mem *mem,
 				uint32_t public_addr,
 				uint16_t tbl_entries,
 				uint16_t expn_tbl_entries)
 {
-	uint32_t index = ipv4_nat_cache.table_cnt;
+	uint32_t index = tbl_indx;
 	char *ipv4_rules_addr = NULL;
 
 	int fd = 0;
@@ -847,6 +1037,77 @@ int ipa_nati_update_cache(struct ipa_ioc_nat_alloc_mem *mem,
 					 sizeof(uint16_t) * (tbl_entries + expn_tbl_entries));
 	}
 
+	/* Allocate memory for the timestamp snapshot state */
+	if (NULL == ipv4_nat_cache.ip4_tbl[index].slot_rule_hdl) {
+		ipv4_nat_cache.ip4_tbl[index].slot_rule_hdl =
+			 calloc(tbl_entries + expn_tbl_entries, sizeof(uint16_t));
+
+		if (NULL == ipv4_nat_cache.ip4_tbl[index].slot_rule_hdl) {
+			IPAERR("Fail to allocate slot rule handle array\n");
+			return -ENOMEM;
+		}
+	}
+
+	if (NULL == ipv4_nat_cache.ip4_tbl[index].slot_last_ts) {
+		ipv4_nat_cache.ip4_tbl[index].slot_last_ts =
+			 calloc(tbl_entries + expn_tbl_entries, sizeof(uint32_t));
+
+		if (NULL == ipv4_nat_cache.ip4_tbl[index].slot_last_ts) {
+			IPAERR("Fail to allocate slot timestamp array\n");
+			return -ENOMEM;
+		}
+	}
+
+	if (NULL == ipv4_nat_cache.ip4_tbl[index].slot_reap_ts) {
+		ipv4_nat_cache.ip4_tbl[index].slot_reap_ts =
+			 calloc(tbl_entries + expn_tbl_entries, sizeof(uint32_t));
+
+		if (NULL == ipv4_nat_cache.ip4_tbl[index].slot_reap_ts) {
+			IPAERR("Fail to allocate slot reaper timestamp array\n");
+			return -ENOMEM;
+		}
+	}
+
+	if (NULL == ipv4_nat_cache.ip4_tbl[index].slot_active) {
+		ipv4_nat_cache.ip4_tbl[index].slot_active =
+			 calloc(tbl_entries + expn_tbl_entries, sizeof(uint32_t));
+
+		if (NULL == ipv4_nat_cache.ip4_tbl[index].slot_active) {
+			IPAERR("Fail to allocate slot activity array\n");
+			return -ENOMEM;
+		}
+	}
+
+	/* Allocate memory for the free slot lists */
+	if (NULL == ipv4_nat_cache.ip4_tbl[index].expn_free_list) {
+		ipv4_nat_cache.ip4_tbl[index].expn_free_list =
+			 malloc(sizeof(uint16_t) * expn_tbl_entries);
+
+		if (NULL == ipv4_nat_cache.ip4_tbl[index].expn_free_list) {
+			IPAERR("Fail to allocate expansion table free list\n");
+			return -ENOMEM;
+		}
+	}
+
+	if (NULL == ipv4_nat_cache.ip4_tbl[index].index_expn_free_list) {
+		ipv4_nat_cache.ip4_tbl[index].index_expn_free_list =
+			 malloc(sizeof(uint16_t) * expn_tbl_entries);
+
+		if (NULL == ipv4_nat_cache.ip4_tbl[index].index_expn_free_list) {
+			IPAERR("Fail to allocate index expansion table free list\n");
+			return -ENOMEM;
+		}
+	}
+
+	if (NULL == ipv4_nat_cache.ip4_tbl[index].rule_id_free_list) {
+		ipv4_nat_cache.ip4_tbl[index].rule_id_free_list =
+			 malloc(sizeof(uint16_t) * (tbl_entries + expn_tbl_entries));
+
+		if (NULL == ipv4_nat_cache.ip4_tbl[index].rule_id_free_list) {
+			IPAERR("Fail to allocate rule id free list\n");
+			return -ENOMEM;
+		}
+	}
 
 	/* open the nat table */
 	strlcpy(mem->dev_name, NAT_DEV_FULL_NAME, IPA_RESOURCE_NAME_MAX);
@@ -906,6 +1167,9 @@ int ipa_nati_update_cache(struct ipa_ioc_nat_alloc_mem *mem,
 	(IPA_NAT_TABLE_ENTRY_SIZE * (tbl_entries + expn_tbl_entries))+
 	(IPA_NAT_INDEX_TABLE_ENTRY_SIZE * tbl_entries);
 
+	/* Build the free slot lists from the mapped tables */
+	ipa_nati_rebuild_free_lists(&ipv4_nat_cache.ip4_tbl[index]);
+
 	return 0;
 }
 
@@ -946,22 +1210,25 @@ int ipa_nati_post_ipv4_init_cmd(uint8_t tbl_index)
 	return 0;
 }
 
-int ipa_nati_del_ipv4_table(uint32_t tbl_hdl)
+/**
+ * ipa_nati_unmap_tbl() - give the memory of a nat table back
+ * @index: [in] index of the table in the cache
+ *
+ * Unmaps the table memory and posts the delete command to the
+ * IPA hw. The memory of a detached table is only freed. The
+ * cache of the table is left as is
+ *
+ * Returns: 0 on success, negative on failure
+ */
+static int ipa_nati_unmap_tbl(uint8_t index)
 {
-	uint8_t index = (uint8_t)(tbl_hdl - 1);
 	void *addr = (void *)ipv4_nat_cache.ip4_tbl[index].ipv4_rules_addr;
 	struct ipa_ioc_v4_nat_del del_cmd;
 	int ret;
 
-	if (!ipv4_nat_cache.ip4_tbl[index].valid) {
-		IPAERR("invalid table handle passed\n");
-		ret = -EINVAL;
-		goto fail;
-	}
-
-	if (pthread_mutex_lock(&nat_mutex) != 0) {
-		ret = -1;
-		goto lock_mutex_fail;
+	if (ipv4_nat_cache.ip4_tbl[index].detached) {
+		free(addr);
+		return 0;
 	}
 
 	/* unmap the device memory from user space */
@@ -975,36 +1242,98 @@ int ipa_nati_del_ipv4_table(uint32_t tbl_hdl)
 	/* close the file descriptor of nat device */
 	if (close(ipv4_nat_cache.ip4_tbl[index].nat_fd)) {
 		IPAERR("unable to close the file descriptor\n");
-		ret = -EINVAL;
-		if (pthread_mutex_unlock(&nat_mutex) != 0)
-			goto unlock_mutex_fail;
-		goto fail;
+		return -EINVAL;
 	}
 
 	del_cmd.table_index = index;
 	del_cmd.public_ip_addr = ipv4_nat_cache.ip4_tbl[index].public_addr;
 	ret = ioctl(ipv4_nat_cache.ipa_fd, IPA_IOC_V4_DEL_NAT, &del_cmd);
 	if (ret != 0) {
-		perror("ipa_nati_del_ipv4_table(): ioctl error value");
+		perror("ipa_nati_unmap_tbl(): ioctl error value");
 		IPAERR("unable to post nat del command init Error: %d\n", ret);
 		IPADBG("ipa fd %d\n", ipv4_nat_cache.ipa_fd);
-		ret = -EINVAL;
-		if (pthread_mutex_unlock(&nat_mutex) != 0)
-			goto unlock_mutex_fail;
-		goto fail;
+		return -EINVAL;
 	}
 	IPAERR("posted IPA_IOC_V4_DEL_NAT to kernel successfully\n");
 
-	free(ipv4_nat_cache.ip4_tbl[index].index_expn_table_meta);
-	free(ipv4_nat_cache.ip4_tbl[index].rule_id_array);
+	return 0;
+}
+
+static void ipa_nati_free_tbl_cache(struct ipa_nat_ip4_table_cache *tbl_ptr)
+{
+	free(tbl_ptr->index_expn_table_meta);
+	free(tbl_ptr->rule_id_array);
+	free(tbl_ptr->expn_free_list);
+	free(tbl_ptr->index_expn_free_list);
+	free(tbl_ptr->rule_id_free_list);
+	free(tbl_ptr->slot_rule_hdl);
+	free(tbl_ptr->slot_last_ts);
+	free(tbl_ptr->slot_reap_ts);
+	free(tbl_ptr->slot_active);
+}
+
+/**
+ * ipa_nati_release_tbl() - free a nat table
+ * @index: [in] index of the table in the cache
+ *
+ * Unmaps the table memory, posts the delete command to the
+ * IPA hw and clears the cache of the table
+ *
+ * Returns: 0 on success, negative on failure
+ */
+static int ipa_nati_release_tbl(uint8_t index)
+{
+	int ret;
+
+	ret = ipa_nati_unmap_tbl(index);
+	if (ret) {
+		return ret;
+	}
 
+	ipa_nati_free_tbl_cache(&ipv4_nat_cache.ip4_tbl[index]);
 	memset(&ipv4_nat_cache.ip4_tbl[index],
 				 0,
 				 sizeof(ipv4_nat_cache.ip4_tbl[index]));
 
+	return 0;
+}
+
+int ipa_nati_del_ipv4_table(uint32_t tbl_hdl)
+{
+	uint8_t index = (uint8_t)(tbl_hdl - 1);
+	int ret;
+
+	if (!ipv4_nat_cache.ip4_tbl[index].valid) {
+		IPAERR("invalid table handle passed\n");
+		ret = -EINVAL;
+		goto fail;
+	}
+
+	if (pthread_mutex_lock(&nat_mutex) != 0) {
+		ret = -1;
+		goto lock_mutex_fail;
+	}
+
+	/* wait for the rule operations in flight on the table */
+	if (ipa_nati_lock_tbl(index, 1) != 0) {
+		ret = -1;
+		if (pthread_mutex_unlock(&nat_mutex) != 0)
+			goto unlock_mutex_fail;
+		goto lock_mutex_fail;
+	}
+
+	ret = ipa_nati_release_tbl(index);
+	if (ret != 0) {
+		ipa_nati_unlock_tbl(index);
+		if (pthread_mutex_unlock(&nat_mutex) != 0)
+			goto unlock_mutex_fail;
+		goto fail;
+	}
+
 	/* Decrease the table count by 1*/
 	ipv4_nat_cache.table_cnt--;
 
+	ipa_nati_unlock_tbl(index);
 	if (pthread_mutex_unlock(&nat_mutex) != 0) {
 		ret = -1;
 		goto unlock_mutex_fail;
@@ -1037,8 +1366,8 @@ int ipa_nati_query_timestamp(uint32_t  tbl_hdl,
 		return -EINVAL;
 	}
 
-	if (pthread_mutex_lock(&nat_mutex) != 0) {
-		IPAERR("unable to lock the nat mutex\n");
+	if (ipa_nati_lock_tbl(tbl_index, 0) != 0) {
+		IPAERR("unable to lock the nat table\n");
 		return -1;
 	}
 
@@ -1056,8 +1385,8 @@ int ipa_nati_query_timestamp(uint32_t  tbl_hdl,
 		*time_stamp = Read32BitFieldValue(tbl_ptr[tbl_entry].ts_proto,
 					TIME_STAMP_FIELD);
 
-	if (pthread_mutex_unlock(&nat_mutex) != 0) {
-		IPAERR("unable to unlock the nat mutex\n");
+	if (ipa_nati_unlock_tbl(tbl_index) != 0) {
+		IPAERR("unable to unlock the nat table\n");
 		return -1;
 	}
 
@@ -1078,7 +1407,7 @@ int ipa_nati_modify_pdn(struct ipa_ioc_nat_pdn_entry *entry)
 		return -EIO;
 	}
 
-	pdns[entry->pdn_index].public_ip = entry->public_ip;
+	ipa_nati_set_pdn_ip(entry->pdn_index, entry->public_ip);
 	pdns[entry->pdn_index].dst_metadata = entry->dst_metadata;
 	pdns[entry->pdn_index].src_metadata = entry->src_metadata;
 
@@ -1088,6 +1417,282 @@ int ipa_nati_modify_pdn(struct ipa_ioc_nat_pdn_entry *entry)
 	return 0;
 }
 
+/**
+ * ipa_nati_set_hash_mode() - select the hash of a nat table
+ * @tbl_hdl: [in] nat table handle
+ * @mode: [in] hash used to place the rules
+ * @seed: [in] seed of IPA_NAT_HASH_SEEDED
+ *
+ * The IPA hw looks the rules up with the xor fold hash, so
+ * the seeded hash is only accepted by builds doing the
+ * lookups in sw (FEATURE_IPA_NAT_SW_LOOKUP)
+ *
+ * Returns: 0 on success, negative on failure
+ */
+int ipa_nati_set_hash_mode(uint32_t tbl_hdl,
+				ipa_nat_hash_mode mode,
+				uint32_t seed)
+{
+	struct ipa_nat_ip4_table_cache *tbl_ptr;
+	int ret = 0;
+
+#ifndef FEATURE_IPA_NAT_SW_LOOKUP
+	if (IPA_NAT_HASH_SEEDED == mode) {
+		IPAERR("hw lookups need the xor fold hash\n");
+		return -EOPNOTSUPP;
+	}
+#endif
+
+	if (ipa_nati_lock_tbl((uint8_t)(tbl_hdl - 1), 1) != 0) {
+		IPAERR("unable to lock the nat table\n");
+		return -1;
+	}
+
+	tbl_ptr = &ipv4_nat_cache.ip4_tbl[tbl_hdl - 1];
+	if (!tbl_ptr->valid) {
+		IPAERR("invalid table handle\n");
+		ret = -EINVAL;
+	} else if (tbl_ptr->rule_id_free_cnt !=
+						 tbl_ptr->table_entries + tbl_ptr->expn_table_entries) {
+		IPAERR("hash can't be changed while the table has rules\n");
+		ret = -EBUSY;
+	} else {
+		tbl_ptr->hash_mode = mode;
+		tbl_ptr->hash_seed = seed;
+		memset(&tbl_ptr->hash_stats, 0, sizeof(tbl_ptr->hash_stats));
+		IPADBG("table %d hash mode %d seed 0x%x\n", tbl_hdl, mode, seed);
+	}
+
+	if (ipa_nati_unlock_tbl((uint8_t)(tbl_hdl - 1)) != 0) {
+		IPAERR("unable to unlock the nat table\n");
+		return -1;
+	}
+
+	return ret;
+}
+
+int ipa_nati_get_hash_stats(uint32_t tbl_hdl,
+				ipa_nat_hash_stats *stats)
+{
+	struct ipa_nat_ip4_table_cache *tbl_ptr;
+	int ret = 0;
+
+	if (ipa_nati_lock_tbl((uint8_t)(tbl_hdl - 1), 0) != 0) {
+		IPAERR("unable to lock the nat table\n");
+		return -1;
+	}
+
+	tbl_ptr = &ipv4_nat_cache.ip4_tbl[tbl_hdl - 1];
+	if (!tbl_ptr->valid) {
+		IPAERR("invalid table handle\n");
+		ret = -EINVAL;
+	} else {
+		*stats = tbl_ptr->hash_stats;
+	}
+
+	if (ipa_nati_unlock_tbl((uint8_t)(tbl_hdl - 1)) != 0) {
+		IPAERR("unable to unlock the nat table\n");
+		return -1;
+	}
+
+	return ret;
+}
+
+int ipa_nati_get_tbl_metrics(uint32_t tbl_hdl,
+				ipa_nat_tbl_metrics *metrics)
+{
+	struct ipa_nat_ip4_table_cache *tbl_ptr;
+	int ret = 0;
+
+	if (ipa_nati_lock_tbl((uint8_t)(tbl_hdl - 1), 0) != 0) {
+		IPAERR("unable to lock the nat table\n");
+		return -1;
+	}
+
+	tbl_ptr = &ipv4_nat_cache.ip4_tbl[tbl_hdl - 1];
+	if (!tbl_ptr->valid) {
+		IPAERR("invalid table handle\n");
+		ret = -EINVAL;
+	} else {
+		memset(metrics, 0, sizeof(*metrics));
+		metrics->base_entries = tbl_ptr->table_entries;
+		metrics->base_used = tbl_ptr->cur_tbl_cnt;
+		metrics->expn_entries = tbl_ptr->expn_table_entries;
+		metrics->expn_used = tbl_ptr->cur_expn_tbl_cnt;
+		metrics->index_expn_entries = tbl_ptr->expn_table_entries;
+		metrics->index_expn_used =
+			tbl_ptr->expn_table_entries - 1 - tbl_ptr->index_expn_free_cnt;
+		metrics->hash = tbl_ptr->hash_stats;
+		metrics->failed_inserts = tbl_ptr->counters.failed_inserts;
+		metrics->dma_cmds = tbl_ptr->counters.dma_cmds;
+		metrics->dma_writes = tbl_ptr->counters.dma_writes;
+		memcpy(metrics->add_latency, tbl_ptr->counters.add_latency,
+					 sizeof(metrics->add_latency));
+		memcpy(metrics->del_latency, tbl_ptr->counters.del_latency,
+					 sizeof(metrics->del_latency));
+	}
+
+	if (ipa_nati_unlock_tbl((uint8_t)(tbl_hdl - 1)) != 0) {
+		IPAERR("unable to unlock the nat table\n");
+		return -1;
+	}
+
+	return ret;
+}
+
+/**
+ * ipa_nati_snapshot_timestamps() - collect changed rule timestamps
+ * @tbl_hdl: [in] nat table handle
+ * @rule_ts: [out] rule handle and timestamp pairs
+ * @max_rules: [in] number of elements of rule_ts
+ * @num_rules: [out] number of pairs filled in rule_ts
+ *
+ * One pass over the base table followed by the expansion table,
+ * both laid out back to back as slots of slot_rule_hdl. The pass
+ * starts where the previous one stopped so a full rule_ts does not
+ * keep the tail of the table from being reported. The snapshot
+ * state is updated, so the table is locked exclusively
+ *
+ * Returns:	0  On Success, negative on failure
+ */
+int ipa_nati_snapshot_timestamps(uint32_t tbl_hdl,
+				ipa_nat_rule_ts *rule_ts,
+				uint16_t max_rules,
+				uint16_t *num_rules)
+{
+	struct ipa_nat_ip4_table_cache *tbl_ptr;
+	struct ipa_nat_rule *base_tbl, *expn_tbl, *rule;
+	uint32_t total, slot, cnt, ts;
+	uint16_t filled = 0;
+	int ret = 0;
+
+	if (ipa_nati_lock_tbl((uint8_t)(tbl_hdl - 1), 1) != 0) {
+		IPAERR("unable to lock the nat table\n");
+		return -1;
+	}
+
+	tbl_ptr = &ipv4_nat_cache.ip4_tbl[tbl_hdl - 1];
+	if (!tbl_ptr->valid) {
+		IPAERR("invalid table handle\n");
+		ret = -EINVAL;
+		goto unlock;
+	}
+
+	base_tbl = (struct ipa_nat_rule *)tbl_ptr->ipv4_rules_addr;
+	expn_tbl = (struct ipa_nat_rule *)tbl_ptr->ipv4_expn_rules_addr;
+	total = tbl_ptr->table_entries + tbl_ptr->expn_table_entries;
+
+	slot = tbl_ptr->snapshot_pos;
+	for (cnt = 0; cnt < total && filled < max_rules; cnt++) {
+		if (IPA_NAT_INVALID_NAT_ENTRY != tbl_ptr->slot_rule_hdl[slot]) {
+			if (slot < tbl_ptr->table_entries) {
+				rule = &base_tbl[slot];
+			} else {
+				rule = &expn_tbl[slot - tbl_ptr->table_entries];
+			}
+
+			ts = Read32BitFieldValue(rule->ts_proto, TIME_STAMP_FIELD);
+			if (ts != tbl_ptr->slot_last_ts[slot]) {
+				tbl_ptr->slot_last_ts[slot] = ts;
+				rule_ts[filled].rule_hdl = tbl_ptr->slot_rule_hdl[slot];
+				rule_ts[filled].time_stamp = ts;
+				filled++;
+			}
+		}
+
+		if (++slot == total) {
+			slot = 0;
+		}
+	}
+	tbl_ptr->snapshot_pos = (uint16_t)slot;
+	*num_rules = filled;
+
+unlock:
+	if (ipa_nati_unlock_tbl((uint8_t)(tbl_hdl - 1)) != 0) {
+		IPAERR("unable to unlock the nat table\n");
+		return -1;
+	}
+
+	return ret;
+}
+
+/**
+ * ipa_nati_rule_frees_room() - tell if deleting a rule helps a new one
+ * @tbl_hdl: [in] nat table handle
+ * @rule_hdl: [in] handle of the rule to delete
+ * @clnt_rule: [in] rule to be added in its place
+ *
+ * Deleting a base table rule frees its index entry as well, so the
+ * rule helps when either of its entries is in an expansion table or
+ * is the one the new rule hashes to
+ *
+ * Returns:	1 if it can, 0 if not, negative on failure
+ */
+int ipa_nati_rule_frees_room(uint32_t tbl_hdl,
+				uint32_t rule_hdl,
+				const ipa_nat_ipv4_rule *clnt_rule)
+{
+	struct ipa_nat_ip4_table_cache *tbl_ptr;
+	struct ipa_nat_rule *rule;
+	uint8_t tbl_indx = (uint8_t)(tbl_hdl - 1);
+	uint8_t expn_tbl;
+	uint16_t tbl_entry, indx_entry;
+	int ret;
+
+	if (ipa_nati_lock_tbl(tbl_indx, 0) != 0) {
+		IPAERR("unable to lock the nat table\n");
+		return -1;
+	}
+
+	tbl_ptr = &ipv4_nat_cache.ip4_tbl[tbl_indx];
+	if (!tbl_ptr->valid) {
+		IPAERR("invalid table handle\n");
+		ret = -EINVAL;
+		goto unlock;
+	}
+
+	ipa_nati_parse_ipv4_rule_hdl(tbl_indx, (uint16_t)rule_hdl,
+															 &expn_tbl, &tbl_entry);
+	if (IPA_NAT_INVALID_NAT_ENTRY == tbl_entry) {
+		IPAERR("Invalid Rule Entry\n");
+		ret = -EINVAL;
+		goto unlock;
+	}
+
+	if (expn_tbl) {
+		ret = 1;
+		goto unlock;
+	}
+
+	rule = &((struct ipa_nat_rule *)tbl_ptr->ipv4_rules_addr)[tbl_entry];
+	indx_entry = Read16BitFieldValue(rule->sw_spec_params,
+																	 SW_SPEC_PARAM_INDX_TBL_ENTRY_FIELD);
+
+	ret = (indx_entry >= tbl_ptr->table_entries ||
+				 tbl_entry == dst_hash(tbl_ptr,
+															 pdns[clnt_rule->pdn_index].public_ip,
+															 clnt_rule->target_ip,
+															 clnt_rule->target_port,
+															 clnt_rule->public_port,
+															 clnt_rule->protocol,
+															 tbl_ptr->table_entries-1) ||
+				 indx_entry == src_hash(tbl_ptr,
+															  clnt_rule->private_ip,
+															  clnt_rule->private_port,
+															  clnt_rule->target_ip,
+															  clnt_rule->target_port,
+															  clnt_rule->protocol,
+															  tbl_ptr->table_entries-1));
+
+unlock:
+	if (ipa_nati_unlock_tbl(tbl_indx) != 0) {
+		IPAERR("unable to unlock the nat table\n");
+		return -1;
+	}
+
+	return ret;
+}
+
 int ipa_nati_add_ipv4_rule(uint32_t tbl_hdl,
 				const ipa_nat_ipv4_rule *clnt_rule,
 				uint32_t *rule_hdl)
@@ -1096,6 +1701,9 @@ int ipa_nati_add_ipv4_rule(uint32_t tbl_hdl,
 	struct ipa_nat_sw_rule sw_rule;
 	struct ipa_nat_indx_tbl_sw_rule index_sw_rule;
 	uint16_t new_entry, new_index_tbl_entry;
+	uint8_t tbl_indx = (uint8_t)(tbl_hdl - 1);
+	uint64_t start_us = ipa_nati_now_us();
+	int ret = 0;
 
 	/* verify that the rule's PDN is valid */
 	if (clnt_rule->pdn_index >= IPA_MAX_PDN_NUM ||
@@ -1108,39 +1716,79 @@ int ipa_nati_add_ipv4_rule(uint32_t tbl_hdl,
 	memset(&sw_rule, 0, sizeof(sw_rule));
 	memset(&index_sw_rule, 0, sizeof(index_sw_rule));
 
+	if (ipa_nati_lock_tbl(tbl_indx, 1) != 0) {
+		IPAERR("unable to lock the nat table\n");
+		return -1;
+	}
+
+	if (!ipv4_nat_cache.ip4_tbl[tbl_indx].valid) {
+		IPAERR("invalid table handle\n");
+		ret = -EINVAL;
+		goto unlock;
+	}
+
+	/* a failed grow keeps the old size, add the rule anyway */
+	ipa_nati_grow_tbl(tbl_indx, 1);
+
 	/* Generate rule from client input */
 	if (ipa_nati_generate_rule(tbl_hdl, clnt_rule,
 					&sw_rule, &index_sw_rule,
 					&new_entry, &new_index_tbl_entry)) {
 		IPAERR("unable to generate rule\n");
-		return -EINVAL;
+		ret = -EINVAL;
+		goto unlock;
 	}
 
 	tbl_ptr = &ipv4_nat_cache.ip4_tbl[tbl_hdl-1];
-	ipa_nati_copy_ipv4_rule_to_hw(tbl_ptr, &sw_rule, new_entry, (uint8_t)(tbl_hdl-1));
+	ipa_nati_copy_ipv4_rule_to_hw(tbl_ptr, &sw_rule, new_entry,
+																(uint8_t)(tbl_hdl-1), NULL);
 	ipa_nati_copy_ipv4_index_rule_to_hw(tbl_ptr,
 																			&index_sw_rule,
 																			new_index_tbl_entry,
-																			(uint8_t)(tbl_hdl-1));
+																			(uint8_t)(tbl_hdl-1), NULL);
 
 	IPADBG("new entry:%d, new index entry: %d\n", new_entry, new_index_tbl_entry);
 	if (ipa_nati_post_ipv4_dma_cmd((uint8_t)(tbl_hdl - 1), new_entry)) {
 		IPAERR("unable to post dma command\n");
-		return -EIO;
+		/* Entries still linked from a list cannot be taken again */
+		if (ipa_nati_unlink_ipv4_rule(tbl_ptr, (uint8_t)(tbl_hdl - 1),
+					sw_rule.prev_index, index_sw_rule.prev_index)) {
+			IPAERR("unable to unlink entry %d, index entry %d\n",
+						 new_entry, new_index_tbl_entry);
+		} else {
+			ipa_nati_release_rule_entries(tbl_ptr, new_entry, new_index_tbl_entry);
+		}
+		ret = -EIO;
+		goto unlock;
 	}
 
 	/* Generate rule handle */
 	*rule_hdl  = ipa_nati_make_rule_hdl((uint16_t)tbl_hdl, new_entry);
 	if (!(*rule_hdl)) {
 		IPAERR("unable to generate rule handle\n");
-		return -EINVAL;
+		ret = -EINVAL;
+		goto unlock;
 	}
 
 #ifdef NAT_DUMP
 	ipa_nat_dump_ipv4_table(tbl_hdl);
 #endif
 
-	return 0;
+unlock:
+	tbl_ptr = &ipv4_nat_cache.ip4_tbl[tbl_indx];
+	if (tbl_ptr->valid) {
+		if (ret) {
+			tbl_ptr->counters.failed_inserts++;
+		}
+		ipa_nati_record_latency(tbl_ptr->counters.add_latency, start_us);
+	}
+
+	if (ipa_nati_unlock_tbl(tbl_indx) != 0) {
+		IPAERR("unable to unlock the nat table\n");
+		return -1;
+	}
+
+	return ret;
 }
 
 int ipa_nati_generate_rule(uint32_t tbl_hdl,
@@ -1176,6 +1824,11 @@ int ipa_nati_generate_rule(uint32_t tbl_hdl,
 																								 tbl_ptr);
 	if (IPA_NAT_INVALID_NAT_ENTRY == *indx_tbl_entry) {
 		IPAERR("unable to generate index table entry\n");
+		/* Give back the expansion entry taken for this rule */
+		if (*tbl_entry >= tbl_ptr->table_entries) {
+			ipa_nati_expn_tbl_release_entry(tbl_ptr,
+							*tbl_entry - tbl_ptr->table_entries);
+		}
 		return -EINVAL;
 	}
 
@@ -1188,12 +1841,35 @@ int ipa_nati_generate_rule(uint32_t tbl_hdl,
 	return 0;
 }
 
+/**
+ * ipa_nati_update_chain_stats() - account one placement of a rule
+ * @stats: [in] chain stats of the base or index table
+ * @probes: [in] number of list entries read to place the rule
+ * @chain_len: [in] length of the list once the rule is added
+ *
+ * Returns: None
+ */
+static void ipa_nati_update_chain_stats(ipa_nat_chain_stats *stats,
+				uint16_t probes,
+				uint16_t chain_len)
+{
+	stats->inserts++;
+	stats->probes += probes;
+	if (chain_len > 1) {
+		stats->collisions++;
+	}
+	if (chain_len > stats->max_chain) {
+		stats->max_chain = chain_len;
+	}
+}
+
 uint16_t ipa_nati_generate_tbl_rule(const ipa_nat_ipv4_rule *clnt_rule,
 						struct ipa_nat_sw_rule *sw_rule,
 						struct ipa_nat_ip4_table_cache *tbl_ptr)
 {
 	uint32_t pub_ip_addr;
 	uint16_t prev = 0, nxt_indx = 0, new_entry;
+	uint16_t probes = 1;
 	struct ipa_nat_rule *tbl = NULL, *expn_tbl = NULL;
 
 	pub_ip_addr = pdns[clnt_rule->pdn_index].public_ip;
@@ -1211,14 +1887,14 @@ uint16_t ipa_nati_generate_tbl_rule(const ipa_nat_ipv4_rule *clnt_rule,
 	sw_rule->pdn_index = clnt_rule->pdn_index;
 
 	/* consider only public and private ip fields */
-	sw_rule->ip_chksum = ipa_nati_calc_ip_cksum(pub_ip_addr,
+	sw_rule->ip_chksum = ipa_nati_calc_ip_cksum(pdn_ip_sums[clnt_rule->pdn_index],
 																							clnt_rule->private_ip);
 
 	if (IPPROTO_TCP == sw_rule->protocol ||
 			IPPROTO_UDP == sw_rule->protocol) {
 		/* consider public and private ip & port fields */
 		sw_rule->tcp_udp_chksum = ipa_nati_calc_tcp_udp_cksum(
-			 pub_ip_addr,
+			 pdn_ip_sums[clnt_rule->pdn_index],
 			 clnt_rule->public_port,
 			 clnt_rule->private_ip,
 			 clnt_rule->private_port);
@@ -1239,7 +1915,7 @@ uint16_t ipa_nati_generate_tbl_rule(const ipa_nat_ipv4_rule *clnt_rule,
 	sw_rule->prev_index = 0;
 	sw_rule->indx_tbl_entry = 0;
 
-	new_entry = dst_hash(pub_ip_addr, clnt_rule->target_ip,
+	new_entry = dst_hash(tbl_ptr, pub_ip_addr, clnt_rule->target_ip,
 											 clnt_rule->target_port,
 											 clnt_rule->public_port,
 											 clnt_rule->protocol,
@@ -1250,6 +1926,7 @@ uint16_t ipa_nati_generate_tbl_rule(const ipa_nat_ipv4_rule *clnt_rule,
 	if (!Read16BitFieldValue(tbl[new_entry].ip_cksm_enbl,
 													 ENABLE_FIELD)) {
 		sw_rule->prev_index = 0;
+		ipa_nati_update_chain_stats(&tbl_ptr->hash_stats.base, 1, 1);
 		IPADBG("Destination Nat New Entry Index %d\n", new_entry);
 		return new_entry;
 	}
@@ -1265,6 +1942,7 @@ uint16_t ipa_nati_generate_tbl_rule(const ipa_nat_ipv4_rule *clnt_rule,
 
 		while (nxt_indx != IPA_NAT_INVALID_NAT_ENTRY) {
 			prev = nxt_indx;
+			probes++;
 
 			nxt_indx -= tbl_ptr->table_entries;
 			nxt_indx = Read16BitFieldValue(expn_tbl[nxt_indx].nxt_indx_pub_port,
@@ -1280,9 +1958,8 @@ uint16_t ipa_nati_generate_tbl_rule(const ipa_nat_ipv4_rule *clnt_rule,
 		sw_rule->prev_index = prev;
 	}
 
-	/* On collision check for the free entry in expansion table */
-	new_entry = ipa_nati_expn_tbl_free_entry(expn_tbl,
-					tbl_ptr->expn_table_entries);
+	/* On collision take a free entry of the expansion table */
+	new_entry = ipa_nati_expn_tbl_free_entry(tbl_ptr);
 
 	if (IPA_NAT_INVALID_NAT_ENTRY == new_entry) {
 		/* Expansion table is full return*/
@@ -1292,42 +1969,65 @@ uint16_t ipa_nati_generate_tbl_rule(const ipa_nat_ipv4_rule *clnt_rule,
 		return IPA_NAT_INVALID_NAT_ENTRY;
 	}
 	new_entry += tbl_ptr->table_entries;
+	ipa_nati_update_chain_stats(&tbl_ptr->hash_stats.base, probes, probes + 1);
 
 	IPADBG("new entry index %d\n", new_entry);
 	return new_entry;
 }
 
 /* returns expn table entry index */
-uint16_t ipa_nati_expn_tbl_free_entry(struct ipa_nat_rule *expn_tbl,
-						uint16_t size)
+uint16_t ipa_nati_expn_tbl_free_entry(struct ipa_nat_ip4_table_cache *tbl_ptr)
 {
-	int cnt;
+	struct ipa_nat_rule *expn_tbl;
+	uint16_t entry;
 
-	for (cnt = 1; cnt < size; cnt++) {
-		if (!Read16BitFieldValue(expn_tbl[cnt].ip_cksm_enbl,
-														 ENABLE_FIELD)) {
-			IPADBG("new expansion table entry index %d\n", cnt);
-			return cnt;
+	expn_tbl = (struct ipa_nat_rule *)tbl_ptr->ipv4_expn_rules_addr;
+
+	while (tbl_ptr->expn_free_cnt) {
+		entry = tbl_ptr->expn_free_list[--tbl_ptr->expn_free_cnt];
+
+		/* Skip stale slots, they are put back once deleted */
+		if (Read16BitFieldValue(expn_tbl[entry].ip_cksm_enbl,
+														ENABLE_FIELD)) {
+			IPAERR("expansion table entry %d is in use\n", entry);
+			continue;
 		}
+
+		IPADBG("new expansion table entry index %d\n", entry);
+		return entry;
 	}
 
 	IPAERR("nat expansion table is full\n");
 	return 0;
 }
 
+void ipa_nati_expn_tbl_release_entry(struct ipa_nat_ip4_table_cache *tbl_ptr,
+						uint16_t entry)
+{
+	if (IPA_NAT_INVALID_NAT_ENTRY == entry ||
+			entry >= tbl_ptr->expn_table_entries ||
+			tbl_ptr->expn_free_cnt >= tbl_ptr->expn_table_entries) {
+		IPAERR("unable to release expansion table entry %d\n", entry);
+		return;
+	}
+
+	tbl_ptr->expn_free_list[tbl_ptr->expn_free_cnt++] = entry;
+}
+
 uint16_t ipa_nati_generate_index_rule(const ipa_nat_ipv4_rule *clnt_rule,
 						struct ipa_nat_indx_tbl_sw_rule *sw_rule,
 						struct ipa_nat_ip4_table_cache *tbl_ptr)
 {
 	struct ipa_nat_indx_tbl_rule *indx_tbl, *indx_expn_tbl;
 	uint16_t prev = 0, nxt_indx = 0, new_entry;
+	uint16_t probes = 1;
 
 	indx_tbl =
 	(struct ipa_nat_indx_tbl_rule *)tbl_ptr->index_table_addr;
 	indx_expn_tbl =
 	(struct ipa_nat_indx_tbl_rule *)tbl_ptr->index_table_expn_addr;
 
-	new_entry = src_hash(clnt_rule->private_ip,
+	new_entry = src_hash(tbl_ptr, clnt_rule->private_ip,
 											 clnt_rule->private_port,
 											 clnt_rule->target_ip,
 											 clnt_rule->target_port,
@@ -1339,6 +2039,7 @@ uint16_t ipa_nati_generate_index_rule(const ipa_nat_ipv4_rule *clnt_rule,
 	if (!Read16BitFieldValue(indx_tbl[new_entry].tbl_entry_nxt_indx,
 													 INDX_TBL_TBL_ENTRY_FIELD)) {
 		sw_rule->prev_index = 0;
+		ipa_nati_update_chain_stats(&tbl_ptr->hash_stats.index, 1, 1);
 		IPADBG("Source Nat Index Table Entry %d\n", new_entry);
 		return new_entry;
 	}
@@ -1355,6 +2056,7 @@ uint16_t ipa_nati_generate_index_rule(const ipa_nat_ipv4_rule *clnt_rule,
 
 		while (nxt_indx != IPA_NAT_INVALID_NAT_ENTRY) {
 			prev = nxt_indx;
+			probes++;
 
 			nxt_indx -= tbl_ptr->table_entries;
 			nxt_indx = Read16BitFieldValue(indx_expn_tbl[nxt_indx].tbl_entry_nxt_indx,
@@ -1370,9 +2072,8 @@ uint16_t ipa_nati_generate_index_rule(const ipa_nat_ipv4_rule *clnt_rule,
 		sw_rule->prev_index = prev;
 	}
 
-	/* On collision check for the free entry in expansion table */
-	new_entry = ipa_nati_index_expn_get_free_entry(indx_expn_tbl,
-					tbl_ptr->expn_table_entries);
+	/* On collision take a free entry of the index expansion table */
+	new_entry = ipa_nati_index_expn_get_free_entry(tbl_ptr);
 
 	if (IPA_NAT_INVALID_NAT_ENTRY == new_entry) {
 		/* Expansion table is full return*/
@@ -1388,71 +2089,161 @@ uint16_t ipa_nati_generate_index_rule(const ipa_nat_ipv4_rule *clnt_rule,
 		IPAERR("Error: prev_entry:%d ", sw_rule->prev_index);
 		IPAERR("and new_entry:%d should not be same ", new_entry);
 		IPAERR("infinite loop detected\n");
+		ipa_nati_index_expn_release_entry(tbl_ptr,
+						new_entry - tbl_ptr->table_entries);
 		return IPA_NAT_INVALID_NAT_ENTRY;
 	}
 
+	ipa_nati_update_chain_stats(&tbl_ptr->hash_stats.index, probes, probes + 1);
+
 	IPADBG("index table entry %d\n", new_entry);
 	return new_entry;
 }
 
 /* returns index expn table entry index */
 uint16_t ipa_nati_index_expn_get_free_entry(
-						struct ipa_nat_indx_tbl_rule *indx_tbl,
-						uint16_t size)
+						struct ipa_nat_ip4_table_cache *tbl_ptr)
 {
-	int cnt;
-	for (cnt = 1; cnt < size; cnt++) {
-		if (!Read16BitFieldValue(indx_tbl[cnt].tbl_entry_nxt_indx,
-														 INDX_TBL_TBL_ENTRY_FIELD)) {
-			return cnt;
+	struct ipa_nat_indx_tbl_rule *indx_tbl;
+	uint16_t entry;
+
+	indx_tbl = (struct ipa_nat_indx_tbl_rule *)tbl_ptr->index_table_expn_addr;
+
+	while (tbl_ptr->index_expn_free_cnt) {
+		entry = tbl_ptr->index_expn_free_list[--tbl_ptr->index_expn_free_cnt];
+
+		/* Skip stale slots, they are put back once deleted */
+		if (Read16BitFieldValue(indx_tbl[entry].tbl_entry_nxt_indx,
+														INDX_TBL_TBL_ENTRY_FIELD)) {
+			IPAERR("index expansion table entry %d is in use\n", entry);
+			continue;
 		}
+
+		return entry;
 	}
 
 	IPAERR("nat index expansion table is full\n");
 	return 0;
 }
 
-void ipa_nati_write_next_index(uint8_t tbl_indx,
-				nat_table_type tbl_type,
-				uint16_t value,
-				uint32_t offset)
+void ipa_nati_index_expn_release_entry(struct ipa_nat_ip4_table_cache *tbl_ptr,
+						uint16_t entry)
 {
-	struct ipa_ioc_nat_dma_cmd *cmd;
-
-	IPADBG("Updating next index field of table %d on collosion using dma\n", tbl_type);
-	IPADBG("table index: %d, value: %d offset;%d\n", tbl_indx, value, offset);
-
-	cmd = (struct ipa_ioc_nat_dma_cmd *)
-	malloc(sizeof(struct ipa_ioc_nat_dma_cmd)+
-				 sizeof(struct ipa_ioc_nat_dma_one));
-	if (NULL == cmd) {
-		IPAERR("unable to allocate memory\n");
+	if (IPA_NAT_INVALID_NAT_ENTRY == entry ||
+			entry >= tbl_ptr->expn_table_entries ||
+			tbl_ptr->index_expn_free_cnt >= tbl_ptr->expn_table_entries) {
+		IPAERR("unable to release index expansion table entry %d\n", entry);
 		return;
 	}
 
-	cmd->dma[0].table_index = tbl_indx;
+	tbl_ptr->index_expn_free_list[tbl_ptr->index_expn_free_cnt++] = entry;
+}
+
+/**
+ * ipa_nati_rebuild_free_lists() - rebuild the free slot lists
+ * @tbl_ptr: [in] nat table cache
+ *
+ * Scan the expansion, index expansion and rule id tables once
+ * and push every unused slot. Slots are pushed in descending
+ * order so the lowest free slot is handed out first
+ *
+ * Returns: None
+ */
+void ipa_nati_rebuild_free_lists(struct ipa_nat_ip4_table_cache *tbl_ptr)
+{
+	struct ipa_nat_rule *expn_tbl;
+	struct ipa_nat_indx_tbl_rule *indx_expn_tbl;
+	int cnt;
+
+	expn_tbl = (struct ipa_nat_rule *)tbl_ptr->ipv4_expn_rules_addr;
+	indx_expn_tbl =
+		(struct ipa_nat_indx_tbl_rule *)tbl_ptr->index_table_expn_addr;
+
+	/* Entry zero is unused in both expansion tables */
+	tbl_ptr->expn_free_cnt = 0;
+	tbl_ptr->index_expn_free_cnt = 0;
+	for (cnt = tbl_ptr->expn_table_entries - 1; cnt > 0; cnt--) {
+		if (!Read16BitFieldValue(expn_tbl[cnt].ip_cksm_enbl,
+														 ENABLE_FIELD)) {
+			tbl_ptr->expn_free_list[tbl_ptr->expn_free_cnt++] = cnt;
+		}
+
+		if (!Read16BitFieldValue(indx_expn_tbl[cnt].tbl_entry_nxt_indx,
+														 INDX_TBL_TBL_ENTRY_FIELD)) {
+			tbl_ptr->index_expn_free_list[tbl_ptr->index_expn_free_cnt++] = cnt;
+		}
+	}
+
+	tbl_ptr->rule_id_free_cnt = 0;
+	for (cnt = tbl_ptr->table_entries + tbl_ptr->expn_table_entries - 1;
+			 cnt >= 0; cnt--) {
+		if (IPA_NAT_INVALID_NAT_ENTRY == tbl_ptr->rule_id_array[cnt]) {
+			tbl_ptr->rule_id_free_list[tbl_ptr->rule_id_free_cnt++] = cnt;
+		}
+	}
+
+	IPADBG("free expn entries: %d, free index expn entries: %d\n",
+				 tbl_ptr->expn_free_cnt, tbl_ptr->index_expn_free_cnt);
+}
+
+static void ipa_nati_batch_add_dma(struct ipa_ioc_nat_dma_one *dma,
+				uint16_t *cnt,
+				uint8_t tbl_indx,
+				nat_table_type tbl_type,
+				uint16_t value,
+				uint32_t offset)
+{
+	dma[*cnt].table_index = tbl_indx;
+	dma[*cnt].base_addr = tbl_type;
+	dma[*cnt].data = value;
+	dma[*cnt].offset = offset;
+	(*cnt)++;
+}
+
+int ipa_nati_write_next_index(uint8_t tbl_indx,
+				nat_table_type tbl_type,
+				uint16_t value,
+				uint32_t offset)
+{
+	struct ipa_ioc_nat_dma_cmd *cmd;
+	int ret = 0;
+
+	IPADBG("Updating next index field of table %d on collosion using dma\n", tbl_type);
+	IPADBG("table index: %d, value: %d offset;%d\n", tbl_indx, value, offset);
+
+	cmd = (struct ipa_ioc_nat_dma_cmd *)
+	malloc(sizeof(struct ipa_ioc_nat_dma_cmd)+
+				 sizeof(struct ipa_ioc_nat_dma_one));
+	if (NULL == cmd) {
+		IPAERR("unable to allocate memory\n");
+		return -ENOMEM;
+	}
+
+	cmd->dma[0].table_index = tbl_indx;
 	cmd->dma[0].base_addr = tbl_type;
 	cmd->dma[0].data = value;
 	cmd->dma[0].offset = offset;
 
 	cmd->entries = 1;
-	if (ioctl(ipv4_nat_cache.ipa_fd, IPA_IOC_NAT_DMA, cmd)) {
+	if (ipa_nati_nat_dma(tbl_indx, cmd)) {
 		perror("ipa_nati_post_ipv4_dma_cmd(): ioctl error value");
 		IPAERR("unable to call dma icotl to update next index\n");
 		IPAERR("ipa fd %d\n", ipv4_nat_cache.ipa_fd);
+		ret = -EIO;
 		goto fail;
 	}
 
 fail:
 	free(cmd);
 
-	return;
+	return ret;
 }
 
 void ipa_nati_copy_ipv4_rule_to_hw(
 				struct ipa_nat_ip4_table_cache *ipv4_cache,
 				struct ipa_nat_sw_rule *rule,
-				uint16_t entry, uint8_t tbl_index)
+				uint16_t entry, uint8_t tbl_index,
+				struct ipa_nat_dma_batch *batch)
 {
 	struct ipa_nat_rule *tbl_ptr;
 	uint16_t prev_entry = rule->prev_index;
@@ -1488,7 +2279,12 @@ void ipa_nati_copy_ipv4_rule_to_hw(
 		offset = ipa_nati_get_entry_offset(ipv4_cache, tbl_type, prev_entry);
 		offset += IPA_NAT_RULE_NEXT_FIELD_OFFSET;
 
-		ipa_nati_write_next_index(tbl_index, tbl_type, entry, offset);
+		if (batch) {
+			ipa_nati_batch_add_dma(batch->base_dma, &batch->base_cnt,
+							tbl_index, tbl_type, entry, offset);
+		} else {
+			ipa_nati_write_next_index(tbl_index, tbl_type, entry, offset);
+		}
 	}
 
 	return;
@@ -1498,7 +2294,8 @@ void ipa_nati_copy_ipv4_index_rule_to_hw(
 				struct ipa_nat_ip4_table_cache *ipv4_cache,
 				struct ipa_nat_indx_tbl_sw_rule *indx_sw_rule,
 				uint16_t entry,
-				uint8_t tbl_index)
+				uint8_t tbl_index,
+				struct ipa_nat_dma_batch *batch)
 {
 	struct ipa_nat_indx_tbl_rule *tbl_ptr;
 	struct ipa_nat_sw_indx_tbl_rule sw_rule;
@@ -1538,55 +2335,167 @@ void ipa_nati_copy_ipv4_index_rule_to_hw(
 		offset = ipa_nati_get_index_entry_offset(ipv4_cache, tbl_type, prev_entry);
 		offset += IPA_NAT_INDEX_RULE_NEXT_FIELD_OFFSET;
 
-		IPADBG("Updating next index field of index table on collosion using dma()\n");
-		ipa_nati_write_next_index(tbl_index, tbl_type, entry, offset);
+		if (batch) {
+			ipa_nati_batch_add_dma(batch->indx_dma, &batch->indx_cnt,
+							tbl_index, tbl_type, entry, offset);
+		} else {
+			IPADBG("Updating next index field of index table on collosion using dma()\n");
+			ipa_nati_write_next_index(tbl_index, tbl_type, entry, offset);
+		}
 	}
 
 	return;
 }
 
-int ipa_nati_post_ipv4_dma_cmd(uint8_t tbl_indx,
-				uint16_t entry)
+/**
+ * ipa_nati_unlink_ipv4_rule() - unlink a rule that was never enabled
+ * @ipv4_cache: [in] nat table cache
+ * @tbl_index: [in] nat table index
+ * @prev_entry: [in] previous entry of the rule in the base list
+ * @indx_prev_entry: [in] previous entry of the rule in the index list
+ *
+ * The rule is the last of both lists, the next index of the
+ * previous entries is reset to end the lists before it
+ *
+ * Returns: 0 on success, negative if a write failed
+ */
+int ipa_nati_unlink_ipv4_rule(
+				struct ipa_nat_ip4_table_cache *ipv4_cache,
+				uint8_t tbl_index,
+				uint16_t prev_entry,
+				uint16_t indx_prev_entry)
 {
-	struct ipa_ioc_nat_dma_cmd *cmd;
-	struct ipa_nat_rule *tbl_ptr;
-	uint32_t offset = ipv4_nat_cache.ip4_tbl[tbl_indx].tbl_addr_offset;
+	nat_table_type tbl_type;
+	uint32_t offset;
 	int ret = 0;
 
-	cmd = (struct ipa_ioc_nat_dma_cmd *)
-	malloc(sizeof(struct ipa_ioc_nat_dma_cmd)+
-				 sizeof(struct ipa_ioc_nat_dma_one));
-	if (NULL == cmd) {
-		IPAERR("unable to allocate memory\n");
-		return -ENOMEM;
+	if (IPA_NAT_INVALID_NAT_ENTRY != prev_entry) {
+		if (prev_entry < ipv4_cache->table_entries) {
+			tbl_type = IPA_NAT_BASE_TBL;
+		} else {
+			tbl_type = IPA_NAT_EXPN_TBL;
+			prev_entry = prev_entry - ipv4_cache->table_entries;
+		}
+
+		offset = ipa_nati_get_entry_offset(ipv4_cache, tbl_type, prev_entry);
+		offset += IPA_NAT_RULE_NEXT_FIELD_OFFSET;
+		if (ipa_nati_write_next_index(tbl_index, tbl_type,
+					IPA_NAT_INVALID_NAT_ENTRY, offset)) {
+			ret = -EIO;
+		}
+	}
+
+	if (IPA_NAT_INVALID_NAT_ENTRY != indx_prev_entry) {
+		if (indx_prev_entry < ipv4_cache->table_entries) {
+			tbl_type = IPA_NAT_INDX_TBL;
+		} else {
+			tbl_type = IPA_NAT_INDEX_EXPN_TBL;
+			indx_prev_entry = indx_prev_entry - ipv4_cache->table_entries;
+		}
+
+		offset = ipa_nati_get_index_entry_offset(ipv4_cache, tbl_type, indx_prev_entry);
+		offset += IPA_NAT_INDEX_RULE_NEXT_FIELD_OFFSET;
+		if (ipa_nati_write_next_index(tbl_index, tbl_type,
+					IPA_NAT_INVALID_NAT_ENTRY, offset)) {
+			ret = -EIO;
+		}
 	}
 
+	return ret;
+}
+
+/**
+ * ipa_nati_release_rule_entries() - give back the entries of a rule
+ * @ipv4_cache: [in] nat table cache
+ * @entry: [in] base or expansion table entry of the rule
+ * @indx_entry: [in] index or index expansion table entry of the rule
+ *
+ * Clears the entries of a rule that was never enabled and puts
+ * its expansion slots back on their free lists. No list may
+ * lead to the entries anymore
+ *
+ * Returns: None
+ */
+void ipa_nati_release_rule_entries(
+				struct ipa_nat_ip4_table_cache *ipv4_cache,
+				uint16_t entry,
+				uint16_t indx_entry)
+{
+	struct ipa_nat_rule *tbl_ptr;
+	struct ipa_nat_indx_tbl_rule *indx_tbl_ptr;
+
+	if (entry < ipv4_cache->table_entries) {
+		tbl_ptr = (struct ipa_nat_rule *)ipv4_cache->ipv4_rules_addr;
+		memset(&tbl_ptr[entry], 0, sizeof(struct ipa_nat_rule));
+	} else {
+		entry = entry - ipv4_cache->table_entries;
+		tbl_ptr = (struct ipa_nat_rule *)ipv4_cache->ipv4_expn_rules_addr;
+		memset(&tbl_ptr[entry], 0, sizeof(struct ipa_nat_rule));
+		ipa_nati_expn_tbl_release_entry(ipv4_cache, entry);
+	}
+
+	if (indx_entry < ipv4_cache->table_entries) {
+		indx_tbl_ptr = (struct ipa_nat_indx_tbl_rule *)ipv4_cache->index_table_addr;
+		memset(&indx_tbl_ptr[indx_entry], 0, sizeof(struct ipa_nat_indx_tbl_rule));
+	} else {
+		indx_entry = indx_entry - ipv4_cache->table_entries;
+		indx_tbl_ptr =
+			(struct ipa_nat_indx_tbl_rule *)ipv4_cache->index_table_expn_addr;
+		memset(&indx_tbl_ptr[indx_entry], 0, sizeof(struct ipa_nat_indx_tbl_rule));
+		ipa_nati_index_expn_release_entry(ipv4_cache, indx_entry);
+	}
+}
+
+void ipa_nati_fill_enable_dma(uint8_t tbl_indx,
+				uint16_t entry,
+				struct ipa_ioc_nat_dma_one *dma)
+{
+	struct ipa_nat_rule *tbl_ptr;
+	uint32_t offset = ipv4_nat_cache.ip4_tbl[tbl_indx].tbl_addr_offset;
+
 	if (entry < ipv4_nat_cache.ip4_tbl[tbl_indx].table_entries) {
 		tbl_ptr =
 			 (struct ipa_nat_rule *)ipv4_nat_cache.ip4_tbl[tbl_indx].ipv4_rules_addr;
 
-		cmd->dma[0].table_index = tbl_indx;
-		cmd->dma[0].base_addr = IPA_NAT_BASE_TBL;
-		cmd->dma[0].data = IPA_NAT_FLAG_ENABLE_BIT_MASK;
+		dma->table_index = tbl_indx;
+		dma->base_addr = IPA_NAT_BASE_TBL;
+		dma->data = IPA_NAT_FLAG_ENABLE_BIT_MASK;
 
-		cmd->dma[0].offset = (char *)&tbl_ptr[entry] - (char *)tbl_ptr;
-		cmd->dma[0].offset += IPA_NAT_RULE_FLAG_FIELD_OFFSET;
+		dma->offset = (char *)&tbl_ptr[entry] - (char *)tbl_ptr;
+		dma->offset += IPA_NAT_RULE_FLAG_FIELD_OFFSET;
 	} else {
 		tbl_ptr =
 			 (struct ipa_nat_rule *)ipv4_nat_cache.ip4_tbl[tbl_indx].ipv4_expn_rules_addr;
 		entry = entry - ipv4_nat_cache.ip4_tbl[tbl_indx].table_entries;
 
-		cmd->dma[0].table_index = tbl_indx;
-		cmd->dma[0].base_addr = IPA_NAT_EXPN_TBL;
-		cmd->dma[0].data = IPA_NAT_FLAG_ENABLE_BIT_MASK;
+		dma->table_index = tbl_indx;
+		dma->base_addr = IPA_NAT_EXPN_TBL;
+		dma->data = IPA_NAT_FLAG_ENABLE_BIT_MASK;
+
+		dma->offset = (char *)&tbl_ptr[entry] - (char *)tbl_ptr;
+		dma->offset += IPA_NAT_RULE_FLAG_FIELD_OFFSET;
+		dma->offset += offset;
+	}
+}
+
+int ipa_nati_post_ipv4_dma_cmd(uint8_t tbl_indx,
+				uint16_t entry)
+{
+	struct ipa_ioc_nat_dma_cmd *cmd;
+	int ret = 0;
 
-		cmd->dma[0].offset = (char *)&tbl_ptr[entry] - (char *)tbl_ptr;
-		cmd->dma[0].offset += IPA_NAT_RULE_FLAG_FIELD_OFFSET;
-		cmd->dma[0].offset += offset;
+	cmd = (struct ipa_ioc_nat_dma_cmd *)
+	malloc(sizeof(struct ipa_ioc_nat_dma_cmd)+
+				 sizeof(struct ipa_ioc_nat_dma_one));
+	if (NULL == cmd) {
+		IPAERR("unable to allocate memory\n");
+		return -ENOMEM;
 	}
 
+	ipa_nati_fill_enable_dma(tbl_indx, entry, &cmd->dma[0]);
+
 	cmd->entries = 1;
-	if (ioctl(ipv4_nat_cache.ipa_fd, IPA_IOC_NAT_DMA, cmd)) {
+	if (ipa_nati_nat_dma(tbl_indx, cmd)) {
 		perror("ipa_nati_post_ipv4_dma_cmd(): ioctl error value");
 		IPAERR("unable to call dma icotl\n");
 		IPADBG("ipa fd %d\n", ipv4_nat_cache.ipa_fd);
@@ -1611,22 +2520,25 @@ int ipa_nati_del_ipv4_rule(uint32_t tbl_hdl,
 	struct ipa_nat_ip4_table_cache *tbl_ptr;
 	del_type rule_pos;
 	uint8_t tbl_indx = (uint8_t)(tbl_hdl - 1);
+	uint64_t start_us = ipa_nati_now_us();
 	int ret;
 
-	/* Parse the rule handle */
+	if (ipa_nati_lock_tbl(tbl_indx, 1) != 0) {
+		ret = -1;
+		goto mutex_lock_error;
+	}
+
+	/* Parse the rule handle, under the lock as deletes reset it */
 	ipa_nati_parse_ipv4_rule_hdl(tbl_indx, (uint16_t)rule_hdl,
 															 &expn_tbl, &tbl_entry);
 	if (IPA_NAT_INVALID_NAT_ENTRY == tbl_entry) {
 		IPAERR("Invalid Rule Entry\n");
 		ret = -EINVAL;
+		if (ipa_nati_unlock_tbl(tbl_indx) != 0)
+			goto mutex_unlock_error;
 		goto fail;
 	}
 
-	if (pthread_mutex_lock(&nat_mutex) != 0) {
-		ret = -1;
-		goto mutex_lock_error;
-	}
-
 	IPADBG("Delete below rule\n");
 	IPADBG("tbl_entry:%d expn_tbl:%d\n", tbl_entry, expn_tbl);
 
@@ -1634,7 +2546,7 @@ int ipa_nati_del_ipv4_rule(uint32_t tbl_hdl,
 	if (!tbl_ptr->valid) {
 		IPAERR("invalid table handle\n");
 		ret = -EINVAL;
-		if (pthread_mutex_unlock(&nat_mutex) != 0)
+		if (ipa_nati_unlock_tbl(tbl_indx) != 0)
 			goto mutex_unlock_error;
 		goto fail;
 	}
@@ -1646,23 +2558,22 @@ int ipa_nati_del_ipv4_rule(uint32_t tbl_hdl,
 	if (ipa_nati_post_del_dma_cmd(tbl_indx, tbl_entry,
 					expn_tbl, rule_pos)) {
 		ret = -EINVAL;
-		if (pthread_mutex_unlock(&nat_mutex) != 0)
+		if (ipa_nati_unlock_tbl(tbl_indx) != 0)
 			goto mutex_unlock_error;
 		goto fail;
 	}
 
 	ipa_nati_del_dead_ipv4_head_nodes(tbl_indx);
 
-	/* Reset rule_id_array entry */
-	ipv4_nat_cache.ip4_tbl[tbl_indx].rule_id_array[rule_hdl-1] =
-	IPA_NAT_INVALID_NAT_ENTRY;
+	ipa_nati_release_rule_hdl(tbl_ptr, (uint16_t)rule_hdl);
+	ipa_nati_record_latency(tbl_ptr->counters.del_latency, start_us);
 
 #ifdef NAT_DUMP
 	IPADBG("Dumping Table after deleting rule\n");
 	ipa_nat_dump_ipv4_table(tbl_hdl);
 #endif
 
-	if (pthread_mutex_unlock(&nat_mutex) != 0) {
+	if (ipa_nati_unlock_tbl(tbl_indx) != 0) {
 		ret = -1;
 		goto mutex_unlock_error;
 	}
@@ -1670,11 +2581,11 @@ int ipa_nati_del_ipv4_rule(uint32_t tbl_hdl,
 	return 0;
 
 mutex_lock_error:
-	IPAERR("unable to lock the nat mutex\n");
+	IPAERR("unable to lock the nat table\n");
 	return ret;
 
 mutex_unlock_error:
-	IPAERR("unable to unlock the nat mutex\n");
+	IPAERR("unable to unlock the nat table\n");
 
 fail:
 	return ret;
@@ -1725,39 +2636,41 @@ void ReorderCmds(struct ipa_ioc_nat_dma_cmd *cmd, int size)
 	return;
 }
 
-int ipa_nati_post_del_dma_cmd(uint8_t tbl_indx,
+/**
+ * ipa_nati_generate_del_dma_cmd() - build the dma writes of a delete
+ * @tbl_indx: [in] nat table index
+ * @cur_tbl_entry: [in] entry of the rule being deleted
+ * @expn_tbl: [in] rule is in the expansion table or not
+ * @rule_pos: [in] position of the rule in its list
+ * @dma: [out] MAX_DMA_ENTRIES_FOR_DEL dma writes, base table write first
+ * @entries: [out] number of dma writes generated
+ * @info: [out] state needed to finish the delete once the dma is posted
+ *
+ * Only reads the tables, nothing is modified until
+ * ipa_nati_update_del_sw_state() is called
+ *
+ * Returns: 0 on success, negative on failure
+ */
+int ipa_nati_generate_del_dma_cmd(uint8_t tbl_indx,
 				uint16_t cur_tbl_entry,
 				uint8_t expn_tbl,
-				del_type rule_pos)
+				del_type rule_pos,
+				struct ipa_ioc_nat_dma_one *dma,
+				uint8_t *entries,
+				struct ipa_nat_del_info *info)
 {
-
-#define MAX_DMA_ENTRIES_FOR_DEL 3
-
 	struct ipa_nat_ip4_table_cache *cache_ptr;
 	struct ipa_nat_indx_tbl_rule *indx_tbl_ptr;
 	struct ipa_nat_rule *tbl_ptr;
-	int ret = 0, size = 0;
 
 	uint16_t indx_tbl_entry = IPA_NAT_INVALID_NAT_ENTRY;
 	del_type indx_rule_pos;
 
-	struct ipa_ioc_nat_dma_cmd *cmd;
 	uint8_t no_of_cmds = 0;
 
 	uint16_t prev_entry = IPA_NAT_INVALID_NAT_ENTRY;
 	uint16_t next_entry = IPA_NAT_INVALID_NAT_ENTRY;
 	uint16_t indx_next_entry = IPA_NAT_INVALID_NAT_ENTRY;
-	uint16_t indx_next_next_entry = IPA_NAT_INVALID_NAT_ENTRY;
-	uint16_t table_entry;
-
-	size = sizeof(struct ipa_ioc_nat_dma_cmd)+
-	(MAX_DMA_ENTRIES_FOR_DEL * sizeof(struct ipa_ioc_nat_dma_one));
-
-	cmd = (struct ipa_ioc_nat_dma_cmd *)malloc(size);
-	if (NULL == cmd) {
-		IPAERR("unable to allocate memory\n");
-		return -ENOMEM;
-	}
 
 	cache_ptr = &ipv4_nat_cache.ip4_tbl[tbl_indx];
 	if (!expn_tbl) {
@@ -1770,8 +2683,7 @@ int ipa_nati_post_del_dma_cmd(uint8_t tbl_indx,
 	if (!Read16BitFieldValue(tbl_ptr[cur_tbl_entry].ip_cksm_enbl,
 													 ENABLE_FIELD)) {
 		IPAERR("Deleting invalid(not enabled) rule\n");
-		ret = -EINVAL;
-		goto fail;
+		return -EINVAL;
 	}
 
 	indx_tbl_entry =
@@ -1783,30 +2695,30 @@ int ipa_nati_post_del_dma_cmd(uint8_t tbl_indx,
 	 ================================================*/
 	/* Just delete the current rule by disabling the flag field */
 	if (IPA_NAT_DEL_TYPE_ONLY_ONE == rule_pos) {
-		cmd->dma[no_of_cmds].table_index = tbl_indx;
-		cmd->dma[no_of_cmds].base_addr = IPA_NAT_BASE_TBL;
-		cmd->dma[no_of_cmds].data = IPA_NAT_FLAG_DISABLE_BIT_MASK;
+		dma[no_of_cmds].table_index = tbl_indx;
+		dma[no_of_cmds].base_addr = IPA_NAT_BASE_TBL;
+		dma[no_of_cmds].data = IPA_NAT_FLAG_DISABLE_BIT_MASK;
 
-		cmd->dma[no_of_cmds].offset =
+		dma[no_of_cmds].offset =
 			 ipa_nati_get_entry_offset(cache_ptr,
-					cmd->dma[no_of_cmds].base_addr,
+					dma[no_of_cmds].base_addr,
 					cur_tbl_entry);
-		cmd->dma[no_of_cmds].offset += IPA_NAT_RULE_FLAG_FIELD_OFFSET;
+		dma[no_of_cmds].offset += IPA_NAT_RULE_FLAG_FIELD_OFFSET;
 	}
 
 	/* Just update the protocol field to invalid */
 	else if (IPA_NAT_DEL_TYPE_HEAD == rule_pos) {
-		cmd->dma[no_of_cmds].table_index = tbl_indx;
-		cmd->dma[no_of_cmds].base_addr = IPA_NAT_BASE_TBL;
-		cmd->dma[no_of_cmds].data = IPA_NAT_INVALID_PROTO_FIELD_VALUE;
+		dma[no_of_cmds].table_index = tbl_indx;
+		dma[no_of_cmds].base_addr = IPA_NAT_BASE_TBL;
+		dma[no_of_cmds].data = IPA_NAT_INVALID_PROTO_FIELD_VALUE;
 
-		cmd->dma[no_of_cmds].offset =
+		dma[no_of_cmds].offset =
 			 ipa_nati_get_entry_offset(cache_ptr,
-					cmd->dma[no_of_cmds].base_addr,
+					dma[no_of_cmds].base_addr,
 					cur_tbl_entry);
-		cmd->dma[no_of_cmds].offset += IPA_NAT_RULE_PROTO_FIELD_OFFSET;
+		dma[no_of_cmds].offset += IPA_NAT_RULE_PROTO_FIELD_OFFSET;
 
-		IPADBG("writing invalid proto: 0x%x\n", cmd->dma[no_of_cmds].data);
+		IPADBG("writing invalid proto: 0x%x\n", dma[no_of_cmds].data);
 	}
 
 	/*
@@ -1818,22 +2730,22 @@ int ipa_nati_post_del_dma_cmd(uint8_t tbl_indx,
 			Read16BitFieldValue(tbl_ptr[cur_tbl_entry].sw_spec_params,
 				SW_SPEC_PARAM_PREV_INDEX_FIELD);
 
-		cmd->dma[no_of_cmds].table_index = tbl_indx;
-		cmd->dma[no_of_cmds].data =
+		dma[no_of_cmds].table_index = tbl_indx;
+		dma[no_of_cmds].data =
 			Read16BitFieldValue(tbl_ptr[cur_tbl_entry].nxt_indx_pub_port,
 					NEXT_INDEX_FIELD);
 
-		cmd->dma[no_of_cmds].base_addr = IPA_NAT_BASE_TBL;
+		dma[no_of_cmds].base_addr = IPA_NAT_BASE_TBL;
 		if (prev_entry >= cache_ptr->table_entries) {
-			cmd->dma[no_of_cmds].base_addr = IPA_NAT_EXPN_TBL;
+			dma[no_of_cmds].base_addr = IPA_NAT_EXPN_TBL;
 			prev_entry -= cache_ptr->table_entries;
 		}
 
-		cmd->dma[no_of_cmds].offset =
+		dma[no_of_cmds].offset =
 			ipa_nati_get_entry_offset(cache_ptr,
-				cmd->dma[no_of_cmds].base_addr, prev_entry);
+				dma[no_of_cmds].base_addr, prev_entry);
 
-		cmd->dma[no_of_cmds].offset += IPA_NAT_RULE_NEXT_FIELD_OFFSET;
+		dma[no_of_cmds].offset += IPA_NAT_RULE_NEXT_FIELD_OFFSET;
 	}
 
 	/*
@@ -1844,20 +2756,20 @@ int ipa_nati_post_del_dma_cmd(uint8_t tbl_indx,
 			Read16BitFieldValue(tbl_ptr[cur_tbl_entry].sw_spec_params,
 				SW_SPEC_PARAM_PREV_INDEX_FIELD);
 
-		cmd->dma[no_of_cmds].table_index = tbl_indx;
-		cmd->dma[no_of_cmds].data = IPA_NAT_INVALID_NAT_ENTRY;
+		dma[no_of_cmds].table_index = tbl_indx;
+		dma[no_of_cmds].data = IPA_NAT_INVALID_NAT_ENTRY;
 
-		cmd->dma[no_of_cmds].base_addr = IPA_NAT_BASE_TBL;
+		dma[no_of_cmds].base_addr = IPA_NAT_BASE_TBL;
 		if (prev_entry >= cache_ptr->table_entries) {
-			cmd->dma[no_of_cmds].base_addr = IPA_NAT_EXPN_TBL;
+			dma[no_of_cmds].base_addr = IPA_NAT_EXPN_TBL;
 			prev_entry -= cache_ptr->table_entries;
 		}
 
-		cmd->dma[no_of_cmds].offset =
+		dma[no_of_cmds].offset =
 			ipa_nati_get_entry_offset(cache_ptr,
-				cmd->dma[no_of_cmds].base_addr, prev_entry);
+				dma[no_of_cmds].base_addr, prev_entry);
 
-		cmd->dma[no_of_cmds].offset += IPA_NAT_RULE_NEXT_FIELD_OFFSET;
+		dma[no_of_cmds].offset += IPA_NAT_RULE_NEXT_FIELD_OFFSET;
 	}
 
 	/* ================================================
@@ -1884,16 +2796,16 @@ int ipa_nati_post_del_dma_cmd(uint8_t tbl_indx,
 	/* Just delete the current rule by resetting nat_table_index field to 0 */
 	if (IPA_NAT_DEL_TYPE_ONLY_ONE == indx_rule_pos) {
 		no_of_cmds++;
-		cmd->dma[no_of_cmds].base_addr = IPA_NAT_INDX_TBL;
-		cmd->dma[no_of_cmds].table_index = tbl_indx;
-		cmd->dma[no_of_cmds].data = IPA_NAT_INVALID_NAT_ENTRY;
+		dma[no_of_cmds].base_addr = IPA_NAT_INDX_TBL;
+		dma[no_of_cmds].table_index = tbl_indx;
+		dma[no_of_cmds].data = IPA_NAT_INVALID_NAT_ENTRY;
 
-		cmd->dma[no_of_cmds].offset =
+		dma[no_of_cmds].offset =
 			ipa_nati_get_index_entry_offset(cache_ptr,
-			cmd->dma[no_of_cmds].base_addr,
+			dma[no_of_cmds].base_addr,
 			indx_tbl_entry);
 
-		cmd->dma[no_of_cmds].offset +=
+		dma[no_of_cmds].offset +=
 			IPA_NAT_INDEX_RULE_NAT_INDEX_FIELD_OFFSET;
 	}
 
@@ -1906,37 +2818,37 @@ int ipa_nati_post_del_dma_cmd(uint8_t tbl_indx,
 		next_entry -= cache_ptr->table_entries;
 
 		no_of_cmds++;
-		cmd->dma[no_of_cmds].base_addr = IPA_NAT_INDX_TBL;
-		cmd->dma[no_of_cmds].table_index = tbl_indx;
+		dma[no_of_cmds].base_addr = IPA_NAT_INDX_TBL;
+		dma[no_of_cmds].table_index = tbl_indx;
 
 		/* Copy the nat_table_index field value of next entry */
 		indx_tbl_ptr =
 			 (struct ipa_nat_indx_tbl_rule *)cache_ptr->index_table_expn_addr;
-		cmd->dma[no_of_cmds].data =
+		dma[no_of_cmds].data =
 			Read16BitFieldValue(indx_tbl_ptr[next_entry].tbl_entry_nxt_indx,
 				INDX_TBL_TBL_ENTRY_FIELD);
 
-		cmd->dma[no_of_cmds].offset =
+		dma[no_of_cmds].offset =
 			ipa_nati_get_index_entry_offset(cache_ptr,
-					cmd->dma[no_of_cmds].base_addr,
+					dma[no_of_cmds].base_addr,
 					indx_tbl_entry);
 
-		cmd->dma[no_of_cmds].offset +=
+		dma[no_of_cmds].offset +=
 			IPA_NAT_INDEX_RULE_NAT_INDEX_FIELD_OFFSET;
 
 		/* Copy the next_index field value of next entry */
 		no_of_cmds++;
-		cmd->dma[no_of_cmds].base_addr = IPA_NAT_INDX_TBL;
-		cmd->dma[no_of_cmds].table_index = tbl_indx;
-		cmd->dma[no_of_cmds].data =
+		dma[no_of_cmds].base_addr = IPA_NAT_INDX_TBL;
+		dma[no_of_cmds].table_index = tbl_indx;
+		dma[no_of_cmds].data =
 			Read16BitFieldValue(indx_tbl_ptr[next_entry].tbl_entry_nxt_indx,
 				INDX_TBL_NEXT_INDEX_FILED);
 
-		cmd->dma[no_of_cmds].offset =
+		dma[no_of_cmds].offset =
 			ipa_nati_get_index_entry_offset(cache_ptr,
-				cmd->dma[no_of_cmds].base_addr, indx_tbl_entry);
+				dma[no_of_cmds].base_addr, indx_tbl_entry);
 
-		cmd->dma[no_of_cmds].offset +=
+		dma[no_of_cmds].offset +=
 			IPA_NAT_INDEX_RULE_NEXT_FIELD_OFFSET;
 		indx_next_entry = next_entry;
 	}
@@ -1949,27 +2861,27 @@ int ipa_nati_post_del_dma_cmd(uint8_t tbl_indx,
 		prev_entry = cache_ptr->index_expn_table_meta[indx_tbl_entry].prev_index;
 
 		no_of_cmds++;
-		cmd->dma[no_of_cmds].table_index = tbl_indx;
-		cmd->dma[no_of_cmds].data =
+		dma[no_of_cmds].table_index = tbl_indx;
+		dma[no_of_cmds].data =
 			Read16BitFieldValue(indx_tbl_ptr[indx_tbl_entry].tbl_entry_nxt_indx,
 				INDX_TBL_NEXT_INDEX_FILED);
 
-		cmd->dma[no_of_cmds].base_addr = IPA_NAT_INDX_TBL;
+		dma[no_of_cmds].base_addr = IPA_NAT_INDX_TBL;
 		if (prev_entry >= cache_ptr->table_entries) {
-			cmd->dma[no_of_cmds].base_addr = IPA_NAT_INDEX_EXPN_TBL;
+			dma[no_of_cmds].base_addr = IPA_NAT_INDEX_EXPN_TBL;
 			prev_entry -= cache_ptr->table_entries;
 		}
 
 		IPADBG("prev_entry: %d update with cur next_index: %d\n",
-				prev_entry, cmd->dma[no_of_cmds].data);
+				prev_entry, dma[no_of_cmds].data);
 		IPADBG("prev_entry: %d exist in table_type:%d\n",
-				prev_entry, cmd->dma[no_of_cmds].base_addr);
+				prev_entry, dma[no_of_cmds].base_addr);
 
-		cmd->dma[no_of_cmds].offset =
+		dma[no_of_cmds].offset =
 			ipa_nati_get_index_entry_offset(cache_ptr,
-				cmd->dma[no_of_cmds].base_addr, prev_entry);
+				dma[no_of_cmds].base_addr, prev_entry);
 
-		cmd->dma[no_of_cmds].offset +=
+		dma[no_of_cmds].offset +=
 			IPA_NAT_INDEX_RULE_NEXT_FIELD_OFFSET;
 	}
 
@@ -1978,41 +2890,83 @@ int ipa_nati_post_del_dma_cmd(uint8_t tbl_indx,
 		prev_entry = cache_ptr->index_expn_table_meta[indx_tbl_entry].prev_index;
 
 		no_of_cmds++;
-		cmd->dma[no_of_cmds].table_index = tbl_indx;
-		cmd->dma[no_of_cmds].data = IPA_NAT_INVALID_NAT_ENTRY;
+		dma[no_of_cmds].table_index = tbl_indx;
+		dma[no_of_cmds].data = IPA_NAT_INVALID_NAT_ENTRY;
 
-		cmd->dma[no_of_cmds].base_addr = IPA_NAT_INDX_TBL;
+		dma[no_of_cmds].base_addr = IPA_NAT_INDX_TBL;
 		if (prev_entry >= cache_ptr->table_entries) {
-			cmd->dma[no_of_cmds].base_addr = IPA_NAT_INDEX_EXPN_TBL;
+			dma[no_of_cmds].base_addr = IPA_NAT_INDEX_EXPN_TBL;
 			prev_entry -= cache_ptr->table_entries;
 		}
 
 		IPADBG("Reseting prev_entry: %d next_index\n", prev_entry);
 		IPADBG("prev_entry: %d exist in table_type:%d\n",
-			prev_entry, cmd->dma[no_of_cmds].base_addr);
+			prev_entry, dma[no_of_cmds].base_addr);
 
-		cmd->dma[no_of_cmds].offset =
+		dma[no_of_cmds].offset =
 			 ipa_nati_get_index_entry_offset(cache_ptr,
-					cmd->dma[no_of_cmds].base_addr, prev_entry);
+					dma[no_of_cmds].base_addr, prev_entry);
 
-		cmd->dma[no_of_cmds].offset +=
+		dma[no_of_cmds].offset +=
 			IPA_NAT_INDEX_RULE_NEXT_FIELD_OFFSET;
 	}
 
 	/* ================================================
 	 Index Table rule Deletion End
 	 ================================================*/
-	cmd->entries = no_of_cmds + 1;
+	*entries = no_of_cmds + 1;
 
-	if (cmd->entries > 1) {
-		ReorderCmds(cmd, size);
+	info->tbl_indx = tbl_indx;
+	info->cur_tbl_entry = cur_tbl_entry;
+	info->expn_tbl = expn_tbl;
+	info->rule_pos = rule_pos;
+	info->indx_tbl_entry = indx_tbl_entry;
+	info->indx_rule_pos = indx_rule_pos;
+	info->indx_next_entry = indx_next_entry;
+
+	return 0;
+}
+
+/**
+ * ipa_nati_update_del_sw_state() - finish a delete after its dma
+ * @info: [in] state returned by ipa_nati_generate_del_dma_cmd()
+ *
+ * Update the sw specific parameters and reset the entries
+ * released by the delete, once the dma writes are posted
+ *
+ * Returns: None
+ */
+void ipa_nati_update_del_sw_state(struct ipa_nat_del_info *info)
+{
+	struct ipa_nat_ip4_table_cache *cache_ptr;
+	struct ipa_nat_indx_tbl_rule *indx_tbl_ptr;
+	struct ipa_nat_rule *tbl_ptr;
+
+	uint16_t cur_tbl_entry = info->cur_tbl_entry;
+	uint16_t indx_tbl_entry = info->indx_tbl_entry;
+	uint16_t indx_next_entry = info->indx_next_entry;
+	del_type rule_pos = info->rule_pos;
+	del_type indx_rule_pos = info->indx_rule_pos;
+
+	uint16_t prev_entry = IPA_NAT_INVALID_NAT_ENTRY;
+	uint16_t next_entry = IPA_NAT_INVALID_NAT_ENTRY;
+	uint16_t indx_next_next_entry = IPA_NAT_INVALID_NAT_ENTRY;
+	uint16_t table_entry;
+
+	cache_ptr = &ipv4_nat_cache.ip4_tbl[info->tbl_indx];
+	if (!info->expn_tbl) {
+		tbl_ptr = (struct ipa_nat_rule *)cache_ptr->ipv4_rules_addr;
+	} else {
+		tbl_ptr = (struct ipa_nat_rule *)cache_ptr->ipv4_expn_rules_addr;
 	}
-	if (ioctl(ipv4_nat_cache.ipa_fd, IPA_IOC_NAT_DMA, cmd)) {
-		perror("ipa_nati_post_del_dma_cmd(): ioctl error value");
-		IPAERR("unable to post cmd\n");
-		IPADBG("ipa fd %d\n", ipv4_nat_cache.ipa_fd);
-		ret = -EIO;
-		goto fail;
+
+	/* Only a lone index rule leaves its entry in the index base table */
+	if (IPA_NAT_DEL_TYPE_ONLY_ONE == indx_rule_pos) {
+		indx_tbl_ptr =
+			 (struct ipa_nat_indx_tbl_rule *)cache_ptr->index_table_addr;
+	} else {
+		indx_tbl_ptr =
+			 (struct ipa_nat_indx_tbl_rule *)cache_ptr->index_table_expn_addr;
 	}
 
 	/* if entry exist in IPA_NAT_DEL_TYPE_MIDDLE of list
@@ -2042,6 +2996,10 @@ int ipa_nati_post_del_dma_cmd(uint8_t tbl_indx,
 			 In case of IPA_NAT_DEL_TYPE_HEAD, don't reset */
 	if (IPA_NAT_DEL_TYPE_HEAD != rule_pos) {
 		memset(&tbl_ptr[cur_tbl_entry], 0, sizeof(struct ipa_nat_rule));
+
+		if (info->expn_tbl) {
+			ipa_nati_expn_tbl_release_entry(cache_ptr, cur_tbl_entry);
+		}
 	}
 
 	if (indx_rule_pos == IPA_NAT_DEL_TYPE_HEAD) {
@@ -2072,6 +3030,7 @@ int ipa_nati_post_del_dma_cmd(uint8_t tbl_indx,
 
     /* This resets both table entry and next index values */
 		indx_tbl_ptr[indx_next_entry].tbl_entry_nxt_indx = 0;
+		ipa_nati_index_expn_release_entry(cache_ptr, indx_next_entry);
 
 		/*
 				 In case of IPA_NAT_DEL_TYPE_HEAD, update the sw specific parameters
@@ -2119,14 +3078,1260 @@ int ipa_nati_post_del_dma_cmd(uint8_t tbl_indx,
 
 		indx_tbl_ptr[indx_tbl_entry].tbl_entry_nxt_indx = 0;
 
+		if (IPA_NAT_DEL_TYPE_MIDDLE == indx_rule_pos ||
+				IPA_NAT_DEL_TYPE_LAST == indx_rule_pos) {
+			ipa_nati_index_expn_release_entry(cache_ptr, indx_tbl_entry);
+		}
+	}
+
+	return;
+}
+
+int ipa_nati_post_del_dma_cmd(uint8_t tbl_indx,
+				uint16_t cur_tbl_entry,
+				uint8_t expn_tbl,
+				del_type rule_pos)
+{
+	struct ipa_nat_del_info info;
+	struct ipa_ioc_nat_dma_cmd *cmd;
+	int ret = 0, size = 0;
+
+	size = sizeof(struct ipa_ioc_nat_dma_cmd)+
+	(MAX_DMA_ENTRIES_FOR_DEL * sizeof(struct ipa_ioc_nat_dma_one));
+
+	cmd = (struct ipa_ioc_nat_dma_cmd *)malloc(size);
+	if (NULL == cmd) {
+		IPAERR("unable to allocate memory\n");
+		return -ENOMEM;
+	}
+
+	ret = ipa_nati_generate_del_dma_cmd(tbl_indx, cur_tbl_entry,
+					expn_tbl, rule_pos,
+					cmd->dma, &cmd->entries, &info);
+	if (ret) {
+		goto fail;
+	}
+
+	if (cmd->entries > 1) {
+		ReorderCmds(cmd, size);
+	}
+	if (ipa_nati_nat_dma(tbl_indx, cmd)) {
+		perror("ipa_nati_post_del_dma_cmd(): ioctl error value");
+		IPAERR("unable to post cmd\n");
+		IPADBG("ipa fd %d\n", ipv4_nat_cache.ipa_fd);
+		ret = -EIO;
+		goto fail;
 	}
 
+	ipa_nati_update_del_sw_state(&info);
+
 fail:
 	free(cmd);
 
 	return ret;
 }
 
+/* ========================================================
+						Batch functions
+	 ========================================================*/
+static int ipa_nati_batch_init(struct ipa_nat_dma_batch *batch,
+				uint8_t tbl_indx)
+{
+	memset(batch, 0, sizeof(struct ipa_nat_dma_batch));
+	batch->tbl_indx = tbl_indx;
+
+	batch->cmd = (struct ipa_ioc_nat_dma_cmd *)
+	malloc(sizeof(struct ipa_ioc_nat_dma_cmd) +
+				 (IPA_NAT_MAX_DMA_ENTRIES * sizeof(struct ipa_ioc_nat_dma_one)));
+	if (NULL == batch->cmd) {
+		IPAERR("unable to allocate memory\n");
+		return -ENOMEM;
+	}
+
+	batch->busy = (uint8_t *)
+	calloc(ipv4_nat_cache.ip4_tbl[tbl_indx].table_entries, sizeof(uint8_t));
+	if (NULL == batch->busy) {
+		IPAERR("unable to allocate memory\n");
+		free(batch->cmd);
+		batch->cmd = NULL;
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static void ipa_nati_batch_free(struct ipa_nat_dma_batch *batch)
+{
+	free(batch->cmd);
+	free(batch->busy);
+	batch->cmd = NULL;
+	batch->busy = NULL;
+}
+
+/* A rule must not be handled while its lists have dma writes pending */
+static int ipa_nati_batch_is_busy(struct ipa_nat_dma_batch *batch,
+				uint16_t base_entry,
+				uint16_t indx_entry)
+{
+	return (batch->busy[base_entry] & IPA_NAT_BATCH_BASE_BUSY) ||
+		(batch->busy[indx_entry] & IPA_NAT_BATCH_INDX_BUSY);
+}
+
+static void ipa_nati_batch_mark_busy(struct ipa_nat_dma_batch *batch,
+				uint16_t base_entry,
+				uint16_t indx_entry)
+{
+	if (!batch->busy[base_entry]) {
+		batch->busy_list[batch->busy_cnt++] = base_entry;
+	}
+	batch->busy[base_entry] |= IPA_NAT_BATCH_BASE_BUSY;
+
+	if (!batch->busy[indx_entry]) {
+		batch->busy_list[batch->busy_cnt++] = indx_entry;
+	}
+	batch->busy[indx_entry] |= IPA_NAT_BATCH_INDX_BUSY;
+}
+
+static int ipa_nati_batch_is_full(struct ipa_nat_dma_batch *batch,
+				uint16_t needed)
+{
+	return batch->rule_cnt == IPA_NAT_MAX_DMA_ENTRIES ||
+		(batch->indx_cnt + batch->base_cnt + batch->enable_cnt + needed) >
+			IPA_NAT_MAX_DMA_ENTRIES;
+}
+
+/**
+ * ipa_nati_batch_post() - post the pending dma writes of a batch
+ * @batch: [in] batch to be posted
+ *
+ * Posts index table writes, base table writes and enable
+ * bits in that order with a single IPA_IOC_NAT_DMA and
+ * clears the busy lists. The rules of the batch are left
+ * to the caller
+ *
+ * Returns: 0 on success, negative on failure
+ */
+static int ipa_nati_batch_post(struct ipa_nat_dma_batch *batch)
+{
+	struct ipa_ioc_nat_dma_cmd *cmd = batch->cmd;
+	uint16_t cnt, entries = 0;
+	int ret = 0;
+
+	for (cnt = 0; cnt < batch->indx_cnt; cnt++) {
+		cmd->dma[entries++] = batch->indx_dma[cnt];
+	}
+	for (cnt = 0; cnt < batch->base_cnt; cnt++) {
+		cmd->dma[entries++] = batch->base_dma[cnt];
+	}
+	for (cnt = 0; cnt < batch->enable_cnt; cnt++) {
+		cmd->dma[entries++] = batch->enable_dma[cnt];
+	}
+	cmd->entries = (uint8_t)entries;
+
+	for (cnt = 0; cnt < batch->busy_cnt; cnt++) {
+		batch->busy[batch->busy_list[cnt]] = 0;
+	}
+	batch->busy_cnt = 0;
+	batch->indx_cnt = 0;
+	batch->base_cnt = 0;
+	batch->enable_cnt = 0;
+
+	if (0 == entries) {
+		return 0;
+	}
+
+	IPADBG("posting %d dma writes for %d rules\n", entries, batch->rule_cnt);
+	if (ipa_nati_nat_dma(batch->tbl_indx, cmd)) {
+		perror("ipa_nati_batch_post(): ioctl error value");
+		IPAERR("unable to post cmd\n");
+		IPADBG("ipa fd %d\n", ipv4_nat_cache.ipa_fd);
+		ret = -EIO;
+	}
+
+	return ret;
+}
+
+static int ipa_nati_batch_flush_adds(struct ipa_nat_dma_batch *batch,
+				uint32_t *rule_hdls)
+{
+	struct ipa_nat_batch_rule *rule;
+	uint16_t cnt;
+	int ret;
+
+	ret = ipa_nati_batch_post(batch);
+	for (cnt = 0; cnt < batch->rule_cnt; cnt++) {
+		rule = &batch->rules[cnt];
+		if (ret) {
+			/* none of the writes was posted, the lists never led here */
+			ipa_nati_release_rule_entries(&ipv4_nat_cache.ip4_tbl[batch->tbl_indx],
+						rule->tbl_entry, rule->indx_tbl_entry);
+			rule_hdls[rule->pos] = 0;
+			continue;
+		}
+
+		/* a rule moved by a resize keeps its handle */
+		if (rule->rule_hdl) {
+			ipa_nati_assign_rule_hdl(&ipv4_nat_cache.ip4_tbl[batch->tbl_indx],
+						rule->tbl_entry, (uint16_t)(rule->rule_hdl - 1));
+			rule_hdls[rule->pos] = rule->rule_hdl;
+			continue;
+		}
+
+		rule_hdls[rule->pos] =
+			ipa_nati_make_rule_hdl((uint16_t)(batch->tbl_indx + 1),
+						rule->tbl_entry);
+		if (!rule_hdls[rule->pos]) {
+			IPAERR("unable to generate rule handle\n");
+			ret = -EINVAL;
+		}
+	}
+	batch->rule_cnt = 0;
+
+	return ret;
+}
+
+static int ipa_nati_batch_flush_dels(struct ipa_nat_dma_batch *batch)
+{
+	struct ipa_nat_ip4_table_cache *tbl_ptr;
+	struct ipa_nat_batch_rule *rule;
+	uint16_t cnt;
+	int ret;
+
+	ret = ipa_nati_batch_post(batch);
+	if (!ret) {
+		tbl_ptr = &ipv4_nat_cache.ip4_tbl[batch->tbl_indx];
+		for (cnt = 0; cnt < batch->rule_cnt; cnt++) {
+			rule = &batch->rules[cnt];
+			ipa_nati_update_del_sw_state(&rule->del_info);
+
+			ipa_nati_release_rule_hdl(tbl_ptr, (uint16_t)rule->rule_hdl);
+		}
+	}
+	batch->rule_cnt = 0;
+
+	return ret;
+}
+
+/* Returns the base table entry heading the list of the given entry */
+static uint16_t ipa_nati_batch_base_head(struct ipa_nat_ip4_table_cache *cache_ptr,
+				uint16_t entry)
+{
+	struct ipa_nat_rule *expn_tbl;
+	uint16_t cnt = 0;
+
+	expn_tbl = (struct ipa_nat_rule *)cache_ptr->ipv4_expn_rules_addr;
+	while (entry >= cache_ptr->table_entries &&
+				 cnt++ <= cache_ptr->expn_table_entries) {
+		entry = Read16BitFieldValue(
+			expn_tbl[entry - cache_ptr->table_entries].sw_spec_params,
+			SW_SPEC_PARAM_PREV_INDEX_FIELD);
+	}
+
+	if (entry >= cache_ptr->table_entries) {
+		return IPA_NAT_INVALID_NAT_ENTRY;
+	}
+	return entry;
+}
+
+/* Returns the index table entry heading the list of the given entry */
+static uint16_t ipa_nati_batch_index_head(struct ipa_nat_ip4_table_cache *cache_ptr,
+				uint16_t entry)
+{
+	uint16_t cnt = 0;
+
+	while (entry >= cache_ptr->table_entries &&
+				 cnt++ <= cache_ptr->expn_table_entries) {
+		entry =
+			cache_ptr->index_expn_table_meta[entry - cache_ptr->table_entries].prev_index;
+	}
+
+	if (entry >= cache_ptr->table_entries) {
+		return IPA_NAT_INVALID_NAT_ENTRY;
+	}
+	return entry;
+}
+
+/**
+ * ipa_nati_batch_add_rules() - add rules through a dma batch
+ * @batch: [in] initialized batch of the table
+ * @tbl_hdl: [in] nat table handle
+ * @clnt_rules: [in] rules to be added
+ * @num_rules: [in] number of rules
+ * @rule_hdls: [in/out] handles of the rules, a non zero handle
+ *  is kept for its rule instead of making a new one
+ *
+ * The table must be locked exclusively
+ *
+ * Returns: 0 on success, negative if any rule failed
+ */
+static int ipa_nati_batch_add_rules(struct ipa_nat_dma_batch *batch,
+				uint32_t tbl_hdl,
+				const ipa_nat_ipv4_rule *clnt_rules,
+				uint16_t num_rules,
+				uint32_t *rule_hdls)
+{
+	struct ipa_nat_ip4_table_cache *tbl_ptr;
+	struct ipa_nat_sw_rule sw_rule;
+	struct ipa_nat_indx_tbl_sw_rule index_sw_rule;
+	const ipa_nat_ipv4_rule *clnt_rule;
+	uint16_t new_entry, new_index_tbl_entry;
+	uint16_t base_head, indx_head;
+	uint8_t tbl_indx = (uint8_t)(tbl_hdl - 1);
+	uint32_t keep_hdl;
+	uint16_t cnt;
+	int ret = 0;
+
+	tbl_ptr = &ipv4_nat_cache.ip4_tbl[tbl_indx];
+	for (cnt = 0; cnt < num_rules; cnt++) {
+		clnt_rule = &clnt_rules[cnt];
+		keep_hdl = rule_hdls[cnt];
+		rule_hdls[cnt] = 0;
+
+		/* verify that the rule's PDN is valid */
+		if (clnt_rule->pdn_index >= IPA_MAX_PDN_NUM ||
+			pdns[clnt_rule->pdn_index].public_ip == 0) {
+			IPAERR("invalid parameters, rule %d pdn index %d\n",
+				cnt, clnt_rule->pdn_index);
+			ret = -EINVAL;
+			continue;
+		}
+
+		base_head = dst_hash(tbl_ptr, pdns[clnt_rule->pdn_index].public_ip,
+												 clnt_rule->target_ip,
+												 clnt_rule->target_port,
+												 clnt_rule->public_port,
+												 clnt_rule->protocol,
+												 tbl_ptr->table_entries-1);
+		indx_head = src_hash(tbl_ptr, clnt_rule->private_ip,
+												 clnt_rule->private_port,
+												 clnt_rule->target_ip,
+												 clnt_rule->target_port,
+												 clnt_rule->protocol,
+												 tbl_ptr->table_entries-1);
+
+		if (ipa_nati_batch_is_busy(batch, base_head, indx_head) ||
+				ipa_nati_batch_is_full(batch, MAX_DMA_ENTRIES_FOR_ADD)) {
+			if (ipa_nati_batch_flush_adds(batch, rule_hdls)) {
+				ret = -EIO;
+			}
+		}
+
+		memset(&sw_rule, 0, sizeof(sw_rule));
+		memset(&index_sw_rule, 0, sizeof(index_sw_rule));
+
+		if (ipa_nati_generate_rule(tbl_hdl, clnt_rule,
+						&sw_rule, &index_sw_rule,
+						&new_entry, &new_index_tbl_entry)) {
+			IPAERR("unable to generate rule %d\n", cnt);
+			ret = -EINVAL;
+			continue;
+		}
+
+		ipa_nati_copy_ipv4_rule_to_hw(tbl_ptr, &sw_rule, new_entry,
+																	tbl_indx, batch);
+		ipa_nati_copy_ipv4_index_rule_to_hw(tbl_ptr, &index_sw_rule,
+																				new_index_tbl_entry,
+																				tbl_indx, batch);
+		ipa_nati_fill_enable_dma(tbl_indx, new_entry,
+					&batch->enable_dma[batch->enable_cnt++]);
+
+		ipa_nati_batch_mark_busy(batch, base_head, indx_head);
+		batch->rules[batch->rule_cnt].pos = cnt;
+		batch->rules[batch->rule_cnt].tbl_entry = new_entry;
+		batch->rules[batch->rule_cnt].indx_tbl_entry = new_index_tbl_entry;
+		batch->rules[batch->rule_cnt].rule_hdl = keep_hdl;
+		batch->rule_cnt++;
+		IPADBG("rule %d new entry:%d, new index entry: %d\n",
+					 cnt, new_entry, new_index_tbl_entry);
+	}
+
+	if (ipa_nati_batch_flush_adds(batch, rule_hdls)) {
+		ret = -EIO;
+	}
+
+	for (cnt = 0; cnt < num_rules; cnt++) {
+		if (!rule_hdls[cnt]) {
+			tbl_ptr->counters.failed_inserts++;
+		}
+	}
+
+	return ret;
+}
+
+/**
+ * ipa_nati_add_ipv4_rules() - add a batch of rules
+ * @tbl_hdl: [in] nat table handle
+ * @clnt_rules: [in] rules to be added
+ * @num_rules: [in] number of rules
+ * @rule_hdls: [out] handle of each rule, 0 if it was not added
+ *
+ * Same as ipa_nati_add_ipv4_rule() for each rule, but the dma
+ * writes are posted with one IPA_IOC_NAT_DMA for up to
+ * IPA_NAT_MAX_DMA_ENTRIES writes. Rules falling in a list
+ * that already has writes pending start a new command
+ *
+ * Returns: 0 on success, negative if any rule failed
+ */
+int ipa_nati_add_ipv4_rules(uint32_t tbl_hdl,
+				const ipa_nat_ipv4_rule *clnt_rules,
+				uint16_t num_rules,
+				uint32_t *rule_hdls)
+{
+	struct ipa_nat_dma_batch *batch;
+	uint8_t tbl_indx = (uint8_t)(tbl_hdl - 1);
+	uint64_t start_us = ipa_nati_now_us();
+	int ret = 0;
+
+	batch = (struct ipa_nat_dma_batch *)malloc(sizeof(struct ipa_nat_dma_batch));
+	if (NULL == batch) {
+		IPAERR("unable to allocate memory\n");
+		return -ENOMEM;
+	}
+
+	if (ipa_nati_lock_tbl(tbl_indx, 1) != 0) {
+		ret = -1;
+		goto mutex_lock_error;
+	}
+
+	if (!ipv4_nat_cache.ip4_tbl[tbl_indx].valid) {
+		IPAERR("invalid table handle\n");
+		ret = -EINVAL;
+		goto unlock;
+	}
+
+	/* a failed grow keeps the old size, add the rules anyway */
+	ipa_nati_grow_tbl(tbl_indx, num_rules);
+
+	ret = ipa_nati_batch_init(batch, tbl_indx);
+	if (ret) {
+		goto unlock;
+	}
+
+	memset(rule_hdls, 0, sizeof(uint32_t) * num_rules);
+	ret = ipa_nati_batch_add_rules(batch, tbl_hdl, clnt_rules,
+					num_rules, rule_hdls);
+	ipa_nati_record_latency(ipv4_nat_cache.ip4_tbl[tbl_indx].counters.add_latency,
+				start_us);
+
+#ifdef NAT_DUMP
+	ipa_nat_dump_ipv4_table(tbl_hdl);
+#endif
+
+	ipa_nati_batch_free(batch);
+
+unlock:
+	if (ipa_nati_unlock_tbl(tbl_indx) != 0) {
+		ret = -1;
+		goto mutex_unlock_error;
+	}
+
+	free(batch);
+	return ret;
+
+mutex_lock_error:
+	IPAERR("unable to lock the nat table\n");
+	free(batch);
+	return ret;
+
+mutex_unlock_error:
+	IPAERR("unable to unlock the nat table\n");
+	free(batch);
+	return ret;
+}
+
+/**
+ * ipa_nati_read_rule() - client view of a rule of the table
+ * @rule: [in] rule in the base or expansion table
+ * @clnt_rule: [out] rule as given to ipa_nati_add_ipv4_rule()
+ *
+ * Returns: None
+ */
+static void ipa_nati_read_rule(const struct ipa_nat_rule *rule,
+				ipa_nat_ipv4_rule *clnt_rule)
+{
+	clnt_rule->target_ip = rule->target_ip;
+	clnt_rule->private_ip = rule->private_ip;
+	clnt_rule->target_port = rule->target_port;
+	clnt_rule->private_port = rule->private_port;
+	clnt_rule->public_port =
+		Read16BitFieldValue(rule->nxt_indx_pub_port, PUBLIC_PORT_FILED);
+	clnt_rule->protocol = Read8BitFieldValue(rule->ts_proto, PROTOCOL_FIELD);
+	clnt_rule->pdn_index = rule->pdn_index;
+}
+
+/**
+ * ipa_nati_post_pdns() - give the pdn config to a new nat table
+ *
+ * The pdn config table of the IPA hw goes with the nat table
+ *
+ * Returns: 0 on success, negative on failure
+ */
+static int ipa_nati_post_pdns(void)
+{
+	struct ipa_ioc_nat_pdn_entry pdn_entry;
+	int cnt, ret = 0;
+
+	if (ipv4_nat_cache.ver < IPA_HW_v4_0) {
+		return 0;
+	}
+
+	for (cnt = 0; cnt < IPA_MAX_PDN_NUM; cnt++) {
+		if (pdns[cnt].public_ip == 0) {
+			continue;
+		}
+
+		pdn_entry.pdn_index = (uint8_t)cnt;
+		pdn_entry.public_ip = pdns[cnt].public_ip;
+		pdn_entry.src_metadata = pdns[cnt].src_metadata;
+		pdn_entry.dst_metadata = pdns[cnt].dst_metadata;
+		if (ipa_nati_modify_pdn(&pdn_entry)) {
+			ret = -EIO;
+		}
+	}
+
+	return ret;
+}
+
+/**
+ * ipa_nati_check_tbl_fit() - check that rules fit in a new table size
+ * @tbl_ptr: [in] nat table the rules are moved from
+ * @clnt_rules: [in] rules of the table
+ * @num_rules: [in] number of rules
+ * @number_of_entries: [in] number of nat entries of the new table
+ *
+ * Hashes the rules with the geometry of the new table and counts
+ * the collisions the base and index expansion tables must take
+ *
+ * Returns: 0 if every rule fits, negative otherwise
+ */
+static int ipa_nati_check_tbl_fit(const struct ipa_nat_ip4_table_cache *tbl_ptr,
+				const ipa_nat_ipv4_rule *clnt_rules,
+				uint16_t num_rules,
+				uint16_t number_of_entries)
+{
+	const ipa_nat_ipv4_rule *clnt_rule;
+	uint16_t table_entries, expn_table_entries;
+	uint16_t base_head, indx_head;
+	uint32_t base_expn = 0, indx_expn = 0;
+	uint8_t *base_used, *indx_used;
+	uint16_t cnt;
+	int ret;
+
+	ret = ipa_nati_calc_tbl_entries(number_of_entries,
+					&table_entries, &expn_table_entries);
+	if (ret) {
+		return ret;
+	}
+
+	base_used = (uint8_t *)calloc(table_entries, sizeof(uint8_t));
+	indx_used = (uint8_t *)calloc(table_entries, sizeof(uint8_t));
+	if (NULL == base_used || NULL == indx_used) {
+		IPAERR("unable to allocate memory\n");
+		ret = -ENOMEM;
+		goto bail;
+	}
+
+	for (cnt = 0; cnt < num_rules; cnt++) {
+		clnt_rule = &clnt_rules[cnt];
+		if (clnt_rule->pdn_index >= IPA_MAX_PDN_NUM ||
+			pdns[clnt_rule->pdn_index].public_ip == 0) {
+			IPAERR("rule %d has invalid pdn index %d\n",
+				cnt, clnt_rule->pdn_index);
+			ret = -EINVAL;
+			goto bail;
+		}
+
+		base_head = dst_hash(tbl_ptr, pdns[clnt_rule->pdn_index].public_ip,
+												 clnt_rule->target_ip,
+												 clnt_rule->target_port,
+												 clnt_rule->public_port,
+												 clnt_rule->protocol,
+												 table_entries-1);
+		indx_head = src_hash(tbl_ptr, clnt_rule->private_ip,
+												 clnt_rule->private_port,
+												 clnt_rule->target_ip,
+												 clnt_rule->target_port,
+												 clnt_rule->protocol,
+												 table_entries-1);
+
+		/* the first rule of a list takes the base entry */
+		if (base_used[base_head]) {
+			base_expn++;
+		}
+		base_used[base_head] = 1;
+
+		if (indx_used[indx_head]) {
+			indx_expn++;
+		}
+		indx_used[indx_head] = 1;
+	}
+
+	/* entry 0 of the expansion tables is never used */
+	if (base_expn >= expn_table_entries || indx_expn >= expn_table_entries) {
+		IPAERR("%d rules need %d and %d of %d expansion entries\n",
+					 num_rules, base_expn, indx_expn, expn_table_entries - 1);
+		ret = -ENOSPC;
+	}
+
+bail:
+	free(base_used);
+	free(indx_used);
+	return ret;
+}
+
+/**
+ * ipa_nati_restore_tbl() - give a table back to the hw as it was
+ * @tbl_indx: [in] nat table index
+ * @old_tbl: [in] cache of the table
+ * @image: [in] heap copy of the table memory, taken over
+ *
+ * The table is recreated with its old size and the image is
+ * copied in, so the rules keep their entries and handles. When
+ * the hw refuses the table it is left detached on the image,
+ * the rules can still be read and the next exclusive lock of
+ * the table tries again
+ *
+ * The table must be locked exclusively
+ *
+ * Returns: 0 on success, negative if the table is detached
+ */
+static int ipa_nati_restore_tbl(uint8_t tbl_indx,
+				const struct ipa_nat_ip4_table_cache *old_tbl,
+				char *image)
+{
+	struct ipa_nat_ip4_table_cache *tbl_ptr = &ipv4_nat_cache.ip4_tbl[tbl_indx];
+	int ret;
+
+	/* the cache arrays of the old table are reused */
+	*tbl_ptr = *old_tbl;
+	tbl_ptr->detached = 0;
+	ret = ipa_nati_create_tbl(tbl_indx, old_tbl->public_addr,
+					old_tbl->num_entries);
+	if (!ret && ipa_nati_post_pdns()) {
+		IPAERR("unable to post the pdn config of table %d\n", tbl_indx);
+	}
+
+	if (ret) {
+		IPAERR("unable to give table %d back to the hw, detaching it\n",
+					 tbl_indx);
+		*tbl_ptr = *old_tbl;
+		tbl_ptr->ipv4_rules_addr = image;
+		tbl_ptr->ipv4_expn_rules_addr = image +
+			(old_tbl->ipv4_expn_rules_addr - old_tbl->ipv4_rules_addr);
+		tbl_ptr->index_table_addr = image +
+			(old_tbl->index_table_addr - old_tbl->ipv4_rules_addr);
+		tbl_ptr->index_table_expn_addr = image +
+			(old_tbl->index_table_expn_addr - old_tbl->ipv4_rules_addr);
+		tbl_ptr->detached = 1;
+		return ret;
+	}
+
+	memcpy(tbl_ptr->ipv4_rules_addr, image, tbl_ptr->size);
+	free(image);
+
+	ipa_nati_rebuild_free_lists(tbl_ptr);
+	tbl_ptr->hash_stats = old_tbl->hash_stats;
+	tbl_ptr->counters = old_tbl->counters;
+	return 0;
+}
+
+static void ipa_nati_attach_tbl(uint8_t tbl_indx)
+{
+	struct ipa_nat_ip4_table_cache old_tbl = ipv4_nat_cache.ip4_tbl[tbl_indx];
+
+	if (!ipa_nati_restore_tbl(tbl_indx, &old_tbl, old_tbl.ipv4_rules_addr)) {
+		IPADBG("table %d is back in the hw\n", tbl_indx);
+	}
+}
+
+/**
+ * ipa_nati_resize_tbl() - move the rules of a table to a new table
+ * @tbl_indx: [in] nat table index
+ * @number_of_entries: [in] number of nat entries of the new table
+ *
+ * The IPA hw has a single nat table, so the old table is deleted
+ * before the new one is allocated and initialized. Meanwhile the
+ * hw finds no rule and the flows take the software path. The live
+ * rules are then rehashed into the new table with batched dma and
+ * keep their rule handles.
+ *
+ * The resize is all or nothing: the rules are checked to fit the
+ * new size first, and the old table memory and cache are kept
+ * until every rule is in the new table. On any failure the old
+ * table is given back to the hw as it was.
+ *
+ * The table must be locked exclusively
+ *
+ * Returns: 0 on success, negative on failure
+ */
+static int ipa_nati_resize_tbl(uint8_t tbl_indx, uint16_t number_of_entries)
+{
+	struct ipa_nat_ip4_table_cache *tbl_ptr = &ipv4_nat_cache.ip4_tbl[tbl_indx];
+	struct ipa_nat_ip4_table_cache old_tbl;
+	struct ipa_nat_dma_batch *batch = NULL;
+	struct ipa_nat_rule *rules;
+	ipa_nat_ipv4_rule *clnt_rules = NULL;
+	uint32_t *rule_hdls = NULL;
+	char *old_image = NULL;
+	uint16_t total, num_rules = 0;
+	uint16_t cnt, tbl_entry;
+	uint8_t expn_tbl;
+	int ret;
+
+	IPADBG("resizing table %d from %d to %d entries\n",
+				 tbl_indx, tbl_ptr->num_entries, number_of_entries);
+
+	/* Save the live rules of the old table */
+	total = tbl_ptr->table_entries + tbl_ptr->expn_table_entries;
+	clnt_rules = (ipa_nat_ipv4_rule *)malloc(sizeof(ipa_nat_ipv4_rule) * total);
+	rule_hdls = (uint32_t *)malloc(sizeof(uint32_t) * total);
+	batch = (struct ipa_nat_dma_batch *)malloc(sizeof(struct ipa_nat_dma_batch));
+	old_image = (char *)malloc(tbl_ptr->size);
+	if (NULL == clnt_rules || NULL == rule_hdls || NULL == batch ||
+			NULL == old_image) {
+		IPAERR("unable to allocate memory\n");
+		ret = -ENOMEM;
+		goto bail;
+	}
+
+	for (cnt = 0; cnt < total; cnt++) {
+		if (IPA_NAT_INVALID_NAT_ENTRY == tbl_ptr->rule_id_array[cnt]) {
+			continue;
+		}
+
+		ipa_nati_parse_ipv4_rule_hdl(tbl_indx, cnt + 1, &expn_tbl, &tbl_entry);
+		rules = (struct ipa_nat_rule *)(expn_tbl ?
+			tbl_ptr->ipv4_expn_rules_addr : tbl_ptr->ipv4_rules_addr);
+
+		ipa_nati_read_rule(&rules[tbl_entry], &clnt_rules[num_rules]);
+		rule_hdls[num_rules++] = cnt + 1;
+	}
+
+	ret = ipa_nati_check_tbl_fit(tbl_ptr, clnt_rules, num_rules,
+					number_of_entries);
+	if (ret) {
+		IPAERR("rules of table %d do not fit %d entries\n",
+					 tbl_indx, number_of_entries);
+		goto bail;
+	}
+
+	/* Swap the tables, keeping the old one until the new one is done */
+	memcpy(old_image, tbl_ptr->ipv4_rules_addr, tbl_ptr->size);
+	old_tbl = *tbl_ptr;
+
+	ret = ipa_nati_unmap_tbl(tbl_indx);
+	if (ret) {
+		IPAERR("unable to release the old table\n");
+		goto restore;
+	}
+
+	/* the new table gets its own cache arrays */
+	memset(tbl_ptr, 0, sizeof(*tbl_ptr));
+	tbl_ptr->hash_mode = old_tbl.hash_mode;
+	tbl_ptr->hash_seed = old_tbl.hash_seed;
+
+	ret = ipa_nati_create_tbl(tbl_indx, old_tbl.public_addr, number_of_entries);
+	if (ret) {
+		IPAERR("unable to create table of %d entries\n", number_of_entries);
+		ipa_nati_free_tbl_cache(tbl_ptr);
+		goto restore;
+	}
+
+	/* the dma of the rehash counts for the table */
+	tbl_ptr->counters = old_tbl.counters;
+
+	ret = ipa_nati_post_pdns();
+	if (ret) {
+		goto undo;
+	}
+
+	/* Rehash the saved rules */
+	ret = ipa_nati_batch_init(batch, tbl_indx);
+	if (ret) {
+		goto undo;
+	}
+
+	ret = ipa_nati_batch_add_rules(batch, tbl_indx + 1, clnt_rules,
+				num_rules, rule_hdls);
+	ipa_nati_batch_free(batch);
+	if (ret) {
+		IPAERR("unable to move all the rules to the new table\n");
+		goto undo;
+	}
+
+	/* The kept handles were never taken from the free list */
+	ipa_nati_rebuild_free_lists(tbl_ptr);
+
+	tbl_ptr->hash_stats = old_tbl.hash_stats;
+	tbl_ptr->grow_threshold = old_tbl.grow_threshold;
+	tbl_ptr->grow_max_entries = old_tbl.grow_max_entries;
+	ipa_nati_free_tbl_cache(&old_tbl);
+
+#ifdef NAT_DUMP
+	ipa_nat_dump_ipv4_table(tbl_indx + 1);
+#endif
+	goto bail;
+
+undo:
+	ipa_nati_unmap_tbl(tbl_indx);
+	ipa_nati_free_tbl_cache(tbl_ptr);
+
+restore:
+	IPAERR("keeping table %d with %d entries\n", tbl_indx, old_tbl.num_entries);
+	ipa_nati_restore_tbl(tbl_indx, &old_tbl, old_image);
+	old_image = NULL;
+
+bail:
+	free(clnt_rules);
+	free(rule_hdls);
+	free(batch);
+	free(old_image);
+	return ret;
+}
+
+/**
+ * ipa_nati_grow_tbl() - grow a table that crossed its threshold
+ * @tbl_indx: [in] nat table index
+ * @new_rules: [in] number of rules about to be added
+ *
+ * The table doubles, up to its maximum, while the rules plus the
+ * new ones or the expansion table occupy more than the threshold
+ * percentage. The table must be locked exclusively
+ *
+ * Returns: 0 on success or when no growth is needed, negative on failure
+ */
+static int ipa_nati_grow_tbl(uint8_t tbl_indx, uint16_t new_rules)
+{
+	struct ipa_nat_ip4_table_cache *tbl_ptr = &ipv4_nat_cache.ip4_tbl[tbl_indx];
+	uint32_t used, size, entries;
+	int ret;
+
+	if (!tbl_ptr->grow_threshold) {
+		return 0;
+	}
+
+	/* entry 0 of the base and expansion tables is never used */
+	used = tbl_ptr->cur_tbl_cnt + tbl_ptr->cur_expn_tbl_cnt + new_rules;
+	size = tbl_ptr->table_entries + tbl_ptr->expn_table_entries - 2;
+	if (used * 100 < size * tbl_ptr->grow_threshold &&
+			tbl_ptr->cur_expn_tbl_cnt * 100 <
+			(tbl_ptr->expn_table_entries - 1) * tbl_ptr->grow_threshold) {
+		return 0;
+	}
+
+	if (tbl_ptr->num_entries >= tbl_ptr->grow_max_entries) {
+		IPADBG("table %d already has its maximum size\n", tbl_indx);
+		return 0;
+	}
+
+	entries = (uint32_t)tbl_ptr->num_entries * 2;
+	if (entries > tbl_ptr->grow_max_entries) {
+		entries = tbl_ptr->grow_max_entries;
+	}
+
+	ret = ipa_nati_resize_tbl(tbl_indx, (uint16_t)entries);
+	if (ret) {
+		/* do not retry on every add */
+		IPAERR("growing table %d failed, disabling growth\n", tbl_indx);
+		tbl_ptr->grow_max_entries = tbl_ptr->num_entries;
+	}
+
+	return ret;
+}
+
+int ipa_nati_resize_ipv4_table(uint32_t tbl_hdl,
+				uint16_t number_of_entries)
+{
+	uint8_t tbl_indx = (uint8_t)(tbl_hdl - 1);
+	int ret;
+
+	if (ipa_nati_lock_tbl(tbl_indx, 1) != 0) {
+		IPAERR("unable to lock the nat table\n");
+		return -1;
+	}
+
+	if (!ipv4_nat_cache.ip4_tbl[tbl_indx].valid) {
+		IPAERR("invalid table handle\n");
+		ret = -EINVAL;
+	} else if (number_of_entries <= ipv4_nat_cache.ip4_tbl[tbl_indx].num_entries) {
+		IPAERR("table can only grow, %d entries requested for %d\n",
+					 number_of_entries, ipv4_nat_cache.ip4_tbl[tbl_indx].num_entries);
+		ret = -EINVAL;
+	} else {
+		ret = ipa_nati_resize_tbl(tbl_indx, number_of_entries);
+	}
+
+	if (ipa_nati_unlock_tbl(tbl_indx) != 0) {
+		IPAERR("unable to unlock the nat table\n");
+		return -1;
+	}
+
+	return ret;
+}
+
+int ipa_nati_set_auto_resize(uint32_t tbl_hdl,
+				uint8_t threshold,
+				uint16_t max_entries)
+{
+	uint8_t tbl_indx = (uint8_t)(tbl_hdl - 1);
+	int ret = 0;
+
+	if (ipa_nati_lock_tbl(tbl_indx, 1) != 0) {
+		IPAERR("unable to lock the nat table\n");
+		return -1;
+	}
+
+	if (!ipv4_nat_cache.ip4_tbl[tbl_indx].valid) {
+		IPAERR("invalid table handle\n");
+		ret = -EINVAL;
+	} else {
+		ipv4_nat_cache.ip4_tbl[tbl_indx].grow_threshold = threshold;
+		ipv4_nat_cache.ip4_tbl[tbl_indx].grow_max_entries = max_entries;
+	}
+
+	if (ipa_nati_unlock_tbl(tbl_indx) != 0) {
+		IPAERR("unable to unlock the nat table\n");
+		return -1;
+	}
+
+	return ret;
+}
+
+/**
+ * ipa_nati_batch_del_rules() - delete rules through a dma batch
+ * @batch: [in] initialized batch of the table
+ * @tbl_indx: [in] nat table index
+ * @rule_hdls: [in] handles of the rules to be deleted
+ * @num_rules: [in] number of rules
+ *
+ * The table must be locked exclusively
+ *
+ * Returns: 0 on success, negative if any rule failed
+ */
+static int ipa_nati_batch_del_rules(struct ipa_nat_dma_batch *batch,
+				uint8_t tbl_indx,
+				const uint32_t *rule_hdls,
+				uint16_t num_rules)
+{
+	struct ipa_nat_ip4_table_cache *tbl_ptr = &ipv4_nat_cache.ip4_tbl[tbl_indx];
+	struct ipa_ioc_nat_dma_one dma[MAX_DMA_ENTRIES_FOR_DEL];
+	struct ipa_nat_batch_rule *rule;
+	struct ipa_nat_rule *rules;
+	del_type rule_pos;
+	uint8_t expn_tbl, entries, dma_cnt;
+	uint16_t tbl_entry, entry, indx_entry;
+	uint16_t base_head, indx_head;
+	uint16_t cnt;
+	int ret = 0;
+
+	for (cnt = 0; cnt < num_rules; cnt++) {
+		if (IPA_NAT_INVALID_NAT_ENTRY == rule_hdls[cnt]) {
+			IPAERR("Invalid Rule handle, rule %d\n", cnt);
+			ret = -EINVAL;
+			continue;
+		}
+
+		ipa_nati_parse_ipv4_rule_hdl(tbl_indx, (uint16_t)rule_hdls[cnt],
+																 &expn_tbl, &tbl_entry);
+		if (IPA_NAT_INVALID_NAT_ENTRY == tbl_entry) {
+			IPAERR("Invalid Rule Entry, rule %d\n", cnt);
+			ret = -EINVAL;
+			continue;
+		}
+
+		/* Find the base and index lists the rule belongs to */
+		if (expn_tbl) {
+			rules = (struct ipa_nat_rule *)tbl_ptr->ipv4_expn_rules_addr;
+			entry = tbl_entry + tbl_ptr->table_entries;
+		} else {
+			rules = (struct ipa_nat_rule *)tbl_ptr->ipv4_rules_addr;
+			entry = tbl_entry;
+		}
+		indx_entry = Read16BitFieldValue(rules[tbl_entry].sw_spec_params,
+						SW_SPEC_PARAM_INDX_TBL_ENTRY_FIELD);
+
+		base_head = ipa_nati_batch_base_head(tbl_ptr, entry);
+		indx_head = ipa_nati_batch_index_head(tbl_ptr, indx_entry);
+		if (IPA_NAT_INVALID_NAT_ENTRY == base_head ||
+				IPA_NAT_INVALID_NAT_ENTRY == indx_head) {
+			IPAERR("unable to find the lists of rule %d\n", cnt);
+			ret = -EINVAL;
+			continue;
+		}
+
+		if (ipa_nati_batch_is_busy(batch, base_head, indx_head) ||
+				ipa_nati_batch_is_full(batch, MAX_DMA_ENTRIES_FOR_DEL)) {
+			if (ipa_nati_batch_flush_dels(batch)) {
+				ret = -EIO;
+			}
+
+			/* The flush may have deleted this very rule */
+			ipa_nati_parse_ipv4_rule_hdl(tbl_indx, (uint16_t)rule_hdls[cnt],
+																	 &expn_tbl, &tbl_entry);
+			if (IPA_NAT_INVALID_NAT_ENTRY == tbl_entry) {
+				IPAERR("Invalid Rule Entry, rule %d\n", cnt);
+				ret = -EINVAL;
+				continue;
+			}
+		}
+
+		ipa_nati_find_rule_pos(tbl_ptr, expn_tbl, tbl_entry, &rule_pos);
+		IPADBG("rule %d tbl_entry:%d expn_tbl:%d rule_pos:%d\n",
+					 cnt, tbl_entry, expn_tbl, rule_pos);
+
+		rule = &batch->rules[batch->rule_cnt];
+		if (ipa_nati_generate_del_dma_cmd(tbl_indx, tbl_entry, expn_tbl,
+						rule_pos, dma, &entries, &rule->del_info)) {
+			ret = -EINVAL;
+			continue;
+		}
+
+		/* First write is for the base table, the rest for the index table */
+		batch->base_dma[batch->base_cnt++] = dma[0];
+		for (dma_cnt = 1; dma_cnt < entries; dma_cnt++) {
+			batch->indx_dma[batch->indx_cnt++] = dma[dma_cnt];
+		}
+
+		ipa_nati_batch_mark_busy(batch, base_head, indx_head);
+		rule->pos = cnt;
+		rule->rule_hdl = rule_hdls[cnt];
+		batch->rule_cnt++;
+	}
+
+	if (ipa_nati_batch_flush_dels(batch)) {
+		ret = -EIO;
+	}
+
+	ipa_nati_del_dead_ipv4_head_nodes(tbl_indx);
+
+	return ret;
+}
+
+/**
+ * ipa_nati_del_ipv4_rules() - delete a batch of rules
+ * @tbl_hdl: [in] nat table handle
+ * @rule_hdls: [in] handles of the rules to be deleted
+ * @num_rules: [in] number of rules
+ *
+ * Same as ipa_nati_del_ipv4_rule() for each rule, but the dma
+ * writes are posted with one IPA_IOC_NAT_DMA for up to
+ * IPA_NAT_MAX_DMA_ENTRIES writes and the dead head nodes
+ * are removed once for the whole batch
+ *
+ * Returns: 0 on success, negative if any rule failed
+ */
+int ipa_nati_del_ipv4_rules(uint32_t tbl_hdl,
+				const uint32_t *rule_hdls,
+				uint16_t num_rules)
+{
+	struct ipa_nat_ip4_table_cache *tbl_ptr;
+	struct ipa_nat_dma_batch *batch;
+	uint8_t tbl_indx = (uint8_t)(tbl_hdl - 1);
+	uint64_t start_us = ipa_nati_now_us();
+	int ret = 0;
+
+	batch = (struct ipa_nat_dma_batch *)malloc(sizeof(struct ipa_nat_dma_batch));
+	if (NULL == batch) {
+		IPAERR("unable to allocate memory\n");
+		return -ENOMEM;
+	}
+
+	if (ipa_nati_lock_tbl(tbl_indx, 1) != 0) {
+		ret = -1;
+		goto mutex_lock_error;
+	}
+
+	tbl_ptr = &ipv4_nat_cache.ip4_tbl[tbl_indx];
+	if (!tbl_ptr->valid) {
+		IPAERR("invalid table handle\n");
+		ret = -EINVAL;
+		goto unlock;
+	}
+
+	ret = ipa_nati_batch_init(batch, tbl_indx);
+	if (ret) {
+		goto unlock;
+	}
+
+	ret = ipa_nati_batch_del_rules(batch, tbl_indx, rule_hdls, num_rules);
+	ipa_nati_record_latency(tbl_ptr->counters.del_latency, start_us);
+
+#ifdef NAT_DUMP
+	IPADBG("Dumping Table after deleting rules\n");
+	ipa_nat_dump_ipv4_table(tbl_hdl);
+#endif
+
+	ipa_nati_batch_free(batch);
+
+unlock:
+	if (ipa_nati_unlock_tbl(tbl_indx) != 0) {
+		ret = -1;
+		goto mutex_unlock_error;
+	}
+
+	free(batch);
+	return ret;
+
+mutex_lock_error:
+	IPAERR("unable to lock the nat table\n");
+	free(batch);
+	return ret;
+
+mutex_unlock_error:
+	IPAERR("unable to unlock the nat table\n");
+	free(batch);
+	return ret;
+}
+
+/**
+ * ipa_nati_reap_idle_rules() - remove the rules without traffic
+ * @tbl_hdl: [in] nat table handle
+ * @cfg: [in] idle thresholds
+ * @cb: [in] called for each removed rule, may be NULL
+ * @arg: [in] passed to cb
+ * @num_reaped: [out] number of removed rules
+ *
+ * Walks the slots like ipa_nati_snapshot_timestamps(), with its own
+ * copy of the timestamps so both can be used together. The walk
+ * resumes where the previous one stopped once max_rules idle rules
+ * are found
+ *
+ * Returns: 0 on success, negative on failure
+ */
+int ipa_nati_reap_idle_rules(uint32_t tbl_hdl,
+				const ipa_nat_reap_cfg *cfg,
+				ipa_nat_reap_cb cb,
+				void *arg,
+				uint16_t *num_reaped)
+{
+	struct ipa_nat_ip4_table_cache *tbl_ptr;
+	struct ipa_nat_dma_batch *batch;
+	struct ipa_nat_rule *base_tbl, *expn_tbl, *rule;
+	ipa_nat_ipv4_rule *clnt_rules;
+	uint32_t *rule_hdls;
+	uint32_t total, slot, cnt, ts, idle;
+	uint32_t now = (uint32_t)(ipa_nati_now_us() / 1000000);
+	uint8_t tbl_indx = (uint8_t)(tbl_hdl - 1);
+	uint16_t reaped = 0;
+	int ret = 0;
+
+	*num_reaped = 0;
+
+	clnt_rules = (ipa_nat_ipv4_rule *)malloc(sizeof(ipa_nat_ipv4_rule) *
+						cfg->max_rules);
+	rule_hdls = (uint32_t *)malloc(sizeof(uint32_t) * cfg->max_rules);
+	batch = (struct ipa_nat_dma_batch *)malloc(sizeof(struct ipa_nat_dma_batch));
+	if (NULL == clnt_rules || NULL == rule_hdls || NULL == batch) {
+		IPAERR("unable to allocate memory\n");
+		ret = -ENOMEM;
+		goto bail;
+	}
+
+	if (ipa_nati_lock_tbl(tbl_indx, 1) != 0) {
+		IPAERR("unable to lock the nat table\n");
+		ret = -1;
+		goto bail;
+	}
+
+	tbl_ptr = &ipv4_nat_cache.ip4_tbl[tbl_indx];
+	if (!tbl_ptr->valid) {
+		IPAERR("invalid table handle\n");
+		ret = -EINVAL;
+		goto unlock;
+	}
+
+	base_tbl = (struct ipa_nat_rule *)tbl_ptr->ipv4_rules_addr;
+	expn_tbl = (struct ipa_nat_rule *)tbl_ptr->ipv4_expn_rules_addr;
+	total = tbl_ptr->table_entries + tbl_ptr->expn_table_entries;
+
+	slot = tbl_ptr->reap_pos;
+	for (cnt = 0; cnt < total && reaped < cfg->max_rules; cnt++) {
+		if (IPA_NAT_INVALID_NAT_ENTRY != tbl_ptr->slot_rule_hdl[slot]) {
+			if (slot < tbl_ptr->table_entries) {
+				rule = &base_tbl[slot];
+			} else {
+				rule = &expn_tbl[slot - tbl_ptr->table_entries];
+			}
+
+			ts = Read32BitFieldValue(rule->ts_proto, TIME_STAMP_FIELD);
+			if (0 == tbl_ptr->slot_active[slot] ||
+					ts != tbl_ptr->slot_reap_ts[slot]) {
+				tbl_ptr->slot_reap_ts[slot] = ts;
+				tbl_ptr->slot_active[slot] = now;
+			} else {
+				switch (Read8BitFieldValue(rule->ts_proto, PROTOCOL_FIELD)) {
+				case IPPROTO_TCP:
+					idle = cfg->tcp_idle;
+					break;
+				case IPPROTO_UDP:
+					idle = cfg->udp_idle;
+					break;
+				default:
+					idle = cfg->other_idle;
+					break;
+				}
+
+				if (idle && now - tbl_ptr->slot_active[slot] >= idle) {
+					ipa_nati_read_rule(rule, &clnt_rules[reaped]);
+					rule_hdls[reaped++] = tbl_ptr->slot_rule_hdl[slot];
+				}
+			}
+		}
+
+		if (++slot == total) {
+			slot = 0;
+		}
+	}
+	tbl_ptr->reap_pos = (uint16_t)slot;
+
+	if (reaped) {
+		ret = ipa_nati_batch_init(batch, tbl_indx);
+		if (ret) {
+			reaped = 0;
+			goto unlock;
+		}
+
+		if (ipa_nati_batch_del_rules(batch, tbl_indx, rule_hdls, reaped)) {
+			ret = -EIO;
+		}
+		ipa_nati_batch_free(batch);
+
+		/* Only report the rules that are really gone */
+		for (cnt = 0; cnt < reaped; cnt++) {
+			if (IPA_NAT_INVALID_NAT_ENTRY !=
+					tbl_ptr->rule_id_array[rule_hdls[cnt] - 1]) {
+				rule_hdls[cnt] = IPA_NAT_INVALID_NAT_ENTRY;
+			}
+		}
+
+		IPADBG("reaped %d idle rules of table %d\n", reaped, tbl_hdl);
+	}
+
+unlock:
+	if (ipa_nati_unlock_tbl(tbl_indx) != 0) {
+		IPAERR("unable to unlock the nat table\n");
+		ret = -1;
+		goto bail;
+	}
+
+	for (cnt = 0; cnt < reaped; cnt++) {
+		if (IPA_NAT_INVALID_NAT_ENTRY == rule_hdls[cnt]) {
+			continue;
+		}
+
+		(*num_reaped)++;
+		if (cb) {
+			cb(tbl_hdl, rule_hdls[cnt], &clnt_rules[cnt], arg);
+		}
+	}
+
+bail:
+	free(clnt_rules);
+	free(rule_hdls);
+	free(batch);
+	return ret;
+}
+
 void ipa_nati_find_index_rule_pos(
 				struct ipa_nat_ip4_table_cache *cache_ptr,
 				uint16_t tbl_entry,
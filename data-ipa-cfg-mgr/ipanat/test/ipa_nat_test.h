@@ -79,6 +79,20 @@
 #define NAT_DUMP
 int ipa_nat_validate_ipv4_table(u32);
 
+/* Public ip of the tables the tests add */
+#define IPA_NAT_TEST_PUB_IP 0x011617c0 /* "192.23.22.1" */
+
+/* Rule the tests start from, rules set up alike share their lists */
+#define IPA_NAT_TEST_RULE(rule) { \
+    (rule).target_ip = 0xC1171601; /* 193.23.22.1 */ \
+    (rule).target_port = 1234; \
+    (rule).private_ip = 0xC2171601; /* 194.23.22.1 */ \
+    (rule).private_port = 5678; \
+    (rule).protocol = IPPROTO_TCP; \
+    (rule).public_port = 9050; \
+    (rule).pdn_index = 0; \
+  }
+
 int ipa_nat_test000(int, u32, u8);
 int ipa_nat_test001(int, u32, u8);
 int ipa_nat_test002(int, u32, u8);
@@ -102,3 +116,9 @@ int ipa_nat_test019(int, u32, u8);
 int ipa_nat_test020(int, u32, u8);
 int ipa_nat_test021(int, int);
 int ipa_nat_test022(int, u32, u8);
+int ipa_nat_test023(int, u32, u8);
+int ipa_nat_test024(int, u32, u8);
+int ipa_nat_test025(int, u32, u8);
+int ipa_nat_test026(int, u32, u8);
+int ipa_nat_test027(int, u32, u8);
+int ipa_nat_test028(int, u32, u8);
@@ -111,7 +111,7 @@ int ipa_nat_test022(int total_entries, u32 tbl_hdl, u8 sep)
 	if(sep)
 	{
 		ret = ipa_nat_del_ipv4_tbl(tbl_hdl);
-		CHECK_ERR1(ret, tbl_hdl);
+		CHECK_ERR(ret);
 	}
 
 	return 0;
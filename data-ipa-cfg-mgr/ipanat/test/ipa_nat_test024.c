@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of The Linux Foundation nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*=========================================================================*/
+/*!
+	@file
+	ipa_nat_test024.c
+
+	@brief
+	Verify the following scenario:
+	1. Add ipv4 table
+	2. Add same 3 ipv4 rules
+	3. Check the collision chain statistics
+	4. Delete the 3 ipv4 rules
+	5. Delete ipv4 table
+*/
+/*=========================================================================*/
+
+#include "ipa_nat_test.h"
+#include "ipa_nat_drv.h"
+
+int ipa_nat_test024(int total_entries, u32 tbl_hdl, u8 sep)
+{
+	int ret, cnt;
+	u32 rule_hdl[3];
+	ipa_nat_ipv4_rule ipv4_rule;
+	ipa_nat_hash_stats before, after;
+
+	IPA_NAT_TEST_RULE(ipv4_rule);
+
+	IPADBG("%s():\n",__FUNCTION__);
+
+	if(sep)
+	{
+		ret = ipa_nat_add_ipv4_tbl(IPA_NAT_TEST_PUB_IP, total_entries, &tbl_hdl);
+		CHECK_ERR(ret);
+	}
+
+	ret = ipa_nat_get_hash_stats(tbl_hdl, &before);
+	CHECK_ERR1(ret, tbl_hdl);
+
+	for (cnt = 0; cnt < 3; cnt++)
+	{
+		ret = ipa_nat_add_ipv4_rule(tbl_hdl, &ipv4_rule, &rule_hdl[cnt]);
+		CHECK_ERR1(ret, tbl_hdl);
+	}
+
+	ret = ipa_nat_get_hash_stats(tbl_hdl, &after);
+	CHECK_ERR1(ret, tbl_hdl);
+
+	/* Same rule 3 times makes a list of at least 3 entries */
+	ret = (after.base.inserts - before.base.inserts != 3 ||
+				 after.index.inserts - before.index.inserts != 3 ||
+				 after.base.max_chain < 3 || after.index.max_chain < 3 ||
+				 after.base.probes - before.base.probes < 3);
+	CHECK_ERR1(ret, tbl_hdl);
+
+	for (cnt = 0; cnt < 3; cnt++)
+	{
+		ret = ipa_nat_del_ipv4_rule(tbl_hdl, rule_hdl[cnt]);
+		CHECK_ERR1(ret, tbl_hdl);
+	}
+
+	if(sep)
+	{
+		ret = ipa_nat_del_ipv4_tbl(tbl_hdl);
+		CHECK_ERR(ret);
+	}
+
+	return 0;
+}
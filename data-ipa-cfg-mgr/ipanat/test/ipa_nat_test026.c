@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of The Linux Foundation nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*=========================================================================*/
+/*!
+	@file
+	ipa_nat_test026.c
+
+	@brief
+	Verify the following scenario:
+	1. Add ipv4 table
+	2. Add 3 distinct ipv4 rules
+	3. Grow the table to twice its size
+	4. Delete the 3 ipv4 rules with the handles given before the resize
+	5. Delete ipv4 table
+*/
+/*=========================================================================*/
+
+#include "ipa_nat_test.h"
+#include "ipa_nat_drv.h"
+
+int ipa_nat_test026(int total_entries, u32 tbl_hdl, u8 sep)
+{
+	int ret, cnt;
+	u32 rule_hdl[3], time_stamp;
+	ipa_nat_ipv4_rule ipv4_rule;
+
+	IPADBG("%s():\n",__FUNCTION__);
+
+	IPA_NAT_TEST_RULE(ipv4_rule);
+
+	if(sep)
+	{
+		ret = ipa_nat_add_ipv4_tbl(IPA_NAT_TEST_PUB_IP, total_entries, &tbl_hdl);
+		CHECK_ERR(ret);
+	}
+
+	for (cnt = 0; cnt < 3; cnt++)
+	{
+		ipv4_rule.private_port++;
+		ret = ipa_nat_add_ipv4_rule(tbl_hdl, &ipv4_rule, &rule_hdl[cnt]);
+		CHECK_ERR1(ret, tbl_hdl);
+	}
+
+	/* A table can only grow */
+	ret = !ipa_nat_resize_ipv4_tbl(tbl_hdl, 1);
+	CHECK_ERR1(ret, tbl_hdl);
+
+	ret = ipa_nat_resize_ipv4_tbl(tbl_hdl, total_entries * 2);
+	CHECK_ERR1(ret, tbl_hdl);
+
+	/* The rule handles survive the resize */
+	for (cnt = 0; cnt < 3; cnt++)
+	{
+		ret = ipa_nat_query_timestamp(tbl_hdl, rule_hdl[cnt], &time_stamp);
+		CHECK_ERR1(ret, tbl_hdl);
+
+		ret = ipa_nat_del_ipv4_rule(tbl_hdl, rule_hdl[cnt]);
+		CHECK_ERR1(ret, tbl_hdl);
+	}
+
+	if(sep)
+	{
+		ret = ipa_nat_del_ipv4_tbl(tbl_hdl);
+		CHECK_ERR(ret);
+	}
+
+	return 0;
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of The Linux Foundation nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*=========================================================================*/
+/*!
+	@file
+	ipa_nat_test027.c
+
+	@brief
+	Verify the following scenario:
+	1. Add ipv4 table
+	2. Add same 2 ipv4 rules
+	3. Check the table occupancy and counters
+	4. Delete the 2 ipv4 rules
+	5. Check the occupancy is back
+	6. Delete ipv4 table
+*/
+/*=========================================================================*/
+
+#include "ipa_nat_test.h"
+#include "ipa_nat_drv.h"
+
+static uint64_t ipa_nat_test027_sum(const uint32_t *hist)
+{
+	uint64_t sum = 0;
+	int cnt;
+
+	for (cnt = 0; cnt < IPA_NAT_LATENCY_BUCKETS; cnt++)
+	{
+		sum += hist[cnt];
+	}
+
+	return sum;
+}
+
+int ipa_nat_test027(int total_entries, u32 tbl_hdl, u8 sep)
+{
+	int ret;
+	u32 rule_hdl1, rule_hdl2;
+	ipa_nat_ipv4_rule ipv4_rule;
+	ipa_nat_tbl_metrics before, added, after;
+
+	IPADBG("%s():\n",__FUNCTION__);
+
+	IPA_NAT_TEST_RULE(ipv4_rule);
+
+	if(sep)
+	{
+		ret = ipa_nat_add_ipv4_tbl(IPA_NAT_TEST_PUB_IP, total_entries, &tbl_hdl);
+		CHECK_ERR(ret);
+	}
+
+	ret = ipa_nat_get_tbl_metrics(tbl_hdl, &before);
+	CHECK_ERR1(ret, tbl_hdl);
+
+	ret = ipa_nat_add_ipv4_rule(tbl_hdl, &ipv4_rule, &rule_hdl1);
+	CHECK_ERR1(ret, tbl_hdl);
+
+	ret = ipa_nat_add_ipv4_rule(tbl_hdl, &ipv4_rule, &rule_hdl2);
+	CHECK_ERR1(ret, tbl_hdl);
+
+	ret = ipa_nat_get_tbl_metrics(tbl_hdl, &added);
+	CHECK_ERR1(ret, tbl_hdl);
+
+	/* The second rule collides with the first one */
+	ret = (added.base_used + added.expn_used !=
+				 before.base_used + before.expn_used + 2 ||
+				 added.hash.base.collisions - before.hash.base.collisions < 1 ||
+				 added.dma_cmds <= before.dma_cmds ||
+				 added.dma_writes < added.dma_cmds ||
+				 ipa_nat_test027_sum(added.add_latency) -
+				 ipa_nat_test027_sum(before.add_latency) != 2);
+	CHECK_ERR1(ret, tbl_hdl);
+
+	ret = ipa_nat_del_ipv4_rule(tbl_hdl, rule_hdl1);
+	CHECK_ERR1(ret, tbl_hdl);
+
+	ret = ipa_nat_del_ipv4_rule(tbl_hdl, rule_hdl2);
+	CHECK_ERR1(ret, tbl_hdl);
+
+	ret = ipa_nat_get_tbl_metrics(tbl_hdl, &after);
+	CHECK_ERR1(ret, tbl_hdl);
+
+	ret = (after.base_used != before.base_used ||
+				 after.expn_used != before.expn_used ||
+				 after.index_expn_used != before.index_expn_used ||
+				 ipa_nat_test027_sum(after.del_latency) -
+				 ipa_nat_test027_sum(added.del_latency) != 2);
+	CHECK_ERR1(ret, tbl_hdl);
+
+	if(sep)
+	{
+		ret = ipa_nat_del_ipv4_tbl(tbl_hdl);
+		CHECK_ERR(ret);
+	}
+
+	return 0;
+}
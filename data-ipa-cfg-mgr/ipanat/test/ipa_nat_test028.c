@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of The Linux Foundation nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*=========================================================================*/
+/*!
+	@file
+	ipa_nat_test028.c
+
+	@brief
+	Verify the following scenario:
+	1. Add ipv4 table
+	2. Add ipv4 tcp rule and ipv4 udp rule
+	3. Reap with a udp threshold of 1 second, the udp rule is not idle yet
+	4. Wait 2 seconds and reap again, the udp rule is removed
+	5. Delete the tcp rule
+	6. Delete ipv4 table
+*/
+/*=========================================================================*/
+
+#include <unistd.h>
+#include "ipa_nat_test.h"
+#include "ipa_nat_drv.h"
+
+static u32 ipa_nat_test028_reaped;
+
+static void ipa_nat_test028_cb(u32 tbl_hdl, u32 rule_hdl,
+		const ipa_nat_ipv4_rule *rule, void *arg)
+{
+	if (rule_hdl == *(u32 *)arg && rule->protocol == IPPROTO_UDP)
+	{
+		ipa_nat_test028_reaped++;
+	}
+}
+
+int ipa_nat_test028(int total_entries, u32 tbl_hdl, u8 sep)
+{
+	int ret;
+	u32 rule_hdl1, rule_hdl2;
+	u16 num_reaped;
+	ipa_nat_ipv4_rule ipv4_rule;
+	ipa_nat_reap_cfg cfg;
+
+	IPA_NAT_TEST_RULE(ipv4_rule);
+
+	cfg.tcp_idle = 0;
+	cfg.udp_idle = 1;
+	cfg.other_idle = 0;
+	cfg.max_rules = 16;
+
+	IPADBG("%s():\n",__FUNCTION__);
+
+	if(sep)
+	{
+		ret = ipa_nat_add_ipv4_tbl(IPA_NAT_TEST_PUB_IP, total_entries, &tbl_hdl);
+		CHECK_ERR(ret);
+	}
+
+	ret = ipa_nat_add_ipv4_rule(tbl_hdl, &ipv4_rule, &rule_hdl1);
+	CHECK_ERR1(ret, tbl_hdl);
+
+	ipv4_rule.protocol = IPPROTO_UDP;
+	ret = ipa_nat_add_ipv4_rule(tbl_hdl, &ipv4_rule, &rule_hdl2);
+	CHECK_ERR1(ret, tbl_hdl);
+
+	ipa_nat_test028_reaped = 0;
+	ret = ipa_nat_reap_idle_rules(tbl_hdl, &cfg, ipa_nat_test028_cb,
+				&rule_hdl2, &num_reaped);
+	CHECK_ERR1(ret, tbl_hdl);
+
+	ret = (ipa_nat_test028_reaped != 0);
+	CHECK_ERR1(ret, tbl_hdl);
+
+	sleep(2);
+
+	ret = ipa_nat_reap_idle_rules(tbl_hdl, &cfg, ipa_nat_test028_cb,
+				&rule_hdl2, &num_reaped);
+	CHECK_ERR1(ret, tbl_hdl);
+
+	/* Earlier tests may have left udp rules of their own */
+	ret = (num_reaped < 1 || ipa_nat_test028_reaped != 1);
+	CHECK_ERR1(ret, tbl_hdl);
+
+	ret = ipa_nat_del_ipv4_rule(tbl_hdl, rule_hdl1);
+	CHECK_ERR1(ret, tbl_hdl);
+
+	if(sep)
+	{
+		ret = ipa_nat_del_ipv4_tbl(tbl_hdl);
+		CHECK_ERR(ret);
+	}
+
+	return 0;
+}